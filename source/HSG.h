@@ -1,14 +1,20 @@
 #pragma once
 
+#include <algorithm>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <queue>
 #include <random>
 #include <stack>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "knn.h"
+#include "parallel.h"
+#include "quantization.h"
 #include "space.h"
 
 namespace HSG
@@ -22,7 +28,27 @@ namespace HSG
     // 向量外部的唯一标识符
     using ID = uint64_t;
 
+    // 并发查询时发布的顶点的邻居
+    //
+    // 发布后不再修改，依次存放短的出边、短的入边、保持连通的边和长的出边的终点和长度，保持连通的边的长度不使用
+    class Neighbors
+    {
+      public:
+        std::vector<std::pair<Offset, float>> edges;
+        // 短边的数量
+        uint64_t short_number;
+        // 短边和保持连通的边的数量
+        uint64_t keep_number;
+
+        Neighbors() : short_number(0), keep_number(0)
+        {
+        }
+    };
+
     // 向量
+    //
+    // Element 为向量中元素的类型
+    template <typename Element>
     class Vector
     {
       public:
@@ -31,7 +57,7 @@ namespace HSG
         // 向量内部的唯一标识符
         Offset offset;
         // 向量的数据
-        const float *data;
+        const Element *data;
         //
         float zero;
         // 短的出边
@@ -44,9 +70,19 @@ namespace HSG
         std::unordered_map<Offset, float> long_edge_in;
         //
         std::unordered_set<Offset> keep_connected;
+        // 并行添加时保护上面的边
+        mutable Parallel::Spinlock lock;
+        // 并发查询时读取的邻居
+        //
+        // 修改上面的边后重新发布，查询不需要加锁
+        Parallel::Published<Neighbors> published;
+        // 是否被标记删除
+        //
+        // 标记删除的向量只用于路由，不出现在查询结果中
+        Parallel::Atomic<bool> deleted;
 
-        explicit Vector(const ID id, Offset offset, const float *const data_address, float zero)
-            : id(id), offset(offset), data(data_address), zero(zero)
+        explicit Vector(const ID id, Offset offset, const Element *const data_address, float zero)
+            : id(id), offset(offset), data(data_address), zero(zero), deleted(false)
         {
         }
     };
@@ -70,6 +106,10 @@ namespace HSG
         uint64_t short_edge_upper_limit;
         // 覆盖范围
         uint64_t cover_range;
+        // 检查连通性时最多遍历的边的数量
+        //
+        // 达到上限时视为不连通，添加一条边
+        uint64_t connected_limit;
 
         explicit Index_Parameters(const uint64_t dimension, const Space::Metric space_metric,
                                   const uint64_t magnification, const uint64_t short_edge_lower_limit,
@@ -77,8 +117,40 @@ namespace HSG
             : dimension(dimension), space_metric(space_metric), magnification(magnification),
               termination_number(short_edge_lower_limit + magnification),
               short_edge_lower_limit(short_edge_lower_limit), short_edge_upper_limit(short_edge_upper_limit),
-              cover_range(cover_range)
+              cover_range(cover_range), connected_limit(8 * short_edge_upper_limit * short_edge_upper_limit)
+        {
+        }
+    };
+
+    // 索引持有的向量数据
+    //
+    // 向量的元素类型和输入类型不同时，添加的向量转换后保存在这里
+    //
+    // 按块分配内存，向量的地址在索引的生命周期内不变
+    template <typename Element>
+    class Storage
+    {
+      public:
+        // 每块保存的向量的数量
+        static constexpr uint64_t block_size = 1024;
+        // 向量的维度
+        uint64_t dimension;
+        // 内存块
+        std::vector<std::unique_ptr<Element[]>> blocks;
+
+        explicit Storage(const uint64_t dimension) : dimension(dimension)
+        {
+        }
+
+        // 偏移量为 offset 的向量的地址
+        Element *address(const Offset offset)
         {
+            while (this->blocks.size() <= offset / block_size)
+            {
+                this->blocks.push_back(std::make_unique<Element[]>(block_size * this->dimension));
+            }
+
+            return this->blocks[offset / block_size].get() + (offset % block_size) * this->dimension;
         }
     };
 
@@ -89,280 +161,896 @@ namespace HSG
     // 使用64位无符号整形的最大值作为零点的id
     //
     // 所以向量的id应大于等于0且小于64位无符号整形的最大值
+    //
+    // Element 为向量中元素的类型，支持 float、uint8_t、Space::Float16 和 Space::BFloat16
+    template <typename Element = float>
     class Index
     {
       public:
         // 索引的参数
         Index_Parameters parameters;
+        // 构造索引时检测到的指令集
+        Space::ISA isa;
         // 距离计算
-        float (*similarity)(const float *vector1, const float *vector2, uint64_t dimension);
+        Space::Similarity<Element> similarity;
         // 索引中向量的数量
         uint64_t count;
         // 索引中的向量
-        std::vector<Vector> vectors;
+        std::vector<Vector<Element>> vectors;
         // 记录存放向量的数组中的空位
         std::stack<uint64_t> empty;
         // 零点向量
-        std::vector<float> zero;
+        std::vector<Element> zero;
+        // 索引持有的向量数据
+        Storage<Element> storage;
         // 记录向量的 id 和 offset 的对应关系
         std::unordered_map<ID, Offset> id_to_offset;
+        // 乘积量化器
+        //
+        // 训练后查询时使用量化编码计算距离，最后使用原始向量重排
+        Quantization::Product_Quantizer quantizer;
+        // 向量的量化编码
+        //
+        // codes[offset * quantizer.code_size]
+        std::vector<uint8_t> codes;
+        // 二值草图
+        //
+        // 启用后查询时先使用草图估计距离的下界，跳过不可能成为最近邻的向量
+        Quantization::Binary_Sketch sketch;
+        // 向量的草图
+        //
+        // sketches[offset * sketch.words]
+        std::vector<uint64_t> sketches;
+        // 向量到草图中心的距离
+        std::vector<float> sketch_norms;
+        // 最大内积查询时向量的平方范数的上界
+        //
+        // 为 0 时不进行范数增广
+        float norm_bound;
+        // 是否正在并行添加
+        //
+        // 为 true 时读取和修改顶点的边需要加锁
+        bool concurrent;
+        // 标记删除但还没有从图中删除的向量的数量
+        uint64_t deleted_count;
+        // 是否允许在修改索引的同时查询
+        //
+        // 为 true 时修改顶点的边后发布顶点的邻居，查询只读取发布的邻居，删除的向量的位置等到查询结束后再重新使用
+        bool serving;
+        // 并发查询时登记正在进行的查询
+        mutable Parallel::Epoch epoch;
+        // 并发查询时等待回收的位置和删除时的轮次
+        std::queue<std::pair<uint64_t, Offset>> retired;
+        // 回收时所有查询登记的轮次中最小的一个，发布邻居时释放轮次小于它的旧邻居
+        uint64_t reclaimable;
 
         explicit Index(const Space::Metric space, const uint64_t dimension, const uint64_t short_edge_lower_limit,
                        const uint64_t short_edge_upper_limit, const uint64_t cover_range, const uint64_t magnification)
             : parameters(dimension, space, magnification, short_edge_lower_limit, short_edge_upper_limit, cover_range),
-              similarity(Space::get_similarity(space)), count(1), zero(dimension, 0.0)
+              isa(Space::get_isa()), similarity(Space::get_similarity<Element>(space, this->isa)), count(1),
+              zero(dimension, Element()), storage(dimension), norm_bound(0), concurrent(false), deleted_count(0),
+              serving(false), reclaimable(0)
         {
-            this->vectors.push_back(Vector(std::numeric_limits<uint64_t>::max(), 0, this->zero.data(), 0));
+            this->vectors.push_back(Vector<Element>(std::numeric_limits<uint64_t>::max(), 0, this->zero.data(), 0));
             this->id_to_offset.insert({std::numeric_limits<uint64_t>::max(), 0});
         }
     };
 
-    inline Offset Get_Offset(const Index &index, const ID id)
+    // 顶点的锁
+    //
+    // 只在并行添加或删除时加锁，同时锁两个顶点时按偏移量从小到大加锁，避免死锁
+    //
+    // 并发查询读取发布的邻居，不加锁
+    class Vertex_Guard
     {
-        return index.id_to_offset.find(id)->second;
-    }
+      public:
+        Parallel::Spinlock *first;
+        Parallel::Spinlock *second;
 
-    inline void Delete_Vector(Index &index, const Offset offset)
-    {
-        auto &vector = index.vectors[offset];
+        template <typename Element>
+        explicit Vertex_Guard(const Index<Element> &index, const Offset offset) : first(nullptr), second(nullptr)
+        {
+            if (index.concurrent)
+            {
+                this->first = &index.vectors[offset].lock;
+                this->first->lock();
+            }
+        }
 
-        vector.data = nullptr;
-        vector.short_edge_in.clear();
-        vector.short_edge_out.clear();
-        vector.keep_connected.clear();
-        vector.long_edge_in.clear();
-        vector.long_edge_out.clear();
-    }
+        template <typename Element>
+        explicit Vertex_Guard(const Index<Element> &index, const Offset offset1, const Offset offset2)
+            : first(nullptr), second(nullptr)
+        {
+            if (index.concurrent)
+            {
+                this->first = &index.vectors[std::min(offset1, offset2)].lock;
+                this->first->lock();
 
-    inline bool Adjacent(const Index &index, const Offset offset1, const Offset offset2)
-    {
-        auto &v1 = index.vectors[offset1];
-        auto &v2 = index.vectors[offset2];
+                if (offset1 != offset2)
+                {
+                    this->second = &index.vectors[std::max(offset1, offset2)].lock;
+                    this->second->lock();
+                }
+            }
+        }
 
-        if (v1.keep_connected.contains(v2.offset))
+        Vertex_Guard(const Vertex_Guard &) = delete;
+        Vertex_Guard &operator=(const Vertex_Guard &) = delete;
+
+        ~Vertex_Guard()
         {
-            return true;
+            if (this->second != nullptr)
+            {
+                this->second->unlock();
+            }
+
+            if (this->first != nullptr)
+            {
+                this->first->unlock();
+            }
         }
+    };
 
-        if (v1.short_edge_in.contains(v2.offset))
+    // 发布顶点的邻居
+    //
+    // 顺序和 Get_Pool_From_SE、Get_Pool_From_LEO 遍历边的顺序相同，并发查询时的结果和不并发时相同
+    template <typename Element>
+    inline void Publish(Index<Element> &index, const Offset offset)
+    {
+        const auto &vector = index.vectors[offset];
+        auto *neighbors = new Neighbors();
+        auto &edges = neighbors->edges;
+
+        edges.reserve(vector.short_edge_out.size() + vector.short_edge_in.size() + vector.keep_connected.size() +
+                      vector.long_edge_out.size());
+
+        for (auto iterator = vector.short_edge_out.begin(); iterator != vector.short_edge_out.end(); ++iterator)
         {
-            return true;
+            edges.push_back({iterator->second, iterator->first});
         }
 
-        if (v2.short_edge_in.contains(v1.offset))
+        edges.insert(edges.end(), vector.short_edge_in.begin(), vector.short_edge_in.end());
+        neighbors->short_number = edges.size();
+
+        for (auto iterator = vector.keep_connected.begin(); iterator != vector.keep_connected.end(); ++iterator)
         {
-            return true;
+            edges.push_back({*iterator, 0});
         }
 
-        return false;
+        neighbors->keep_number = edges.size();
+        edges.insert(edges.end(), vector.long_edge_out.begin(), vector.long_edge_out.end());
+
+        index.vectors[offset].published.store(neighbors, index.epoch, index.reclaimable);
     }
 
-    inline void Get_Pool_From_LEO(const Index &index, const Offset processing_offset, std::vector<bool> &visited,
-                                  std::vector<Offset> &pool)
+    // 修改顶点的边时持有的锁
+    //
+    // 并发查询时释放锁之前重新发布顶点的邻居
+    template <typename Element>
+    class Edge_Guard
     {
-        auto &processing_vector = index.vectors[processing_offset];
+      public:
+        Index<Element> &index;
+        Offset first;
+        Offset second;
+        Vertex_Guard guard;
 
-        for (auto iterator = processing_vector.long_edge_out.begin(); iterator != processing_vector.long_edge_out.end();
-             ++iterator)
+        explicit Edge_Guard(Index<Element> &index, const Offset offset)
+            : index(index), first(offset), second(offset), guard(index, offset)
         {
-            auto &neighbor_offset = iterator->first;
+        }
 
-            // 计算当前向量的出边指向的向量和目标向量的距离
-            if (!visited[neighbor_offset])
-            {
-                visited[neighbor_offset] = true;
-                pool.push_back(neighbor_offset);
-            }
+        explicit Edge_Guard(Index<Element> &index, const Offset offset1, const Offset offset2)
+            : index(index), first(offset1), second(offset2), guard(index, offset1, offset2)
+        {
         }
-    }
 
-    inline void Get_Pool_From_SE(const Index &index, const Offset processing_offset, std::vector<bool> &visited,
-                                 std::vector<Offset> &pool)
-    {
-        auto &processing_vector = index.vectors[processing_offset];
+        Edge_Guard(const Edge_Guard &) = delete;
+        Edge_Guard &operator=(const Edge_Guard &) = delete;
 
-        for (auto iterator = processing_vector.short_edge_out.begin();
-             iterator != processing_vector.short_edge_out.end(); ++iterator)
+        ~Edge_Guard()
         {
-            auto &neighbor_offset = iterator->second;
-
-            // 计算当前向量的出边指向的向量和目标向量的距离
-            if (!visited[neighbor_offset])
+            if (this->index.serving)
             {
-                visited[neighbor_offset] = true;
-                pool.push_back(neighbor_offset);
+                Publish(this->index, this->first);
+
+                if (this->second != this->first)
+                {
+                    Publish(this->index, this->second);
+                }
             }
         }
+    };
 
-        for (auto iterator = processing_vector.short_edge_in.begin(); iterator != processing_vector.short_edge_in.end();
-             ++iterator)
-        {
-            auto &neighbor_offset = iterator->first;
+    // 查询的登记
+    //
+    // 并发查询时在整个查询期间持有，查询期间被删除的向量的位置不会被重新使用
+    class Read_Guard
+    {
+      public:
+        Parallel::Epoch *epoch;
+        uint64_t slot;
 
-            // 计算当前向量的出边指向的向量和目标向量的距离
-            if (!visited[neighbor_offset])
+        template <typename Element>
+        explicit Read_Guard(const Index<Element> &index) : epoch(nullptr), slot(0)
+        {
+            if (index.serving)
             {
-                visited[neighbor_offset] = true;
-                pool.push_back(neighbor_offset);
+                this->epoch = &index.epoch;
+                this->slot = this->epoch->enter();
             }
         }
 
-        for (auto iterator = processing_vector.keep_connected.begin();
-             iterator != processing_vector.keep_connected.end(); ++iterator)
-        {
-            auto &neighbor_offset = *iterator;
+        Read_Guard(const Read_Guard &) = delete;
+        Read_Guard &operator=(const Read_Guard &) = delete;
 
-            // 计算当前向量的出边指向的向量和目标向量的距离
-            if (!visited[neighbor_offset])
+        ~Read_Guard()
+        {
+            if (this->epoch != nullptr)
             {
-                visited[neighbor_offset] = true;
-                pool.push_back(neighbor_offset);
+                this->epoch->exit(this->slot);
             }
         }
-    }
+    };
 
-    inline void Prefetch(const float *const data)
+    // 按轮次标记顶点是否被遍历过
+    //
+    // 每次遍历前调用 reset 开始新的一轮，标记等于当前轮次的顶点已经被遍历过，不需要清空整个数组
+    class Visited_Marks
     {
-#if defined(__SSE__)
-        _mm_prefetch(data, _MM_HINT_T0);
-#endif
-    }
+      public:
+        std::vector<uint32_t> marks;
+        uint32_t epoch;
 
-    inline void Similarity(const Index &index, const float *const target_vector, std::vector<Offset> &pool,
-                           std::priority_queue<std::pair<float, Offset>, std::vector<std::pair<float, Offset>>,
-                                               std::greater<>> &waiting_vectors)
-    {
-        if (!pool.empty())
+        // 和 std::vector<bool> 的下标访问方式相同
+        class Reference
         {
-            Prefetch(index.vectors[pool.front()].data);
-
-            const auto number = pool.size() - 1;
+          public:
+            uint32_t &mark;
+            const uint32_t epoch;
 
-            for (auto i = 0; i < number; ++i)
+            explicit Reference(uint32_t &mark, const uint32_t epoch) : mark(mark), epoch(epoch)
             {
-                auto &neighbor_offset = pool[i];
-                auto &next_offset = pool[i + 1];
+            }
 
-                Prefetch(index.vectors[next_offset].data);
-                waiting_vectors.push(
-                    {index.similarity(target_vector, index.vectors[neighbor_offset].data, index.parameters.dimension),
-                     neighbor_offset});
+            operator bool() const
+            {
+                return this->mark == this->epoch;
             }
 
-            waiting_vectors.push(
-                {index.similarity(target_vector, index.vectors[pool.back()].data, index.parameters.dimension),
-                 pool.back()});
+            Reference &operator=(const bool visited)
+            {
+                this->mark = visited ? this->epoch : 0;
+                return *this;
+            }
+        };
 
-            pool.clear();
+        Visited_Marks() : epoch(0)
+        {
         }
-    }
 
-    inline void Similarity_Add(const Index &index, const float *const target_vector, std::vector<Offset> &pool,
-                               std::priority_queue<std::pair<float, Offset>, std::vector<std::pair<float, Offset>>,
-                                                   std::greater<>> &waiting_vectors,
-                               std::vector<std::pair<Offset, float>> &all)
-    {
-        if (!pool.empty())
+        // 开始新的一轮，size 为顶点的数量
+        void reset(const uint64_t size)
         {
-            const auto number = pool.size() - 1;
-
-            Prefetch(index.vectors[pool.front()].data);
-
-            for (auto i = 0; i < number; ++i)
+            if (this->marks.size() < size)
             {
-                auto &neighbor_offset = pool[i];
-                auto &neighbor_vector = index.vectors[neighbor_offset];
-                auto &next_offset = pool[i + 1];
-                auto distance =
-                    index.similarity(target_vector, index.vectors[neighbor_offset].data, index.parameters.dimension);
-
-                waiting_vectors.push({distance, neighbor_offset});
+                this->marks.resize(size, 0);
+            }
 
-                if (neighbor_vector.short_edge_out.size() < index.parameters.short_edge_lower_limit ||
-                    distance < neighbor_vector.short_edge_out.rbegin()->first)
-                {
-                    all.push_back({neighbor_offset, distance});
-                }
+            ++this->epoch;
 
-                Prefetch(index.vectors[next_offset].data);
+            // 轮次溢出时清空一次
+            if (this->epoch == 0)
+            {
+                std::fill(this->marks.begin(), this->marks.end(), 0);
+                this->epoch = 1;
             }
+        }
 
-            auto &neighbor_offset = pool.back();
-            auto &neighbor_vector = index.vectors[neighbor_offset];
-            auto distance =
-                index.similarity(target_vector, index.vectors[neighbor_offset].data, index.parameters.dimension);
+        Reference operator[](const Offset offset)
+        {
+            return Reference(this->marks[offset], this->epoch);
+        }
 
-            waiting_vectors.push({distance, pool.back()});
+        bool operator[](const Offset offset) const
+        {
+            return this->marks[offset] == this->epoch;
+        }
+    };
 
-            if (neighbor_vector.short_edge_out.size() < index.parameters.short_edge_lower_limit ||
-                distance < neighbor_vector.short_edge_out.rbegin()->first)
-            {
-                all.push_back({neighbor_offset, distance});
-            }
+    // 可以清空并保留内存的优先队列
+    template <typename Compare>
+    class Reusable_Queue
+        : public std::priority_queue<std::pair<float, Offset>, std::vector<std::pair<float, Offset>>, Compare>
+    {
+      public:
+        void clear()
+        {
+            this->c.clear();
+        }
+    };
 
-            pool.clear();
+    // 连通性检查的统计
+    class Connected_Statistics
+    {
+      public:
+        // 检查的次数
+        uint64_t checks;
+        // 两个向量连通的次数
+        uint64_t connected;
+        // 遍历的边的数量达到上限的次数
+        uint64_t truncated;
+        // 遍历的边的总数
+        uint64_t explored;
+
+        Connected_Statistics() : checks(0), connected(0), truncated(0), explored(0)
+        {
         }
-    }
+    };
 
-    // 查询距离目标向量最近的k个向量
+    // 添加向量时使用的缓冲区
     //
-    // k = index.parameters.short_edge_lower_limit
+    // 在多次添加之间重复使用，除了顶点的边以外，稳定添加时不分配内存
     //
-    // 返回最近邻和不属于最近邻但是在路径上的顶点
-    inline void Search_Add(const Index &index, const Offset offset, std::vector<std::pair<float, Offset>> &long_path,
-                           std::vector<std::pair<float, Offset>> &short_path,
-                           std::priority_queue<std::pair<float, Offset>> &nearest_neighbors,
-                           std::vector<std::pair<Offset, float>> &all)
+    // 同一时刻只能被一个线程使用
+    template <typename Element>
+    class Insert_Context
     {
-        const auto &new_vector = index.vectors[offset];
-
+      public:
+        Visited_Marks visited;
+        // 检查连通性时从另一个向量出发遍历过的顶点
+        Visited_Marks reached;
+        // 向量的元素类型和输入类型不同时保存转换后的向量
+        std::vector<Space::Input_Type<Element>> buffer;
         // 等待队列
-        auto waiting_vectors =
-            std::priority_queue<std::pair<float, Offset>, std::vector<std::pair<float, Offset>>, std::greater<>>();
-
-        waiting_vectors.push({new_vector.zero, 0});
-        long_path.push_back({new_vector.zero, 0});
-        all.push_back({0, new_vector.zero});
-
-        // 标记是否被遍历过
-        auto visited = std::vector<bool>(index.vectors.size(), false);
-
-        visited[0] = true;
-
+        Reusable_Queue<std::greater<>> waiting_vectors;
+        // 最近邻
+        Reusable_Queue<std::less<>> nearest_neighbors;
         // 计算池子
-        auto pool = std::vector<Offset>();
+        std::vector<Offset> pool;
+        std::vector<std::pair<float, Offset>> long_path;
+        std::vector<std::pair<float, Offset>> short_path;
+        // 可能把新向量作为短边的向量
+        std::vector<std::pair<Offset, float>> all;
+        // 检查连通性时两侧当前一层的顶点和下一层的顶点
+        std::vector<Offset> forward;
+        std::vector<Offset> backward;
+        std::vector<Offset> next;
+        // 原地更新向量时原来的邻居
+        std::vector<Offset> neighbors;
+        // 删除时标记被删除的向量和受影响的向量
+        Visited_Marks removed;
+        Visited_Marks affected;
+        Connected_Statistics statistics;
+
+        // 开始添加一个向量，size 为顶点的数量
+        void reset(const uint64_t size)
+        {
+            this->visited.reset(size);
+            this->waiting_vectors.clear();
+            this->nearest_neighbors.clear();
+            this->pool.clear();
+            this->long_path.clear();
+            this->short_path.clear();
+            this->all.clear();
+        }
+    };
 
-        Get_Pool_From_SE(index, 0, visited, pool);
-        Similarity_Add(index, new_vector.data, pool, waiting_vectors, all);
+    // 不在索引中的 id 抛出异常，零点不是添加的向量，也不能通过 id 访问
+    template <typename Element>
+    inline Offset Get_Offset(const Index<Element> &index, const ID id)
+    {
+        const auto iterator = index.id_to_offset.find(id);
 
-        auto &short_offset = waiting_vectors.top().second;
+        if (iterator == index.id_to_offset.end() || iterator->second == 0)
+        {
+            throw std::invalid_argument("The vector is not in the index. ");
+        }
 
-        Get_Pool_From_LEO(index, 0, visited, pool);
-        Similarity_Add(index, new_vector.data, pool, waiting_vectors, all);
+        return iterator->second;
+    }
 
-        auto &nearest_offset = waiting_vectors.top().second;
+    // 以输入类型读取索引中的向量
+    //
+    // 向量的元素类型和输入类型相同时直接返回向量的数据，否则转换到 buffer 中
+    template <typename Element>
+    inline const Space::Input_Type<Element> *Get_Input(const Index<Element> &index, const Element *const data,
+                                                       std::vector<Space::Input_Type<Element>> &buffer)
+    {
+        if constexpr (std::is_same_v<Element, Space::Input_Type<Element>>)
+        {
+            return data;
+        }
+        else
+        {
+            buffer.resize(index.parameters.dimension);
+            Space::convert(data, buffer.data(), index.parameters.dimension);
+            return buffer.data();
+        }
+    }
 
-        if (short_offset != nearest_offset)
+    // 查询向量
+    //
+    // 余弦距离的查询向量归一化到 buffer 中，其它度量直接返回查询向量
+    //
+    // 冻结的索引和磁盘上的索引也用这个函数处理查询向量
+    template <typename Input>
+    inline const Input *Get_Query(const Space::Metric space_metric, const uint64_t dimension,
+                                  const Input *const target_vector, std::vector<Input> &buffer)
+    {
+        if constexpr (std::is_same_v<Input, float>)
         {
-            while (true)
+            if (space_metric == Space::Metric::Cosine_Similarity)
             {
-                long_path.push_back(waiting_vectors.top());
-
-                const auto &processing_offset = waiting_vectors.top().second;
-
-                Get_Pool_From_SE(index, processing_offset, visited, pool);
-                Similarity_Add(index, new_vector.data, pool, waiting_vectors, all);
-
-                const auto &short_offset = waiting_vectors.top().second;
-
-                Get_Pool_From_LEO(index, processing_offset, visited, pool);
-                Similarity_Add(index, new_vector.data, pool, waiting_vectors, all);
+                buffer.resize(dimension);
 
-                const auto &nearest_offset = waiting_vectors.top().second;
-
-                if (short_offset == nearest_offset)
+                if (Space::Cosine::normalize(target_vector, buffer.data(), dimension) == 0)
                 {
-                    break;
+                    throw std::invalid_argument("The norm of the vector must be positive for 'Cosine Similarity'. ");
+                }
+
+                return buffer.data();
+            }
+        }
+
+        return target_vector;
+    }
+
+    template <typename Element>
+    inline const Space::Input_Type<Element> *Get_Query(const Index<Element> &index,
+                                                       const Space::Input_Type<Element> *const target_vector,
+                                                       std::vector<Space::Input_Type<Element>> &buffer)
+    {
+        return Get_Query(index.parameters.space_metric, index.parameters.dimension, target_vector, buffer);
+    }
+
+    // 最大内积查询的范数增广
+    //
+    // 向量 x 增广为 (x, sqrt(M^2 - |x|^2))，查询向量 q 增广为 (q, 0)
+    //
+    // 两个增广后的向量的平方欧氏距离为 2M^2 - 2<x,y> - 2 sqrt(M^2 - |x|^2) sqrt(M^2 - |y|^2)，建图时仍是欧氏空间
+    //
+    // 查询向量和增广后的向量的平方欧氏距离为 |q|^2 + M^2 - 2<q,x>，和内积的顺序一致，所以查询时直接使用内积
+    //
+    // distance 为内积的相反数，zero1 和 zero2 为两个向量的平方范数
+    template <typename Element>
+    inline float Augment(const Index<Element> &index, const float distance, const float zero1, const float zero2)
+    {
+        if (index.norm_bound == 0)
+        {
+            return distance;
+        }
+
+        const auto &M2 = index.norm_bound;
+        auto augmented = 2 * M2 + 2 * distance - 2 * std::sqrt(std::max(0.0f, M2 - zero1) * std::max(0.0f, M2 - zero2));
+
+        return std::max(0.0f, augmented);
+    }
+
+    // 向量到零点的距离
+    //
+    // 最大内积查询时零点和其他向量一样增广为 (0, M)，到向量 x 的距离为 2M^2 - 2M sqrt(M^2 - |x|^2)，
+    // 和 Similarity 计算的零点的距离一致，并且随 |x| 单调增加，所以长边按原始范数排序和按增广后到零点的距离排序相同
+    //
+    // 余弦距离的向量已经归一化，余弦距离是平方欧氏距离的一半，到零点的距离也取一半
+    template <typename Element>
+    inline float Zero_Distance(const Index<Element> &index, const float zero)
+    {
+        if (index.parameters.space_metric == Space::Metric::Cosine_Similarity)
+        {
+            return zero / 2;
+        }
+
+        if (index.norm_bound == 0)
+        {
+            return zero;
+        }
+
+        // 零点和向量的内积为 0
+        return Augment(index, 0, 0, zero);
+    }
+
+    // 删除向量的数据和边，空出的位置由之后添加的向量使用
+    //
+    // 并发查询时正在进行的查询可能还在访问向量的数据，位置等到这些查询结束后再回收
+    template <typename Element>
+    inline void Delete_Vector(Index<Element> &index, const Offset offset)
+    {
+        auto &vector = index.vectors[offset];
+
+        {
+            auto guard = Edge_Guard(index, offset);
+
+            vector.deleted = false;
+            vector.short_edge_in.clear();
+            vector.short_edge_out.clear();
+            vector.keep_connected.clear();
+            vector.long_edge_in.clear();
+            vector.long_edge_out.clear();
+        }
+
+        --index.count;
+
+        if (index.serving)
+        {
+            index.retired.push({index.epoch.advance(), offset});
+            return;
+        }
+
+        vector.data = nullptr;
+        index.empty.push(offset);
+    }
+
+    // 回收删除的向量的位置
+    //
+    // 只回收删除之前开始的查询都已经结束的位置，被替换的邻居在之后发布时释放
+    template <typename Element>
+    inline void Reclaim(Index<Element> &index)
+    {
+        const auto minimum = index.epoch.minimum();
+
+        index.reclaimable = minimum;
+
+        while (!index.retired.empty() && index.retired.front().first < minimum)
+        {
+            const auto offset = index.retired.front().second;
+
+            index.vectors[offset].data = nullptr;
+            index.empty.push(offset);
+            index.retired.pop();
+        }
+    }
+
+    // 并发查询时数组不能重新分配，检查预留的位置是否足够添加 number 个向量
+    template <typename Element>
+    inline void Check_Capacity(Index<Element> &index, const uint64_t number)
+    {
+        Reclaim(index);
+
+        if (index.vectors.capacity() - index.vectors.size() + index.empty.size() < number)
+        {
+            throw std::logic_error("The capacity reserved for concurrent search is exhausted. ");
+        }
+    }
+
+    // 查询时顶点的数量
+    //
+    // 并发查询时写者可能正在添加向量，使用预留的容量
+    template <typename Element>
+    inline uint64_t Vertex_Number(const Index<Element> &index)
+    {
+        return index.serving ? index.vectors.capacity() : index.vectors.size();
+    }
+
+    // 向量是否被标记删除
+    template <typename Element>
+    inline bool Deleted(const Index<Element> &index, const Offset offset)
+    {
+        return index.vectors[offset].deleted.load(std::memory_order_acquire);
+    }
+
+    // 并发查询时读取的邻居，还没有发布时没有邻居
+    template <typename Element>
+    inline const Neighbors &Published_Neighbors(const Index<Element> &index, const Offset offset)
+    {
+        static const auto empty = Neighbors();
+        const auto *neighbors = index.vectors[offset].published.load();
+
+        return neighbors == nullptr ? empty : *neighbors;
+    }
+
+    template <typename Element>
+    inline bool Adjacent(const Index<Element> &index, const Offset offset1, const Offset offset2)
+    {
+        auto &v1 = index.vectors[offset1];
+        auto &v2 = index.vectors[offset2];
+        auto guard = Vertex_Guard(index, offset1, offset2);
+
+        if (v1.keep_connected.contains(v2.offset))
+        {
+            return true;
+        }
+
+        if (v1.short_edge_in.contains(v2.offset))
+        {
+            return true;
+        }
+
+        if (v2.short_edge_in.contains(v1.offset))
+        {
+            return true;
+        }
+
+        return false;
+    }
+
+    // visited 可以是 std::vector<bool> 或 Visited_Marks
+    template <typename Element, typename Visited>
+    inline void Get_Pool_From_LEO(const Index<Element> &index, const Offset processing_offset, Visited &visited,
+                                  std::vector<Offset> &pool)
+    {
+        if (index.serving)
+        {
+            const auto &neighbors = Published_Neighbors(index, processing_offset);
+
+            for (auto i = neighbors.keep_number; i < neighbors.edges.size(); ++i)
+            {
+                const auto &neighbor_offset = neighbors.edges[i].first;
+
+                if (!visited[neighbor_offset])
+                {
+                    visited[neighbor_offset] = true;
+                    pool.push_back(neighbor_offset);
+                }
+            }
+
+            return;
+        }
+
+        auto &processing_vector = index.vectors[processing_offset];
+        auto guard = Vertex_Guard(index, processing_offset);
+
+        for (auto iterator = processing_vector.long_edge_out.begin(); iterator != processing_vector.long_edge_out.end();
+             ++iterator)
+        {
+            auto &neighbor_offset = iterator->first;
+
+            // 计算当前向量的出边指向的向量和目标向量的距离
+            if (!visited[neighbor_offset])
+            {
+                visited[neighbor_offset] = true;
+                pool.push_back(neighbor_offset);
+            }
+        }
+    }
+
+    template <typename Element, typename Visited>
+    inline void Get_Pool_From_SE(const Index<Element> &index, const Offset processing_offset, Visited &visited,
+                                 std::vector<Offset> &pool)
+    {
+        if (index.serving)
+        {
+            const auto &neighbors = Published_Neighbors(index, processing_offset);
+
+            for (auto i = 0; i < neighbors.keep_number; ++i)
+            {
+                const auto &neighbor_offset = neighbors.edges[i].first;
+
+                if (!visited[neighbor_offset])
+                {
+                    visited[neighbor_offset] = true;
+                    pool.push_back(neighbor_offset);
+                }
+            }
+
+            return;
+        }
+
+        auto &processing_vector = index.vectors[processing_offset];
+        auto guard = Vertex_Guard(index, processing_offset);
+
+        for (auto iterator = processing_vector.short_edge_out.begin();
+             iterator != processing_vector.short_edge_out.end(); ++iterator)
+        {
+            auto &neighbor_offset = iterator->second;
+
+            // 计算当前向量的出边指向的向量和目标向量的距离
+            if (!visited[neighbor_offset])
+            {
+                visited[neighbor_offset] = true;
+                pool.push_back(neighbor_offset);
+            }
+        }
+
+        for (auto iterator = processing_vector.short_edge_in.begin(); iterator != processing_vector.short_edge_in.end();
+             ++iterator)
+        {
+            auto &neighbor_offset = iterator->first;
+
+            // 计算当前向量的出边指向的向量和目标向量的距离
+            if (!visited[neighbor_offset])
+            {
+                visited[neighbor_offset] = true;
+                pool.push_back(neighbor_offset);
+            }
+        }
+
+        for (auto iterator = processing_vector.keep_connected.begin();
+             iterator != processing_vector.keep_connected.end(); ++iterator)
+        {
+            auto &neighbor_offset = *iterator;
+
+            // 计算当前向量的出边指向的向量和目标向量的距离
+            if (!visited[neighbor_offset])
+            {
+                visited[neighbor_offset] = true;
+                pool.push_back(neighbor_offset);
+            }
+        }
+    }
+
+    inline void Prefetch(const void *const data)
+    {
+#if defined(__SSE__)
+        _mm_prefetch((const char *)data, _MM_HINT_T0);
+#endif
+    }
+
+    // distance 为距离计算函数，可以是 index.similarity 或 Space::Distance 的实例
+    template <typename Element, typename Distance>
+    inline void Similarity(const Index<Element> &index, const Space::Input_Type<Element> *const target_vector,
+                           std::vector<Offset> &pool,
+                           std::priority_queue<std::pair<float, Offset>, std::vector<std::pair<float, Offset>>,
+                                               std::greater<>> &waiting_vectors,
+                           const Distance &distance)
+    {
+        if (!pool.empty())
+        {
+            Prefetch(index.vectors[pool.front()].data);
+
+            const auto number = pool.size() - 1;
+
+            for (auto i = 0; i < number; ++i)
+            {
+                auto &neighbor_offset = pool[i];
+                auto &next_offset = pool[i + 1];
+
+                Prefetch(index.vectors[next_offset].data);
+                waiting_vectors.push(
+                    {distance(target_vector, index.vectors[neighbor_offset].data, index.parameters.dimension),
+                     neighbor_offset});
+            }
+
+            waiting_vectors.push(
+                {distance(target_vector, index.vectors[pool.back()].data, index.parameters.dimension), pool.back()});
+
+            pool.clear();
+        }
+    }
+
+    // 目标向量是索引中的向量时使用，target_zero 为目标向量的平方范数
+    template <typename Element>
+    inline void Similarity(const Index<Element> &index, const Space::Input_Type<Element> *const target_vector,
+                           const float target_zero, std::vector<Offset> &pool,
+                           std::priority_queue<std::pair<float, Offset>, std::vector<std::pair<float, Offset>>,
+                                               std::greater<>> &waiting_vectors)
+    {
+        if (index.norm_bound == 0)
+        {
+            Similarity(index, target_vector, pool, waiting_vectors, index.similarity);
+            return;
+        }
+
+        for (auto i = 0; i < pool.size(); ++i)
+        {
+            auto &neighbor_vector = index.vectors[pool[i]];
+            auto distance = index.similarity(target_vector, neighbor_vector.data, index.parameters.dimension);
+
+            waiting_vectors.push({Augment(index, distance, target_zero, neighbor_vector.zero), pool[i]});
+        }
+
+        pool.clear();
+    }
+
+    // 距离为 distance 的新向量能否成为邻居向量的短边
+    template <typename Element>
+    inline bool Replaceable(const Index<Element> &index, const Offset neighbor_offset, const float distance)
+    {
+        auto &neighbor_vector = index.vectors[neighbor_offset];
+        auto guard = Vertex_Guard(index, neighbor_offset);
+
+        return neighbor_vector.short_edge_out.size() < index.parameters.short_edge_lower_limit ||
+               distance < neighbor_vector.short_edge_out.rbegin()->first;
+    }
+
+    template <typename Element>
+    inline void Similarity_Add(const Index<Element> &index, const Space::Input_Type<Element> *const target_vector,
+                               const float target_zero, std::vector<Offset> &pool,
+                               std::priority_queue<std::pair<float, Offset>, std::vector<std::pair<float, Offset>>,
+                                                   std::greater<>> &waiting_vectors,
+                               std::vector<std::pair<Offset, float>> &all)
+    {
+        if (!pool.empty())
+        {
+            const auto number = pool.size() - 1;
+
+            Prefetch(index.vectors[pool.front()].data);
+
+            for (auto i = 0; i < number; ++i)
+            {
+                auto &neighbor_offset = pool[i];
+                auto &neighbor_vector = index.vectors[neighbor_offset];
+                auto &next_offset = pool[i + 1];
+                auto distance = Augment(
+                    index, index.similarity(target_vector, neighbor_vector.data, index.parameters.dimension),
+                    target_zero, neighbor_vector.zero);
+
+                waiting_vectors.push({distance, neighbor_offset});
+
+                if (Replaceable(index, neighbor_offset, distance))
+                {
+                    all.push_back({neighbor_offset, distance});
+                }
+
+                Prefetch(index.vectors[next_offset].data);
+            }
+
+            auto &neighbor_offset = pool.back();
+            auto &neighbor_vector = index.vectors[neighbor_offset];
+            auto distance =
+                Augment(index, index.similarity(target_vector, neighbor_vector.data, index.parameters.dimension),
+                        target_zero, neighbor_vector.zero);
+
+            waiting_vectors.push({distance, pool.back()});
+
+            if (Replaceable(index, neighbor_offset, distance))
+            {
+                all.push_back({neighbor_offset, distance});
+            }
+
+            pool.clear();
+        }
+    }
+
+    // 查询距离目标向量最近的k个向量
+    //
+    // k = index.parameters.short_edge_lower_limit
+    //
+    // 返回最近邻和不属于最近邻但是在路径上的顶点
+    template <typename Element>
+    inline void Search_Add(const Index<Element> &index, const Offset offset, Insert_Context<Element> &context)
+    {
+        const auto &new_vector = index.vectors[offset];
+        const auto *target_vector = Get_Input(index, new_vector.data, context.buffer);
+        auto &waiting_vectors = context.waiting_vectors;
+        auto &nearest_neighbors = context.nearest_neighbors;
+        auto &long_path = context.long_path;
+        auto &short_path = context.short_path;
+        auto &visited = context.visited;
+        auto &pool = context.pool;
+        auto &all = context.all;
+
+        context.reset(index.vectors.size());
+
+        const auto zero_distance = Zero_Distance(index, new_vector.zero);
+
+        waiting_vectors.push({zero_distance, 0});
+        long_path.push_back({zero_distance, 0});
+        all.push_back({0, zero_distance});
+
+        visited[0] = true;
+
+        Get_Pool_From_SE(index, 0, visited, pool);
+        Similarity_Add(index, target_vector, new_vector.zero, pool, waiting_vectors, all);
+
+        const auto short_offset = waiting_vectors.top().second;
+
+        Get_Pool_From_LEO(index, 0, visited, pool);
+        Similarity_Add(index, target_vector, new_vector.zero, pool, waiting_vectors, all);
+
+        const auto nearest_offset = waiting_vectors.top().second;
+
+        if (short_offset != nearest_offset)
+        {
+            while (true)
+            {
+                long_path.push_back(waiting_vectors.top());
+
+                const auto processing_offset = waiting_vectors.top().second;
+
+                Get_Pool_From_SE(index, processing_offset, visited, pool);
+                Similarity_Add(index, target_vector, new_vector.zero, pool, waiting_vectors, all);
+
+                const auto short_offset = waiting_vectors.top().second;
+
+                Get_Pool_From_LEO(index, processing_offset, visited, pool);
+                Similarity_Add(index, target_vector, new_vector.zero, pool, waiting_vectors, all);
+
+                const auto nearest_offset = waiting_vectors.top().second;
+
+                if (short_offset == nearest_offset)
+                {
+                    break;
                 }
             }
         }
@@ -371,630 +1059,2676 @@ namespace HSG
         // 利用短边找到和目标向量最近的向量
         while (true)
         {
-            const auto &processing_offset = waiting_vectors.top().second;
+            const auto processing_offset = waiting_vectors.top().second;
+
+            Get_Pool_From_SE(index, processing_offset, visited, pool);
+            Similarity_Add(index, target_vector, new_vector.zero, pool, waiting_vectors, all);
+
+            const auto nearest_offset = waiting_vectors.top().second;
+
+            if (processing_offset == nearest_offset)
+            {
+                break;
+            }
+
+            short_path.push_back(waiting_vectors.top());
+        }
+
+        // 阶段三：
+        // 查找与目标向量相似度最高（距离最近）的k个向量
+        while (!waiting_vectors.empty())
+        {
+            const auto [processing_distance, processing_offset] = waiting_vectors.top();
+
+            // 如果优先队列中的向量的数量小于k
+            if (nearest_neighbors.size() < index.parameters.magnification)
+            {
+                nearest_neighbors.push({processing_distance, processing_offset});
+            }
+            else
+            {
+                // 如果当前的向量和查询向量的距离小于优先队列中的最大值
+                if (processing_distance < nearest_neighbors.top().first)
+                {
+                    nearest_neighbors.pop();
+                    nearest_neighbors.push({processing_distance, processing_offset});
+                }
+                else
+                {
+                    break;
+                }
+            }
+
+            waiting_vectors.pop();
+            Get_Pool_From_SE(index, processing_offset, visited, pool);
+            Similarity_Add(index, target_vector, new_vector.zero, pool, waiting_vectors, all);
+        }
+
+        while (index.parameters.short_edge_lower_limit < nearest_neighbors.size())
+        {
+            nearest_neighbors.pop();
+        }
+    }
+
+    // 只计算添加向量时的搜索路径，不查找最近邻，返回路径终点的距离和偏移量
+    //
+    // 搜索路径保存在 context 中
+    //
+    // 批量构建时向量已经在图中，所以先把向量自己标记为已遍历
+    template <typename Element>
+    inline std::pair<float, Offset> Search_Path(const Index<Element> &index, const Offset offset,
+                                                Insert_Context<Element> &context)
+    {
+        const auto &vector = index.vectors[offset];
+        const auto *target_vector = Get_Input(index, vector.data, context.buffer);
+        auto &waiting_vectors = context.waiting_vectors;
+        auto &long_path = context.long_path;
+        auto &short_path = context.short_path;
+        auto &visited = context.visited;
+        auto &pool = context.pool;
+
+        context.reset(index.vectors.size());
+
+        const auto zero_distance = Zero_Distance(index, vector.zero);
+
+        waiting_vectors.push({zero_distance, 0});
+        long_path.push_back({zero_distance, 0});
+
+        visited[0] = true;
+        visited[offset] = true;
+
+        Get_Pool_From_SE(index, 0, visited, pool);
+        Similarity(index, target_vector, vector.zero, pool, waiting_vectors);
+
+        auto short_offset = waiting_vectors.top().second;
+
+        Get_Pool_From_LEO(index, 0, visited, pool);
+        Similarity(index, target_vector, vector.zero, pool, waiting_vectors);
+
+        auto nearest_offset = waiting_vectors.top().second;
+
+        // 阶段一：
+        // 利用长边接近目标向量
+        while (short_offset != nearest_offset)
+        {
+            long_path.push_back(waiting_vectors.top());
+
+            const auto processing_offset = waiting_vectors.top().second;
+
+            Get_Pool_From_SE(index, processing_offset, visited, pool);
+            Similarity(index, target_vector, vector.zero, pool, waiting_vectors);
+
+            short_offset = waiting_vectors.top().second;
+
+            Get_Pool_From_LEO(index, processing_offset, visited, pool);
+            Similarity(index, target_vector, vector.zero, pool, waiting_vectors);
+
+            nearest_offset = waiting_vectors.top().second;
+        }
+
+        // 阶段二：
+        // 利用短边找到和目标向量最近的向量
+        while (true)
+        {
+            const auto processing_offset = waiting_vectors.top().second;
+
+            Get_Pool_From_SE(index, processing_offset, visited, pool);
+            Similarity(index, target_vector, vector.zero, pool, waiting_vectors);
+
+            if (processing_offset == waiting_vectors.top().second)
+            {
+                return waiting_vectors.top();
+            }
+
+            short_path.push_back(waiting_vectors.top());
+        }
+    }
+
+    // 把 frontier 中的顶点的邻居加入 next
+    //
+    // 遇到另一侧遍历过的顶点时返回 true，遍历的边的数量达到 limit 时停止
+    template <typename Element>
+    inline bool Expand(const Index<Element> &index, const std::vector<Offset> &frontier, std::vector<Offset> &next,
+                       Visited_Marks &own, Visited_Marks &other, const uint64_t limit, uint64_t &explored)
+    {
+        next.clear();
+
+        for (auto i = 0; i < frontier.size(); ++i)
+        {
+            auto &vector = index.vectors[frontier[i]];
+            auto guard = Vertex_Guard(index, frontier[i]);
+
+            for (auto iterator = vector.short_edge_in.begin(); iterator != vector.short_edge_in.end(); ++iterator)
+            {
+                const auto &neighbor_offset = iterator->first;
+
+                if (other[neighbor_offset])
+                {
+                    return true;
+                }
+
+                if (!own[neighbor_offset])
+                {
+                    own[neighbor_offset] = true;
+                    next.push_back(neighbor_offset);
+                }
+            }
+
+            for (auto iterator = vector.short_edge_out.begin(); iterator != vector.short_edge_out.end(); ++iterator)
+            {
+                const auto &neighbor_offset = iterator->second;
+
+                if (other[neighbor_offset])
+                {
+                    return true;
+                }
+
+                if (!own[neighbor_offset])
+                {
+                    own[neighbor_offset] = true;
+                    next.push_back(neighbor_offset);
+                }
+            }
+
+            for (auto iterator = vector.keep_connected.begin(); iterator != vector.keep_connected.end(); ++iterator)
+            {
+                const auto &neighbor_offset = *iterator;
+
+                if (other[neighbor_offset])
+                {
+                    return true;
+                }
+
+                if (!own[neighbor_offset])
+                {
+                    own[neighbor_offset] = true;
+                    next.push_back(neighbor_offset);
+                }
+            }
+
+            explored += vector.short_edge_in.size() + vector.short_edge_out.size() + vector.keep_connected.size();
+
+            if (limit <= explored)
+            {
+                return false;
+            }
+        }
+
+        return false;
+    }
+
+    // 检查两个向量是否在四步之内通过短边或保持连通的边连通
+    //
+    // 从两个向量同时出发，每次扩展一层较小的一侧，两侧相遇时连通
+    //
+    // 遍历的边的数量达到 index.parameters.connected_limit 时视为不连通
+    template <typename Element>
+    inline bool Connected(const Index<Element> &index, const Offset start, const Offset offset,
+                          Insert_Context<Element> &context)
+    {
+        auto &statistics = context.statistics;
+        auto &forward = context.forward;
+        auto &backward = context.backward;
+        auto &next = context.next;
+        const auto &limit = index.parameters.connected_limit;
+        uint64_t explored = 0;
+        auto connected = false;
+
+        context.visited.reset(index.vectors.size());
+        context.reached.reset(index.vectors.size());
+        forward.clear();
+        backward.clear();
+
+        context.visited[start] = true;
+        context.reached[offset] = true;
+        forward.push_back(start);
+        backward.push_back(offset);
+
+        for (auto depth = 0; depth < 4 && !forward.empty() && !backward.empty() && explored < limit; ++depth)
+        {
+            if (forward.size() <= backward.size())
+            {
+                connected = Expand(index, forward, next, context.visited, context.reached, limit, explored);
+                std::swap(forward, next);
+            }
+            else
+            {
+                connected = Expand(index, backward, next, context.reached, context.visited, limit, explored);
+                std::swap(backward, next);
+            }
+
+            if (connected)
+            {
+                break;
+            }
+        }
+
+        ++statistics.checks;
+        statistics.explored += explored;
+
+        if (connected)
+        {
+            ++statistics.connected;
+        }
+        else if (limit <= explored)
+        {
+            ++statistics.truncated;
+        }
+
+        return connected;
+    }
+
+    // 计算角A的余弦值
+    //
+    // 余弦值没有除以2
+    inline float Cosine_Value(const float a, const float b, const float c)
+    {
+        return (b * b + c * c - a * a) / (b * c);
+    }
+
+    // 添加长边
+    template <typename Element>
+    inline void Add_Long_Edges(Index<Element> &index, std::vector<std::pair<float, Offset>> &long_path,
+                               std::vector<std::pair<float, Offset>> &short_path, const Offset offset)
+    {
+        auto &vector = index.vectors[offset];
+
+        if (index.parameters.cover_range < short_path.size())
+        {
+            float added_distance = 0;
+            float maximum_cosine = -2;
+            Offset added_offset = 0;
+
+            for (int i = long_path.size() - 1; 0 < i; --i)
+            {
+                const auto &D = long_path[i].first;
+                const auto &neighbor_offset = long_path[i].second;
+                auto &neighbor_vector = index.vectors[neighbor_offset];
+
+                if (neighbor_vector.zero < vector.zero && !Adjacent(index, offset, neighbor_offset))
+                {
+                    auto CV = Cosine_Value(added_distance, Zero_Distance(index, vector.zero),
+                                           Zero_Distance(index, neighbor_vector.zero));
+
+                    if (maximum_cosine < CV)
+                    {
+                        added_distance = D;
+                        maximum_cosine = CV;
+                        added_offset = neighbor_offset;
+                    }
+                }
+            }
+
+            if (1.732 < maximum_cosine)
+            {
+                auto &neighbor_vector = index.vectors[added_offset];
+                auto guard = Edge_Guard(index, added_offset, offset);
+
+                neighbor_vector.long_edge_out.insert({offset, added_distance});
+                vector.long_edge_in.insert({added_offset, added_distance});
+            }
+            else
+            {
+                auto guard = Edge_Guard(index, 0, offset);
+
+                index.vectors.front().long_edge_out.insert({added_offset, Zero_Distance(index, vector.zero)});
+                vector.long_edge_in.insert({0, Zero_Distance(index, vector.zero)});
+            }
+        }
+    }
+
+    // 并行添加时其它线程可能在两次加锁之间修改了邻居向量的边，所以加锁后重新检查
+    template <typename Element>
+    inline void Neighbor_Optimize(Index<Element> &index, const Offset offset,
+                                  const std::vector<std::pair<Offset, float>> &all, Insert_Context<Element> &context)
+    {
+        auto &new_vector = index.vectors[offset];
+
+        for (auto i = 0; i < all.size(); ++i)
+        {
+            const auto &neighbor_offset = all[i].first;
+            const auto &distance = all[i].second;
+            auto &neighbor = index.vectors[neighbor_offset];
+
+            // neighbor neighbor offset
+            Offset NN_offset = 0;
+            float farest_distance = 0;
+            // 是否删除了邻居向量距离最大的出边
+            auto removed = false;
+            // 删除后两个向量之间是否还有短边
+            auto linked = false;
+
+            while (true)
+            {
+                {
+                    auto guard = Edge_Guard(index, neighbor_offset, offset);
+
+                    // 如果邻居向量的出边小于短边下限
+                    if (neighbor.short_edge_out.size() < index.parameters.short_edge_lower_limit)
+                    {
+                        // 邻居向量添加出边
+                        neighbor.short_edge_out.insert({distance, offset});
+
+                        // 新向量添加入边
+                        new_vector.short_edge_in.insert({neighbor_offset, distance});
+
+                        break;
+                    }
+
+                    // 如果新向量和邻居的距离不小于邻居当前距离最大的出边的距离
+                    if (neighbor.short_edge_out.rbegin()->first <= distance)
+                    {
+                        break;
+                    }
+
+                    farest_distance = neighbor.short_edge_out.rbegin()->first;
+                    NN_offset = neighbor.short_edge_out.rbegin()->second;
+                }
+
+                auto guard = Edge_Guard(index, neighbor_offset, NN_offset);
+
+                // 两次加锁之间距离最大的出边被修改时重试
+                if (neighbor.short_edge_out.size() < index.parameters.short_edge_lower_limit ||
+                    neighbor.short_edge_out.rbegin()->second != NN_offset)
+                {
+                    continue;
+                }
+
+                auto &neighbor_neighbor = index.vectors[NN_offset];
+
+                // 邻居向量删除距离最大的出边
+                neighbor.short_edge_out.erase(std::prev(neighbor.short_edge_out.end()));
+                neighbor_neighbor.short_edge_in.erase(neighbor_offset);
+
+                linked = neighbor.short_edge_in.contains(NN_offset);
+                removed = true;
+
+                break;
+            }
+
+            if (!removed)
+            {
+                continue;
+            }
+
+            // 添加一条长边
+            if (!linked && !Connected(index, neighbor_offset, NN_offset, context))
+            {
+                auto &neighbor_neighbor = index.vectors[NN_offset];
+                auto guard = Edge_Guard(index, neighbor_offset, NN_offset);
+
+                if (neighbor.short_edge_out.size() < index.parameters.short_edge_upper_limit)
+                {
+                    neighbor.short_edge_out.insert({farest_distance, NN_offset});
+                    neighbor_neighbor.short_edge_in.insert({neighbor_offset, farest_distance});
+                }
+                else
+                {
+                    neighbor.keep_connected.insert(NN_offset);
+                    neighbor_neighbor.keep_connected.insert(neighbor_offset);
+                }
+            }
+
+            auto guard = Edge_Guard(index, neighbor_offset, offset);
+
+            // 邻居向量添加出边
+            neighbor.short_edge_out.insert({distance, offset});
+            // 新向量添加入边
+            new_vector.short_edge_in.insert({neighbor_offset, distance});
+        }
+    }
+
+    // 计算向量的量化编码
+    template <typename Element>
+    inline void Encode_Vector(Index<Element> &index, const Offset offset)
+    {
+        const auto &code_size = index.quantizer.code_size;
+
+        if (index.codes.size() < index.vectors.size() * code_size)
+        {
+            index.codes.resize(index.vectors.size() * code_size, 0);
+        }
+
+        Quantization::Encode(index.quantizer, index.vectors[offset].data, index.codes.data() + offset * code_size);
+    }
+
+    // 计算向量的草图
+    template <typename Element>
+    inline void Encode_Sketch(Index<Element> &index, const Offset offset)
+    {
+        const auto &words = index.sketch.words;
+
+        if (index.sketch_norms.size() < index.vectors.size())
+        {
+            index.sketches.resize(index.vectors.size() * words, 0);
+            index.sketch_norms.resize(index.vectors.size(), 0);
+        }
+
+        index.sketch_norms[offset] =
+            Quantization::Encode(index.sketch, index.vectors[offset].data, index.sketches.data() + offset * words);
+    }
+
+    // 保存添加的向量
+    //
+    // 向量的元素类型和输入类型相同时索引只记录向量的地址，否则转换后保存在索引中
+    //
+    // 余弦距离的向量归一化后保存在索引中
+    template <typename Element>
+    inline const Element *Store(Index<Element> &index, const Offset offset,
+                                const Space::Input_Type<Element> *const added_vector_data)
+    {
+        if constexpr (std::is_same_v<Element, float>)
+        {
+            if (index.parameters.space_metric == Space::Metric::Cosine_Similarity)
+            {
+                auto *address = index.storage.address(offset);
+                Space::Cosine::normalize(added_vector_data, address, index.parameters.dimension);
+                return address;
+            }
+        }
+
+        if constexpr (std::is_same_v<Element, Space::Input_Type<Element>>)
+        {
+            return added_vector_data;
+        }
+        else
+        {
+            auto *address = index.storage.address(offset);
+            Space::convert(added_vector_data, address, index.parameters.dimension);
+            return address;
+        }
+    }
+
+    // 检查添加的向量是否满足度量的要求
+    template <typename Element>
+    inline void Check_Vector(const Index<Element> &index, const Space::Input_Type<Element> *const added_vector_data)
+    {
+        if (index.norm_bound != 0 &&
+            index.norm_bound < Space::Euclidean2::zero(added_vector_data, index.parameters.dimension))
+        {
+            throw std::invalid_argument("The norm of the vector exceeds the bound of maximum inner product search. ");
+        }
+
+        if (index.parameters.space_metric == Space::Metric::Cosine_Similarity &&
+            Space::Euclidean2::zero(added_vector_data, index.parameters.dimension) == 0)
+        {
+            throw std::invalid_argument("The norm of the vector must be positive for 'Cosine Similarity'. ");
+        }
+    }
+
+    // 为添加的向量分配位置并保存向量，返回向量的偏移量
+    //
+    // 此时向量还没有连接到图中
+    template <typename Element>
+    inline Offset Allocate(Index<Element> &index, const ID id,
+                           const Space::Input_Type<Element> *const added_vector_data)
+    {
+        Offset offset = index.vectors.size();
+        ++index.count;
+
+        if (index.empty.empty())
+        {
+            const auto *data = Store(index, offset, added_vector_data);
+
+            // 在索引中创建一个新向量
+            index.vectors.push_back(
+                Vector<Element>(id, offset, data, Space::Euclidean2::zero(data, index.parameters.dimension)));
+        }
+        else
+        {
+            offset = index.empty.top();
+            index.empty.pop();
+
+            const auto *data = Store(index, offset, added_vector_data);
+
+            index.vectors[offset].id = id;
+            index.vectors[offset].data = data;
+            index.vectors[offset].zero = Space::Euclidean2::zero(data, index.parameters.dimension);
+        }
+
+        index.id_to_offset.insert({id, offset});
+
+        return offset;
+    }
+
+    // 把已经分配位置的向量连接到图中
+    //
+    // 并行添加时多个线程同时调用，只修改顶点的边
+    template <typename Element>
+    inline void Link(Index<Element> &index, const Offset offset, Insert_Context<Element> &context)
+    {
+        auto &new_vector = index.vectors[offset];
+        auto &nearest_neighbors = context.nearest_neighbors;
+
+        // 搜索距离新增向量最近的 index.parameters.short_edge_lower_limit 个向量
+        // 同时记录搜索路径
+        Search_Add(index, offset, context);
+
+        Neighbor_Optimize(index, offset, context.all, context);
+
+        // 添加短边
+        while (!nearest_neighbors.empty())
+        {
+            const auto &distance = nearest_neighbors.top().first;
+            const auto &neighbor_offset = nearest_neighbors.top().second;
+            auto &neighbor = index.vectors[neighbor_offset];
+            auto guard = Edge_Guard(index, offset, neighbor_offset);
+
+            // 为新向量添加出边
+            new_vector.short_edge_out.insert({distance, neighbor_offset});
+
+            // 为邻居向量添加入边
+            neighbor.short_edge_in.insert({offset, distance});
+
+            nearest_neighbors.pop();
+        }
+
+        Add_Long_Edges(index, context.long_path, context.short_path, offset);
+    }
+
+    // 添加
+    //
+    // 连续添加多个向量时传入同一个 context，重复使用其中的缓冲区
+    template <typename Element>
+    inline void Add(Index<Element> &index, const ID id, const Space::Input_Type<Element> *const added_vector_data,
+                    Insert_Context<Element> &context)
+    {
+        Check_Vector(index, added_vector_data);
+
+        if (index.serving)
+        {
+            Check_Capacity(index, 1);
+        }
+
+        const auto offset = Allocate(index, id, added_vector_data);
+
+        // 先编码再连接到图中，并发查询时查询到的向量都已经编码
+        if (index.quantizer.trained())
+        {
+            Encode_Vector(index, offset);
+        }
+
+        if (index.sketch.trained())
+        {
+            Encode_Sketch(index, offset);
+        }
+
+        Link(index, offset, context);
+    }
+
+    template <typename Element>
+    inline void Add(Index<Element> &index, const ID id, const Space::Input_Type<Element> *const added_vector_data)
+    {
+        auto context = Insert_Context<Element>();
+
+        Add(index, id, added_vector_data, context);
+    }
+
+    // 并行添加
+    //
+    // ids 和 data 中保存 number 个向量，向量依次存放
+    //
+    // 先依次为所有向量分配位置，再由 thread_number 个线程并行地把向量连接到图中，修改顶点的边时加锁
+    //
+    // 并行添加期间不能同时修改索引，只有启用并发查询时可以同时查询
+    template <typename Element>
+    inline void Add_Batch(Index<Element> &index, const ID *const ids, const Space::Input_Type<Element> *const data,
+                          const uint64_t number, const uint64_t thread_number)
+    {
+        const auto &dimension = index.parameters.dimension;
+
+        for (auto i = 0; i < number; ++i)
+        {
+            Check_Vector(index, data + i * dimension);
+        }
+
+        // 添加前索引中的向量的数量
+        const auto existing = index.count;
+        auto offsets = std::vector<Offset>(number);
+
+        if (index.serving)
+        {
+            Check_Capacity(index, number);
+        }
+        else
+        {
+            index.vectors.reserve(index.vectors.size() + number);
+        }
+
+        for (auto i = 0; i < number; ++i)
+        {
+            offsets[i] = Allocate(index, ids[i], data + i * dimension);
+        }
+
+        for (auto i = 0; i < number; ++i)
+        {
+            if (index.quantizer.trained())
+            {
+                Encode_Vector(index, offsets[i]);
+            }
+
+            if (index.sketch.trained())
+            {
+                Encode_Sketch(index, offsets[i]);
+            }
+        }
+
+        // 图中的向量太少时并行添加的向量互相看不到，先串行地添加一部分
+        const auto warm_up = index.parameters.short_edge_upper_limit * thread_number;
+        auto serial_number = uint64_t(0);
+
+        // 每个线程使用自己的缓冲区
+        auto contexts = std::vector<Insert_Context<Element>>(std::max<uint64_t>(thread_number, 1));
+
+        for (; serial_number < number && serial_number + existing < warm_up; ++serial_number)
+        {
+            Link(index, offsets[serial_number], contexts.front());
+        }
+
+        index.concurrent = 1 < thread_number;
+
+        Parallel::For(serial_number, number, thread_number,
+                      [&](const uint64_t thread, const uint64_t i) { Link(index, offsets[i], contexts[thread]); });
+
+        index.concurrent = false;
+    }
+
+    // 把向量和 nearest 连接起来
+    //
+    // 向量的短边没有达到上限时添加短边，否则添加保持连通的边
+    template <typename Element>
+    inline void Connect(Index<Element> &index, const Offset offset, const std::pair<float, Offset> &nearest)
+    {
+        auto &vector = index.vectors[offset];
+        auto &neighbor = index.vectors[nearest.second];
+        auto guard = Edge_Guard(index, offset, nearest.second);
+
+        if (vector.short_edge_out.size() < index.parameters.short_edge_upper_limit)
+        {
+            vector.short_edge_out.insert(nearest);
+            neighbor.short_edge_in.insert({offset, nearest.first});
+        }
+        else
+        {
+            vector.keep_connected.insert(nearest.second);
+            neighbor.keep_connected.insert(offset);
+        }
+    }
+
+    // 批量构建
+    //
+    // ids 和 data 中保存 number 个向量，向量依次存放，只能在空的索引上调用
+    //
+    // 先用 NN-Descent 并行地构建近似 k 近邻图，再按照 Neighbor_Optimize 的规则得到短边，
+    // 然后把零点和最近的向量连接并保证零点可以到达所有向量，最后按照 Add_Long_Edges 的规则添加长边
+    template <typename Element>
+    inline void Build(Index<Element> &index, const ID *const ids, const Space::Input_Type<Element> *const data,
+                      const uint64_t number, const uint64_t thread_number)
+    {
+        if (index.vectors.size() != 1)
+        {
+            throw std::logic_error("The index must be empty before building. ");
+        }
+
+        if (index.serving)
+        {
+            throw std::logic_error("Build cannot be called while concurrent search is enabled. ");
+        }
+
+        const auto &dimension = index.parameters.dimension;
+
+        for (auto i = 0; i < number; ++i)
+        {
+            Check_Vector(index, data + i * dimension);
+        }
+
+        index.vectors.reserve(number + 1);
+
+        // 第 i 个向量的偏移量为 i + 1
+        for (auto i = 0; i < number; ++i)
+        {
+            Allocate(index, ids[i], data + i * dimension);
+        }
+
+        auto distance = [&](const uint64_t i, const uint64_t j)
+        {
+            thread_local auto buffer = std::vector<Space::Input_Type<Element>>();
+            const auto &vector1 = index.vectors[i + 1];
+            const auto &vector2 = index.vectors[j + 1];
+
+            return Augment(index, index.similarity(Get_Input(index, vector1.data, buffer), vector2.data, dimension),
+                           vector1.zero, vector2.zero);
+        };
+
+        // 近邻的数量取短边数量的上限
+        const auto graph = KNN::NN_Descent(number, index.parameters.short_edge_upper_limit, thread_number, distance);
+
+        // 每个线程使用自己的缓冲区
+        auto contexts = std::vector<Insert_Context<Element>>(std::max<uint64_t>(thread_number, 1));
+
+        index.concurrent = 1 < thread_number;
+
+        // 把每个向量的近邻按距离从小到大交给 Neighbor_Optimize，得到短边
+        Parallel::For(0, number, thread_number,
+                      [&](const uint64_t thread, const uint64_t i)
+                      {
+                          const auto offset = i + 1;
+                          const auto &neighbors = graph.neighbors[i];
+                          auto &context = contexts[thread];
+                          auto all = std::vector<std::pair<Offset, float>>(1);
+
+                          for (auto j = 0; j < neighbors.size(); ++j)
+                          {
+                              const auto neighbor_offset = neighbors[j].offset + 1;
+
+                              // 已经有这条短边时跳过
+                              {
+                                  auto guard = Vertex_Guard(index, neighbor_offset);
+
+                                  if (index.vectors[neighbor_offset].short_edge_in.contains(offset))
+                                  {
+                                      continue;
+                                  }
+                              }
+
+                              all.front() = {offset, neighbors[j].distance};
+                              Neighbor_Optimize(index, neighbor_offset, all, context);
+                          }
+                      });
+
+        index.concurrent = false;
+
+        // 和逐个添加时相同，零点的短边指向距离零点最近的向量
+        //
+        // 否则零点只有一条短边，之后添加的向量成为零点的邻居时，查询会走上没有修复过的路径
+        auto nearest_to_zero = std::vector<std::pair<float, Offset>>(number);
+
+        for (auto i = 0; i < number; ++i)
+        {
+            nearest_to_zero[i] = {Zero_Distance(index, index.vectors[i + 1].zero), i + 1};
+        }
+
+        const auto zero_edges = std::min<uint64_t>(index.parameters.short_edge_lower_limit, number);
+
+        std::partial_sort(nearest_to_zero.begin(), nearest_to_zero.begin() + zero_edges, nearest_to_zero.end());
+
+        for (auto i = 0; i < zero_edges; ++i)
+        {
+            const auto &[distance, offset] = nearest_to_zero[i];
+
+            if (!index.vectors[offset].short_edge_in.contains(0))
+            {
+                index.vectors.front().short_edge_out.insert({distance, offset});
+                index.vectors[offset].short_edge_in.insert({0, distance});
+            }
+        }
+
+        // k 近邻图可能不连通，把零点不能到达的每个连通分量中的一个向量和零点能够到达的最近的向量连接起来
+        auto root = std::vector<Offset>(number + 1);
+
+        for (auto offset = 0; offset <= number; ++offset)
+        {
+            root[offset] = offset;
+        }
+
+        auto find = [&](Offset offset)
+        {
+            while (root[offset] != offset)
+            {
+                root[offset] = root[root[offset]];
+                offset = root[offset];
+            }
+
+            return offset;
+        };
+
+        for (auto offset = 0; offset <= number; ++offset)
+        {
+            const auto &vector = index.vectors[offset];
+
+            for (auto iterator = vector.short_edge_out.begin(); iterator != vector.short_edge_out.end(); ++iterator)
+            {
+                root[find(iterator->second)] = find(offset);
+            }
+
+            for (auto iterator = vector.keep_connected.begin(); iterator != vector.keep_connected.end(); ++iterator)
+            {
+                root[find(*iterator)] = find(offset);
+            }
+        }
+
+        for (auto offset = 1; offset <= number; ++offset)
+        {
+            if (find(offset) == find(0))
+            {
+                continue;
+            }
+
+            Connect(index, offset, Search_Path(index, offset, contexts.front()));
+
+            root[find(offset)] = find(0);
+        }
+
+        index.concurrent = 1 < thread_number;
+
+        // 从零点贪心地搜索每个向量，终点不是它的近邻时说明搜索停在了局部最优，把终点和向量连接起来
+        //
+        // 同时按照 Add_Long_Edges 的规则添加长边
+        Parallel::For(1, number + 1, thread_number,
+                      [&](const uint64_t thread, const uint64_t offset)
+                      {
+                          auto &context = contexts[thread];
+                          const auto nearest = Search_Path(index, offset, context);
+                          const auto &neighbors = graph.neighbors[offset - 1];
+                          auto found = false;
+
+                          for (auto j = 0; j < neighbors.size(); ++j)
+                          {
+                              if (neighbors[j].offset + 1 == nearest.second)
+                              {
+                                  found = true;
+                              }
+                          }
+
+                          if (!found && nearest.second != 0 && !Adjacent(index, offset, nearest.second))
+                          {
+                              Connect(index, offset, nearest);
+                          }
+
+                          Add_Long_Edges(index, context.long_path, context.short_path, offset);
+                      });
+
+        index.concurrent = false;
+
+        for (auto offset = 1; offset <= number; ++offset)
+        {
+            if (index.quantizer.trained())
+            {
+                Encode_Vector(index, offset);
+            }
+
+            if (index.sketch.trained())
+            {
+                Encode_Sketch(index, offset);
+            }
+        }
+    }
+
+    // 训练乘积量化器并为索引中已有的向量编码
+    //
+    // 训练样本从索引中已有的向量中随机抽取，之后添加的向量在添加时编码
+    template <typename Element>
+    inline void Train_Quantizer(Index<Element> &index, const uint64_t subspace_number, const uint64_t bits,
+                                const uint64_t sample_number)
+    {
+        if (index.parameters.space_metric != Space::Metric::Euclidean2)
+        {
+            throw std::logic_error("for now, product quantization only supports 'Euclidean2'. ");
+        }
+
+        if (index.serving)
+        {
+            throw std::logic_error("Train_Quantizer cannot be called while concurrent search is enabled. ");
+        }
+
+        auto quantizer = Quantization::Product_Quantizer(index.parameters.dimension, subspace_number, bits);
+        auto samples = std::vector<const Element *>();
+
+        for (auto offset = 1; offset < index.vectors.size(); ++offset)
+        {
+            if (index.vectors[offset].data != nullptr)
+            {
+                samples.push_back(index.vectors[offset].data);
+            }
+        }
+
+        auto random = std::mt19937(0);
+
+        std::shuffle(samples.begin(), samples.end(), random);
+
+        if (sample_number < samples.size())
+        {
+            samples.resize(sample_number);
+        }
+
+        Quantization::Train(quantizer, samples);
+        index.quantizer = std::move(quantizer);
+        index.codes.assign(index.vectors.size() * index.quantizer.code_size, 0);
+
+        for (auto offset = 0; offset < index.vectors.size(); ++offset)
+        {
+            if (index.vectors[offset].data != nullptr)
+            {
+                Encode_Vector(index, offset);
+            }
+        }
+    }
+
+    // 启用二值草图并为索引中已有的向量计算草图
+    //
+    // 草图的中心为索引中已有向量的均值
+    //
+    // margin 为估计夹角时减去的标准差的数量，越大越保守
+    template <typename Element>
+    inline void Enable_Sketch(Index<Element> &index, const uint64_t bits, const float margin)
+    {
+        if (index.parameters.space_metric != Space::Metric::Euclidean2)
+        {
+            throw std::logic_error("for now, binary sketch only supports 'Euclidean2'. ");
+        }
+
+        if (index.serving)
+        {
+            throw std::logic_error("Enable_Sketch cannot be called while concurrent search is enabled. ");
+        }
+
+        auto sketch = Quantization::Binary_Sketch(index.parameters.dimension, bits);
+        auto samples = std::vector<const Element *>();
+
+        for (auto offset = 1; offset < index.vectors.size(); ++offset)
+        {
+            if (index.vectors[offset].data != nullptr)
+            {
+                samples.push_back(index.vectors[offset].data);
+            }
+        }
+
+        Quantization::Train(sketch, samples, margin);
+        index.sketch = std::move(sketch);
+        index.sketches.assign(index.vectors.size() * index.sketch.words, 0);
+        index.sketch_norms.assign(index.vectors.size(), 0);
+
+        for (auto offset = 0; offset < index.vectors.size(); ++offset)
+        {
+            if (index.vectors[offset].data != nullptr)
+            {
+                Encode_Sketch(index, offset);
+            }
+        }
+    }
+
+    // 启用最大内积查询
+    //
+    // 建图时使用范数增广后的欧氏距离，查询时使用内积
+    //
+    // maximum_norm 为向量范数的上界，需要在添加向量之前启用
+    template <typename Element>
+    inline void Enable_MIPS(Index<Element> &index, const float maximum_norm)
+    {
+        if (index.parameters.space_metric != Space::Metric::Inner_Product)
+        {
+            throw std::logic_error("for now, maximum inner product search only supports 'Inner Product'. ");
+        }
+
+        if (index.vectors.size() != 1)
+        {
+            throw std::logic_error("Maximum inner product search must be enabled before adding vectors. ");
+        }
+
+        if (maximum_norm <= 0)
+        {
+            throw std::invalid_argument("The bound of norms must be positive. ");
+        }
+
+        index.norm_bound = maximum_norm * maximum_norm;
+    }
+
+    // 启用并发查询
+    //
+    // 之后一个写者线程可以调用 Add、Add_Batch、Erase、Erase_Batch、Mark_Deleted、Consolidate 和 Update，
+    // 同时任意多个线程调用 Search。写者修改顶点的边后发布顶点的邻居，查询不加锁地读取发布的邻居，
+    // 被替换的邻居和删除的向量的位置等到之前开始的查询都结束后才释放或者交给之后添加的向量使用
+    //
+    // capacity 为索引中最多保存的向量的数量，包括零点和等待回收的位置，预先分配内存使查询期间数组不会重新分配
+    template <typename Element>
+    inline void Enable_Concurrent_Search(Index<Element> &index, const uint64_t capacity)
+    {
+        if (capacity < index.vectors.size())
+        {
+            throw std::invalid_argument("The capacity must not be less than the number of vectors in the index. ");
+        }
+
+        index.vectors.reserve(capacity);
+
+        if (index.quantizer.trained())
+        {
+            index.codes.reserve(capacity * index.quantizer.code_size);
+        }
+
+        if (index.sketch.trained())
+        {
+            index.sketches.reserve(capacity * index.sketch.words);
+            index.sketch_norms.reserve(capacity);
+        }
+
+        index.serving = true;
+        Reclaim(index);
+
+        for (auto offset = 0; offset < index.vectors.size(); ++offset)
+        {
+            Publish(index, offset);
+        }
+    }
+
+    // 停用并发查询，需要在所有查询结束后调用
+    template <typename Element>
+    inline void Disable_Concurrent_Search(Index<Element> &index)
+    {
+        Reclaim(index);
+
+        index.serving = false;
+
+        for (auto offset = 0; offset < index.vectors.size(); ++offset)
+        {
+            index.vectors[offset].published.clear();
+        }
+    }
+
+    template <typename Element>
+    inline void Transfer_LEO(Index<Element> &index, const Offset whose_offset, const Offset to_offset)
+    {
+        auto &whose_V = index.vectors[whose_offset];
+        auto &to_V = index.vectors[to_offset];
+        auto buffer = std::vector<Space::Input_Type<Element>>();
+        const auto *to_data = Get_Input(index, to_V.data, buffer);
+
+        for (auto i = whose_V.long_edge_out.begin(); i != whose_V.long_edge_out.end(); ++i)
+        {
+            auto &neighbor_O = i->first;
+            auto &neighbor_V = index.vectors[neighbor_O];
+            auto distance = Augment(index, index.similarity(to_data, neighbor_V.data, index.parameters.dimension),
+                                    to_V.zero, neighbor_V.zero);
+
+            neighbor_V.long_edge_in.erase(whose_offset);
+            neighbor_V.long_edge_in.insert({to_offset, distance});
+
+            auto guard = Edge_Guard(index, to_offset);
+
+            to_V.long_edge_out.insert({neighbor_O, distance});
+        }
+
+        auto guard = Edge_Guard(index, whose_offset);
+
+        whose_V.long_edge_out.clear();
+    }
+
+    template <typename Element, typename Visited>
+    inline void Mark_Erase(const Vector<Element> &repaired_vector, Visited &visited)
+    {
+        for (auto iterator = repaired_vector.short_edge_in.begin(); iterator != repaired_vector.short_edge_in.end();
+             ++iterator)
+        {
+            auto &neighbor_offset = iterator->first;
+
+            visited[neighbor_offset] = true;
+        }
+
+        for (auto iterator = repaired_vector.short_edge_out.begin(); iterator != repaired_vector.short_edge_out.end();
+             ++iterator)
+        {
+            auto &neighbor_offset = iterator->second;
+
+            visited[neighbor_offset] = true;
+        }
+
+        for (auto iterator = repaired_vector.keep_connected.begin(); iterator != repaired_vector.keep_connected.end();
+             ++iterator)
+        {
+            auto &neighbor_offset = *iterator;
+
+            visited[neighbor_offset] = true;
+        }
+    }
+
+    // 把修复的向量的邻居的邻居去重后放入计算池子，再一次计算所有距离
+    //
+    // 更远的候选由之后的搜索从最近的候选开始展开，池子的大小只和邻居的数量有关
+    template <typename Element, typename Visited>
+    inline void Similarity_Erase(const Index<Element> &index, const Vector<Element> &repaired_vector,
+                                 const Space::Input_Type<Element> *const target_vector, Visited &visited,
+                                 std::vector<Offset> &pool,
+                                 std::priority_queue<std::pair<float, Offset>, std::vector<std::pair<float, Offset>>,
+                                                     std::greater<>> &waiting_vectors)
+    {
+        for (auto iterator = repaired_vector.short_edge_in.begin(); iterator != repaired_vector.short_edge_in.end();
+             ++iterator)
+        {
+            Get_Pool_From_SE(index, iterator->first, visited, pool);
+        }
+
+        for (auto iterator = repaired_vector.short_edge_out.begin(); iterator != repaired_vector.short_edge_out.end();
+             ++iterator)
+        {
+            Get_Pool_From_SE(index, iterator->second, visited, pool);
+        }
+
+        for (auto iterator = repaired_vector.keep_connected.begin(); iterator != repaired_vector.keep_connected.end();
+             ++iterator)
+        {
+            Get_Pool_From_SE(index, *iterator, visited, pool);
+        }
+
+        Similarity(index, target_vector, repaired_vector.zero, pool, waiting_vectors);
+    }
+
+    // 从零点贪心地搜索向量，终点不是向量的邻居时说明搜索停在了局部最优，把终点和向量连接起来，
+    // 没有边的向量直接连接到终点
+    //
+    // 搜索停在零点时，向量在四步之内和零点连通就不需要连接，否则连接到搜索到的除了零点以外最近的向量，
+    // 避免零点的边越来越多
+    template <typename Element>
+    inline void Repair_Path(Index<Element> &index, const Offset offset, Insert_Context<Element> &context)
+    {
+        auto nearest = Search_Path(index, offset, context);
+        const auto &vector = index.vectors[offset];
+        auto &waiting_vectors = context.waiting_vectors;
+        auto isolated = false;
+
+        {
+            auto guard = Vertex_Guard(index, offset);
+
+            isolated = vector.short_edge_out.empty() && vector.short_edge_in.empty() && vector.keep_connected.empty();
+        }
+
+        if (nearest.second == 0)
+        {
+            waiting_vectors.pop();
+
+            if (!waiting_vectors.empty())
+            {
+                nearest = waiting_vectors.top();
+            }
+
+            if (!isolated && Connected(index, 0, offset, context))
+            {
+                return;
+            }
+        }
+
+        if (isolated || !Adjacent(index, offset, nearest.second))
+        {
+            Connect(index, offset, nearest);
+        }
+    }
+
+    // 修复经过被删除的向量的贪心路径
+    //
+    // affected 中从 begins[i] 到 begins[i + 1] 的向量和同一个被删除的向量相邻，其中距离零点最近的向量作为锚点，
+    // 零点在其中时零点作为锚点
+    //
+    // 经过被删除的向量的路径从它的一个邻居进入，从另一个邻居离开，其它向量都在四步之内和锚点连通时，
+    // 路径可以在邻域中绕过被删除的向量，不需要修复，所以删除的代价只和邻域的大小有关
+    //
+    // 不连通或者检查被截断的向量和它们的锚点从零点贪心地搜索，邻域分裂后不知道哪一侧可以从零点到达
+    template <typename Element, typename Local>
+    inline void Repair_Paths(Index<Element> &index, const std::vector<Offset> &affected,
+                             const std::vector<uint64_t> &begins, const uint64_t thread_number, Local &&local)
+    {
+        auto anchors = std::vector<Offset>(affected.size());
+
+        for (auto i = 0; i + 1 < begins.size(); ++i)
+        {
+            auto anchor = begins[i] < begins[i + 1] ? affected[begins[i]] : 0;
+
+            for (auto j = begins[i]; j < begins[i + 1] && anchor != 0; ++j)
+            {
+                if (affected[j] == 0 || index.vectors[affected[j]].zero < index.vectors[anchor].zero)
+                {
+                    anchor = affected[j];
+                }
+            }
+
+            std::fill(anchors.begin() + begins[i], anchors.begin() + begins[i + 1], anchor);
+        }
+
+        auto disconnected = std::vector<uint8_t>(affected.size(), false);
+
+        Parallel::For(0, affected.size(), thread_number,
+                      [&](const uint64_t thread, const uint64_t i)
+                      {
+                          const auto &offset = affected[i];
+
+                          if (offset != 0 && offset != anchors[i])
+                          {
+                              disconnected[i] = !Connected(index, anchors[i], offset, local(thread));
+                          }
+                      });
+
+        auto repaired = std::vector<Offset>();
+
+        for (auto i = 0; i + 1 < begins.size(); ++i)
+        {
+            const auto size = repaired.size();
+
+            for (auto j = begins[i]; j < begins[i + 1]; ++j)
+            {
+                if (disconnected[j])
+                {
+                    repaired.push_back(affected[j]);
+                }
+            }
+
+            if (size < repaired.size() && anchors[begins[i]] != 0)
+            {
+                repaired.push_back(anchors[begins[i]]);
+            }
+        }
+
+        // 和多组相邻的向量只修复一次
+        std::sort(repaired.begin(), repaired.end());
+        repaired.erase(std::unique(repaired.begin(), repaired.end()), repaired.end());
+
+        Parallel::For(0, repaired.size(), thread_number, [&](const uint64_t thread, const uint64_t i)
+                      { Repair_Path(index, repaired[i], local(thread)); });
+    }
+
+    // 删除索引中的向量
+    //
+    // 连续删除多个向量时传入同一个 context，修复邻居时重复使用其中的缓冲区，删除的代价和索引的大小无关
+    template <typename Element>
+    inline void Erase(Index<Element> &index, const ID removed_id, Insert_Context<Element> &context)
+    {
+        // 并发查询时使用修改顶点的边时加锁的批量删除
+        if (index.serving)
+        {
+            const auto removed_offsets = std::vector<Offset>(1, Get_Offset(index, removed_id));
+
+            index.id_to_offset.erase(removed_id);
+            Erase_Offsets(index, removed_offsets, 1, context);
+            return;
+        }
+
+        auto removed_offset = Get_Offset(index, removed_id);
+        index.id_to_offset.erase(removed_id);
+        auto &removed_vector = index.vectors[removed_offset];
+
+        // 删除短边的出边
+        for (auto iterator = removed_vector.short_edge_out.begin(); iterator != removed_vector.short_edge_out.end();
+             ++iterator)
+        {
+            auto &neighbor_offset = iterator->second;
+            auto &neighbor_vector = index.vectors[neighbor_offset];
+
+            neighbor_vector.short_edge_in.erase(removed_offset);
+        }
+
+        // 删除短边的入边
+        for (auto iterator = removed_vector.short_edge_in.begin(); iterator != removed_vector.short_edge_in.end();
+             ++iterator)
+        {
+            auto &neighbor_offset = iterator->first;
+            auto &distance = iterator->second;
+            auto &vector = index.vectors[neighbor_offset];
+            auto temporary_iterator = vector.short_edge_out.find(distance);
+
+            while (temporary_iterator->second != removed_offset)
+            {
+                ++temporary_iterator;
+            }
+
+            vector.short_edge_out.erase(temporary_iterator);
+        }
+
+        for (auto iterator = removed_vector.keep_connected.begin(); iterator != removed_vector.keep_connected.end();
+             ++iterator)
+        {
+            auto &neighbor_offset = *iterator;
+            auto &vector = index.vectors[neighbor_offset];
+
+            vector.keep_connected.erase(removed_offset);
+        }
+
+        // 删除长边
+        for (auto iterator = removed_vector.long_edge_out.begin(); iterator != removed_vector.long_edge_out.end();
+             ++iterator)
+        {
+            auto &neighbor_offset = iterator->first;
+            auto &neighbor_vector = index.vectors[neighbor_offset];
+
+            neighbor_vector.long_edge_in.erase(removed_offset);
+        }
+
+        for (auto iterator = removed_vector.long_edge_in.begin(); iterator != removed_vector.long_edge_in.end();
+             ++iterator)
+        {
+            auto &neighbor_offset = iterator->first;
+            auto &neighbor_vector = index.vectors[neighbor_offset];
+
+            neighbor_vector.long_edge_out.erase(removed_offset);
+        }
+
+        // 补边
+        for (auto iterator = removed_vector.short_edge_in.begin(); iterator != removed_vector.short_edge_in.end();
+             ++iterator)
+        {
+            auto &repaired_offset = iterator->first;
+            auto &repaired_vector = index.vectors[repaired_offset];
+
+            if (repaired_vector.short_edge_out.size() < index.parameters.short_edge_lower_limit)
+            {
+                auto &visited = context.visited;
+                auto &nearest_neighbors = context.nearest_neighbors;
+                auto &waiting_vectors = context.waiting_vectors;
+                auto &pool = context.pool;
+
+                context.reset(index.vectors.size());
+                visited[repaired_offset] = true;
+
+                const auto *target_vector = Get_Input(index, repaired_vector.data, context.buffer);
+
+                Mark_Erase(repaired_vector, visited);
+                Similarity_Erase(index, repaired_vector, target_vector, visited, pool, waiting_vectors);
+
+                // 修复的向量没有其它邻居时，从被删除的向量的邻居中选择
+                if (waiting_vectors.empty())
+                {
+                    Get_Pool_From_SE(index, removed_offset, visited, pool);
+                    Similarity(index, target_vector, repaired_vector.zero, pool, waiting_vectors);
+                }
+
+                while (!waiting_vectors.empty())
+                {
+                    auto processing_distance = waiting_vectors.top().first;
+                    auto processing_offset = waiting_vectors.top().second;
+
+                    waiting_vectors.pop();
+
+                    // 如果已遍历的向量小于候选数量
+                    if (nearest_neighbors.size() < index.parameters.magnification)
+                    {
+                        nearest_neighbors.push({processing_distance, processing_offset});
+                    }
+                    else
+                    {
+                        // 如果当前的向量和查询向量的距离小于已优先队列中的最大值
+                        if (processing_distance < nearest_neighbors.top().first)
+                        {
+                            nearest_neighbors.pop();
+                            nearest_neighbors.push({processing_distance, processing_offset});
+                        }
+                        else
+                        {
+                            break;
+                        }
+                    }
+
+                    Get_Pool_From_SE(index, processing_offset, visited, pool);
+                    Similarity(index, target_vector, repaired_vector.zero, pool, waiting_vectors);
+                }
+
+                // 没有找到可以连接的向量
+                if (nearest_neighbors.empty())
+                {
+                    continue;
+                }
+
+                while (nearest_neighbors.size() != 1)
+                {
+                    nearest_neighbors.pop();
+                }
+
+                auto &TD = nearest_neighbors.top().first;
+                auto &TO = nearest_neighbors.top().second;
+                auto &TV = index.vectors[TO];
+
+                repaired_vector.short_edge_out.insert(nearest_neighbors.top());
+                TV.short_edge_in.insert({repaired_offset, TD});
+
+                if (repaired_vector.long_edge_out.contains(TO))
+                {
+                    repaired_vector.long_edge_out.erase(TO);
+                    TV.long_edge_in.erase(repaired_offset);
+                    Transfer_LEO(index, TO, repaired_offset);
+                }
+                else if (TV.long_edge_out.contains(repaired_offset))
+                {
+                    TV.long_edge_out.erase(repaired_offset);
+                    repaired_vector.long_edge_in.erase(TO);
+                    Transfer_LEO(index, repaired_offset, TO);
+                }
+            }
+        }
+
+        if (!removed_vector.long_edge_out.empty())
+        {
+            Transfer_LEO(index, removed_offset, removed_vector.long_edge_in.begin()->first);
+        }
+
+        // 和被删除的向量相邻的向量
+        auto affected = std::vector<Offset>();
+
+        for (auto iterator = removed_vector.short_edge_out.begin(); iterator != removed_vector.short_edge_out.end();
+             ++iterator)
+        {
+            affected.push_back(iterator->second);
+        }
+
+        for (auto iterator = removed_vector.short_edge_in.begin(); iterator != removed_vector.short_edge_in.end();
+             ++iterator)
+        {
+            affected.push_back(iterator->first);
+        }
+
+        affected.insert(affected.end(), removed_vector.keep_connected.begin(), removed_vector.keep_connected.end());
+        std::sort(affected.begin(), affected.end());
+        affected.erase(std::unique(affected.begin(), affected.end()), affected.end());
+
+        Delete_Vector(index, removed_offset);
+
+        // 和批量删除相同，修复经过被删除的向量的贪心路径
+        //
+        // 批量构建的图中不同区域之间的路径可能只经过少数向量，删除它们之后不修复路径，查询会停在错误的区域
+        const auto begins = std::vector<uint64_t>{0, affected.size()};
+
+        Repair_Paths(index, affected, begins, 1, [&](const uint64_t) -> Insert_Context<Element> & { return context; });
+    }
+
+    template <typename Element>
+    inline void Erase(Index<Element> &index, const ID removed_id)
+    {
+        auto context = Insert_Context<Element>();
+
+        Erase(index, removed_id, context);
+    }
+
+    // 批量删除时修复和被删除的向量相邻的向量
+    //
+    // 删除它和被删除的向量之间的边，短边少于下限时从被删除的邻居的邻居中选择距离最近的向量补充，
+    // 被删除的邻居的邻居不够时再向外找一层
+    //
+    // removed 标记被删除的向量，修复期间被删除的向量的边不会被修改
+    template <typename Element>
+    inline void Repair(Index<Element> &index, const Offset offset, const Visited_Marks &removed,
+                       Insert_Context<Element> &context)
+    {
+        auto &vector = index.vectors[offset];
+        auto &visited = context.visited;
+        auto &removed_neighbors = context.forward;
+        auto &next = context.next;
+        auto &pool = context.pool;
+        auto &waiting_vectors = context.waiting_vectors;
+        const auto &lower_limit = index.parameters.short_edge_lower_limit;
+
+        context.reset(index.vectors.size());
+        removed_neighbors.clear();
+
+        visited[offset] = true;
+
+        // 删除和被删除的向量之间的边，同时把现有的邻居标记为已遍历
+        {
+            auto guard = Edge_Guard(index, offset);
 
-            Get_Pool_From_SE(index, processing_offset, visited, pool);
-            Similarity_Add(index, new_vector.data, pool, waiting_vectors, all);
+            for (auto iterator = vector.short_edge_out.begin(); iterator != vector.short_edge_out.end();)
+            {
+                visited[iterator->second] = true;
 
-            const auto &nearest_offset = waiting_vectors.top().second;
+                if (removed[iterator->second])
+                {
+                    removed_neighbors.push_back(iterator->second);
+                    iterator = vector.short_edge_out.erase(iterator);
+                }
+                else
+                {
+                    ++iterator;
+                }
+            }
 
-            if (processing_offset == nearest_offset)
+            for (auto iterator = vector.short_edge_in.begin(); iterator != vector.short_edge_in.end();)
             {
-                break;
+                visited[iterator->first] = true;
+
+                if (removed[iterator->first])
+                {
+                    removed_neighbors.push_back(iterator->first);
+                    iterator = vector.short_edge_in.erase(iterator);
+                }
+                else
+                {
+                    ++iterator;
+                }
             }
 
-            short_path.push_back(waiting_vectors.top());
+            for (auto iterator = vector.keep_connected.begin(); iterator != vector.keep_connected.end();)
+            {
+                visited[*iterator] = true;
+
+                if (removed[*iterator])
+                {
+                    removed_neighbors.push_back(*iterator);
+                    iterator = vector.keep_connected.erase(iterator);
+                }
+                else
+                {
+                    ++iterator;
+                }
+            }
+
+            std::erase_if(vector.long_edge_out, [&](const auto &edge) { return removed[edge.first]; });
+            std::erase_if(vector.long_edge_in, [&](const auto &edge) { return removed[edge.first]; });
         }
 
-        // 阶段三：
-        // 查找与目标向量相似度最高（距离最近）的k个向量
-        while (!waiting_vectors.empty())
+        if (lower_limit <= vector.short_edge_out.size())
         {
-            const auto &processing_distance = waiting_vectors.top().first;
-            const auto &processing_offset = waiting_vectors.top().second;
+            return;
+        }
 
-            // 如果优先队列中的向量的数量小于k
-            if (nearest_neighbors.size() < index.parameters.magnification)
+        const auto needed = lower_limit - vector.short_edge_out.size();
+
+        for (auto depth = 0; depth < 2 && !removed_neighbors.empty() && pool.size() < needed; ++depth)
+        {
+            next.clear();
+
+            for (auto i = 0; i < removed_neighbors.size(); ++i)
             {
-                nearest_neighbors.push({processing_distance, processing_offset});
+                const auto &removed_vector = index.vectors[removed_neighbors[i]];
+
+                for (auto iterator = removed_vector.short_edge_out.begin();
+                     iterator != removed_vector.short_edge_out.end(); ++iterator)
+                {
+                    if (!visited[iterator->second])
+                    {
+                        visited[iterator->second] = true;
+                        (removed[iterator->second] ? next : pool).push_back(iterator->second);
+                    }
+                }
+
+                for (auto iterator = removed_vector.short_edge_in.begin();
+                     iterator != removed_vector.short_edge_in.end(); ++iterator)
+                {
+                    if (!visited[iterator->first])
+                    {
+                        visited[iterator->first] = true;
+                        (removed[iterator->first] ? next : pool).push_back(iterator->first);
+                    }
+                }
+
+                for (auto iterator = removed_vector.keep_connected.begin();
+                     iterator != removed_vector.keep_connected.end(); ++iterator)
+                {
+                    if (!visited[*iterator])
+                    {
+                        visited[*iterator] = true;
+                        (removed[*iterator] ? next : pool).push_back(*iterator);
+                    }
+                }
+            }
+
+            std::swap(removed_neighbors, next);
+        }
+
+        const auto *target_vector = Get_Input(index, vector.data, context.buffer);
+
+        for (auto i = 0; i < pool.size(); ++i)
+        {
+            const auto &neighbor_offset = pool[i];
+            const auto &neighbor_vector = index.vectors[neighbor_offset];
+
+            if (i + 1 < pool.size())
+            {
+                Prefetch(index.vectors[pool[i + 1]].data);
+            }
+
+            if (offset == 0)
+            {
+                waiting_vectors.push({Zero_Distance(index, neighbor_vector.zero), neighbor_offset});
+            }
+            else if (neighbor_offset == 0)
+            {
+                waiting_vectors.push({Zero_Distance(index, vector.zero), neighbor_offset});
             }
             else
             {
-                // 如果当前的向量和查询向量的距离小于优先队列中的最大值
-                if (processing_distance < nearest_neighbors.top().first)
+                waiting_vectors.push(
+                    {Augment(index, index.similarity(target_vector, neighbor_vector.data, index.parameters.dimension),
+                             vector.zero, neighbor_vector.zero),
+                     neighbor_offset});
+            }
+        }
+
+        for (auto i = 0; i < needed && !waiting_vectors.empty(); ++i)
+        {
+            const auto nearest = waiting_vectors.top();
+            auto &neighbor_vector = index.vectors[nearest.second];
+            auto guard = Edge_Guard(index, offset, nearest.second);
+
+            vector.short_edge_out.insert(nearest);
+            neighbor_vector.short_edge_in.insert({offset, nearest.first});
+            waiting_vectors.pop();
+        }
+    }
+
+    // 从图中删除偏移量为 removed_offsets 的向量
+    //
+    // 先标记所有被删除的向量，再由 thread_number 个线程并行地修复和被删除的向量相邻的向量，每个向量只修复一次，
+    // 删除的代价只和被删除的向量的邻域的大小有关
+    //
+    // 第一个线程使用 context 中的缓冲区，连续删除时传入同一个 context 可以避免每次分配和顶点数量相同的标记
+    template <typename Element>
+    inline void Erase_Offsets(Index<Element> &index, const std::vector<Offset> &removed_offsets,
+                              const uint64_t thread_number, Insert_Context<Element> &context)
+    {
+        const auto number = removed_offsets.size();
+        auto &removed = context.removed;
+
+        // 修改的顶点重新发布邻居时释放已经没有查询访问的旧邻居
+        if (index.serving)
+        {
+            Reclaim(index);
+        }
+
+        removed.reset(index.vectors.size());
+
+        for (auto i = 0; i < number; ++i)
+        {
+            removed[removed_offsets[i]] = true;
+        }
+
+        // 和被删除的向量相邻的向量
+        auto affected = std::vector<Offset>();
+        auto &marked = context.affected;
+
+        marked.reset(index.vectors.size());
+
+        auto mark = [&](const Offset offset)
+        {
+            if (!removed[offset] && !marked[offset])
+            {
+                marked[offset] = true;
+                affected.push_back(offset);
+            }
+        };
+
+        // 对被删除的向量的每个邻居调用 function，第二个参数表示是否通过长边相邻
+        auto for_each_neighbor = [&](const Vector<Element> &removed_vector, auto &&function)
+        {
+            for (auto iterator = removed_vector.short_edge_out.begin(); iterator != removed_vector.short_edge_out.end();
+                 ++iterator)
+            {
+                function(iterator->second, false);
+            }
+
+            for (auto iterator = removed_vector.short_edge_in.begin(); iterator != removed_vector.short_edge_in.end();
+                 ++iterator)
+            {
+                function(iterator->first, false);
+            }
+
+            for (auto iterator = removed_vector.keep_connected.begin(); iterator != removed_vector.keep_connected.end();
+                 ++iterator)
+            {
+                function(*iterator, false);
+            }
+
+            for (auto iterator = removed_vector.long_edge_out.begin(); iterator != removed_vector.long_edge_out.end();
+                 ++iterator)
+            {
+                function(iterator->first, true);
+            }
+
+            for (auto iterator = removed_vector.long_edge_in.begin(); iterator != removed_vector.long_edge_in.end();
+                 ++iterator)
+            {
+                function(iterator->first, true);
+            }
+        };
+
+        // 通过短边或保持连通的边相邻的被删除的向量分为一组，经过它们的路径从整组的一个邻居进入，从另一个邻居离开，
+        // 长边指向的向量在长边转移后仍然可以到达，不需要检查
+        auto root = std::vector<uint64_t>(number);
+        auto position = std::unordered_map<Offset, uint64_t>();
+
+        for (auto i = 0; i < number; ++i)
+        {
+            root[i] = i;
+            position.insert({removed_offsets[i], i});
+        }
+
+        auto find = [&](uint64_t i)
+        {
+            while (root[i] != i)
+            {
+                root[i] = root[root[i]];
+                i = root[i];
+            }
+
+            return i;
+        };
+
+        for (auto i = 0; i < number; ++i)
+        {
+            for_each_neighbor(index.vectors[removed_offsets[i]],
+                              [&](const Offset offset, const bool long_edge)
+                              {
+                                  if (!long_edge && removed[offset])
+                                  {
+                                      root[find(position[offset])] = find(i);
+                                  }
+                              });
+        }
+
+        auto groups = std::vector<std::pair<uint64_t, uint64_t>>(number);
+
+        for (auto i = 0; i < number; ++i)
+        {
+            groups[i] = {find(i), i};
+        }
+
+        std::sort(groups.begin(), groups.end());
+
+        // 和同一组被删除的向量通过短边或保持连通的边相邻的向量从 begins[i] 开始，和多组相邻的向量在每一组中都出现
+        auto neighbors = std::vector<Offset>();
+        auto begins = std::vector<uint64_t>();
+
+        for (auto i = 0; i < number;)
+        {
+            const auto begin = neighbors.size();
+            auto j = i;
+
+            for (; j < number && groups[j].first == groups[i].first; ++j)
+            {
+                for_each_neighbor(index.vectors[removed_offsets[groups[j].second]],
+                                  [&](const Offset offset, const bool long_edge)
+                                  {
+                                      mark(offset);
+
+                                      if (!long_edge && !removed[offset])
+                                      {
+                                          neighbors.push_back(offset);
+                                      }
+                                  });
+            }
+
+            std::sort(neighbors.begin() + begin, neighbors.end());
+            neighbors.erase(std::unique(neighbors.begin() + begin, neighbors.end()), neighbors.end());
+            begins.push_back(begin);
+            i = j;
+        }
+
+        begins.push_back(neighbors.size());
+
+        // 每个线程使用自己的缓冲区
+        auto contexts = std::vector<Insert_Context<Element>>(std::max<uint64_t>(thread_number, 1) - 1);
+
+        auto local = [&](const uint64_t thread) -> Insert_Context<Element> &
+        { return thread == 0 ? context : contexts[thread - 1]; };
+
+        index.concurrent = 1 < thread_number;
+
+        Parallel::For(0, affected.size(), thread_number, [&](const uint64_t thread, const uint64_t i)
+                      { Repair(index, affected[i], removed, local(thread)); });
+
+        index.concurrent = false;
+
+        // 被删除的向量的长边转移给指向它的未被删除的向量，没有时转移给零点
+        for (auto i = 0; i < number; ++i)
+        {
+            auto &removed_vector = index.vectors[removed_offsets[i]];
+            Offset to_offset = 0;
+
+            for (auto iterator = removed_vector.long_edge_in.begin(); iterator != removed_vector.long_edge_in.end();
+                 ++iterator)
+            {
+                if (!removed[iterator->first])
                 {
-                    nearest_neighbors.pop();
-                    nearest_neighbors.push({processing_distance, processing_offset});
+                    to_offset = iterator->first;
+                    break;
                 }
-                else
+            }
+
+            {
+                auto guard = Edge_Guard(index, removed_offsets[i]);
+
+                std::erase_if(removed_vector.long_edge_out,
+                              [&](const auto &edge) { return removed[edge.first] || edge.first == to_offset; });
+            }
+
+            Transfer_LEO(index, removed_offsets[i], to_offset);
+        }
+
+        for (auto i = 0; i < number; ++i)
+        {
+            Delete_Vector(index, removed_offsets[i]);
+        }
+
+        // 零点的邻居都被删除时，连接到距离零点最近的受影响的向量
+        auto &zero_vector = index.vectors.front();
+
+        if (zero_vector.short_edge_out.empty() && zero_vector.short_edge_in.empty() &&
+            zero_vector.keep_connected.empty())
+        {
+            Offset nearest_offset = 0;
+
+            for (auto i = 0; i < affected.size(); ++i)
+            {
+                if (affected[i] != 0 &&
+                    (nearest_offset == 0 || Zero_Distance(index, index.vectors[affected[i]].zero) <
+                                                Zero_Distance(index, index.vectors[nearest_offset].zero)))
                 {
-                    break;
+                    nearest_offset = affected[i];
                 }
             }
 
-            waiting_vectors.pop();
-            Get_Pool_From_SE(index, processing_offset, visited, pool);
-            Similarity_Add(index, new_vector.data, pool, waiting_vectors, all);
+            if (nearest_offset != 0)
+            {
+                const auto distance = Zero_Distance(index, index.vectors[nearest_offset].zero);
+                auto guard = Edge_Guard(index, 0, nearest_offset);
+
+                zero_vector.short_edge_out.insert({distance, nearest_offset});
+                index.vectors[nearest_offset].short_edge_in.insert({0, distance});
+            }
         }
 
-        while (index.parameters.short_edge_lower_limit < nearest_neighbors.size())
+        index.concurrent = 1 < thread_number;
+
+        // 和批量构建相同，从零点贪心地搜索受影响的向量，搜索停在局部最优时把终点和向量连接起来
+        Repair_Paths(index, neighbors, begins, thread_number, local);
+
+        index.concurrent = false;
+    }
+
+    // 批量删除
+    //
+    // ids 中保存 number 个向量的 id
+    //
+    // 批量删除期间不能同时修改索引，只有启用并发查询时可以同时查询
+    template <typename Element>
+    inline void Erase_Batch(Index<Element> &index, const ID *const ids, const uint64_t number,
+                            const uint64_t thread_number)
+    {
+        auto removed_offsets = std::vector<Offset>(number);
+
+        // 先检查所有的 id，有不在索引中或者重复的 id 时不修改索引
+        for (auto i = 0; i < number; ++i)
         {
-            nearest_neighbors.pop();
+            removed_offsets[i] = Get_Offset(index, ids[i]);
         }
+
+        if (std::unordered_set<Offset>(removed_offsets.begin(), removed_offsets.end()).size() != number)
+        {
+            throw std::invalid_argument("The vectors to be erased must not be repeated. ");
+        }
+
+        for (auto i = 0; i < number; ++i)
+        {
+            index.id_to_offset.erase(ids[i]);
+        }
+
+        auto context = Insert_Context<Element>();
+
+        Erase_Offsets(index, removed_offsets, thread_number, context);
     }
 
-    inline bool Connected(const Index &index, const Offset start, const Offset offset)
+    // 标记删除
+    //
+    // 只设置删除标记，向量仍然留在图中用于路由，不影响图的连通性，但不再出现在查询结果中
+    //
+    // 向量的 id 立即失效，可以重新添加
+    template <typename Element>
+    inline void Mark_Deleted(Index<Element> &index, const ID id)
     {
-        auto visited = std::unordered_set<Offset>();
+        const auto offset = Get_Offset(index, id);
 
-        visited.insert(start);
+        index.vectors[offset].deleted.store(true, std::memory_order_release);
+        index.id_to_offset.erase(id);
+        ++index.deleted_count;
+    }
 
-        auto last = std::vector<Offset>();
+    // 标记删除的向量在索引中所占的比例超过 threshold 时，从图中删除所有标记删除的向量，返回是否删除
+    //
+    // 删除期间不能同时修改索引，只有启用并发查询时可以同时查询
+    template <typename Element>
+    inline bool Consolidate(Index<Element> &index, const float threshold, const uint64_t thread_number)
+    {
+        // id_to_offset 中包括零点
+        const auto total = index.id_to_offset.size() - 1 + index.deleted_count;
+
+        if (index.deleted_count == 0 || index.deleted_count <= threshold * total)
+        {
+            return false;
+        }
+
+        auto removed_offsets = std::vector<Offset>();
+
+        for (auto offset = 1; offset < index.vectors.size(); ++offset)
+        {
+            if (index.vectors[offset].deleted)
+            {
+                removed_offsets.push_back(offset);
+            }
+        }
+
+        auto context = Insert_Context<Element>();
+
+        Erase_Offsets(index, removed_offsets, thread_number, context);
+
+        index.deleted_count = 0;
+
+        return true;
+    }
+
+    // 向量的数据是否保存在 index.storage 中
+    //
+    // 和 Store 的规则相同
+    template <typename Element>
+    inline bool Stored(const Index<Element> &index)
+    {
+        if constexpr (!std::is_same_v<Element, Space::Input_Type<Element>>)
+        {
+            return true;
+        }
+        else if constexpr (std::is_same_v<Element, float>)
+        {
+            return index.parameters.space_metric == Space::Metric::Cosine_Similarity;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    // 压缩索引
+    //
+    // 把存活的向量（包括标记删除的向量）按原来的顺序重新编号为连续的偏移量，重写所有的边和 id_to_offset，
+    // 并释放被删除的向量占用的位置、数据、量化编码和草图
+    //
+    // 压缩期间不能同时查询或修改索引
+    template <typename Element>
+    inline void Compact(Index<Element> &index)
+    {
+        if (index.serving)
+        {
+            throw std::logic_error("Compact cannot be called while concurrent search is enabled. ");
+        }
+
+        const auto &dimension = index.parameters.dimension;
+        auto new_offsets = std::vector<Offset>(index.vectors.size(), 0);
+        uint64_t number = 0;
+
+        for (auto offset = 0; offset < index.vectors.size(); ++offset)
+        {
+            if (offset == 0 || index.vectors[offset].data != nullptr)
+            {
+                new_offsets[offset] = number;
+                ++number;
+            }
+        }
 
-        last.push_back(start);
+        const auto stored = Stored(index);
+        const auto &code_size = index.quantizer.code_size;
+        const auto &words = index.sketch.words;
+        auto vectors = std::vector<Vector<Element>>();
 
-        auto next = std::vector<Offset>();
+        vectors.reserve(number);
 
-        for (auto round = 0; round < 3; ++round)
+        // 新的偏移量不大于原来的偏移量，按偏移量从小到大移动时不会覆盖还没有移动的数据
+        for (auto offset = 0; offset < index.vectors.size(); ++offset)
         {
-            for (auto iterator = last.begin(); iterator != last.end(); ++iterator)
+            auto &vector = index.vectors[offset];
+            const auto &new_offset = new_offsets[offset];
+
+            if (offset != 0 && vector.data == nullptr)
             {
-                auto &t = index.vectors[*iterator];
+                continue;
+            }
 
-                for (auto iterator = t.short_edge_in.begin(); iterator != t.short_edge_in.end(); ++iterator)
+            if (offset != new_offset)
+            {
+                if (stored)
                 {
-                    auto &t1 = iterator->first;
+                    auto *address = index.storage.address(new_offset);
 
-                    if (!visited.contains(t1))
-                    {
-                        visited.insert(t1);
-                        next.push_back(t1);
-                    }
+                    std::copy(vector.data, vector.data + dimension, address);
+                    vector.data = address;
                 }
 
-                for (auto iterator = t.short_edge_out.begin(); iterator != t.short_edge_out.end(); ++iterator)
+                if (index.quantizer.trained())
                 {
-                    auto &t1 = iterator->second;
-
-                    if (!visited.contains(t1))
-                    {
-                        visited.insert(t1);
-                        next.push_back(t1);
-                    }
+                    std::copy(index.codes.begin() + offset * code_size, index.codes.begin() + (offset + 1) * code_size,
+                              index.codes.begin() + new_offset * code_size);
                 }
 
-                for (auto iterator = t.keep_connected.begin(); iterator != t.keep_connected.end(); ++iterator)
+                if (index.sketch.trained())
                 {
-                    auto &t1 = *iterator;
-
-                    if (!visited.contains(t1))
-                    {
-                        visited.insert(t1);
-                        next.push_back(t1);
-                    }
+                    std::copy(index.sketches.begin() + offset * words, index.sketches.begin() + (offset + 1) * words,
+                              index.sketches.begin() + new_offset * words);
+                    index.sketch_norms[new_offset] = index.sketch_norms[offset];
                 }
             }
 
-            if (visited.contains(offset))
+            auto short_edge_out = std::multimap<float, Offset>();
+
+            for (auto iterator = vector.short_edge_out.begin(); iterator != vector.short_edge_out.end(); ++iterator)
             {
-                return true;
+                short_edge_out.insert({iterator->first, new_offsets[iterator->second]});
             }
 
-            std::swap(last, next);
-            next.clear();
-        }
-
-        for (auto iterator = last.begin(); iterator != last.end(); ++iterator)
-        {
-            auto &t = index.vectors[*iterator];
+            auto short_edge_in = std::unordered_map<Offset, float>();
 
-            for (auto iterator = t.short_edge_in.begin(); iterator != t.short_edge_in.end(); ++iterator)
+            for (auto iterator = vector.short_edge_in.begin(); iterator != vector.short_edge_in.end(); ++iterator)
             {
-                auto &t1 = iterator->first;
-
-                visited.insert(t1);
+                short_edge_in.insert({new_offsets[iterator->first], iterator->second});
             }
 
-            for (auto iterator = t.short_edge_out.begin(); iterator != t.short_edge_out.end(); ++iterator)
-            {
-                auto &t1 = iterator->second;
+            auto long_edge_out = std::unordered_map<Offset, float>();
 
-                visited.insert(t1);
+            for (auto iterator = vector.long_edge_out.begin(); iterator != vector.long_edge_out.end(); ++iterator)
+            {
+                long_edge_out.insert({new_offsets[iterator->first], iterator->second});
             }
 
-            for (auto iterator = t.keep_connected.begin(); iterator != t.keep_connected.end(); ++iterator)
+            auto long_edge_in = std::unordered_map<Offset, float>();
+
+            for (auto iterator = vector.long_edge_in.begin(); iterator != vector.long_edge_in.end(); ++iterator)
             {
-                auto &t1 = *iterator;
+                long_edge_in.insert({new_offsets[iterator->first], iterator->second});
+            }
 
-                visited.insert(t1);
+            auto keep_connected = std::unordered_set<Offset>();
+
+            for (auto iterator = vector.keep_connected.begin(); iterator != vector.keep_connected.end(); ++iterator)
+            {
+                keep_connected.insert(new_offsets[*iterator]);
             }
+
+            vector.offset = new_offset;
+            vector.short_edge_out = std::move(short_edge_out);
+            vector.short_edge_in = std::move(short_edge_in);
+            vector.long_edge_out = std::move(long_edge_out);
+            vector.long_edge_in = std::move(long_edge_in);
+            vector.keep_connected = std::move(keep_connected);
+            vectors.push_back(std::move(vector));
         }
 
-        if (visited.contains(offset))
+        index.vectors = std::move(vectors);
+
+        for (auto iterator = index.id_to_offset.begin(); iterator != index.id_to_offset.end(); ++iterator)
         {
-            return true;
+            iterator->second = new_offsets[iterator->second];
         }
 
-        return false;
-    }
+        if (index.quantizer.trained())
+        {
+            index.codes.resize(number * code_size);
+            index.codes.shrink_to_fit();
+        }
 
-    // 计算角A的余弦值
-    //
-    // 余弦值没有除以2
-    inline float Cosine_Value(const float a, const float b, const float c)
-    {
-        return (b * b + c * c - a * a) / (b * c);
+        if (index.sketch.trained())
+        {
+            index.sketches.resize(number * words);
+            index.sketches.shrink_to_fit();
+            index.sketch_norms.resize(number);
+            index.sketch_norms.shrink_to_fit();
+        }
+
+        if (stored)
+        {
+            index.storage.blocks.resize((number + Storage<Element>::block_size - 1) / Storage<Element>::block_size);
+        }
+
+        index.empty = std::stack<uint64_t>();
+        index.count = number;
     }
 
-    // 添加长边
-    inline void Add_Long_Edges(Index &index, std::vector<std::pair<float, Offset>> &long_path,
-                               std::vector<std::pair<float, Offset>> &short_path, const Offset offset)
+    // 更新向量的长边的距离
+    template <typename Element>
+    inline void Update_Long_Edges(Index<Element> &index, const Offset offset,
+                                  const Space::Input_Type<Element> *const target_vector)
     {
         auto &vector = index.vectors[offset];
 
-        if (index.parameters.cover_range < short_path.size())
+        for (auto iterator = vector.long_edge_out.begin(); iterator != vector.long_edge_out.end(); ++iterator)
         {
-            float added_distance = 0;
-            float maximum_cosine = -2;
-            Offset added_offset = 0;
-
-            for (int i = long_path.size() - 1; 0 < i; --i)
-            {
-                const auto &D = long_path[i].first;
-                const auto &neighbor_offset = long_path[i].second;
-                auto &neighbor_vector = index.vectors[neighbor_offset];
-
-                if (neighbor_vector.zero < vector.zero && !Adjacent(index, offset, neighbor_offset))
-                {
-                    auto CV = Cosine_Value(added_distance, vector.zero, neighbor_vector.zero);
+            auto &neighbor_offset = iterator->first;
+            auto &neighbor_vector = index.vectors[neighbor_offset];
+            auto distance =
+                Augment(index, index.similarity(target_vector, neighbor_vector.data, index.parameters.dimension),
+                        vector.zero, neighbor_vector.zero);
 
-                    if (maximum_cosine < CV)
-                    {
-                        added_distance = D;
-                        maximum_cosine = CV;
-                        added_offset = neighbor_offset;
-                    }
-                }
-            }
+            iterator->second = distance;
+            neighbor_vector.long_edge_in[offset] = distance;
+        }
 
-            if (1.732 < maximum_cosine)
-            {
-                auto &neighbor_vector = index.vectors[added_offset];
+        for (auto iterator = vector.long_edge_in.begin(); iterator != vector.long_edge_in.end(); ++iterator)
+        {
+            auto &neighbor_offset = iterator->first;
+            auto &neighbor_vector = index.vectors[neighbor_offset];
+            auto distance = Zero_Distance(index, vector.zero);
 
-                neighbor_vector.long_edge_out.insert({offset, added_distance});
-                vector.long_edge_in.insert({added_offset, added_distance});
-            }
-            else
+            if (neighbor_offset != 0)
             {
-                index.vectors.front().long_edge_out.insert({added_offset, vector.zero});
-                vector.long_edge_in.insert({0, vector.zero});
+                distance =
+                    Augment(index, index.similarity(target_vector, neighbor_vector.data, index.parameters.dimension),
+                            vector.zero, neighbor_vector.zero);
             }
+
+            iterator->second = distance;
+            neighbor_vector.long_edge_out[offset] = distance;
         }
     }
 
-    inline void Neighbor_Optimize(Index &index, const Offset offset, std::vector<std::pair<Offset, float>> &all)
+    // 原地更新向量
+    //
+    // 新向量和原来的向量的距离小于原来距离最大的短边时视为小幅移动：保留向量的位置，
+    // 删除向量的短边后从原来的邻居出发重新搜索最近邻并连接，长边保留并更新距离，
+    // 范数改变后两端顺序不对的长边删除后重新添加
+    //
+    // 移动较大时或者启用了并发查询时先删除再重新添加
+    //
+    // 连续更新多个向量时传入同一个 context，重复使用其中的缓冲区
+    template <typename Element>
+    inline void Update(Index<Element> &index, const ID id, const Space::Input_Type<Element> *const new_vector_data,
+                       Insert_Context<Element> &context)
     {
-        auto &new_vector = index.vectors[offset];
+        Check_Vector(index, new_vector_data);
 
-        for (auto i = 0; i < all.size(); ++i)
+        const auto offset = Get_Offset(index, id);
+        auto &vector = index.vectors[offset];
+        const auto *query_vector = Get_Query(index, new_vector_data, context.buffer);
+        const auto moved =
+            Augment(index, index.similarity(query_vector, vector.data, index.parameters.dimension),
+                    Space::Euclidean2::zero(new_vector_data, index.parameters.dimension), vector.zero);
+
+        if (index.serving || vector.short_edge_out.empty() || vector.short_edge_out.rbegin()->first <= moved)
         {
-            const auto &neighbor_offset = all[i].first;
-            const auto &distance = all[i].second;
-            auto &neighbor = index.vectors[neighbor_offset];
+            Erase(index, id, context);
+            Add(index, id, new_vector_data, context);
+            return;
+        }
 
-            // 如果邻居向量的出边小于短边下限
-            if (neighbor.short_edge_out.size() < index.parameters.short_edge_lower_limit)
-            {
-                // 邻居向量添加出边
-                neighbor.short_edge_out.insert({distance, offset});
+        auto &waiting_vectors = context.waiting_vectors;
+        auto &nearest_neighbors = context.nearest_neighbors;
+        auto &neighbors = context.neighbors;
+        auto &visited = context.visited;
+        auto &pool = context.pool;
+        auto &all = context.all;
 
-                // 新向量添加入边
-                new_vector.short_edge_in.insert({neighbor_offset, distance});
-            }
-            // 如果新向量和邻居的距离小于邻居当前距离最大的出边的距离
-            else if (distance < neighbor.short_edge_out.rbegin()->first)
-            {
-                const auto farest_distance = neighbor.short_edge_out.rbegin()->first;
-                auto &neighbor_neighbor = index.vectors[neighbor.short_edge_out.rbegin()->second];
+        context.reset(index.vectors.size());
+        visited[offset] = true;
 
-                // neighbor neighbor offset
-                const auto &NN_offset = neighbor_neighbor.offset;
+        // 原来的邻居作为搜索的起点
+        Get_Pool_From_SE(index, offset, visited, pool);
+        neighbors.assign(pool.begin(), pool.end());
 
-                // 邻居向量删除距离最大的出边
-                neighbor.short_edge_out.erase(std::prev(neighbor.short_edge_out.end()));
-                neighbor_neighbor.short_edge_in.erase(neighbor_offset);
+        // 删除短边
+        for (auto iterator = vector.short_edge_out.begin(); iterator != vector.short_edge_out.end(); ++iterator)
+        {
+            index.vectors[iterator->second].short_edge_in.erase(offset);
+        }
 
-                if (!neighbor.short_edge_in.contains(NN_offset))
-                {
-                    // 添加一条长边
-                    if (!Connected(index, neighbor_offset, NN_offset))
-                    {
-                        if (neighbor.short_edge_out.size() < index.parameters.short_edge_upper_limit)
-                        {
-                            neighbor.short_edge_out.insert({farest_distance, NN_offset});
-                            neighbor_neighbor.short_edge_in.insert({neighbor_offset, farest_distance});
-                        }
-                        else
-                        {
-                            neighbor.keep_connected.insert(NN_offset);
-                            neighbor_neighbor.keep_connected.insert(neighbor_offset);
-                        }
-                    }
-                }
+        for (auto iterator = vector.short_edge_in.begin(); iterator != vector.short_edge_in.end(); ++iterator)
+        {
+            auto &neighbor_vector = index.vectors[iterator->first];
+            auto temporary_iterator = neighbor_vector.short_edge_out.find(iterator->second);
 
-                // 邻居向量添加出边
-                neighbor.short_edge_out.insert({distance, offset});
-                // 新向量添加入边
-                new_vector.short_edge_in.insert({neighbor_offset, distance});
+            while (temporary_iterator->second != offset)
+            {
+                ++temporary_iterator;
             }
+
+            neighbor_vector.short_edge_out.erase(temporary_iterator);
         }
-    }
 
-    // 添加
-    inline void Add(Index &index, const ID id, const float *const added_vector_data)
-    {
-        Offset offset = index.vectors.size();
-        ++index.count;
+        vector.short_edge_out.clear();
+        vector.short_edge_in.clear();
 
-        if (index.empty.empty())
-        {
-            // 在索引中创建一个新向量
-            index.vectors.push_back(Vector(id, offset, added_vector_data,
-                                           Space::Euclidean2::zero(added_vector_data, index.parameters.dimension)));
-        }
-        else
+        vector.data = Store(index, offset, new_vector_data);
+        vector.zero = Space::Euclidean2::zero(vector.data, index.parameters.dimension);
+
+        const auto *target_vector = Get_Input(index, vector.data, context.buffer);
+
+        Similarity_Add(index, target_vector, vector.zero, pool, waiting_vectors, all);
+
+        // 查找与新向量距离最近的k个向量
+        while (!waiting_vectors.empty())
         {
-            offset = index.empty.top();
-            index.empty.pop();
-            index.vectors[offset].id = id;
-            index.vectors[offset].data = added_vector_data;
-            index.vectors[offset].zero = Space::Euclidean2::zero(added_vector_data, index.parameters.dimension);
-        }
+            auto processing_distance = waiting_vectors.top().first;
+            auto processing_offset = waiting_vectors.top().second;
 
-        index.id_to_offset.insert({id, offset});
-        auto &new_vector = index.vectors[offset];
+            if (nearest_neighbors.size() < index.parameters.magnification)
+            {
+                nearest_neighbors.push({processing_distance, processing_offset});
+            }
+            else if (processing_distance < nearest_neighbors.top().first)
+            {
+                nearest_neighbors.pop();
+                nearest_neighbors.push({processing_distance, processing_offset});
+            }
+            else
+            {
+                break;
+            }
 
-        auto nearest_neighbors = std::priority_queue<std::pair<float, Offset>>();
-        auto long_path = std::vector<std::pair<float, Offset>>();
-        auto short_path = std::vector<std::pair<float, Offset>>();
-        auto all = std::vector<std::pair<Offset, float>>();
+            waiting_vectors.pop();
+            Get_Pool_From_SE(index, processing_offset, visited, pool);
+            Similarity_Add(index, target_vector, vector.zero, pool, waiting_vectors, all);
+        }
 
-        // 搜索距离新增向量最近的 index.parameters.short_edge_lower_limit 个向量
-        // 同时记录搜索路径
-        Search_Add(index, offset, long_path, short_path, nearest_neighbors, all);
+        while (index.parameters.short_edge_lower_limit < nearest_neighbors.size())
+        {
+            nearest_neighbors.pop();
+        }
 
-        Neighbor_Optimize(index, offset, all);
+        Neighbor_Optimize(index, offset, all, context);
 
         // 添加短边
         while (!nearest_neighbors.empty())
         {
             const auto &distance = nearest_neighbors.top().first;
             const auto &neighbor_offset = nearest_neighbors.top().second;
-            auto &neighbor = index.vectors[neighbor_offset];
 
-            // 为新向量添加出边
-            new_vector.short_edge_out.insert({distance, neighbor_offset});
-
-            // 为邻居向量添加入边
-            neighbor.short_edge_in.insert({offset, distance});
+            vector.short_edge_out.insert({distance, neighbor_offset});
+            index.vectors[neighbor_offset].short_edge_in.insert({offset, distance});
 
             nearest_neighbors.pop();
         }
 
-        Add_Long_Edges(index, long_path, short_path, offset);
-    }
-
-    inline void Transfer_LEO(Index &index, const Offset whose_offset, const Offset to_offset)
-    {
-        auto &whose_V = index.vectors[whose_offset];
-        auto &to_V = index.vectors[to_offset];
-
-        for (auto i = whose_V.long_edge_out.begin(); i != whose_V.long_edge_out.end(); ++i)
+        // 原来的邻居和向量不再连通时，由原来的邻居连接到向量
+        for (auto i = 0; i < neighbors.size(); ++i)
         {
-            auto &neighbor_O = i->first;
-            auto &neighbor_V = index.vectors[neighbor_O];
-            auto distance = index.similarity(to_V.data, neighbor_V.data, index.parameters.dimension);
-
-            neighbor_V.long_edge_in.erase(whose_offset);
-            to_V.long_edge_out.insert({neighbor_O, distance});
-            neighbor_V.long_edge_in.insert({to_offset, distance});
-        }
-
-        whose_V.long_edge_out.clear();
-    }
+            const auto &neighbor_offset = neighbors[i];
 
-    inline void Mark_Erase(const Vector &repaired_vector, std::vector<bool> &visited)
-    {
-        for (auto iterator = repaired_vector.short_edge_in.begin(); iterator != repaired_vector.short_edge_in.end();
-             ++iterator)
-        {
-            auto &neighbor_offset = iterator->first;
+            if (!Adjacent(index, offset, neighbor_offset) && !Connected(index, neighbor_offset, offset, context))
+            {
+                auto &neighbor_vector = index.vectors[neighbor_offset];
+                auto distance =
+                    Augment(index, index.similarity(target_vector, neighbor_vector.data, index.parameters.dimension),
+                            vector.zero, neighbor_vector.zero);
 
-            visited[neighbor_offset] = true;
+                Connect(index, neighbor_offset, {distance, offset});
+            }
         }
 
-        for (auto iterator = repaired_vector.short_edge_out.begin(); iterator != repaired_vector.short_edge_out.end();
-             ++iterator)
+        // 长边总是从范数较小的向量连向范数较大的向量，新的范数可能破坏这个顺序，
+        // 删除不满足顺序的长边，再按照 Add_Long_Edges 的规则为失去长的入边的向量重新添加长边
+        auto relinked = std::vector<Offset>();
+        auto lost = false;
+
+        for (auto iterator = vector.long_edge_in.begin(); iterator != vector.long_edge_in.end();)
         {
-            auto &neighbor_offset = iterator->second;
+            auto &neighbor_vector = index.vectors[iterator->first];
 
-            visited[neighbor_offset] = true;
+            if (iterator->first != 0 && vector.zero <= neighbor_vector.zero)
+            {
+                neighbor_vector.long_edge_out.erase(offset);
+                iterator = vector.long_edge_in.erase(iterator);
+                lost = true;
+            }
+            else
+            {
+                ++iterator;
+            }
         }
 
-        for (auto iterator = repaired_vector.keep_connected.begin(); iterator != repaired_vector.keep_connected.end();
-             ++iterator)
+        if (lost)
         {
-            auto &neighbor_offset = *iterator;
-
-            visited[neighbor_offset] = true;
+            relinked.push_back(offset);
         }
-    }
 
-    inline void Similarity_Erase(const Index &index, const Vector &repaired_vector, std::vector<bool> &visited,
-                                 std::vector<Offset> &pool,
-                                 std::priority_queue<std::pair<float, Offset>, std::vector<std::pair<float, Offset>>,
-                                                     std::greater<>> &waiting_vectors)
-    {
-        for (auto iterator = repaired_vector.short_edge_in.begin(); iterator != repaired_vector.short_edge_in.end();
-             ++iterator)
+        for (auto iterator = vector.long_edge_out.begin(); iterator != vector.long_edge_out.end();)
         {
-            auto &neighbor_offset = iterator->first;
-            auto &neighbor_vector = index.vectors[neighbor_offset];
+            auto &neighbor_vector = index.vectors[iterator->first];
 
-            for (auto iterator = neighbor_vector.short_edge_in.begin(); iterator != neighbor_vector.short_edge_in.end();
-                 ++iterator)
+            if (neighbor_vector.zero <= vector.zero)
             {
-                auto &NNO = iterator->first;
-
-                Get_Pool_From_SE(index, NNO, visited, pool);
-                Similarity(index, repaired_vector.data, pool, waiting_vectors);
+                neighbor_vector.long_edge_in.erase(offset);
+                relinked.push_back(iterator->first);
+                iterator = vector.long_edge_out.erase(iterator);
             }
-
-            for (auto iterator = neighbor_vector.short_edge_out.begin();
-                 iterator != neighbor_vector.short_edge_out.end(); ++iterator)
+            else
             {
-                auto &NNO = iterator->second;
-
-                Get_Pool_From_SE(index, NNO, visited, pool);
-                Similarity(index, repaired_vector.data, pool, waiting_vectors);
+                ++iterator;
             }
+        }
 
-            for (auto iterator = neighbor_vector.keep_connected.begin();
-                 iterator != neighbor_vector.keep_connected.end(); ++iterator)
-            {
-                auto &NNO = *iterator;
+        Update_Long_Edges(index, offset, target_vector);
 
-                Get_Pool_From_SE(index, NNO, visited, pool);
-                Similarity(index, repaired_vector.data, pool, waiting_vectors);
-            }
+        for (auto i = 0; i < relinked.size(); ++i)
+        {
+            Search_Path(index, relinked[i], context);
+            Add_Long_Edges(index, context.long_path, context.short_path, relinked[i]);
         }
 
-        for (auto iterator = repaired_vector.short_edge_out.begin(); iterator != repaired_vector.short_edge_out.end();
-             ++iterator)
+        if (index.quantizer.trained())
         {
-            auto &neighbor_offset = iterator->second;
-            auto &neighbor_vector = index.vectors[neighbor_offset];
-
-            for (auto iterator = neighbor_vector.short_edge_in.begin(); iterator != neighbor_vector.short_edge_in.end();
-                 ++iterator)
-            {
-                auto &NNO = iterator->first;
-
-                Get_Pool_From_SE(index, NNO, visited, pool);
-                Similarity(index, repaired_vector.data, pool, waiting_vectors);
-            }
+            Encode_Vector(index, offset);
+        }
 
-            for (auto iterator = neighbor_vector.short_edge_out.begin();
-                 iterator != neighbor_vector.short_edge_out.end(); ++iterator)
-            {
-                auto &NNO = iterator->second;
+        if (index.sketch.trained())
+        {
+            Encode_Sketch(index, offset);
+        }
+    }
 
-                Get_Pool_From_SE(index, NNO, visited, pool);
-                Similarity(index, repaired_vector.data, pool, waiting_vectors);
-            }
+    template <typename Element>
+    inline void Update(Index<Element> &index, const ID id, const Space::Input_Type<Element> *const new_vector_data)
+    {
+        auto context = Insert_Context<Element>();
 
-            for (auto iterator = neighbor_vector.keep_connected.begin();
-                 iterator != neighbor_vector.keep_connected.end(); ++iterator)
-            {
-                auto &NNO = *iterator;
+        Update(index, id, new_vector_data, context);
+    }
 
-                Get_Pool_From_SE(index, NNO, visited, pool);
-                Similarity(index, repaired_vector.data, pool, waiting_vectors);
-            }
+    // 使用量化编码计算池子中的向量和查询向量的近似距离
+    template <typename Element>
+    inline void Similarity_Quantized(const Index<Element> &index, Quantization::Query_Table &query_table,
+                                     std::vector<Offset> &pool,
+                                     std::priority_queue<std::pair<float, Offset>,
+                                                         std::vector<std::pair<float, Offset>>, std::greater<>>
+                                         &waiting_vectors)
+    {
+        if (pool.empty())
+        {
+            return;
         }
 
-        for (auto iterator = repaired_vector.keep_connected.begin(); iterator != repaired_vector.keep_connected.end();
-             ++iterator)
-        {
-            auto &neighbor_offset = *iterator;
-            auto &neighbor_vector = index.vectors[neighbor_offset];
+        const auto &code_size = index.quantizer.code_size;
+        const auto *codes = index.codes.data();
 
-            for (auto iterator = neighbor_vector.short_edge_in.begin(); iterator != neighbor_vector.short_edge_in.end();
-                 ++iterator)
+        if (index.quantizer.bits == 8)
+        {
+            for (auto i = 0; i < pool.size(); ++i)
             {
-                auto &NNO = iterator->first;
+                if (i + 1 < pool.size())
+                {
+                    Prefetch(codes + pool[i + 1] * code_size);
+                }
 
-                Get_Pool_From_SE(index, NNO, visited, pool);
-                Similarity(index, repaired_vector.data, pool, waiting_vectors);
+                waiting_vectors.push(
+                    {Quantization::Distance(index.quantizer, query_table, codes + pool[i] * code_size), pool[i]});
             }
+        }
+        else
+        {
+            auto &addresses = query_table.addresses;
 
-            for (auto iterator = neighbor_vector.short_edge_out.begin();
-                 iterator != neighbor_vector.short_edge_out.end(); ++iterator)
-            {
-                auto &NNO = iterator->second;
+            addresses.resize(pool.size());
 
-                Get_Pool_From_SE(index, NNO, visited, pool);
-                Similarity(index, repaired_vector.data, pool, waiting_vectors);
+            for (auto i = 0; i < pool.size(); ++i)
+            {
+                addresses[i] = codes + pool[i] * code_size;
             }
 
-            for (auto iterator = neighbor_vector.keep_connected.begin();
-                 iterator != neighbor_vector.keep_connected.end(); ++iterator)
-            {
-                auto &NNO = *iterator;
+            Quantization::Fast_Scan(index.quantizer, query_table, addresses.data(), pool.size());
 
-                Get_Pool_From_SE(index, NNO, visited, pool);
-                Similarity(index, repaired_vector.data, pool, waiting_vectors);
+            for (auto i = 0; i < pool.size(); ++i)
+            {
+                waiting_vectors.push({query_table.distances[i], pool[i]});
             }
         }
+
+        pool.clear();
     }
 
-    // 删除索引中的向量
-    inline void Erase(Index &index, const ID removed_id)
+    // 使用量化编码查询距离目标向量最近的top-k个向量
+    //
+    // 遍历图时使用查表计算的近似距离，最后使用原始向量计算精确距离重排候选
+    template <typename Element>
+    inline std::priority_queue<std::pair<float, ID>> Search_Quantized(
+        const Index<Element> &index, const Space::Input_Type<Element> *const target_vector, const uint64_t top_k,
+        const uint64_t magnification)
     {
-        auto removed_offset = Get_Offset(index, removed_id);
-        index.id_to_offset.erase(removed_id);
-        auto &removed_vector = index.vectors[removed_offset];
+        auto query_table = Quantization::Query_Table();
 
-        // 删除短边的出边
-        for (auto iterator = removed_vector.short_edge_out.begin(); iterator != removed_vector.short_edge_out.end();
-             ++iterator)
+        Quantization::Compute_Table(index.quantizer, target_vector, query_table);
+
+        // 近似距离的候选
+        auto candidates = std::priority_queue<std::pair<float, Offset>>();
+
+        // 标记是否被遍历过
+        //
+        // 每个线程重复使用同一份标记，不再每次查询分配和顶点数量相同的数组；
+        // 查询期间不会等待线程池，同一个线程上的另一个查询不会在使用标记时插入执行
+        thread_local auto visited = Visited_Marks();
+
+        visited.reset(Vertex_Number(index));
+        visited[0] = true;
+
+        // 排队队列
+        auto waiting_vectors =
+            std::priority_queue<std::pair<float, Offset>, std::vector<std::pair<float, Offset>>, std::greater<>>();
+
+        // 计算池子
+        auto pool = std::vector<Offset>();
+
+        Get_Pool_From_SE(index, 0, visited, pool);
+        Similarity_Quantized(index, query_table, pool, waiting_vectors);
+
+        auto short_offset = waiting_vectors.top().second;
+
+        Get_Pool_From_LEO(index, 0, visited, pool);
+        Similarity_Quantized(index, query_table, pool, waiting_vectors);
+
+        auto nearest_offset = waiting_vectors.top().second;
+
+        while (short_offset != nearest_offset)
         {
-            auto &neighbor_offset = iterator->second;
-            auto &neighbor_vector = index.vectors[neighbor_offset];
+            auto processing_offset = waiting_vectors.top().second;
 
-            neighbor_vector.short_edge_in.erase(removed_offset);
+            Get_Pool_From_SE(index, processing_offset, visited, pool);
+            Similarity_Quantized(index, query_table, pool, waiting_vectors);
+
+            short_offset = waiting_vectors.top().second;
+
+            Get_Pool_From_LEO(index, processing_offset, visited, pool);
+            Similarity_Quantized(index, query_table, pool, waiting_vectors);
+
+            nearest_offset = waiting_vectors.top().second;
         }
 
-        // 删除短边的入边
-        for (auto iterator = removed_vector.short_edge_in.begin(); iterator != removed_vector.short_edge_in.end();
-             ++iterator)
+        while (!waiting_vectors.empty())
         {
-            auto &neighbor_offset = iterator->first;
-            auto &distance = iterator->second;
-            auto &vector = index.vectors[neighbor_offset];
-            auto temporary_iterator = vector.short_edge_out.find(distance);
+            auto processing_distance = waiting_vectors.top().first;
+            auto processing_offset = waiting_vectors.top().second;
+            waiting_vectors.pop();
 
-            while (temporary_iterator->second != removed_offset)
+            const auto deleted = Deleted(index, processing_offset);
+
+            // 标记删除的向量只用于路由，不加入候选
+            if (candidates.size() < top_k + magnification)
             {
-                ++temporary_iterator;
+                if (!deleted)
+                {
+                    candidates.push({processing_distance, processing_offset});
+                }
+            }
+            else
+            {
+                if (processing_distance < candidates.top().first)
+                {
+                    if (!deleted)
+                    {
+                        candidates.pop();
+                        candidates.push({processing_distance, processing_offset});
+                    }
+                }
+                else
+                {
+                    break;
+                }
             }
 
-            vector.short_edge_out.erase(temporary_iterator);
+            Get_Pool_From_SE(index, processing_offset, visited, pool);
+            Similarity_Quantized(index, query_table, pool, waiting_vectors);
         }
 
-        for (auto iterator = removed_vector.keep_connected.begin(); iterator != removed_vector.keep_connected.end();
-             ++iterator)
+        // 重排
+        auto nearest_neighbors = std::priority_queue<std::pair<float, ID>>();
+
+        while (!candidates.empty())
         {
-            auto &neighbor_offset = *iterator;
-            auto &vector = index.vectors[neighbor_offset];
+            const auto &vector = index.vectors[candidates.top().second];
 
-            vector.keep_connected.erase(removed_offset);
+            nearest_neighbors.push(
+                {index.similarity(target_vector, vector.data, index.parameters.dimension), vector.id});
+            candidates.pop();
         }
 
-        // 删除长边
-        for (auto iterator = removed_vector.long_edge_out.begin(); iterator != removed_vector.long_edge_out.end();
-             ++iterator)
-        {
-            auto &neighbor_offset = iterator->first;
-            auto &neighbor_vector = index.vectors[neighbor_offset];
+        return nearest_neighbors;
+    }
 
-            neighbor_vector.long_edge_in.erase(removed_offset);
-        }
+    // 查询时能否使用三角不等式剪枝
+    //
+    // 欧氏距离和归一化后的余弦距离都是平方欧氏距离（的倍数），满足剪枝的条件，内积不满足
+    template <typename Element>
+    inline bool Prunable(const Index<Element> &index)
+    {
+        return index.parameters.space_metric == Space::Metric::Euclidean2 ||
+               index.parameters.space_metric == Space::Metric::Cosine_Similarity;
+    }
 
-        for (auto iterator = removed_vector.long_edge_in.begin(); iterator != removed_vector.long_edge_in.end();
-             ++iterator)
-        {
-            auto &neighbor_offset = iterator->first;
-            auto &neighbor_vector = index.vectors[neighbor_offset];
+    // 使用三角不等式估计邻居向量和查询向量的平方距离的下界
+    //
+    // 由边长得到 (sqrt(d(q,v)) - sqrt(d(v,x)))^2，由范数得到 (|q| - |x|)^2，取两者中较大的一个
+    //
+    // 余弦距离的向量已经归一化，范数的下界恒为 0，只使用边长
+    template <typename Element>
+    inline float Lower_Bound(const Index<Element> &index, const float processing_root, const float query_root,
+                             const float length, const Offset neighbor_offset)
+    {
+        auto edge_bound = processing_root - std::sqrt(length);
+        edge_bound *= edge_bound;
 
-            neighbor_vector.long_edge_out.erase(removed_offset);
+        if (index.parameters.space_metric != Space::Metric::Euclidean2)
+        {
+            return edge_bound;
         }
 
-        // 补边
-        for (auto iterator = removed_vector.short_edge_in.begin(); iterator != removed_vector.short_edge_in.end();
-             ++iterator)
-        {
-            auto &repaired_offset = iterator->first;
-            auto &repaired_vector = index.vectors[repaired_offset];
+        auto norm_bound = query_root - std::sqrt(index.vectors[neighbor_offset].zero);
+        norm_bound *= norm_bound;
 
-            if (repaired_vector.short_edge_out.size() < index.parameters.short_edge_lower_limit)
-            {
-                auto visited = std::vector<bool>(index.vectors.size(), false);
+        return std::max(edge_bound, norm_bound);
+    }
 
-                visited[repaired_offset] = true;
+    // 从短边获取计算池，跳过距离的下界超过 bound 的向量
+    //
+    // processing_distance 为当前向量和查询向量的距离，query_root 为查询向量的范数
+    //
+    // 被跳过的向量比当前最远的候选还远，出队时必然终止查询，所以标记为已遍历
+    template <typename Element>
+    inline void Get_Pool_From_SE(const Index<Element> &index, const Offset processing_offset,
+                                 const float processing_distance, const float query_root, const float bound,
+                                 std::vector<bool> &visited, std::vector<Offset> &pool)
+    {
+        auto &processing_vector = index.vectors[processing_offset];
+        const auto processing_root = std::sqrt(processing_distance);
 
-                auto nearest_neighbors = std::priority_queue<std::pair<float, Offset>>();
-                auto waiting_vectors = std::priority_queue<std::pair<float, Offset>,
-                                                           std::vector<std::pair<float, Offset>>, std::greater<>>();
-                auto pool = std::vector<Offset>();
+        if (index.serving)
+        {
+            const auto &neighbors = Published_Neighbors(index, processing_offset);
 
-                Mark_Erase(repaired_vector, visited);
-                Similarity_Erase(index, repaired_vector, visited, pool, waiting_vectors);
+            for (auto i = 0; i < neighbors.keep_number; ++i)
+            {
+                const auto &neighbor_offset = neighbors.edges[i].first;
 
-                while (!waiting_vectors.empty())
+                if (!visited[neighbor_offset])
                 {
-                    auto processing_distance = waiting_vectors.top().first;
-                    auto processing_offset = waiting_vectors.top().second;
-
-                    waiting_vectors.pop();
+                    visited[neighbor_offset] = true;
 
-                    // 如果已遍历的向量小于候选数量
-                    if (nearest_neighbors.size() < index.parameters.magnification)
-                    {
-                        nearest_neighbors.push({processing_distance, processing_offset});
-                    }
-                    else
+                    // 保持连通的边没有长度，总是加入计算池
+                    if (neighbors.short_number <= i ||
+                        Lower_Bound(index, processing_root, query_root, neighbors.edges[i].second, neighbor_offset) <=
+                            bound)
                     {
-                        // 如果当前的向量和查询向量的距离小于已优先队列中的最大值
-                        if (processing_distance < nearest_neighbors.top().first)
-                        {
-                            nearest_neighbors.pop();
-                            nearest_neighbors.push({processing_distance, processing_offset});
-                        }
-                        else
-                        {
-                            break;
-                        }
+                        pool.push_back(neighbor_offset);
                     }
-
-                    Get_Pool_From_SE(index, processing_offset, visited, pool);
-                    Similarity(index, repaired_vector.data, pool, waiting_vectors);
                 }
+            }
 
-                while (nearest_neighbors.size() != 1)
-                {
-                    nearest_neighbors.pop();
-                }
+            return;
+        }
 
-                auto &TD = nearest_neighbors.top().first;
-                auto &TO = nearest_neighbors.top().second;
-                auto &TV = index.vectors[TO];
+        auto guard = Vertex_Guard(index, processing_offset);
 
-                repaired_vector.short_edge_out.insert(nearest_neighbors.top());
-                TV.short_edge_in.insert({repaired_offset, TD});
+        for (auto iterator = processing_vector.short_edge_out.begin();
+             iterator != processing_vector.short_edge_out.end(); ++iterator)
+        {
+            auto &neighbor_offset = iterator->second;
 
-                if (repaired_vector.long_edge_out.contains(TO))
+            if (!visited[neighbor_offset])
+            {
+                visited[neighbor_offset] = true;
+
+                if (Lower_Bound(index, processing_root, query_root, iterator->first, neighbor_offset) <= bound)
                 {
-                    repaired_vector.long_edge_out.erase(TO);
-                    TV.long_edge_in.erase(repaired_offset);
-                    Transfer_LEO(index, TO, repaired_offset);
+                    pool.push_back(neighbor_offset);
                 }
-                else if (TV.long_edge_out.contains(repaired_offset))
+            }
+        }
+
+        for (auto iterator = processing_vector.short_edge_in.begin(); iterator != processing_vector.short_edge_in.end();
+             ++iterator)
+        {
+            auto &neighbor_offset = iterator->first;
+
+            if (!visited[neighbor_offset])
+            {
+                visited[neighbor_offset] = true;
+
+                if (Lower_Bound(index, processing_root, query_root, iterator->second, neighbor_offset) <= bound)
                 {
-                    TV.long_edge_out.erase(repaired_offset);
-                    repaired_vector.long_edge_in.erase(TO);
-                    Transfer_LEO(index, repaired_offset, TO);
+                    pool.push_back(neighbor_offset);
                 }
             }
         }
 
-        if (!removed_vector.long_edge_out.empty())
+        for (auto iterator = processing_vector.keep_connected.begin();
+             iterator != processing_vector.keep_connected.end(); ++iterator)
         {
-            Transfer_LEO(index, removed_offset, removed_vector.long_edge_in.begin()->first);
+            auto &neighbor_offset = *iterator;
+
+            if (!visited[neighbor_offset])
+            {
+                visited[neighbor_offset] = true;
+                pool.push_back(neighbor_offset);
+            }
         }
+    }
 
-        Delete_Vector(index, removed_offset);
+    // 先用二值草图估计距离下界，下界超过 bound 的向量不再计算精确距离
+    template <typename Element, typename Distance>
+    inline void Similarity_Sketch(const Index<Element> &index, const Space::Input_Type<Element> *const target_vector,
+                                  const uint64_t *const query_code, const float query_norm, std::vector<Offset> &pool,
+                                  std::priority_queue<std::pair<float, Offset>, std::vector<std::pair<float, Offset>>,
+                                                      std::greater<>> &waiting_vectors,
+                                  const float bound, const Distance &distance)
+    {
+        const auto &words = index.sketch.words;
+
+        for (auto i = 0; i < pool.size(); ++i)
+        {
+            auto &neighbor_offset = pool[i];
+
+            auto hamming =
+                Quantization::Hamming(index.sketch, query_code, index.sketches.data() + neighbor_offset * words);
+            auto lower_bound =
+                Quantization::Lower_Bound(index.sketch, hamming, query_norm, index.sketch_norms[neighbor_offset]);
+
+            if (bound < lower_bound)
+            {
+                continue;
+            }
+
+            waiting_vectors.push(
+                {distance(target_vector, index.vectors[neighbor_offset].data, index.parameters.dimension),
+                 neighbor_offset});
+        }
+
+        pool.clear();
     }
 
     // 查询距离目标向量最近的top-k个向量
-    inline std::priority_queue<std::pair<float, ID>> Search(const Index &index, const float *const target_vector,
-                                                            const uint64_t top_k, const uint64_t magnification)
+    //
+    // distance 在编译期确定度量和维度，由下面的 Search 根据索引的参数选择
+    template <typename Element, typename Distance>
+    inline std::priority_queue<std::pair<float, ID>> Search(const Index<Element> &index,
+                                                            const Space::Input_Type<Element> *const target_vector,
+                                                            const uint64_t top_k, const uint64_t magnification,
+                                                            const Distance &distance)
     {
         // 优先队列
         auto nearest_neighbors = std::priority_queue<std::pair<float, ID>>();
 
         // 标记是否被遍历过
-        auto visited = std::vector<bool>(index.vectors.size(), false);
+        auto visited = std::vector<bool>(Vertex_Number(index), false);
         visited[0] = true;
 
         // 排队队列
@@ -1005,14 +3739,14 @@ namespace HSG
         auto pool = std::vector<Offset>();
 
         Get_Pool_From_SE(index, 0, visited, pool);
-        Similarity(index, target_vector, pool, waiting_vectors);
+        Similarity(index, target_vector, pool, waiting_vectors, distance);
 
-        auto &short_offset = waiting_vectors.top().second;
+        const auto short_offset = waiting_vectors.top().second;
 
         Get_Pool_From_LEO(index, 0, visited, pool);
-        Similarity(index, target_vector, pool, waiting_vectors);
+        Similarity(index, target_vector, pool, waiting_vectors, distance);
 
-        auto &nearest_offset = waiting_vectors.top().second;
+        const auto nearest_offset = waiting_vectors.top().second;
 
         if (short_offset != nearest_offset)
         {
@@ -1021,14 +3755,14 @@ namespace HSG
                 auto processing_offset = waiting_vectors.top().second;
 
                 Get_Pool_From_SE(index, processing_offset, visited, pool);
-                Similarity(index, target_vector, pool, waiting_vectors);
+                Similarity(index, target_vector, pool, waiting_vectors, distance);
 
-                auto &short_offset = waiting_vectors.top().second;
+                const auto short_offset = waiting_vectors.top().second;
 
                 Get_Pool_From_LEO(index, processing_offset, visited, pool);
-                Similarity(index, target_vector, pool, waiting_vectors);
+                Similarity(index, target_vector, pool, waiting_vectors, distance);
 
-                auto &nearest_offset = waiting_vectors.top().second;
+                const auto nearest_offset = waiting_vectors.top().second;
 
                 if (short_offset == nearest_offset)
                 {
@@ -1037,6 +3771,20 @@ namespace HSG
             }
         }
 
+        // 查询向量的二值草图
+        auto query_code = std::vector<uint64_t>(index.sketch.words, 0);
+        auto query_norm = 0.0F;
+
+        if (index.sketch.trained())
+        {
+            query_norm = Quantization::Encode(index.sketch, target_vector, query_code.data());
+        }
+
+        // 查询向量的范数，用于三角不等式剪枝
+        const auto prunable = Prunable(index);
+        const auto query_root =
+            prunable ? std::sqrt(Space::Euclidean2::zero(target_vector, index.parameters.dimension)) : 0.0F;
+
         // 阶段二
         // 查找与目标向量相似度最高（距离最近）的top-k个向量
         while (!waiting_vectors.empty())
@@ -1044,20 +3792,29 @@ namespace HSG
             auto processing_distance = waiting_vectors.top().first;
             auto processing_offset = waiting_vectors.top().second;
             auto &processing_vector = index.vectors[processing_offset];
+            const auto deleted = Deleted(index, processing_offset);
             waiting_vectors.pop();
 
+            // 标记删除的向量只用于路由，不加入结果
+            //
             // 如果已遍历的向量小于候选数量
             if (nearest_neighbors.size() < top_k + magnification)
             {
-                nearest_neighbors.push({processing_distance, processing_vector.id});
+                if (!deleted)
+                {
+                    nearest_neighbors.push({processing_distance, processing_vector.id});
+                }
             }
             else
             {
                 // 如果当前的向量和查询向量的距离小于已优先队列中的最大值
                 if (processing_distance < nearest_neighbors.top().first)
                 {
-                    nearest_neighbors.pop();
-                    nearest_neighbors.push({processing_distance, processing_vector.id});
+                    if (!deleted)
+                    {
+                        nearest_neighbors.pop();
+                        nearest_neighbors.push({processing_distance, processing_vector.id});
+                    }
                 }
                 else
                 {
@@ -1065,13 +3822,73 @@ namespace HSG
                 }
             }
 
-            Get_Pool_From_SE(index, processing_offset, visited, pool);
-            Similarity(index, target_vector, pool, waiting_vectors);
+            // 候选已满时，比当前最远候选还远的向量出队时必然终止查询，可以跳过
+            const auto full = nearest_neighbors.size() == top_k + magnification;
+
+            if (prunable && full)
+            {
+                Get_Pool_From_SE(index, processing_offset, processing_distance, query_root,
+                                 nearest_neighbors.top().first, visited, pool);
+            }
+            else
+            {
+                Get_Pool_From_SE(index, processing_offset, visited, pool);
+            }
+
+            if (index.sketch.trained() && full)
+            {
+                Similarity_Sketch(index, target_vector, query_code.data(), query_norm, pool, waiting_vectors,
+                                  nearest_neighbors.top().first, distance);
+            }
+            else
+            {
+                Similarity(index, target_vector, pool, waiting_vectors, distance);
+            }
         }
 
         return nearest_neighbors;
     }
 
+    // 查询距离目标向量最近的top-k个向量
+    //
+    // 启用并发查询时可以和一个写者同时调用
+    template <typename Element>
+    inline std::priority_queue<std::pair<float, ID>> Search(const Index<Element> &index,
+                                                            const Space::Input_Type<Element> *const target_vector,
+                                                            const uint64_t top_k, const uint64_t magnification)
+    {
+        auto read_guard = Read_Guard(index);
+        auto buffer = std::vector<Space::Input_Type<Element>>();
+        const auto *query_vector = Get_Query(index, target_vector, buffer);
+
+        if (index.quantizer.trained())
+        {
+            return Search_Quantized(index, query_vector, top_k, magnification);
+        }
+
+        return Space::dispatch<Element>(index.isa, index.parameters.space_metric, index.parameters.dimension,
+                                        [&](const auto &distance)
+                                        { return Search(index, query_vector, top_k, magnification, distance); });
+    }
+
+    // 批量查询
+    //
+    // targets 中依次存放 number 个目标向量，由默认线程池中的 thread_number 个线程同时查询
+    template <typename Element>
+    inline std::vector<std::priority_queue<std::pair<float, ID>>> Search_Batch(
+        const Index<Element> &index, const Space::Input_Type<Element> *const targets, const uint64_t number,
+        const uint64_t top_k, const uint64_t magnification, const uint64_t thread_number)
+    {
+        const auto &dimension = index.parameters.dimension;
+        auto results = std::vector<std::priority_queue<std::pair<float, ID>>>(number);
+
+        Parallel::For(0, number, thread_number,
+                      [&](const uint64_t i)
+                      { results[i] = Search(index, targets + i * dimension, top_k, magnification); });
+
+        return results;
+    }
+
     // 查询
     // inline std::priority_queue<std::pair<float, uint64_t>> search(const Index &index, const float *const
     // query_vector,
@@ -1091,7 +3908,8 @@ namespace HSG
     // }
 
     // Breadth First Search through Short Edges.
-    inline void BFS_Through_SE(const Index &index, const Vector &start, std::vector<bool> &VC)
+    template <typename Element>
+    inline void BFS_Through_SE(const Index<Element> &index, const Vector<Element> &start, std::vector<bool> &VC)
     {
         auto visited = std::unordered_set<Offset>();
         visited.insert(start.offset);
@@ -1178,7 +3996,8 @@ namespace HSG
     // 通过长边进行广度优先遍历
     //
     //  Breadth First Search Through Long Edges Out.
-    inline void BFS_Through_LEO(const Index &index, std::unordered_set<Offset> &VR, std::vector<bool> &VC)
+    template <typename Element>
+    inline void BFS_Through_LEO(const Index<Element> &index, std::unordered_set<Offset> &VR, std::vector<bool> &VC)
     {
         auto last = std::vector<Offset>();
 
@@ -1212,7 +4031,8 @@ namespace HSG
     }
 
     // 计算覆盖率
-    inline float Calculate_Coverage(const Index &index)
+    template <typename Element>
+    inline float Calculate_Coverage(const Index<Element> &index)
     {
         auto VC = std::vector<bool>(index.vectors.size(), false);
         auto VR = std::unordered_set<Offset>();
@@ -1239,8 +4059,9 @@ namespace HSG
         return float(number - 1) / (index.count - 1);
     }
 
-    inline bool Calculate_Benefits(const Index &index, const std::unordered_set<Offset> &missed, const Offset start,
-                                   uint64_t &benefits)
+    template <typename Element>
+    inline bool Calculate_Benefits(const Index<Element> &index, const std::unordered_set<Offset> &missed,
+                                   const Offset start, uint64_t &benefits)
     {
 
         auto visited = std::unordered_set<Offset>();
@@ -1398,8 +4219,9 @@ namespace HSG
     }
 
     // 计算为哪个顶点补长边可以覆盖的顶点最多
-    inline void Max_Benefits(const Index &index, const std::unordered_set<Offset> &missed, uint64_t &max_benefits,
-                             Offset &max_benefit_offset)
+    template <typename Element>
+    inline void Max_Benefits(const Index<Element> &index, const std::unordered_set<Offset> &missed,
+                             uint64_t &max_benefits, Offset &max_benefit_offset)
     {
         for (auto iterator = missed.begin(); iterator != missed.end(); ++iterator)
         {
@@ -1420,17 +4242,22 @@ namespace HSG
         }
     }
 
-    inline void Search_Optimize(const Index &index, const Offset offset,
+    template <typename Element>
+    inline void Search_Optimize(const Index<Element> &index, const Offset offset,
                                 std::vector<std::pair<float, Offset>> &long_path)
     {
         const auto &vector = index.vectors[offset];
+        auto buffer = std::vector<Space::Input_Type<Element>>();
+        const auto *target_vector = Get_Input(index, vector.data, buffer);
 
         // 等待队列
         auto waiting_vectors =
             std::priority_queue<std::pair<float, Offset>, std::vector<std::pair<float, Offset>>, std::greater<>>();
 
-        waiting_vectors.push({vector.zero, 0});
-        long_path.push_back({vector.zero, 0});
+        const auto zero_distance = Zero_Distance(index, vector.zero);
+
+        waiting_vectors.push({zero_distance, 0});
+        long_path.push_back({zero_distance, 0});
 
         // 标记是否被遍历过
         auto visited = std::vector<bool>(index.vectors.size(), false);
@@ -1441,14 +4268,14 @@ namespace HSG
         auto pool = std::vector<Offset>();
 
         Get_Pool_From_SE(index, 0, visited, pool);
-        Similarity(index, vector.data, pool, waiting_vectors);
+        Similarity(index, target_vector, vector.zero, pool, waiting_vectors);
 
-        auto &short_offset = waiting_vectors.top().second;
+        const auto short_offset = waiting_vectors.top().second;
 
         Get_Pool_From_LEO(index, 0, visited, pool);
-        Similarity(index, vector.data, pool, waiting_vectors);
+        Similarity(index, target_vector, vector.zero, pool, waiting_vectors);
 
-        auto &nearest_offset = waiting_vectors.top().second;
+        const auto nearest_offset = waiting_vectors.top().second;
 
         if (short_offset != nearest_offset)
         {
@@ -1456,17 +4283,17 @@ namespace HSG
             {
                 long_path.push_back(waiting_vectors.top());
 
-                const auto &processing_offset = waiting_vectors.top().second;
+                const auto processing_offset = waiting_vectors.top().second;
 
                 Get_Pool_From_SE(index, processing_offset, visited, pool);
-                Similarity(index, vector.data, pool, waiting_vectors);
+                Similarity(index, target_vector, vector.zero, pool, waiting_vectors);
 
-                const auto &short_offset = waiting_vectors.top().second;
+                const auto short_offset = waiting_vectors.top().second;
 
                 Get_Pool_From_LEO(index, processing_offset, visited, pool);
-                Similarity(index, vector.data, pool, waiting_vectors);
+                Similarity(index, target_vector, vector.zero, pool, waiting_vectors);
 
-                const auto &nearest_offset = waiting_vectors.top().second;
+                const auto nearest_offset = waiting_vectors.top().second;
 
                 if (short_offset == nearest_offset)
                 {
@@ -1476,7 +4303,8 @@ namespace HSG
         }
     }
 
-    inline void Add_Long_Edges_Optimize(Index &index, std::vector<std::pair<float, Offset>> &long_path,
+    template <typename Element>
+    inline void Add_Long_Edges_Optimize(Index<Element> &index, std::vector<std::pair<float, Offset>> &long_path,
                                         const Offset offset)
     {
         auto &vector = index.vectors[offset];
@@ -1492,7 +4320,8 @@ namespace HSG
 
             if (neighbor_vector.zero < vector.zero && !Adjacent(index, offset, neighbor_offset))
             {
-                auto CV = Cosine_Value(added_distance, vector.zero, neighbor_vector.zero);
+                auto CV = Cosine_Value(added_distance, Zero_Distance(index, vector.zero),
+                                       Zero_Distance(index, neighbor_vector.zero));
 
                 if (maximum_cosine < CV)
                 {
@@ -1510,7 +4339,8 @@ namespace HSG
     }
 
     // 优化索引结构
-    inline void Optimize(Index &index)
+    template <typename Element>
+    inline void Optimize(Index<Element> &index)
     {
         auto VC = std::vector<bool>(index.vectors.size(), false);
         auto VR = std::unordered_set<Offset>();
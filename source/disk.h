@@ -0,0 +1,924 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define HSG_IO_URING 1
+#endif
+
+#include "HSG.h"
+#include "parallel.h"
+#include "serialization.h"
+
+namespace HSG
+{
+
+    // 保存在磁盘上的索引的文件格式
+    //
+    // 第一个扇区为文件头，之后第 offset + 1 个扇区保存第 offset 个顶点：
+    // 邻居的数量、最多 degree 个邻居和原始向量，扇区的大小为 4KB 的整数倍
+    //
+    // 所有扇区之后是常驻内存的部分：每个顶点的 id、标记和乘积量化的编码，按 serialization.h 的段格式保存
+    namespace Disk_Format
+    {
+        // 文件开头的标识
+        constexpr char magic[8] = {'H', 'S', 'G', 'D', 'I', 'S', 'K', '\0'};
+        // 格式的版本，格式改变时增加
+        constexpr uint64_t version = 1;
+        // 扇区的对齐
+        constexpr uint64_t alignment = 4096;
+        // 顶点的标记
+        constexpr uint8_t has_data = 1;
+        constexpr uint8_t deleted = 2;
+
+        class Header
+        {
+          public:
+            char magic[8];
+            uint64_t version;
+            uint64_t element_code;
+            uint64_t space_metric;
+            uint64_t dimension;
+            uint64_t vertex_number;
+            uint64_t sector_size;
+            uint64_t degree;
+            // 上面所有字段的校验和
+            uint64_t checksum;
+
+            uint64_t compute_checksum() const
+            {
+                auto checksum = Format::Checksum();
+
+                checksum.update(reinterpret_cast<const char *>(this), offsetof(Header, checksum));
+
+                return checksum.value();
+            }
+        };
+
+        // 一个顶点占用的扇区大小
+        template <typename Element>
+        inline uint64_t Sector_Size(const uint64_t dimension, const uint64_t degree)
+        {
+            const auto size = sizeof(uint64_t) + degree * sizeof(Offset) + dimension * sizeof(Element);
+
+            return (size + alignment - 1) / alignment * alignment;
+        }
+
+        // 读取扇区开头的邻居的数量
+        //
+        // 查询时直接用扇区中的邻居访问常驻内存的数组，所以邻居的数量不能超过 degree，邻居必须是有效的位置
+        inline uint64_t Neighbor_Number(const char *const sector, const uint64_t degree, const uint64_t vertex_number)
+        {
+            const auto *neighbors = reinterpret_cast<const Offset *>(sector + sizeof(uint64_t));
+            uint64_t neighbor_number = 0;
+
+            std::memcpy(&neighbor_number, sector, sizeof(neighbor_number));
+
+            if (degree < neighbor_number)
+            {
+                throw std::runtime_error("The disk index file is corrupted. ");
+            }
+
+            for (auto i = 0; i < neighbor_number; ++i)
+            {
+                if (vertex_number <= neighbors[i])
+                {
+                    throw std::runtime_error("The disk index file is corrupted. ");
+                }
+            }
+
+            return neighbor_number;
+        }
+
+        // 按扇区对齐的缓冲区，直接读写磁盘时要求地址对齐
+        class Buffer
+        {
+          public:
+            std::unique_ptr<char, decltype(&std::free)> data;
+            uint64_t size;
+
+            explicit Buffer() : data(nullptr, &std::free), size(0)
+            {
+            }
+
+            char *reserve(const uint64_t size)
+            {
+                if (this->size < size)
+                {
+                    this->data.reset(static_cast<char *>(std::aligned_alloc(alignment, size)));
+
+                    if (this->data == nullptr)
+                    {
+                        throw std::bad_alloc();
+                    }
+
+                    this->size = size;
+                }
+
+                return this->data.get();
+            }
+        };
+
+    } // namespace Disk_Format
+
+#if defined(HSG_IO_URING)
+    // 不依赖 liburing 的 io_uring，每个线程使用自己的队列
+    //
+    // 内核不支持或者禁止 io_uring 时 valid 为 false，由调用者改用 pread
+    class Ring
+    {
+      public:
+        int file;
+        io_uring_params parameters;
+        void *submission_ring;
+        uint64_t submission_ring_size;
+        void *completion_ring;
+        uint64_t completion_ring_size;
+        io_uring_sqe *entries;
+        uint64_t entries_size;
+
+        explicit Ring(const uint32_t depth)
+            : file(-1), parameters(), submission_ring(MAP_FAILED), submission_ring_size(0),
+              completion_ring(MAP_FAILED), completion_ring_size(0), entries(static_cast<io_uring_sqe *>(MAP_FAILED)),
+              entries_size(0)
+        {
+            this->file = int(syscall(__NR_io_uring_setup, depth, &this->parameters));
+
+            if (this->file < 0)
+            {
+                return;
+            }
+
+            const auto &p = this->parameters;
+
+            this->submission_ring_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+            this->completion_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+
+            // 较新的内核中两个环共用一次映射
+            if ((p.features & IORING_FEAT_SINGLE_MMAP) != 0)
+            {
+                this->submission_ring_size = std::max(this->submission_ring_size, this->completion_ring_size);
+            }
+
+            this->submission_ring = mmap(nullptr, this->submission_ring_size, PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_POPULATE, this->file, IORING_OFF_SQ_RING);
+
+            if ((p.features & IORING_FEAT_SINGLE_MMAP) != 0)
+            {
+                this->completion_ring = this->submission_ring;
+            }
+            else
+            {
+                this->completion_ring = mmap(nullptr, this->completion_ring_size, PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE, this->file, IORING_OFF_CQ_RING);
+            }
+
+            this->entries_size = p.sq_entries * sizeof(io_uring_sqe);
+            this->entries = static_cast<io_uring_sqe *>(mmap(nullptr, this->entries_size, PROT_READ | PROT_WRITE,
+                                                             MAP_SHARED | MAP_POPULATE, this->file,
+                                                             IORING_OFF_SQES));
+
+            if (this->submission_ring == MAP_FAILED || this->completion_ring == MAP_FAILED ||
+                this->entries == MAP_FAILED)
+            {
+                this->release();
+            }
+        }
+
+        Ring(const Ring &) = delete;
+        Ring &operator=(const Ring &) = delete;
+
+        ~Ring()
+        {
+            this->release();
+        }
+
+        void release()
+        {
+            if (this->entries != MAP_FAILED)
+            {
+                munmap(this->entries, this->entries_size);
+                this->entries = static_cast<io_uring_sqe *>(MAP_FAILED);
+            }
+
+            if (this->completion_ring != MAP_FAILED && this->completion_ring != this->submission_ring)
+            {
+                munmap(this->completion_ring, this->completion_ring_size);
+            }
+
+            if (this->submission_ring != MAP_FAILED)
+            {
+                munmap(this->submission_ring, this->submission_ring_size);
+            }
+
+            this->submission_ring = MAP_FAILED;
+            this->completion_ring = MAP_FAILED;
+
+            if (0 <= this->file)
+            {
+                close(this->file);
+                this->file = -1;
+            }
+        }
+
+        bool valid() const
+        {
+            return 0 <= this->file;
+        }
+
+        uint32_t *submission(const uint32_t field) const
+        {
+            return reinterpret_cast<uint32_t *>(static_cast<char *>(this->submission_ring) + field);
+        }
+
+        uint32_t *completion(const uint32_t field) const
+        {
+            return reinterpret_cast<uint32_t *>(static_cast<char *>(this->completion_ring) + field);
+        }
+
+        // 从 file 读取 number 个扇区，第 i 个扇区从 positions[i] 读到 buffer + i * size
+        //
+        // 请求一次提交，等待全部完成后返回，读取失败时抛出异常
+        void read(const int file, const uint64_t *const positions, const uint64_t number, char *const buffer,
+                  const uint64_t size)
+        {
+            const auto &p = this->parameters;
+            auto *const cqes = reinterpret_cast<io_uring_cqe *>(static_cast<char *>(this->completion_ring) +
+                                                                p.cq_off.cqes);
+
+            for (auto begin = 0; begin < number; begin += p.sq_entries)
+            {
+                const auto end = std::min<uint64_t>(begin + p.sq_entries, number);
+                const auto mask = *this->submission(p.sq_off.ring_mask);
+                auto tail = *this->submission(p.sq_off.tail);
+
+                for (auto i = begin; i < end; ++i, ++tail)
+                {
+                    const auto index = tail & mask;
+                    auto &entry = this->entries[index];
+
+                    std::memset(&entry, 0, sizeof(entry));
+                    entry.opcode = IORING_OP_READ;
+                    entry.fd = file;
+                    entry.off = positions[i];
+                    entry.addr = reinterpret_cast<uint64_t>(buffer + i * size);
+                    entry.len = uint32_t(size);
+                    entry.user_data = i;
+                    this->submission(p.sq_off.array)[index] = index;
+                }
+
+                __atomic_store_n(this->submission(p.sq_off.tail), tail, __ATOMIC_RELEASE);
+
+                const auto submitted = uint32_t(end - begin);
+
+                if (syscall(__NR_io_uring_enter, this->file, submitted, submitted, IORING_ENTER_GETEVENTS, nullptr,
+                            0) < 0)
+                {
+                    throw std::runtime_error("Failed to submit the disk reads. ");
+                }
+
+                // 取出全部完成的请求
+                auto head = *this->completion(p.cq_off.head);
+                auto failed = false;
+
+                for (auto completed = 0; completed < submitted;)
+                {
+                    const auto available = __atomic_load_n(this->completion(p.cq_off.tail), __ATOMIC_ACQUIRE);
+
+                    if (head == available)
+                    {
+                        if (syscall(__NR_io_uring_enter, this->file, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+                            errno != EINTR)
+                        {
+                            throw std::runtime_error("Failed to wait for the disk reads. ");
+                        }
+
+                        continue;
+                    }
+
+                    for (; head != available; ++head, ++completed)
+                    {
+                        const auto &completion = cqes[head & *this->completion(p.cq_off.ring_mask)];
+
+                        failed |= completion.res != int32_t(size);
+                    }
+
+                    __atomic_store_n(this->completion(p.cq_off.head), head, __ATOMIC_RELEASE);
+                }
+
+                if (failed)
+                {
+                    throw std::runtime_error("Failed to read the disk index. ");
+                }
+            }
+        }
+    };
+
+    // 调用的线程的 io_uring 队列
+    inline Ring &Local_Ring()
+    {
+        static thread_local auto ring = Ring(64);
+
+        return ring;
+    }
+#endif
+
+    // 保存在磁盘上的索引
+    //
+    // 向量和有上限的邻居保存在磁盘上，每个顶点占用一个扇区，查询时每一步只读取几个扇区；
+    // 乘积量化的编码、id 和标记常驻内存，用于选择下一步读取的扇区
+    template <typename Element = float>
+    class Disk_Index
+    {
+      public:
+        // 向量的维度
+        uint64_t dimension;
+        // 距离类型
+        Space::Metric space_metric;
+        // 查询时使用的指令集
+        Space::ISA isa;
+        // 顶点的数量，包括零点
+        uint64_t vertex_number;
+        // 一个顶点占用的字节数
+        uint64_t sector_size;
+        // 每个顶点最多保存的邻居数量
+        uint64_t degree;
+        // 每一步读取的扇区数量
+        uint64_t beam_width;
+        // 是否使用 io_uring，为 false 或者不可用时由线程池中的线程调用 pread
+        bool io_uring;
+        // 每个顶点的 id 和标记
+        std::vector<ID> ids;
+        std::vector<uint8_t> flags;
+        // 乘积量化器和每个向量的编码
+        //
+        // codes[offset * quantizer.code_size]
+        Quantization::Product_Quantizer quantizer;
+        std::vector<uint8_t> codes;
+        // 零点的邻居，查询的起点
+        std::vector<Offset> entry;
+        int file;
+
+        // direct 为 true 时绕过页缓存直接读取磁盘，文件系统不支持时自动关闭
+        explicit Disk_Index(const std::string &path, const bool direct = true)
+            : dimension(0), space_metric(Space::Metric::Euclidean2), isa(Space::get_isa()), vertex_number(0),
+              sector_size(0), degree(0), beam_width(4), io_uring(true), file(-1)
+        {
+#if defined(__unix__)
+#if defined(O_DIRECT)
+            if (direct)
+            {
+                this->file = open(path.c_str(), O_RDONLY | O_DIRECT);
+            }
+#endif
+
+            if (this->file < 0)
+            {
+                this->file = open(path.c_str(), O_RDONLY);
+            }
+
+            if (this->file < 0)
+            {
+                throw std::runtime_error("Cannot open '" + path + "' for reading. ");
+            }
+
+            try
+            {
+                this->load(path);
+            }
+            catch (...)
+            {
+                close(this->file);
+                throw;
+            }
+#else
+            throw std::logic_error("Disk indexes are only supported on Unix. ");
+#endif
+        }
+
+        Disk_Index(const Disk_Index &) = delete;
+        Disk_Index &operator=(const Disk_Index &) = delete;
+
+        ~Disk_Index()
+        {
+#if defined(__unix__)
+            if (0 <= this->file)
+            {
+                close(this->file);
+            }
+#endif
+        }
+
+        // 读取文件头、常驻内存的部分和零点的邻居
+        void load(const std::string &path)
+        {
+            auto buffer = Disk_Format::Buffer();
+            auto *data = buffer.reserve(Disk_Format::alignment);
+
+            if (pread(this->file, data, Disk_Format::alignment, 0) != Disk_Format::alignment)
+            {
+                throw std::runtime_error("The disk index file is truncated or corrupted. ");
+            }
+
+            auto header = Disk_Format::Header();
+
+            std::memcpy(&header, data, sizeof(header));
+
+            if (std::memcmp(header.magic, Disk_Format::magic, sizeof(header.magic)) != 0 ||
+                header.checksum != header.compute_checksum())
+            {
+                throw std::runtime_error("The disk index file is truncated or corrupted. ");
+            }
+
+            if (header.version != Disk_Format::version)
+            {
+                throw std::runtime_error("The version of the disk index file is not supported. ");
+            }
+
+            if (header.element_code != Format::element_code<Element>())
+            {
+                throw std::invalid_argument("The element type of the disk index file is different. ");
+            }
+
+            this->dimension = header.dimension;
+            this->space_metric = Space::Metric(header.space_metric);
+            this->vertex_number = header.vertex_number;
+            this->sector_size = header.sector_size;
+            this->degree = header.degree;
+
+            if (this->dimension == 0 || this->vertex_number == 0 ||
+                this->sector_size != Disk_Format::Sector_Size<Element>(this->dimension, this->degree) ||
+                std::numeric_limits<uint64_t>::max() / this->sector_size <= this->vertex_number)
+            {
+                throw std::runtime_error("The disk index file is truncated or corrupted. ");
+            }
+
+            // 检查距离计算函数是否支持这种度量
+            Space::get_similarity<Element>(this->space_metric, this->isa);
+
+            // 常驻内存的部分
+            auto stream = std::ifstream(path, std::ios::in | std::ios::binary);
+
+            stream.seekg((this->vertex_number + 1) * this->sector_size);
+
+            if (!stream)
+            {
+                throw std::runtime_error("The disk index file is truncated or corrupted. ");
+            }
+
+            auto vertices = Format::Section(stream);
+            const auto *ids = vertices.array<ID>(this->vertex_number);
+            const auto *flags = vertices.array<uint8_t>(this->vertex_number);
+
+            this->ids.assign(ids, ids + this->vertex_number);
+            this->flags.assign(flags, flags + this->vertex_number);
+
+            auto quantization = Format::Section(stream);
+            const auto subspace_number = quantization.value<uint64_t>();
+            const auto bits = quantization.value<uint64_t>();
+            const auto centroid_number = quantization.value<uint64_t>();
+
+            this->quantizer = Quantization::Product_Quantizer(this->dimension, subspace_number, bits);
+
+            const auto *centroids = quantization.array<float>(centroid_number);
+            const auto *codes = quantization.array<uint8_t>(this->vertex_number * this->quantizer.code_size);
+
+            this->quantizer.centroids.assign(centroids, centroids + centroid_number);
+            this->codes.assign(codes, codes + this->vertex_number * this->quantizer.code_size);
+
+            // 零点的邻居
+            const auto position = this->sector_size;
+
+            data = buffer.reserve(this->sector_size);
+
+            if (pread(this->file, data, this->sector_size, position) != this->sector_size)
+            {
+                throw std::runtime_error("The disk index file is truncated or corrupted. ");
+            }
+
+            const auto neighbor_number = Disk_Format::Neighbor_Number(data, this->degree, this->vertex_number);
+
+            this->entry.resize(neighbor_number);
+            std::memcpy(this->entry.data(), data + sizeof(uint64_t), neighbor_number * sizeof(Offset));
+        }
+    };
+
+    // 选择保存在磁盘上的邻居
+    //
+    // 先取保持连通的边，再把短的出边和入边按边长从短到长加入，最后取长的出边，去掉重复的邻居，最多保留 degree 个
+    template <typename Element>
+    inline void Disk_Neighbors(const Index<Element> &index, const Offset offset, const uint64_t degree,
+                               std::vector<Offset> &neighbors)
+    {
+        const auto &vector = index.vectors[offset];
+        auto selected = std::unordered_set<Offset>();
+        auto short_edges = std::vector<std::pair<float, Offset>>();
+
+        auto add = [&](const Offset neighbor_offset)
+        {
+            if (neighbors.size() < degree && selected.insert(neighbor_offset).second)
+            {
+                neighbors.push_back(neighbor_offset);
+            }
+        };
+
+        neighbors.clear();
+
+        for (auto iterator = vector.keep_connected.begin(); iterator != vector.keep_connected.end(); ++iterator)
+        {
+            add(*iterator);
+        }
+
+        for (auto iterator = vector.short_edge_out.begin(); iterator != vector.short_edge_out.end(); ++iterator)
+        {
+            short_edges.push_back({iterator->first, iterator->second});
+        }
+
+        for (auto iterator = vector.short_edge_in.begin(); iterator != vector.short_edge_in.end(); ++iterator)
+        {
+            short_edges.push_back({iterator->second, iterator->first});
+        }
+
+        std::sort(short_edges.begin(), short_edges.end());
+
+        for (auto i = 0; i < short_edges.size(); ++i)
+        {
+            add(short_edges[i].second);
+        }
+
+        for (auto iterator = vector.long_edge_out.begin(); iterator != vector.long_edge_out.end(); ++iterator)
+        {
+            add(iterator->first);
+        }
+    }
+
+    // 把索引写成保存在磁盘上的格式
+    //
+    // 写入前必须训练乘积量化器，编码常驻内存用于查询时选择扇区
+    template <typename Element>
+    inline void Write_Disk(const Index<Element> &index, const std::string &path, const uint64_t degree)
+    {
+        if (index.serving)
+        {
+            throw std::logic_error("Write_Disk cannot be called while concurrent search is enabled. ");
+        }
+
+        if (!index.quantizer.trained())
+        {
+            throw std::logic_error("The quantizer must be trained before writing a disk index. ");
+        }
+
+        if (degree == 0)
+        {
+            throw std::invalid_argument("The degree of a disk index must be positive. ");
+        }
+
+        const auto &dimension = index.parameters.dimension;
+        const auto vertex_number = index.vectors.size();
+        const auto sector_size = Disk_Format::Sector_Size<Element>(dimension, degree);
+        auto header = Disk_Format::Header();
+
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, Disk_Format::magic, sizeof(header.magic));
+        header.version = Disk_Format::version;
+        header.element_code = Format::element_code<Element>();
+        header.space_metric = uint64_t(index.parameters.space_metric);
+        header.dimension = dimension;
+        header.vertex_number = vertex_number;
+        header.sector_size = sector_size;
+        header.degree = degree;
+        header.checksum = header.compute_checksum();
+
+        auto writer = Format::Writer(path);
+        auto sector = std::vector<char>(sector_size, 0);
+        auto neighbors = std::vector<Offset>();
+        auto ids = std::vector<ID>(vertex_number);
+        auto flags = std::vector<uint8_t>(vertex_number);
+
+        std::memcpy(sector.data(), &header, sizeof(header));
+        writer.raw(sector.data(), sector_size);
+
+        // 每个顶点一个扇区，零点和被删除的位置的向量为 0
+        for (auto offset = 0; offset < vertex_number; ++offset)
+        {
+            const auto &vector = index.vectors[offset];
+            const auto has_data = offset != 0 && vector.data != nullptr;
+
+            ids[offset] = vector.id;
+            flags[offset] = (has_data ? Disk_Format::has_data : 0) | (vector.deleted ? Disk_Format::deleted : 0);
+
+            Disk_Neighbors(index, offset, degree, neighbors);
+            std::fill(sector.begin(), sector.end(), 0);
+
+            const uint64_t neighbor_number = neighbors.size();
+            auto *vector_data = sector.data() + sizeof(uint64_t) + degree * sizeof(Offset);
+
+            std::memcpy(sector.data(), &neighbor_number, sizeof(neighbor_number));
+            std::memcpy(sector.data() + sizeof(uint64_t), neighbors.data(), neighbor_number * sizeof(Offset));
+
+            if (has_data)
+            {
+                std::memcpy(vector_data, vector.data, dimension * sizeof(Element));
+            }
+
+            writer.raw(sector.data(), sector_size);
+        }
+
+        // 常驻内存的部分
+        writer.begin(Format::array_size<ID>(vertex_number) + Format::array_size<uint8_t>(vertex_number));
+        writer.array(ids.data(), vertex_number);
+        writer.array(flags.data(), vertex_number);
+        writer.end();
+
+        const auto &quantizer = index.quantizer;
+
+        writer.begin(3 * 8 + Format::array_size<float>(quantizer.centroids.size()) +
+                     Format::array_size<uint8_t>(index.codes.size()));
+        writer.value(quantizer.subspace_number);
+        writer.value(quantizer.bits);
+        writer.value(uint64_t(quantizer.centroids.size()));
+        writer.array(quantizer.centroids.data(), quantizer.centroids.size());
+        writer.array(index.codes.data(), index.codes.size());
+        writer.end();
+        writer.flush();
+    }
+
+    // 读取 number 个顶点的扇区，第 i 个顶点读到 buffer + i * sector_size
+    //
+    // 优先使用调用的线程的 io_uring 队列一次提交，不可用时由默认线程池中的线程同时调用 pread
+    template <typename Element>
+    inline void Read_Sectors(const Disk_Index<Element> &index, const Offset *const offsets, const uint64_t number,
+                             char *const buffer)
+    {
+        const auto &sector_size = index.sector_size;
+
+#if defined(HSG_IO_URING)
+        if (index.io_uring)
+        {
+            auto &ring = Local_Ring();
+
+            if (ring.valid())
+            {
+                auto positions = std::vector<uint64_t>(number);
+
+                for (auto i = 0; i < number; ++i)
+                {
+                    positions[i] = (offsets[i] + 1) * sector_size;
+                }
+
+                ring.read(index.file, positions.data(), number, buffer, sector_size);
+
+                return;
+            }
+        }
+#endif
+
+        auto failed = std::atomic<bool>(false);
+
+        Parallel::For(0, number, number,
+                      [&](const uint64_t i)
+                      {
+                          const auto position = (offsets[i] + 1) * sector_size;
+
+                          if (pread(index.file, buffer + i * sector_size, sector_size, position) != sector_size)
+                          {
+                              failed = true;
+                          }
+                      });
+
+        if (failed)
+        {
+            throw std::runtime_error("Failed to read the disk index. ");
+        }
+    }
+
+    // 用乘积量化的编码计算 pool 中的向量和查询向量的近似距离
+    template <typename Element>
+    inline void Similarity_Quantized(const Disk_Index<Element> &index, Quantization::Query_Table &query_table,
+                                     const std::vector<Offset> &pool, std::vector<float> &distances)
+    {
+        const auto &code_size = index.quantizer.code_size;
+        const auto *codes = index.codes.data();
+
+        distances.resize(pool.size());
+
+        if (index.quantizer.bits == 8)
+        {
+            for (auto i = 0; i < pool.size(); ++i)
+            {
+                distances[i] = Quantization::Distance(index.quantizer, query_table, codes + pool[i] * code_size);
+            }
+
+            return;
+        }
+
+        auto addresses = std::vector<const uint8_t *>(pool.size(), nullptr);
+
+        for (auto i = 0; i < pool.size(); ++i)
+        {
+            addresses[i] = codes + pool[i] * code_size;
+        }
+
+        Quantization::Fast_Scan(index.quantizer, query_table, addresses.data(), pool.size());
+        std::copy_n(query_table.distances.begin(), pool.size(), distances.begin());
+    }
+
+    // 在磁盘上的索引中查询距离目标向量最近的top-k个向量
+    //
+    // 候选按近似距离排序，最多保留 top_k + magnification 个，每一步读取最近的 beam_width 个没有展开的候选的扇区，
+    // 用扇区中的原始向量计算精确距离加入结果，再用近似距离把扇区中的邻居加入候选，直到所有候选都展开
+    template <typename Element, typename Distance>
+    inline std::priority_queue<std::pair<float, ID>> Search(const Disk_Index<Element> &index,
+                                                            const Space::Input_Type<Element> *const target_vector,
+                                                            const uint64_t top_k, const uint64_t magnification,
+                                                            const Distance &distance)
+    {
+        const auto candidate_number = top_k + magnification;
+        const auto beam_width = std::max<uint64_t>(index.beam_width, 1);
+        auto nearest_neighbors = std::priority_queue<std::pair<float, ID>>();
+        auto query_table = Quantization::Query_Table();
+
+        Quantization::Compute_Table(index.quantizer, target_vector, query_table);
+
+        // 候选按近似距离从小到大排列，second 为 true 时已经展开
+        auto candidates = std::vector<std::pair<std::pair<float, Offset>, bool>>();
+        // 十亿规模的索引中每次查询只访问很少的顶点，所以用哈希表标记
+        auto visited = std::unordered_set<Offset>();
+        auto pool = std::vector<Offset>();
+        auto distances = std::vector<float>();
+        auto beam = std::vector<Offset>();
+        // 每次查询使用自己的缓冲区，pread 在线程池中等待时当前线程可能执行另一个查询
+        auto buffer = Disk_Format::Buffer();
+        auto *sectors = buffer.reserve(beam_width * index.sector_size);
+
+        // 把 pool 中的向量按近似距离加入候选
+        auto insert = [&]()
+        {
+            Similarity_Quantized(index, query_table, pool, distances);
+
+            for (auto i = 0; i < pool.size(); ++i)
+            {
+                const auto candidate = std::make_pair(std::make_pair(distances[i], pool[i]), false);
+
+                if (candidates.size() == candidate_number && candidates.back().first <= candidate.first)
+                {
+                    continue;
+                }
+
+                candidates.insert(std::upper_bound(candidates.begin(), candidates.end(), candidate), candidate);
+
+                if (candidate_number < candidates.size())
+                {
+                    candidates.pop_back();
+                }
+            }
+
+            pool.clear();
+        };
+
+        visited.insert(0);
+
+        for (auto i = 0; i < index.entry.size(); ++i)
+        {
+            if (visited.insert(index.entry[i]).second)
+            {
+                pool.push_back(index.entry[i]);
+            }
+        }
+
+        insert();
+
+        while (true)
+        {
+            beam.clear();
+
+            for (auto i = 0; i < candidates.size() && beam.size() < beam_width; ++i)
+            {
+                if (!candidates[i].second)
+                {
+                    candidates[i].second = true;
+                    beam.push_back(candidates[i].first.second);
+                }
+            }
+
+            if (beam.empty())
+            {
+                break;
+            }
+
+            Read_Sectors(index, beam.data(), beam.size(), sectors);
+
+            for (auto i = 0; i < beam.size(); ++i)
+            {
+                const auto processing_offset = beam[i];
+                const auto *sector = sectors + i * index.sector_size;
+                const auto *neighbors = reinterpret_cast<const Offset *>(sector + sizeof(uint64_t));
+                const auto *vector_data =
+                    reinterpret_cast<const Element *>(sector + sizeof(uint64_t) + index.degree * sizeof(Offset));
+                const auto neighbor_number = Disk_Format::Neighbor_Number(sector, index.degree, index.vertex_number);
+
+                // 标记删除的向量只用于路由，不加入结果
+                if ((index.flags[processing_offset] & Disk_Format::deleted) == 0)
+                {
+                    const auto processing_distance = distance(target_vector, vector_data, index.dimension);
+
+                    if (nearest_neighbors.size() < candidate_number)
+                    {
+                        nearest_neighbors.push({processing_distance, index.ids[processing_offset]});
+                    }
+                    else if (processing_distance < nearest_neighbors.top().first)
+                    {
+                        nearest_neighbors.pop();
+                        nearest_neighbors.push({processing_distance, index.ids[processing_offset]});
+                    }
+                }
+
+                for (auto j = 0; j < neighbor_number; ++j)
+                {
+                    if (visited.insert(neighbors[j]).second)
+                    {
+                        pool.push_back(neighbors[j]);
+                    }
+                }
+            }
+
+            insert();
+        }
+
+        return nearest_neighbors;
+    }
+
+    // 在磁盘上的索引中查询距离目标向量最近的top-k个向量
+    template <typename Element>
+    inline std::priority_queue<std::pair<float, ID>> Search(const Disk_Index<Element> &index,
+                                                            const Space::Input_Type<Element> *const target_vector,
+                                                            const uint64_t top_k, const uint64_t magnification)
+    {
+        auto buffer = std::vector<Space::Input_Type<Element>>();
+        const auto *query_vector = Get_Query(index.space_metric, index.dimension, target_vector, buffer);
+
+        return Space::dispatch<Element>(index.isa, index.space_metric, index.dimension,
+                                        [&](const auto &distance)
+                                        { return Search(index, query_vector, top_k, magnification, distance); });
+    }
+
+    // 批量查询
+    //
+    // targets 中依次存放 number 个目标向量，由默认线程池中的 thread_number 个线程同时查询
+    template <typename Element>
+    inline std::vector<std::priority_queue<std::pair<float, ID>>> Search_Batch(
+        const Disk_Index<Element> &index, const Space::Input_Type<Element> *const targets, const uint64_t number,
+        const uint64_t top_k, const uint64_t magnification, const uint64_t thread_number)
+    {
+        auto results = std::vector<std::priority_queue<std::pair<float, ID>>>(number);
+        // 损坏的扇区在查询时才能发现，线程池中的第一个异常在所有查询结束后重新抛出
+        auto failed = std::atomic<bool>(false);
+        auto error = std::exception_ptr();
+
+        Parallel::For(0, number, thread_number,
+                      [&](const uint64_t i)
+                      {
+                          try
+                          {
+                              results[i] = Search(index, targets + i * index.dimension, top_k, magnification);
+                          }
+                          catch (...)
+                          {
+                              if (!failed.exchange(true))
+                              {
+                                  error = std::current_exception();
+                              }
+                          }
+                      });
+
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+
+        return results;
+    }
+
+} // namespace HSG
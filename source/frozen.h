@@ -0,0 +1,639 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "HSG.h"
+#include "serialization.h"
+
+namespace HSG
+{
+
+    // 冻结的索引的文件格式
+    //
+    // 文件头之后是按页对齐的扁平数组，映射到内存后不需要解析就可以直接查询，
+    // 多个进程映射同一个文件时共用页缓存中的同一份数据
+    //
+    // 短边的邻居按查询时遍历的顺序合并出边、入边和保持连通的边，保持连通的边没有长度，记为 -1
+    namespace Frozen_Format
+    {
+        // 文件开头的标识
+        constexpr char magic[8] = {'H', 'S', 'G', 'F', 'R', 'O', 'Z', 'N'};
+        // 格式的版本，格式改变时增加
+        constexpr uint64_t version = 1;
+        // 数组的对齐
+        constexpr uint64_t alignment = 4096;
+        // 顶点的标记
+        constexpr uint8_t has_data = 1;
+        constexpr uint8_t deleted = 2;
+
+        // 文件头
+        //
+        // 各个数组的位置为距离文件开头的字节数
+        class Header
+        {
+          public:
+            char magic[8];
+            uint64_t version;
+            uint64_t element_code;
+            uint64_t space_metric;
+            uint64_t dimension;
+            uint64_t vertex_number;
+            uint64_t short_number;
+            uint64_t long_number;
+            uint64_t ids;
+            uint64_t zeros;
+            uint64_t flags;
+            uint64_t short_begins;
+            uint64_t short_targets;
+            uint64_t short_lengths;
+            uint64_t long_begins;
+            uint64_t long_targets;
+            uint64_t vectors;
+            uint64_t size;
+            // 上面所有字段的校验和
+            uint64_t checksum;
+
+            uint64_t compute_checksum() const
+            {
+                auto checksum = Format::Checksum();
+
+                checksum.update(reinterpret_cast<const char *>(this), offsetof(Header, checksum));
+
+                return checksum.value();
+            }
+        };
+
+        inline uint64_t Align(const uint64_t position)
+        {
+            return (position + alignment - 1) / alignment * alignment;
+        }
+
+    } // namespace Frozen_Format
+
+    // 映射冻结的索引时的预热方式
+    enum class Advice
+    {
+        // 按需读入
+        Normal,
+        // 查询时随机访问，关闭预读
+        Random,
+        // 建议内核在后台读入整个文件
+        Will_Need,
+        // 映射时读入整个文件，之后的查询不会缺页
+        Populate
+    };
+
+    // 冻结的索引
+    //
+    // 只读地映射 Freeze 写出的文件，查询直接访问映射的内存
+    template <typename Element = float>
+    class Frozen_Index
+    {
+      public:
+        // 向量的维度
+        uint64_t dimension;
+        // 距离类型
+        Space::Metric space_metric;
+        // 查询时使用的指令集
+        Space::ISA isa;
+        // 顶点的数量，包括零点
+        uint64_t vertex_number;
+        // 映射的内存
+        void *address;
+        uint64_t size;
+        // 每个顶点的 id、到零点的距离和标记
+        const ID *ids;
+        const float *zeros;
+        const uint8_t *flags;
+        // 短边，第 i 个顶点的邻居为 [short_begins[i], short_begins[i + 1])
+        const uint64_t *short_begins;
+        const uint64_t *short_targets;
+        const float *short_lengths;
+        // 长的出边
+        const uint64_t *long_begins;
+        const uint64_t *long_targets;
+        // 向量数据
+        //
+        // vectors[offset * dimension]，零点和被删除的位置为 0
+        const Element *vectors;
+
+        explicit Frozen_Index(const std::string &path, const Advice advice = Advice::Normal)
+            : dimension(0), space_metric(Space::Metric::Euclidean2), isa(Space::get_isa()), vertex_number(0),
+              address(nullptr), size(0)
+        {
+#if defined(__unix__)
+            const auto file = open(path.c_str(), O_RDONLY);
+
+            if (file < 0)
+            {
+                throw std::runtime_error("Cannot open '" + path + "' for reading. ");
+            }
+
+            struct stat status = {};
+
+            if (fstat(file, &status) != 0 || uint64_t(status.st_size) < sizeof(Frozen_Format::Header))
+            {
+                close(file);
+                throw std::runtime_error("'" + path + "' is not a frozen index file. ");
+            }
+
+            this->size = status.st_size;
+
+            auto flags = MAP_SHARED;
+
+#if defined(MAP_POPULATE)
+            if (advice == Advice::Populate)
+            {
+                flags |= MAP_POPULATE;
+            }
+#endif
+
+            this->address = mmap(nullptr, this->size, PROT_READ, flags, file, 0);
+            close(file);
+
+            if (this->address == MAP_FAILED)
+            {
+                this->address = nullptr;
+                throw std::runtime_error("Cannot map '" + path + "'. ");
+            }
+
+            if (advice == Advice::Random)
+            {
+                madvise(this->address, this->size, MADV_RANDOM);
+            }
+            else if (advice == Advice::Will_Need)
+            {
+                madvise(this->address, this->size, MADV_WILLNEED);
+            }
+#else
+            throw std::logic_error("Memory mapped indexes are only supported on Unix. ");
+#endif
+
+            try
+            {
+                this->check();
+            }
+            catch (...)
+            {
+                this->unmap();
+                throw;
+            }
+        }
+
+        Frozen_Index(const Frozen_Index &) = delete;
+        Frozen_Index &operator=(const Frozen_Index &) = delete;
+
+        ~Frozen_Index()
+        {
+            this->unmap();
+        }
+
+        void unmap()
+        {
+#if defined(__unix__)
+            if (this->address != nullptr)
+            {
+                munmap(this->address, this->size);
+                this->address = nullptr;
+            }
+#endif
+        }
+
+        // 检查文件头和邻接表并设置各个数组的地址
+        //
+        // 映射时遍历一次邻接表，损坏的文件在打开时就报错，而不是在查询时越界访问
+        void check()
+        {
+            const auto &header = *static_cast<const Frozen_Format::Header *>(this->address);
+            const auto *base = static_cast<const char *>(this->address);
+
+            if (std::memcmp(header.magic, Frozen_Format::magic, sizeof(header.magic)) != 0 ||
+                header.checksum != header.compute_checksum() || header.size != this->size)
+            {
+                throw std::runtime_error("The frozen index file is truncated or corrupted. ");
+            }
+
+            if (header.version != Frozen_Format::version)
+            {
+                throw std::runtime_error("The version of the frozen index file is not supported. ");
+            }
+
+            if (header.element_code != Format::element_code<Element>())
+            {
+                throw std::invalid_argument("The element type of the frozen index file is different. ");
+            }
+
+            // 每个数组都必须对齐并且完整地位于文件中
+            auto inside = [&](const uint64_t position, const uint64_t number, const uint64_t element_size)
+            {
+                return position % Frozen_Format::alignment == 0 && position <= this->size &&
+                       number <= (this->size - position) / element_size;
+            };
+
+            const auto &vertex_number = header.vertex_number;
+
+            if (header.dimension == 0 || vertex_number == 0 || vertex_number == std::numeric_limits<uint64_t>::max() ||
+                !inside(header.ids, vertex_number, sizeof(ID)) || !inside(header.zeros, vertex_number, sizeof(float)) ||
+                !inside(header.flags, vertex_number, sizeof(uint8_t)) ||
+                !inside(header.short_begins, vertex_number + 1, sizeof(uint64_t)) ||
+                !inside(header.short_targets, header.short_number, sizeof(uint64_t)) ||
+                !inside(header.short_lengths, header.short_number, sizeof(float)) ||
+                !inside(header.long_begins, vertex_number + 1, sizeof(uint64_t)) ||
+                !inside(header.long_targets, header.long_number, sizeof(uint64_t)) ||
+                vertex_number > std::numeric_limits<uint64_t>::max() / header.dimension / sizeof(Element) ||
+                !inside(header.vectors, vertex_number * header.dimension, sizeof(Element)))
+            {
+                throw std::runtime_error("The frozen index file is truncated or corrupted. ");
+            }
+
+            // 查询时直接用邻接表中的位置访问其他数组，所以边的范围必须单调并且邻居必须是有效的位置
+            auto valid_edges = [&](const uint64_t *begins, const uint64_t *targets, const uint64_t edge_number)
+            {
+                if (begins[0] != 0 || begins[vertex_number] != edge_number)
+                {
+                    return false;
+                }
+
+                for (auto offset = 0; offset < vertex_number; ++offset)
+                {
+                    if (begins[offset + 1] < begins[offset])
+                    {
+                        return false;
+                    }
+                }
+
+                for (auto i = 0; i < edge_number; ++i)
+                {
+                    if (vertex_number <= targets[i])
+                    {
+                        return false;
+                    }
+                }
+
+                return true;
+            };
+
+            if (!valid_edges(reinterpret_cast<const uint64_t *>(base + header.short_begins),
+                             reinterpret_cast<const uint64_t *>(base + header.short_targets), header.short_number) ||
+                !valid_edges(reinterpret_cast<const uint64_t *>(base + header.long_begins),
+                             reinterpret_cast<const uint64_t *>(base + header.long_targets), header.long_number))
+            {
+                throw std::runtime_error("The frozen index file is corrupted. ");
+            }
+
+            this->dimension = header.dimension;
+            this->space_metric = Space::Metric(header.space_metric);
+            this->vertex_number = header.vertex_number;
+            this->ids = reinterpret_cast<const ID *>(base + header.ids);
+            this->zeros = reinterpret_cast<const float *>(base + header.zeros);
+            this->flags = reinterpret_cast<const uint8_t *>(base + header.flags);
+            this->short_begins = reinterpret_cast<const uint64_t *>(base + header.short_begins);
+            this->short_targets = reinterpret_cast<const uint64_t *>(base + header.short_targets);
+            this->short_lengths = reinterpret_cast<const float *>(base + header.short_lengths);
+            this->long_begins = reinterpret_cast<const uint64_t *>(base + header.long_begins);
+            this->long_targets = reinterpret_cast<const uint64_t *>(base + header.long_targets);
+            this->vectors = reinterpret_cast<const Element *>(base + header.vectors);
+
+            // 检查距离计算函数是否支持这种度量
+            Space::get_similarity<Element>(this->space_metric, this->isa);
+        }
+    };
+
+    // 把索引写成可以直接映射的冻结格式
+    //
+    // 冻结的索引只能查询，不使用量化编码和草图
+    template <typename Element>
+    inline void Freeze(const Index<Element> &index, const std::string &path)
+    {
+        if (index.serving)
+        {
+            throw std::logic_error("Freeze cannot be called while concurrent search is enabled. ");
+        }
+
+        const auto &dimension = index.parameters.dimension;
+        const auto vertex_number = index.vectors.size();
+        auto ids = std::vector<ID>(vertex_number);
+        auto zeros = std::vector<float>(vertex_number);
+        auto flags = std::vector<uint8_t>(vertex_number);
+        auto short_begins = std::vector<uint64_t>(vertex_number + 1, 0);
+        auto short_targets = std::vector<uint64_t>();
+        auto short_lengths = std::vector<float>();
+        auto long_begins = std::vector<uint64_t>(vertex_number + 1, 0);
+        auto long_targets = std::vector<uint64_t>();
+        auto last = std::vector<uint64_t>(vertex_number, std::numeric_limits<uint64_t>::max());
+
+        for (auto offset = 0; offset < vertex_number; ++offset)
+        {
+            const auto &vector = index.vectors[offset];
+
+            // 和 Get_Pool_From_SE 的遍历顺序相同，重复的邻居只保留第一次出现
+            auto add = [&](const Offset neighbor_offset, const float length)
+            {
+                if (last[neighbor_offset] != offset)
+                {
+                    last[neighbor_offset] = offset;
+                    short_targets.push_back(neighbor_offset);
+                    short_lengths.push_back(length);
+                }
+            };
+
+            ids[offset] = vector.id;
+            zeros[offset] = vector.zero;
+            flags[offset] = vector.deleted ? Frozen_Format::deleted : 0;
+
+            if (offset != 0 && vector.data != nullptr)
+            {
+                flags[offset] |= Frozen_Format::has_data;
+            }
+
+            for (auto iterator = vector.short_edge_out.begin(); iterator != vector.short_edge_out.end(); ++iterator)
+            {
+                add(iterator->second, iterator->first);
+            }
+
+            for (auto iterator = vector.short_edge_in.begin(); iterator != vector.short_edge_in.end(); ++iterator)
+            {
+                add(iterator->first, iterator->second);
+            }
+
+            for (auto iterator = vector.keep_connected.begin(); iterator != vector.keep_connected.end(); ++iterator)
+            {
+                add(*iterator, -1);
+            }
+
+            for (auto iterator = vector.long_edge_out.begin(); iterator != vector.long_edge_out.end(); ++iterator)
+            {
+                long_targets.push_back(iterator->first);
+            }
+
+            short_begins[offset + 1] = short_targets.size();
+            long_begins[offset + 1] = long_targets.size();
+        }
+
+        // 计算各个数组的位置
+        auto header = Frozen_Format::Header();
+        uint64_t position = Frozen_Format::Align(sizeof(header));
+
+        auto place = [&](uint64_t &field, const uint64_t bytes)
+        {
+            field = position;
+            position = Frozen_Format::Align(position + bytes);
+        };
+
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, Frozen_Format::magic, sizeof(header.magic));
+        header.version = Frozen_Format::version;
+        header.element_code = Format::element_code<Element>();
+        header.space_metric = uint64_t(index.parameters.space_metric);
+        header.dimension = dimension;
+        header.vertex_number = vertex_number;
+        header.short_number = short_targets.size();
+        header.long_number = long_targets.size();
+        place(header.ids, vertex_number * sizeof(ID));
+        place(header.zeros, vertex_number * sizeof(float));
+        place(header.flags, vertex_number * sizeof(uint8_t));
+        place(header.short_begins, (vertex_number + 1) * sizeof(uint64_t));
+        place(header.short_targets, short_targets.size() * sizeof(uint64_t));
+        place(header.short_lengths, short_lengths.size() * sizeof(float));
+        place(header.long_begins, (vertex_number + 1) * sizeof(uint64_t));
+        place(header.long_targets, long_targets.size() * sizeof(uint64_t));
+        place(header.vectors, vertex_number * dimension * sizeof(Element));
+        header.size = position;
+        header.checksum = header.compute_checksum();
+
+        auto writer = Format::Writer(path);
+        uint64_t written = 0;
+        const auto zero_page = std::vector<char>(Frozen_Format::alignment, 0);
+
+        // 写入数组并补齐到下一个数组的位置
+        auto write = [&](const uint64_t field, const void *data, const uint64_t bytes)
+        {
+            writer.raw(zero_page.data(), field - written);
+            writer.raw(data, bytes);
+            written = field + bytes;
+        };
+
+        write(0, &header, sizeof(header));
+        write(header.ids, ids.data(), vertex_number * sizeof(ID));
+        write(header.zeros, zeros.data(), vertex_number * sizeof(float));
+        write(header.flags, flags.data(), vertex_number * sizeof(uint8_t));
+        write(header.short_begins, short_begins.data(), (vertex_number + 1) * sizeof(uint64_t));
+        write(header.short_targets, short_targets.data(), short_targets.size() * sizeof(uint64_t));
+        write(header.short_lengths, short_lengths.data(), short_lengths.size() * sizeof(float));
+        write(header.long_begins, long_begins.data(), (vertex_number + 1) * sizeof(uint64_t));
+        write(header.long_targets, long_targets.data(), long_targets.size() * sizeof(uint64_t));
+
+        // 向量逐个写入，零点和被删除的位置写入 0
+        const auto empty_vector = std::vector<Element>(dimension, Element());
+
+        write(header.vectors, empty_vector.data(), dimension * sizeof(Element));
+
+        for (auto offset = 1; offset < vertex_number; ++offset)
+        {
+            const auto *data = (flags[offset] & Frozen_Format::has_data) != 0 ? index.vectors[offset].data
+                                                                               : empty_vector.data();
+
+            writer.raw(data, dimension * sizeof(Element));
+        }
+
+        written = header.vectors + vertex_number * dimension * sizeof(Element);
+        writer.raw(zero_page.data(), header.size - written);
+        writer.flush();
+    }
+
+    // 从冻结的索引的短边获取计算池
+    //
+    // bound 为正无穷时不剪枝，其余和 Get_Pool_From_SE 相同
+    template <typename Element>
+    inline void Get_Pool_From_SE(const Frozen_Index<Element> &index, const Offset processing_offset,
+                                 const float processing_distance, const float query_root, const float bound,
+                                 std::vector<bool> &visited, std::vector<Offset> &pool)
+    {
+        const auto processing_root = std::sqrt(processing_distance);
+        const auto prunable = bound != std::numeric_limits<float>::infinity();
+
+        for (auto i = index.short_begins[processing_offset]; i < index.short_begins[processing_offset + 1]; ++i)
+        {
+            const auto neighbor_offset = index.short_targets[i];
+            const auto length = index.short_lengths[i];
+
+            if (visited[neighbor_offset])
+            {
+                continue;
+            }
+
+            visited[neighbor_offset] = true;
+
+            if (prunable && 0 <= length)
+            {
+                auto edge_bound = processing_root - std::sqrt(length);
+                edge_bound *= edge_bound;
+
+                auto norm_bound = 0.0F;
+
+                if (index.space_metric == Space::Metric::Euclidean2)
+                {
+                    norm_bound = query_root - std::sqrt(index.zeros[neighbor_offset]);
+                    norm_bound *= norm_bound;
+                }
+
+                if (bound < std::max(edge_bound, norm_bound))
+                {
+                    continue;
+                }
+            }
+
+            pool.push_back(neighbor_offset);
+        }
+    }
+
+    template <typename Element>
+    inline void Get_Pool_From_LEO(const Frozen_Index<Element> &index, const Offset processing_offset,
+                                  std::vector<bool> &visited, std::vector<Offset> &pool)
+    {
+        for (auto i = index.long_begins[processing_offset]; i < index.long_begins[processing_offset + 1]; ++i)
+        {
+            const auto neighbor_offset = index.long_targets[i];
+
+            if (!visited[neighbor_offset])
+            {
+                visited[neighbor_offset] = true;
+                pool.push_back(neighbor_offset);
+            }
+        }
+    }
+
+    template <typename Element, typename Distance>
+    inline void Similarity(const Frozen_Index<Element> &index, const Space::Input_Type<Element> *const target_vector,
+                           std::vector<Offset> &pool,
+                           std::priority_queue<std::pair<float, Offset>, std::vector<std::pair<float, Offset>>,
+                                               std::greater<>> &waiting_vectors,
+                           const Distance &distance)
+    {
+        for (auto i = 0; i < pool.size(); ++i)
+        {
+            if (i + 1 < pool.size())
+            {
+                Prefetch(index.vectors + pool[i + 1] * index.dimension);
+            }
+
+            waiting_vectors.push(
+                {distance(target_vector, index.vectors + pool[i] * index.dimension, index.dimension), pool[i]});
+        }
+
+        pool.clear();
+    }
+
+    // 在冻结的索引中查询距离目标向量最近的top-k个向量
+    //
+    // 和 Index 的查询相同，先沿长边接近目标向量，再沿短边查找
+    template <typename Element, typename Distance>
+    inline std::priority_queue<std::pair<float, ID>> Search(const Frozen_Index<Element> &index,
+                                                            const Space::Input_Type<Element> *const target_vector,
+                                                            const uint64_t top_k, const uint64_t magnification,
+                                                            const Distance &distance)
+    {
+        const auto infinity = std::numeric_limits<float>::infinity();
+        auto nearest_neighbors = std::priority_queue<std::pair<float, ID>>();
+        auto visited = std::vector<bool>(index.vertex_number, false);
+        auto waiting_vectors =
+            std::priority_queue<std::pair<float, Offset>, std::vector<std::pair<float, Offset>>, std::greater<>>();
+        auto pool = std::vector<Offset>();
+
+        visited[0] = true;
+
+        // 阶段一
+        // 利用长边接近目标向量
+        for (Offset processing_offset = 0;; processing_offset = waiting_vectors.top().second)
+        {
+            Get_Pool_From_SE(index, processing_offset, 0, 0, infinity, visited, pool);
+            Similarity(index, target_vector, pool, waiting_vectors, distance);
+
+            if (waiting_vectors.empty())
+            {
+                return nearest_neighbors;
+            }
+
+            const auto short_offset = waiting_vectors.top().second;
+
+            Get_Pool_From_LEO(index, processing_offset, visited, pool);
+            Similarity(index, target_vector, pool, waiting_vectors, distance);
+
+            if (short_offset == waiting_vectors.top().second)
+            {
+                break;
+            }
+        }
+
+        const auto prunable =
+            index.space_metric == Space::Metric::Euclidean2 || index.space_metric == Space::Metric::Cosine_Similarity;
+        const auto query_root = prunable ? std::sqrt(Space::Euclidean2::zero(target_vector, index.dimension)) : 0.0F;
+
+        // 阶段二
+        // 查找与目标向量距离最近的top-k个向量
+        while (!waiting_vectors.empty())
+        {
+            const auto [processing_distance, processing_offset] = waiting_vectors.top();
+            const auto deleted = (index.flags[processing_offset] & Frozen_Format::deleted) != 0;
+
+            waiting_vectors.pop();
+
+            if (nearest_neighbors.size() < top_k + magnification)
+            {
+                if (!deleted)
+                {
+                    nearest_neighbors.push({processing_distance, index.ids[processing_offset]});
+                }
+            }
+            else if (processing_distance < nearest_neighbors.top().first)
+            {
+                if (!deleted)
+                {
+                    nearest_neighbors.pop();
+                    nearest_neighbors.push({processing_distance, index.ids[processing_offset]});
+                }
+            }
+            else
+            {
+                break;
+            }
+
+            const auto full = nearest_neighbors.size() == top_k + magnification;
+
+            Get_Pool_From_SE(index, processing_offset, processing_distance, query_root,
+                             prunable && full ? nearest_neighbors.top().first : infinity, visited, pool);
+            Similarity(index, target_vector, pool, waiting_vectors, distance);
+        }
+
+        return nearest_neighbors;
+    }
+
+    // 在冻结的索引中查询距离目标向量最近的top-k个向量
+    template <typename Element>
+    inline std::priority_queue<std::pair<float, ID>> Search(const Frozen_Index<Element> &index,
+                                                            const Space::Input_Type<Element> *const target_vector,
+                                                            const uint64_t top_k, const uint64_t magnification)
+    {
+        auto buffer = std::vector<Space::Input_Type<Element>>();
+        const auto *query_vector = Get_Query(index.space_metric, index.dimension, target_vector, buffer);
+
+        return Space::dispatch<Element>(index.isa, index.space_metric, index.dimension,
+                                        [&](const auto &distance)
+                                        { return Search(index, query_vector, top_k, magnification, distance); });
+    }
+
+} // namespace HSG
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "parallel.h"
+
+namespace KNN
+{
+
+    // 近邻
+    class Neighbor
+    {
+      public:
+        // 和近邻的距离
+        float distance;
+        // 近邻的下标
+        uint64_t offset;
+        // 是否是上一轮迭代之后新加入的近邻
+        bool fresh;
+
+        explicit Neighbor(const float distance, const uint64_t offset, const bool fresh)
+            : distance(distance), offset(offset), fresh(fresh)
+        {
+        }
+    };
+
+    // 近似 k 近邻图
+    class Graph
+    {
+      public:
+        // 每个顶点最多保存的近邻的数量
+        uint64_t k;
+        // 每个顶点的近邻，按距离从小到大排列
+        std::vector<std::vector<Neighbor>> neighbors;
+        // 并行构建时保护 neighbors 中对应的一项
+        std::vector<Parallel::Spinlock> locks;
+
+        explicit Graph(const uint64_t number, const uint64_t k) : k(k), neighbors(number), locks(number)
+        {
+        }
+    };
+
+    // 尝试把 offset 加入 i 的近邻中，返回是否加入
+    inline bool Insert(Graph &graph, const uint64_t i, const uint64_t offset, const float distance)
+    {
+        auto &neighbors = graph.neighbors[i];
+        auto guard = std::lock_guard(graph.locks[i]);
+
+        if (neighbors.size() == graph.k && neighbors.back().distance <= distance)
+        {
+            return false;
+        }
+
+        for (auto j = 0; j < neighbors.size(); ++j)
+        {
+            if (neighbors[j].offset == offset)
+            {
+                return false;
+            }
+        }
+
+        auto position = std::upper_bound(neighbors.begin(), neighbors.end(), distance,
+                                         [](const float distance, const Neighbor &neighbor)
+                                         { return distance < neighbor.distance; });
+
+        neighbors.insert(position, Neighbor(distance, offset, true));
+
+        if (graph.k < neighbors.size())
+        {
+            neighbors.pop_back();
+        }
+
+        return true;
+    }
+
+    // 使用 NN-Descent 构建 number 个点的近似 k 近邻图
+    //
+    // distance(i, j) 返回第 i 个点和第 j 个点的距离，需要可以被多个线程同时调用
+    //
+    // 每轮迭代中每个点只和新近邻（包括反向近邻）中采样的 sample 个点做局部连接，
+    // 近邻更新的次数少于 termination * number * k 时停止
+    template <typename Distance>
+    inline Graph NN_Descent(const uint64_t number, const uint64_t k, const uint64_t thread_number,
+                            const Distance &distance, const uint64_t iteration_limit = 12,
+                            const float termination = 0.002)
+    {
+        auto graph = Graph(number, k);
+        const auto sample = std::max<uint64_t>(k / 2, 1);
+
+        // 随机初始化
+        Parallel::For(0, number, thread_number,
+                      [&](const uint64_t i)
+                      {
+                          auto random = std::mt19937_64(i);
+
+                          for (auto tried = 0; graph.neighbors[i].size() < std::min(k, number - 1) && tried < 4 * k;
+                               ++tried)
+                          {
+                              auto j = random() % number;
+
+                              if (j != i)
+                              {
+                                  Insert(graph, i, j, distance(i, j));
+                              }
+                          }
+                      });
+
+        auto fresh = std::vector<std::vector<uint64_t>>(number);
+        auto stale = std::vector<std::vector<uint64_t>>(number);
+        auto fresh_reverse = std::vector<std::vector<uint64_t>>(number);
+        auto stale_reverse = std::vector<std::vector<uint64_t>>(number);
+
+        for (auto iteration = 0; iteration < iteration_limit; ++iteration)
+        {
+            // 把近邻分为新旧两组，新近邻最多取 sample 个，取出后标记为旧近邻
+            for (auto i = 0; i < number; ++i)
+            {
+                fresh[i].clear();
+                stale[i].clear();
+                fresh_reverse[i].clear();
+                stale_reverse[i].clear();
+            }
+
+            for (auto i = 0; i < number; ++i)
+            {
+                auto &neighbors = graph.neighbors[i];
+
+                for (auto j = 0; j < neighbors.size(); ++j)
+                {
+                    if (!neighbors[j].fresh)
+                    {
+                        stale[i].push_back(neighbors[j].offset);
+                    }
+                    else if (fresh[i].size() < sample)
+                    {
+                        fresh[i].push_back(neighbors[j].offset);
+                        neighbors[j].fresh = false;
+                    }
+                }
+            }
+
+            // 反向近邻
+            for (auto i = 0; i < number; ++i)
+            {
+                for (auto j = 0; j < fresh[i].size(); ++j)
+                {
+                    if (fresh_reverse[fresh[i][j]].size() < sample)
+                    {
+                        fresh_reverse[fresh[i][j]].push_back(i);
+                    }
+                }
+
+                for (auto j = 0; j < stale[i].size(); ++j)
+                {
+                    if (stale_reverse[stale[i][j]].size() < sample)
+                    {
+                        stale_reverse[stale[i][j]].push_back(i);
+                    }
+                }
+            }
+
+            for (auto i = 0; i < number; ++i)
+            {
+                fresh[i].insert(fresh[i].end(), fresh_reverse[i].begin(), fresh_reverse[i].end());
+                stale[i].insert(stale[i].end(), stale_reverse[i].begin(), stale_reverse[i].end());
+            }
+
+            // 局部连接：新近邻之间、新近邻和旧近邻之间互相介绍
+            auto updates = std::atomic<uint64_t>(0);
+
+            Parallel::For(0, number, thread_number,
+                          [&](const uint64_t i)
+                          {
+                              auto &fresh_neighbors = fresh[i];
+                              auto &stale_neighbors = stale[i];
+                              uint64_t updated = 0;
+
+                              for (auto a = 0; a < fresh_neighbors.size(); ++a)
+                              {
+                                  for (auto b = a + 1; b < fresh_neighbors.size(); ++b)
+                                  {
+                                      if (fresh_neighbors[a] != fresh_neighbors[b])
+                                      {
+                                          auto between = distance(fresh_neighbors[a], fresh_neighbors[b]);
+                                          updated += Insert(graph, fresh_neighbors[a], fresh_neighbors[b], between);
+                                          updated += Insert(graph, fresh_neighbors[b], fresh_neighbors[a], between);
+                                      }
+                                  }
+
+                                  for (auto b = 0; b < stale_neighbors.size(); ++b)
+                                  {
+                                      if (fresh_neighbors[a] != stale_neighbors[b])
+                                      {
+                                          auto between = distance(fresh_neighbors[a], stale_neighbors[b]);
+                                          updated += Insert(graph, fresh_neighbors[a], stale_neighbors[b], between);
+                                          updated += Insert(graph, stale_neighbors[b], fresh_neighbors[a], between);
+                                      }
+                                  }
+                              }
+
+                              updates += updated;
+                          });
+
+            if (updates < termination * number * k)
+            {
+                break;
+            }
+        }
+
+        return graph;
+    }
+
+} // namespace KNN
@@ -0,0 +1,671 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <immintrin.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace Parallel
+{
+
+    // 自旋锁
+    //
+    // 保护单个顶点的数据，临界区很短，所以不使用互斥量
+    //
+    // 复制时不复制锁的状态，使持有锁的对象可以保存在 std::vector 中
+    class Spinlock
+    {
+      public:
+        std::atomic_flag flag;
+
+        Spinlock()
+        {
+        }
+
+        Spinlock(const Spinlock &)
+        {
+        }
+
+        Spinlock &operator=(const Spinlock &)
+        {
+            return *this;
+        }
+
+        // 自旋一定次数后让出时间片，避免持有锁的线程没有被调度时空转
+        void lock()
+        {
+            while (this->flag.test_and_set(std::memory_order_acquire))
+            {
+                for (auto i = 0; this->flag.test(std::memory_order_relaxed); ++i)
+                {
+                    if (i < 64)
+                    {
+#if defined(__SSE2__)
+                        _mm_pause();
+#endif
+                    }
+                    else
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            }
+        }
+
+        void unlock()
+        {
+            this->flag.clear(std::memory_order_release);
+        }
+    };
+
+    // 基于轮次的回收
+    //
+    // 读者开始读取时在一个空闲的槽中登记当前的轮次，读取结束时清除，
+    // 写者删除对象后推进轮次并记录推进前的轮次，所有登记的轮次都大于记录的轮次时没有读者还能访问该对象，可以回收
+    //
+    // 复制时不复制状态，和 Spinlock 相同
+    class Epoch
+    {
+      public:
+        // 同时读取的读者的最大数量，读者更多时等待空闲的槽
+        static constexpr uint64_t slot_number = 256;
+        // 当前的轮次
+        std::atomic<uint64_t> current;
+        // 读者登记的轮次，为 0 时空闲
+        std::unique_ptr<std::atomic<uint64_t>[]> slots;
+
+        Epoch() : current(1), slots(std::make_unique<std::atomic<uint64_t>[]>(slot_number))
+        {
+        }
+
+        Epoch(const Epoch &) : Epoch()
+        {
+        }
+
+        Epoch &operator=(const Epoch &)
+        {
+            return *this;
+        }
+
+        // 登记当前的轮次，返回槽的编号
+        uint64_t enter()
+        {
+            auto slot = std::hash<std::thread::id>()(std::this_thread::get_id()) % slot_number;
+            auto epoch = this->current.load();
+
+            for (auto tried = 1;; ++tried)
+            {
+                uint64_t expected = 0;
+
+                if (this->slots[slot].compare_exchange_strong(expected, epoch))
+                {
+                    break;
+                }
+
+                slot = (slot + 1) % slot_number;
+
+                if (tried % slot_number == 0)
+                {
+                    std::this_thread::yield();
+                    epoch = this->current.load();
+                }
+            }
+
+            // 登记期间轮次被推进时重新登记，保证写者要么看到登记的轮次，要么读者看到删除之后的图
+            for (auto latest = this->current.load(); latest != epoch; latest = this->current.load())
+            {
+                epoch = latest;
+                this->slots[slot].store(epoch);
+            }
+
+            return slot;
+        }
+
+        void exit(const uint64_t slot)
+        {
+            this->slots[slot].store(0, std::memory_order_release);
+        }
+
+        // 推进轮次，返回推进前的轮次
+        uint64_t advance()
+        {
+            return this->current.fetch_add(1);
+        }
+
+        // 所有读者登记的轮次中最小的一个，没有读者时为当前的轮次
+        uint64_t minimum() const
+        {
+            auto result = this->current.load();
+
+            for (auto i = 0; i < slot_number; ++i)
+            {
+                const auto epoch = this->slots[i].load();
+
+                if (epoch != 0 && epoch < result)
+                {
+                    result = epoch;
+                }
+            }
+
+            return result;
+        }
+    };
+
+    // 可以复制的原子变量
+    //
+    // 复制时读取当前的值，使持有它的对象可以保存在 std::vector 中
+    template <typename Type>
+    class Atomic : public std::atomic<Type>
+    {
+      public:
+        using std::atomic<Type>::operator=;
+
+        Atomic(const Type value) : std::atomic<Type>(value)
+        {
+        }
+
+        Atomic(const Atomic &other) : std::atomic<Type>(other.load())
+        {
+        }
+
+        Atomic &operator=(const Atomic &other)
+        {
+            this->store(other.load());
+
+            return *this;
+        }
+    };
+
+    // 发布的不可变对象
+    //
+    // 读者不加锁地读取当前的对象，写者替换对象后记录旧的对象和替换前的轮次，等到 Epoch 中没有读者还能访问时释放
+    //
+    // 写者之间需要互斥，复制时不复制对象，和 Spinlock 相同
+    template <typename Type>
+    class Published
+    {
+      public:
+        std::atomic<const Type *> current;
+        // 被替换的对象和替换前的轮次
+        std::vector<std::pair<uint64_t, const Type *>> retired;
+
+        Published() : current(nullptr)
+        {
+        }
+
+        Published(const Published &) : Published()
+        {
+        }
+
+        Published &operator=(const Published &)
+        {
+            return *this;
+        }
+
+        ~Published()
+        {
+            this->clear();
+        }
+
+        // 没有发布时返回空指针
+        const Type *load() const
+        {
+            return this->current.load(std::memory_order_acquire);
+        }
+
+        // 发布新的对象，同时释放轮次小于 reclaimable 的旧对象
+        void store(const Type *const object, Epoch &epoch, const uint64_t reclaimable)
+        {
+            std::erase_if(this->retired,
+                          [&](const auto &retired)
+                          {
+                              if (reclaimable <= retired.first)
+                              {
+                                  return false;
+                              }
+
+                              delete retired.second;
+
+                              return true;
+                          });
+
+            const auto *replaced = this->current.exchange(object);
+
+            if (replaced != nullptr)
+            {
+                this->retired.push_back({epoch.advance(), replaced});
+            }
+        }
+
+        // 释放所有对象，只能在没有读者时调用
+        void clear()
+        {
+            delete this->current.exchange(nullptr);
+
+            for (auto i = 0; i < this->retired.size(); ++i)
+            {
+                delete this->retired[i].second;
+            }
+
+            this->retired.clear();
+        }
+    };
+
+    // 解析 "0-3,8-11" 形式的编号列表
+    inline std::vector<uint64_t> Parse_List(const std::string &list)
+    {
+        auto result = std::vector<uint64_t>();
+        auto begin = 0;
+
+        while (begin < list.size())
+        {
+            auto end = list.find(',', begin);
+
+            if (end == std::string::npos)
+            {
+                end = list.size();
+            }
+
+            const auto range = list.substr(begin, end - begin);
+            const auto dash = range.find('-');
+
+            if (!range.empty())
+            {
+                const auto first = std::stoull(range.substr(0, dash));
+                const auto last = dash == std::string::npos ? first : std::stoull(range.substr(dash + 1));
+
+                for (auto i = first; i <= last; ++i)
+                {
+                    result.push_back(i);
+                }
+            }
+
+            begin = end + 1;
+        }
+
+        return result;
+    }
+
+    // 每个 NUMA 节点上的 CPU 的编号
+    //
+    // 从 /sys/devices/system/node 中读取，读取失败时视为只有一个节点，包括所有的 CPU
+    inline std::vector<std::vector<uint64_t>> Nodes()
+    {
+        auto nodes = std::vector<std::vector<uint64_t>>();
+        auto online = std::ifstream("/sys/devices/system/node/online");
+        auto line = std::string();
+
+        if (online && std::getline(online, line))
+        {
+            const auto ids = Parse_List(line);
+
+            for (auto i = 0; i < ids.size(); ++i)
+            {
+                auto file = std::ifstream("/sys/devices/system/node/node" + std::to_string(ids[i]) + "/cpulist");
+                auto cpus = std::string();
+
+                // 没有 CPU 的节点只有内存，不能运行线程
+                if (file && std::getline(file, cpus) && !Parse_List(cpus).empty())
+                {
+                    nodes.push_back(Parse_List(cpus));
+                }
+            }
+        }
+
+        if (nodes.empty())
+        {
+            nodes.push_back(std::vector<uint64_t>());
+
+            for (auto i = 0; i < std::max(std::thread::hardware_concurrency(), 1U); ++i)
+            {
+                nodes.front().push_back(i);
+            }
+        }
+
+        return nodes;
+    }
+
+    // 把调用的线程绑定到 cpus 中的 CPU 上
+    //
+    // 绑定后线程新分配的内存默认在它所在的节点上，不支持时什么都不做
+    inline void Pin(const std::vector<uint64_t> &cpus)
+    {
+#if defined(__linux__)
+        auto set = cpu_set_t();
+
+        CPU_ZERO(&set);
+
+        for (auto i = 0; i < cpus.size(); ++i)
+        {
+            if (cpus[i] < CPU_SETSIZE)
+            {
+                CPU_SET(cpus[i], &set);
+            }
+        }
+
+        sched_setaffinity(0, sizeof(set), &set);
+#endif
+    }
+
+    // 所有节点上的 CPU，先排列一个节点的 CPU 再排列下一个
+    inline std::vector<uint64_t> CPUs()
+    {
+        const auto nodes = Nodes();
+        auto cpus = std::vector<uint64_t>();
+
+        for (auto i = 0; i < nodes.size(); ++i)
+        {
+            cpus.insert(cpus.end(), nodes[i].begin(), nodes[i].end());
+        }
+
+        return cpus;
+    }
+
+    // 调用的线程当前所在的 CPU 的编号，不支持时为 0
+    inline uint64_t Current_CPU()
+    {
+#if defined(__linux__)
+        const auto cpu = sched_getcpu();
+
+        if (0 <= cpu)
+        {
+            return cpu;
+        }
+#endif
+
+        return 0;
+    }
+
+    // 工作窃取的线程池
+    //
+    // 每个工作线程有自己的任务队列，从队尾取出自己提交的任务，自己的队列为空时从其它队列的队头窃取，
+    // 不在线程池中的线程提交的任务轮流放入各个队列
+    //
+    // 等待的线程也执行队列中的任务，所以任务中可以再提交任务并等待，嵌套的并行阶段共用同一组线程，不会超额订阅
+    class Thread_Pool
+    {
+      public:
+        // 任务队列
+        class Queue
+        {
+          public:
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        // 每个工作线程的任务队列，没有工作线程时也有一个队列，由等待的线程执行
+        std::vector<std::unique_ptr<Queue>> queues;
+        // 工作线程
+        std::vector<std::thread> workers;
+        // 所有队列中任务的数量
+        std::atomic<uint64_t> pending;
+        // 不在线程池中的线程下一次提交任务的队列
+        std::atomic<uint64_t> next;
+        // 没有任务时工作线程在 condition 上等待
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping;
+
+        // 当前线程所在的线程池和它的队列的编号
+        static inline thread_local Thread_Pool *current = nullptr;
+        static inline thread_local uint64_t current_queue = 0;
+
+        // pin 为 true 时工作线程依次绑定到各个 CPU 上，先占满一个 NUMA 节点再使用下一个
+        explicit Thread_Pool(const uint64_t worker_number, const bool pin = false)
+            : Thread_Pool(worker_number, pin ? CPUs() : std::vector<uint64_t>())
+        {
+        }
+
+        // 第 i 个工作线程绑定到 cpus[i % cpus.size()] 上，cpus 为空时不绑定
+        explicit Thread_Pool(const uint64_t worker_number, const std::vector<uint64_t> &cpus)
+            : pending(0), next(0), stopping(false)
+        {
+            for (auto i = 0; i < std::max<uint64_t>(worker_number, 1); ++i)
+            {
+                this->queues.push_back(std::make_unique<Queue>());
+            }
+
+            for (auto i = 0; i < worker_number; ++i)
+            {
+                this->workers.push_back(std::thread(
+                    [this, i, cpus]()
+                    {
+                        if (!cpus.empty())
+                        {
+                            Pin({cpus[i % cpus.size()]});
+                        }
+
+                        current = this;
+                        current_queue = i;
+                        this->work();
+                    }));
+            }
+        }
+
+        Thread_Pool(const Thread_Pool &) = delete;
+        Thread_Pool &operator=(const Thread_Pool &) = delete;
+
+        // 执行完队列中剩余的任务后结束工作线程
+        ~Thread_Pool()
+        {
+            {
+                auto guard = std::lock_guard(this->mutex);
+
+                this->stopping = true;
+            }
+
+            this->condition.notify_all();
+
+            for (auto i = 0; i < this->workers.size(); ++i)
+            {
+                this->workers[i].join();
+            }
+        }
+
+        void submit(std::function<void()> task)
+        {
+            const auto queue = current == this ? current_queue : this->next++ % this->queues.size();
+
+            {
+                auto guard = std::lock_guard(this->queues[queue]->mutex);
+
+                this->queues[queue]->tasks.push_back(std::move(task));
+            }
+
+            ++this->pending;
+
+            // 加锁后再通知，避免工作线程检查完条件、开始等待之前错过通知
+            {
+                auto guard = std::lock_guard(this->mutex);
+            }
+
+            this->condition.notify_one();
+        }
+
+        // 执行一个任务，没有任务时返回 false
+        bool run_one()
+        {
+            const auto number = this->queues.size();
+            const auto own = current == this ? current_queue : 0;
+            auto task = std::function<void()>();
+
+            for (auto i = 0; i < number && !task; ++i)
+            {
+                auto &queue = *this->queues[(own + i) % number];
+                auto guard = std::lock_guard(queue.mutex);
+
+                if (queue.tasks.empty())
+                {
+                    continue;
+                }
+
+                // 自己的队列从队尾取出，最近提交的任务的数据更可能还在缓存中
+                if (i == 0 && current == this)
+                {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                }
+                else
+                {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+            }
+
+            if (!task)
+            {
+                return false;
+            }
+
+            --this->pending;
+            task();
+
+            return true;
+        }
+
+        // 执行队列中的任务，直到 done() 为 true
+        template <typename Predicate>
+        void wait(const Predicate &done)
+        {
+            while (!done())
+            {
+                if (!this->run_one())
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        void work()
+        {
+            while (true)
+            {
+                if (this->run_one())
+                {
+                    continue;
+                }
+
+                auto lock = std::unique_lock(this->mutex);
+
+                this->condition.wait(lock, [this]() { return this->pending != 0 || this->stopping; });
+
+                if (this->stopping && this->pending == 0)
+                {
+                    return;
+                }
+            }
+        }
+    };
+
+    // 默认的线程池
+    //
+    // 第一次使用时创建，调用的线程也参与计算，所以工作线程比硬件线程少一个
+    inline std::unique_ptr<Thread_Pool> &Pool_Instance()
+    {
+        static auto pool = std::unique_ptr<Thread_Pool>();
+
+        return pool;
+    }
+
+    inline std::mutex &Pool_Mutex()
+    {
+        static auto mutex = std::mutex();
+
+        return mutex;
+    }
+
+    inline Thread_Pool &Default_Pool()
+    {
+        auto guard = std::lock_guard(Pool_Mutex());
+        auto &pool = Pool_Instance();
+
+        if (pool == nullptr)
+        {
+            pool = std::make_unique<Thread_Pool>(std::max(std::thread::hardware_concurrency(), 1U) - 1);
+        }
+
+        return *pool;
+    }
+
+    // 设置默认的线程池的工作线程的数量和是否绑定 CPU
+    //
+    // 需要在没有并行任务时调用
+    inline void Configure(const uint64_t worker_number, const bool pin = false)
+    {
+        auto guard = std::lock_guard(Pool_Mutex());
+
+        Pool_Instance().reset();
+        Pool_Instance() = std::make_unique<Thread_Pool>(worker_number, pin);
+    }
+
+    // 由 thread_number 个线程对 [begin, end) 中的每个 i 调用 function(i)
+    //
+    // 向 pool 提交 thread_number - 1 个任务，每个任务依次领取下一个 i，调用的线程也参与计算，
+    // 线程池中的线程较少时同一时刻参与计算的线程也较少，pool 为空指针时只由调用的线程计算
+    //
+    // function 也可以接受两个参数 function(thread, i)，thread 为任务的编号，取值为 [0, thread_number)，
+    // 调用的线程的编号为 0，同一时刻每个编号只被一个线程使用，用于访问每个线程自己的缓冲区
+    template <typename Function>
+    inline void For(Thread_Pool *const pool, const uint64_t begin, const uint64_t end, const uint64_t thread_number,
+                    Function &&function)
+    {
+        auto next = std::atomic<uint64_t>(begin);
+        auto remaining = std::atomic<uint64_t>(0);
+
+        auto work = [&](const uint64_t thread)
+        {
+            for (auto j = next++; j < end; j = next++)
+            {
+                if constexpr (std::is_invocable_v<Function &, uint64_t, uint64_t>)
+                {
+                    function(thread, j);
+                }
+                else
+                {
+                    function(j);
+                }
+            }
+        };
+
+        for (auto i = 1; pool != nullptr && begin + i < end && i < thread_number; ++i)
+        {
+            ++remaining;
+            pool->submit(
+                [&, i]()
+                {
+                    work(i);
+                    --remaining;
+                });
+        }
+
+        work(0);
+
+        if (pool != nullptr)
+        {
+            pool->wait([&]() { return remaining == 0; });
+        }
+    }
+
+    // 使用默认的线程池
+    template <typename Function>
+    inline void For(const uint64_t begin, const uint64_t end, const uint64_t thread_number, Function &&function)
+    {
+        auto *pool = thread_number <= 1 || end <= begin + 1 ? nullptr : &Default_Pool();
+
+        For(pool, begin, end, thread_number, function);
+    }
+
+} // namespace Parallel
@@ -0,0 +1,756 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+#include <limits>
+#include <numbers>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "space.h"
+
+namespace Quantization
+{
+
+    // 子空间中两个向量的平方欧氏距离
+    //
+    // 子空间的维度通常较小且不一定是SIMD宽度的整数倍，所以不使用 Space 中的距离
+    template <typename Element>
+    inline float Subspace_Distance(const Element *vector1, const float *vector2, const uint64_t dimension)
+    {
+        float distance = 0;
+
+        for (auto i = 0; i < dimension; ++i)
+        {
+            auto difference = float(vector1[i]) - vector2[i];
+            distance += difference * difference;
+        }
+
+        return distance;
+    }
+
+    // 乘积量化器
+    //
+    // 向量被切分为 subspace_number 个子空间，每个子空间使用 k-means 训练 2^bits 个聚类中心
+    //
+    // bits 为 8 时每个子空间的编码占一个字节
+    //
+    // bits 为 4 时两个子空间的编码共用一个字节，低4位为偶数子空间，高4位为奇数子空间
+    class Product_Quantizer
+    {
+      public:
+        // 向量的维度
+        uint64_t dimension;
+        // 子空间的数量
+        uint64_t subspace_number;
+        // 每个子空间编码的位数
+        uint64_t bits;
+        // 每个子空间聚类中心的数量
+        uint64_t centroid_number;
+        // 子空间的维度
+        uint64_t subspace_dimension;
+        // 一个向量的编码占用的字节数
+        uint64_t code_size;
+        // 聚类中心
+        //
+        // centroids[(subspace * centroid_number + centroid) * subspace_dimension]
+        std::vector<float> centroids;
+        // 查表使用的指令集
+        Space::ISA isa;
+
+        explicit Product_Quantizer()
+            : dimension(0), subspace_number(0), bits(0), centroid_number(0), subspace_dimension(0), code_size(0),
+              isa(Space::get_isa())
+        {
+        }
+
+        explicit Product_Quantizer(const uint64_t dimension, const uint64_t subspace_number, const uint64_t bits)
+            : dimension(dimension), subspace_number(subspace_number), bits(bits), centroid_number(1ULL << bits),
+              subspace_dimension(0), code_size(0), isa(Space::get_isa())
+        {
+            if (bits != 4 && bits != 8)
+            {
+                throw std::invalid_argument("for now, product quantization only supports 4 or 8 bits. ");
+            }
+
+            if (subspace_number == 0 || dimension % subspace_number != 0)
+            {
+                throw std::invalid_argument("The dimension of vectors must be divisible by the number of subspaces. ");
+            }
+
+            // 4位编码的距离使用16位无符号整数累加
+            if (bits == 4 && 256 < subspace_number)
+            {
+                throw std::invalid_argument("4 bits product quantization supports at most 256 subspaces. ");
+            }
+
+            this->subspace_dimension = dimension / subspace_number;
+            this->code_size = bits == 8 ? subspace_number : (subspace_number + 1) / 2;
+        }
+
+        bool trained() const
+        {
+            return !this->centroids.empty();
+        }
+    };
+
+    // 读取编码中第 subspace 个子空间的聚类中心编号
+    inline uint64_t Get_Code(const Product_Quantizer &quantizer, const uint8_t *code, const uint64_t subspace)
+    {
+        if (quantizer.bits == 8)
+        {
+            return code[subspace];
+        }
+
+        return (code[subspace / 2] >> ((subspace % 2) * 4)) & 0x0F;
+    }
+
+    inline void Set_Code(const Product_Quantizer &quantizer, uint8_t *code, const uint64_t subspace,
+                         const uint64_t centroid)
+    {
+        if (quantizer.bits == 8)
+        {
+            code[subspace] = centroid;
+        }
+        else
+        {
+            auto shift = (subspace % 2) * 4;
+            code[subspace / 2] = (code[subspace / 2] & ~(0x0F << shift)) | (centroid << shift);
+        }
+    }
+
+    // 在 K 个聚类中心中找到与向量最近的一个
+    template <typename Element>
+    inline uint64_t Nearest_Center(const float *const centers, const uint64_t K, const Element *vector,
+                                   const uint64_t dimension)
+    {
+        uint64_t nearest = 0;
+        float nearest_distance = std::numeric_limits<float>::max();
+
+        for (auto i = 0; i < K; ++i)
+        {
+            auto distance = Subspace_Distance(vector, centers + i * dimension, dimension);
+
+            if (distance < nearest_distance)
+            {
+                nearest_distance = distance;
+                nearest = i;
+            }
+        }
+
+        return nearest;
+    }
+
+    // k-means
+    //
+    // 每个样本取从 begin 开始的 dimension 维，训练 K 个聚类中心保存到 centers 中
+    //
+    // 乘积量化的每个子空间和分片索引的聚类都使用这个函数，random 由调用者提供，多次训练时结果仍然确定
+    template <typename Element>
+    inline void K_Means(const std::vector<const Element *> &samples, const uint64_t begin, const uint64_t dimension,
+                        const uint64_t K, const uint64_t iterations, std::mt19937 &random, float *const centers)
+    {
+        auto order = std::vector<uint64_t>(samples.size(), 0);
+        auto sum = std::vector<float>(K * dimension, 0);
+        auto size = std::vector<uint64_t>(K, 0);
+
+        for (auto i = 0; i < order.size(); ++i)
+        {
+            order[i] = i;
+        }
+
+        std::shuffle(order.begin(), order.end(), random);
+
+        // 随机选择样本作为初始聚类中心
+        for (auto i = 0; i < K; ++i)
+        {
+            std::copy_n(samples[order[i]] + begin, dimension, centers + i * dimension);
+        }
+
+        for (auto iteration = 0; iteration < iterations; ++iteration)
+        {
+            std::fill(sum.begin(), sum.end(), 0);
+            std::fill(size.begin(), size.end(), 0);
+
+            for (auto i = 0; i < samples.size(); ++i)
+            {
+                const auto *vector = samples[i] + begin;
+                auto nearest = Nearest_Center(centers, K, vector, dimension);
+
+                ++size[nearest];
+
+                for (auto j = 0; j < dimension; ++j)
+                {
+                    sum[nearest * dimension + j] += vector[j];
+                }
+            }
+
+            for (auto i = 0; i < K; ++i)
+            {
+                // 空的聚类使用随机样本重新初始化
+                if (size[i] == 0)
+                {
+                    std::copy_n(samples[random() % samples.size()] + begin, dimension, centers + i * dimension);
+                    continue;
+                }
+
+                for (auto j = 0; j < dimension; ++j)
+                {
+                    centers[i * dimension + j] = sum[i * dimension + j] / size[i];
+                }
+            }
+        }
+    }
+
+    // 在一个子空间中找到与子向量最近的聚类中心
+    template <typename Element>
+    inline uint64_t Nearest_Centroid(const Product_Quantizer &quantizer, const uint64_t subspace,
+                                     const Element *sub_vector)
+    {
+        const auto &SD = quantizer.subspace_dimension;
+        const auto *centroids = quantizer.centroids.data() + subspace * quantizer.centroid_number * SD;
+
+        return Nearest_Center(centroids, quantizer.centroid_number, sub_vector, SD);
+    }
+
+    // 使用 k-means 训练每个子空间的聚类中心
+    template <typename Element>
+    inline void Train(Product_Quantizer &quantizer, const std::vector<const Element *> &samples,
+                      const uint64_t iterations = 25)
+    {
+        if (samples.size() < quantizer.centroid_number)
+        {
+            throw std::invalid_argument("The number of training samples is less than the number of centroids. ");
+        }
+
+        const auto &K = quantizer.centroid_number;
+        const auto &SD = quantizer.subspace_dimension;
+
+        quantizer.centroids.assign(quantizer.subspace_number * K * SD, 0);
+
+        auto random = std::mt19937(0);
+
+        for (auto subspace = 0; subspace < quantizer.subspace_number; ++subspace)
+        {
+            K_Means(samples, subspace * SD, SD, K, iterations, random, quantizer.centroids.data() + subspace * K * SD);
+        }
+    }
+
+    // 编码一个向量
+    template <typename Element>
+    inline void Encode(const Product_Quantizer &quantizer, const Element *vector, uint8_t *code)
+    {
+        for (auto subspace = 0; subspace < quantizer.subspace_number; ++subspace)
+        {
+            Set_Code(quantizer, code, subspace,
+                     Nearest_Centroid(quantizer, subspace, vector + subspace * quantizer.subspace_dimension));
+        }
+    }
+
+    // 查询向量的距离表
+    //
+    // 每次查询计算一次，之后每个向量的距离只需要 subspace_number 次查表
+    class Query_Table
+    {
+      public:
+        // 查询向量到每个子空间中每个聚类中心的距离
+        //
+        // table[subspace * centroid_number + centroid]
+        std::vector<float> table;
+        // 4位编码使用的量化后的距离表
+        std::vector<uint8_t> quantized_table;
+        // quantized = (table - minimum) * scale
+        float scale;
+        // 所有子空间最小距离的和
+        float bias;
+        // 4位编码批量计算时每个向量的编码的地址
+        std::vector<const uint8_t *> addresses;
+        // 4位编码批量计算时转置后的编码
+        std::vector<uint8_t> block;
+        // 批量计算的结果
+        std::vector<float> distances;
+
+        explicit Query_Table() : scale(1), bias(0)
+        {
+        }
+    };
+
+    template <typename Element>
+    inline void Compute_Table(const Product_Quantizer &quantizer, const Element *query, Query_Table &query_table)
+    {
+        const auto &K = quantizer.centroid_number;
+        const auto &SD = quantizer.subspace_dimension;
+
+        query_table.table.resize(quantizer.subspace_number * K);
+
+        for (auto subspace = 0; subspace < quantizer.subspace_number; ++subspace)
+        {
+            const auto *centroids = quantizer.centroids.data() + subspace * K * SD;
+
+            for (auto i = 0; i < K; ++i)
+            {
+                query_table.table[subspace * K + i] = Subspace_Distance(query + subspace * SD, centroids + i * SD, SD);
+            }
+        }
+
+        if (quantizer.bits != 4)
+        {
+            return;
+        }
+
+        // 所有子空间使用相同的缩放比例，每个子空间减去各自的最小值
+        auto minimums = std::vector<float>(quantizer.subspace_number, 0);
+        float width = 0;
+
+        query_table.bias = 0;
+
+        for (auto subspace = 0; subspace < quantizer.subspace_number; ++subspace)
+        {
+            const auto *begin = query_table.table.data() + subspace * K;
+            auto [minimum, maximum] = std::minmax_element(begin, begin + K);
+
+            minimums[subspace] = *minimum;
+            width = std::max(width, *maximum - *minimum);
+            query_table.bias += *minimum;
+        }
+
+        query_table.scale = 0 < width ? 255 / width : 1;
+        query_table.quantized_table.resize(quantizer.subspace_number * K);
+
+        for (auto subspace = 0; subspace < quantizer.subspace_number; ++subspace)
+        {
+            for (auto i = 0; i < K; ++i)
+            {
+                auto value = (query_table.table[subspace * K + i] - minimums[subspace]) * query_table.scale;
+
+                query_table.quantized_table[subspace * K + i] = std::min(255.0f, std::round(value));
+            }
+        }
+    }
+
+    // 通过查表计算查询向量和8位编码的向量的近似距离
+    //
+    // 每次使用聚集指令查找16个子空间
+    __attribute__((target("avx512f"))) inline float Distance_AVX512(const Product_Quantizer &quantizer,
+                                                                    const Query_Table &query_table,
+                                                                    const uint8_t *code)
+    {
+        const auto *table = query_table.table.data();
+        const auto &M = quantizer.subspace_number;
+        uint64_t subspace = 0;
+
+        const auto step = _mm512_set_epi32(15 * 256, 14 * 256, 13 * 256, 12 * 256, 11 * 256, 10 * 256, 9 * 256,
+                                           8 * 256, 7 * 256, 6 * 256, 5 * 256, 4 * 256, 3 * 256, 2 * 256, 256, 0);
+        __m512 sum = _mm512_set1_ps(0);
+
+        for (; subspace + 16 <= M; subspace += 16)
+        {
+            auto index = _mm512_add_epi32(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(code + subspace))),
+                                          step);
+
+            sum = _mm512_add_ps(sum, _mm512_i32gather_ps(index, table + subspace * 256, 4));
+        }
+
+        float distance = _mm512_reduce_add_ps(sum);
+
+        for (; subspace < M; ++subspace)
+        {
+            distance += table[subspace * 256 + code[subspace]];
+        }
+
+        return distance;
+    }
+
+    inline float Distance(const Product_Quantizer &quantizer, const Query_Table &query_table, const uint8_t *code)
+    {
+        if (quantizer.isa == Space::ISA::AVX512)
+        {
+            return Distance_AVX512(quantizer, query_table, code);
+        }
+
+        const auto *table = query_table.table.data();
+        float distance = 0;
+
+        for (auto subspace = 0; subspace < quantizer.subspace_number; ++subspace)
+        {
+            distance += table[subspace * 256 + code[subspace]];
+        }
+
+        return distance;
+    }
+
+    // 使用字节重排指令计算一组32个向量的距离，结果为量化后的16位整数
+    __attribute__((target("avx2"))) inline void Fast_Scan_Block_AVX2(const Product_Quantizer &quantizer,
+                                                                     const Query_Table &query_table, uint16_t *sum)
+    {
+        const auto &M = quantizer.subspace_number;
+
+        auto zero = _mm256_setzero_si256();
+        auto low = _mm256_setzero_si256();
+        auto high = _mm256_setzero_si256();
+
+        for (auto subspace = 0; subspace < M; ++subspace)
+        {
+            auto table = _mm256_broadcastsi128_si256(
+                _mm_loadu_si128((const __m128i *)(query_table.quantized_table.data() + subspace * 16)));
+            auto index = _mm256_loadu_si256((const __m256i *)(query_table.block.data() + subspace * 32));
+            auto result = _mm256_shuffle_epi8(table, index);
+
+            low = _mm256_add_epi16(low, _mm256_unpacklo_epi8(result, zero));
+            high = _mm256_add_epi16(high, _mm256_unpackhi_epi8(result, zero));
+        }
+
+        uint16_t __attribute__((aligned(32))) temporary_low[16];
+        uint16_t __attribute__((aligned(32))) temporary_high[16];
+
+        _mm256_store_si256((__m256i *)temporary_low, low);
+        _mm256_store_si256((__m256i *)temporary_high, high);
+
+        // 解包按128位分组进行，需要还原向量的顺序
+        for (auto i = 0; i < 8; ++i)
+        {
+            sum[i] = temporary_low[i];
+            sum[i + 8] = temporary_high[i];
+            sum[i + 16] = temporary_low[i + 8];
+            sum[i + 24] = temporary_high[i + 8];
+        }
+    }
+
+    // 把一组最多32个向量的4位编码转置为 block[subspace * 32 + i]，不足32个时其余位置为 0
+    //
+    // 每次取16个向量的16个字节，用4轮字节交错完成 16x16 的转置，再用掩码和移位拆开高低4位，
+    // 每个字节只需要常数条指令，不需要逐个子空间提取编码
+    __attribute__((target("avx2"))) inline void Transpose_Block_AVX2(const Product_Quantizer &quantizer,
+                                                                     const uint8_t *const *codes,
+                                                                     const uint64_t count, uint8_t *block)
+    {
+        const auto &code_size = quantizer.code_size;
+        const auto mask = _mm_set1_epi8(0x0F);
+        __m128i rows[16];
+        __m128i next[16];
+
+        for (uint64_t column = 0; column < code_size; column += 16)
+        {
+            const auto width = std::min<uint64_t>(16, code_size - column);
+
+            for (auto half = 0; half < 2; ++half)
+            {
+                for (auto i = 0; i < 16; ++i)
+                {
+                    const auto vector = half * 16 + i;
+
+                    if (count <= vector)
+                    {
+                        rows[i] = _mm_setzero_si128();
+                    }
+                    else if (width == 16)
+                    {
+                        rows[i] = _mm_loadu_si128((const __m128i *)(codes[vector] + column));
+                    }
+                    else
+                    {
+                        // 编码的最后不足16个字节，不能越界读取
+                        uint8_t __attribute__((aligned(16))) tail[16] = {};
+
+                        std::memcpy(tail, codes[vector] + column, width);
+                        rows[i] = _mm_load_si128((const __m128i *)tail);
+                    }
+                }
+
+                // 每轮把第 i 行和第 i + 8 行交错，4轮后 rows[j] 为16个向量的第 column + j 个字节
+                for (auto round = 0; round < 4; ++round)
+                {
+                    for (auto i = 0; i < 8; ++i)
+                    {
+                        next[2 * i] = _mm_unpacklo_epi8(rows[i], rows[i + 8]);
+                        next[2 * i + 1] = _mm_unpackhi_epi8(rows[i], rows[i + 8]);
+                    }
+
+                    std::copy_n(next, 16, rows);
+                }
+
+                for (auto j = 0; j < width; ++j)
+                {
+                    const auto subspace = 2 * (column + j);
+
+                    _mm_storeu_si128((__m128i *)(block + subspace * 32 + half * 16), _mm_and_si128(rows[j], mask));
+                    _mm_storeu_si128((__m128i *)(block + (subspace + 1) * 32 + half * 16),
+                                     _mm_and_si128(_mm_srli_epi16(rows[j], 4), mask));
+                }
+            }
+        }
+    }
+
+    // 批量计算查询向量和4位编码的向量的近似距离
+    //
+    // 每32个向量一组，将编码转置为子空间优先的布局后使用字节重排指令查表
+    inline void Fast_Scan(const Product_Quantizer &quantizer, Query_Table &query_table, const uint8_t *const *codes,
+                          const uint64_t number)
+    {
+        const auto &M = quantizer.subspace_number;
+
+        // 子空间的数量为奇数时最后一个字节的高4位也会转置，多留一行
+        query_table.block.resize(quantizer.code_size * 2 * 32);
+        query_table.distances.resize(number);
+
+        for (auto begin = 0; begin < number; begin += 32)
+        {
+            const auto count = std::min<uint64_t>(32, number - begin);
+
+            // 转置：block[subspace * 32 + i] 是第 i 个向量在第 subspace 个子空间的编码
+            if (quantizer.isa >= Space::ISA::AVX2)
+            {
+                Transpose_Block_AVX2(quantizer, codes + begin, count, query_table.block.data());
+            }
+            else
+            {
+                std::fill(query_table.block.begin(), query_table.block.end(), 0);
+
+                for (auto i = 0; i < count; ++i)
+                {
+                    const auto *code = codes[begin + i];
+
+                    for (auto subspace = 0; subspace < M; ++subspace)
+                    {
+                        query_table.block[subspace * 32 + i] = Get_Code(quantizer, code, subspace);
+                    }
+                }
+            }
+
+            uint16_t __attribute__((aligned(32))) sum[32];
+
+            if (quantizer.isa >= Space::ISA::AVX2)
+            {
+                Fast_Scan_Block_AVX2(quantizer, query_table, sum);
+            }
+            else
+            {
+                std::fill_n(sum, 32, 0);
+
+                for (auto subspace = 0; subspace < M; ++subspace)
+                {
+                    const auto *table = query_table.quantized_table.data() + subspace * 16;
+
+                    for (auto i = 0; i < count; ++i)
+                    {
+                        sum[i] += table[query_table.block[subspace * 32 + i]];
+                    }
+                }
+            }
+
+            for (auto i = 0; i < count; ++i)
+            {
+                query_table.distances[begin + i] = query_table.bias + sum[i] / query_table.scale;
+            }
+        }
+    }
+
+    // 二值草图
+    //
+    // 向量减去中心后经过随机旋转，每个维度只保留符号位
+    //
+    // 两个草图的汉明距离 h 可以估计两个向量的夹角 θ ≈ π * h / bits
+    class Binary_Sketch
+    {
+      public:
+        // 向量的维度
+        uint64_t dimension;
+        // 草图的位数，是64的整数倍
+        uint64_t bits;
+        // 一个草图占用的64位整数的数量
+        uint64_t words;
+        // 所有向量的中心
+        std::vector<float> center;
+        // 随机旋转矩阵，每行是一个单位向量
+        //
+        // projections[bit * dimension]
+        std::vector<float> projections;
+        // 汉明距离为 h 时夹角余弦的上界
+        //
+        // 估计的夹角减去 margin 个标准差，用于计算距离的下界
+        std::vector<float> cosine_upper_bounds;
+        // 计算汉明距离使用的指令集
+        Space::ISA isa;
+
+        explicit Binary_Sketch() : dimension(0), bits(0), words(0), isa(Space::get_isa())
+        {
+        }
+
+        explicit Binary_Sketch(const uint64_t dimension, const uint64_t bits)
+            : dimension(dimension), bits(bits), words(bits / 64), isa(Space::get_isa())
+        {
+            if (bits == 0 || bits % 64 != 0)
+            {
+                throw std::invalid_argument("The number of sketch bits must be a positive multiple of 64. ");
+            }
+        }
+
+        bool trained() const
+        {
+            return !this->projections.empty();
+        }
+    };
+
+    // 计算草图的中心和随机旋转矩阵
+    //
+    // 每 dimension 行为一组，组内使用施密特正交化得到正交的旋转
+    template <typename Element>
+    inline void Train(Binary_Sketch &sketch, const std::vector<const Element *> &samples, const float margin)
+    {
+        const auto &D = sketch.dimension;
+
+        sketch.center.assign(D, 0);
+
+        for (auto i = 0; i < samples.size(); ++i)
+        {
+            for (auto j = 0; j < D; ++j)
+            {
+                sketch.center[j] += float(samples[i][j]);
+            }
+        }
+
+        for (auto j = 0; j < D && !samples.empty(); ++j)
+        {
+            sketch.center[j] /= samples.size();
+        }
+
+        auto random = std::mt19937(0);
+        auto normal = std::normal_distribution<float>(0, 1);
+
+        sketch.projections.assign(sketch.bits * D, 0);
+
+        for (auto bit = 0; bit < sketch.bits; ++bit)
+        {
+            auto *row = sketch.projections.data() + bit * D;
+
+            for (auto j = 0; j < D; ++j)
+            {
+                row[j] = normal(random);
+            }
+
+            for (auto previous = bit - bit % D; previous < bit; ++previous)
+            {
+                const auto *previous_row = sketch.projections.data() + previous * D;
+                float product = 0;
+
+                for (auto j = 0; j < D; ++j)
+                {
+                    product += row[j] * previous_row[j];
+                }
+
+                for (auto j = 0; j < D; ++j)
+                {
+                    row[j] -= product * previous_row[j];
+                }
+            }
+
+            float norm = 0;
+
+            for (auto j = 0; j < D; ++j)
+            {
+                norm += row[j] * row[j];
+            }
+
+            norm = std::sqrt(norm);
+
+            for (auto j = 0; j < D; ++j)
+            {
+                row[j] /= norm;
+            }
+        }
+
+        // 汉明距离占比的标准差不超过 0.5 / sqrt(bits)
+        const auto deviation = margin * std::numbers::pi_v<float> * 0.5f / std::sqrt(float(sketch.bits));
+
+        sketch.cosine_upper_bounds.resize(sketch.bits + 1);
+
+        for (auto h = 0; h <= sketch.bits; ++h)
+        {
+            auto angle = std::numbers::pi_v<float> * h / sketch.bits - deviation;
+            sketch.cosine_upper_bounds[h] = std::cos(std::max(0.0f, angle));
+        }
+    }
+
+    // 计算向量的草图，返回向量到中心的距离
+    template <typename Element>
+    inline float Encode(const Binary_Sketch &sketch, const Element *vector, uint64_t *code)
+    {
+        const auto &D = sketch.dimension;
+        auto centered = std::vector<float>(D, 0);
+        float norm = 0;
+
+        for (auto j = 0; j < D; ++j)
+        {
+            centered[j] = float(vector[j]) - sketch.center[j];
+            norm += centered[j] * centered[j];
+        }
+
+        std::fill_n(code, sketch.words, 0);
+
+        for (auto bit = 0; bit < sketch.bits; ++bit)
+        {
+            const auto *row = sketch.projections.data() + bit * D;
+            float product = 0;
+
+            for (auto j = 0; j < D; ++j)
+            {
+                product += row[j] * centered[j];
+            }
+
+            if (0 <= product)
+            {
+                code[bit / 64] |= 1ULL << (bit % 64);
+            }
+        }
+
+        return std::sqrt(norm);
+    }
+
+    // 两个草图的汉明距离
+    //
+    // 支持 AVX2 的处理器都支持 POPCNT 指令，否则 std::popcount 使用软件实现
+    __attribute__((target("popcnt"))) inline uint64_t Hamming_POPCNT(const uint64_t *code1, const uint64_t *code2,
+                                                                     const uint64_t words)
+    {
+        uint64_t distance = 0;
+
+        for (auto i = 0; i < words; ++i)
+        {
+            distance += std::popcount(code1[i] ^ code2[i]);
+        }
+
+        return distance;
+    }
+
+    inline uint64_t Hamming(const Binary_Sketch &sketch, const uint64_t *code1, const uint64_t *code2)
+    {
+        if (sketch.isa >= Space::ISA::AVX2)
+        {
+            return Hamming_POPCNT(code1, code2, sketch.words);
+        }
+
+        uint64_t distance = 0;
+
+        for (auto i = 0; i < sketch.words; ++i)
+        {
+            distance += std::popcount(code1[i] ^ code2[i]);
+        }
+
+        return distance;
+    }
+
+    // 根据草图估计的平方欧氏距离的下界
+    //
+    // norm1 和 norm2 为两个向量到中心的距离
+    inline float Lower_Bound(const Binary_Sketch &sketch, const uint64_t hamming, const float norm1,
+                             const float norm2)
+    {
+        return norm1 * norm1 + norm2 * norm2 - 2 * norm1 * norm2 * sketch.cosine_upper_bounds[hamming];
+    }
+
+} // namespace Quantization
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "HSG.h"
+#include "parallel.h"
+
+namespace HSG
+{
+
+    // 按 NUMA 节点复制的索引
+    //
+    // 每个节点保存一份图和向量数据的副本，副本的内存由绑定在这个节点上的线程分配，
+    // 查询时使用执行查询的线程所在节点的副本，避免跨节点访问内存
+    //
+    // 有多个节点时每个节点有自己的线程池，工作线程绑定在这个节点的 CPU 上，复制和批量查询都在这些线程中执行
+    //
+    // 副本只用于查询，源索引修改后需要重新调用 Replicate
+    template <typename Element = float>
+    class Replicated_Index
+    {
+      public:
+        // 每个节点上的 CPU 的编号
+        std::vector<std::vector<uint64_t>> nodes;
+        // CPU 所在的节点
+        std::vector<uint64_t> cpu_to_node;
+        // 每个节点的副本
+        std::vector<std::unique_ptr<Index<Element>>> replicas;
+        // 每个副本持有的向量数据
+        //
+        // arenas[node][offset * dimension]
+        std::vector<std::vector<Element>> arenas;
+        // 每个节点的线程池，只有一个节点时为空，使用默认的线程池
+        std::vector<std::unique_ptr<Parallel::Thread_Pool>> pools;
+
+        explicit Replicated_Index() : nodes(Parallel::Nodes()), replicas(this->nodes.size()), arenas(this->nodes.size())
+        {
+            for (auto node = 0; node < this->nodes.size(); ++node)
+            {
+                for (auto i = 0; i < this->nodes[node].size(); ++i)
+                {
+                    const auto cpu = this->nodes[node][i];
+
+                    if (this->cpu_to_node.size() <= cpu)
+                    {
+                        this->cpu_to_node.resize(cpu + 1, 0);
+                    }
+
+                    this->cpu_to_node[cpu] = node;
+                }
+            }
+        }
+    };
+
+    // 把 index 复制到 replica 中，向量数据复制到 arena 中
+    //
+    // 在副本所在节点的线程中调用，复制的边和向量数据都分配在这个节点上
+    template <typename Element>
+    inline std::unique_ptr<Index<Element>> Copy_Index(const Index<Element> &index, std::vector<Element> &arena)
+    {
+        const auto &parameters = index.parameters;
+        auto replica = std::make_unique<Index<Element>>(parameters.space_metric, parameters.dimension,
+                                                        parameters.short_edge_lower_limit,
+                                                        parameters.short_edge_upper_limit, parameters.cover_range,
+                                                        parameters.magnification);
+
+        replica->parameters = parameters;
+        replica->count = index.count;
+        replica->vectors = index.vectors;
+        replica->empty = index.empty;
+        replica->id_to_offset = index.id_to_offset;
+        replica->quantizer = index.quantizer;
+        replica->codes = index.codes;
+        replica->sketch = index.sketch;
+        replica->sketches = index.sketches;
+        replica->sketch_norms = index.sketch_norms;
+        replica->norm_bound = index.norm_bound;
+        replica->deleted_count = index.deleted_count;
+
+        // 向量的地址指向副本自己的数据，零点指向副本的零点
+        arena.assign(index.vectors.size() * parameters.dimension, Element());
+        replica->vectors.front().data = replica->zero.data();
+
+        for (auto offset = 1; offset < index.vectors.size(); ++offset)
+        {
+            const auto *data = index.vectors[offset].data;
+
+            if (data != nullptr)
+            {
+                auto *address = arena.data() + offset * parameters.dimension;
+
+                std::copy_n(data, parameters.dimension, address);
+                replica->vectors[offset].data = address;
+            }
+        }
+
+        return replica;
+    }
+
+    // 在每个节点的线程池中调用 thread_numbers[node] 次 function(node)，等待全部结束
+    //
+    // 调用的线程只等待，不执行任务，所以 function(node) 只在绑定到这个节点的线程中执行
+    template <typename Element, typename Function>
+    inline void Run_On_Nodes(const Replicated_Index<Element> &replicated_index,
+                             const std::vector<uint64_t> &thread_numbers, Function &&function)
+    {
+        auto remaining = std::atomic<uint64_t>(0);
+
+        for (auto node = 0; node < replicated_index.pools.size(); ++node)
+        {
+            for (auto i = 0; i < thread_numbers[node]; ++i)
+            {
+                ++remaining;
+                replicated_index.pools[node]->submit(
+                    [&, node]()
+                    {
+                        function(node);
+                        --remaining;
+                    });
+            }
+        }
+
+        while (remaining != 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    // 在每个节点上复制 index
+    //
+    // 复制期间不能修改 index
+    template <typename Element>
+    inline void Replicate(Replicated_Index<Element> &replicated_index, const Index<Element> &index)
+    {
+        if (index.serving)
+        {
+            throw std::logic_error("Replicate cannot be called while concurrent search is enabled. ");
+        }
+
+        const auto &nodes = replicated_index.nodes;
+
+        replicated_index.replicas.resize(nodes.size());
+        replicated_index.arenas.resize(nodes.size());
+
+        if (nodes.size() == 1)
+        {
+            replicated_index.pools.clear();
+            replicated_index.replicas.front() = Copy_Index(index, replicated_index.arenas.front());
+
+            return;
+        }
+
+        if (replicated_index.pools.size() != nodes.size())
+        {
+            replicated_index.pools.clear();
+
+            for (auto node = 0; node < nodes.size(); ++node)
+            {
+                replicated_index.pools.push_back(
+                    std::make_unique<Parallel::Thread_Pool>(std::max<uint64_t>(nodes[node].size(), 1), nodes[node]));
+            }
+        }
+
+        // 线程分配的内存默认在线程所在的节点上，所以由每个节点的线程池中的一个线程复制
+        Run_On_Nodes(replicated_index, std::vector<uint64_t>(nodes.size(), 1),
+                     [&](const uint64_t node)
+                     { replicated_index.replicas[node] = Copy_Index(index, replicated_index.arenas[node]); });
+    }
+
+    // 调用的线程所在节点的副本
+    template <typename Element>
+    inline const Index<Element> &Local_Replica(const Replicated_Index<Element> &replicated_index)
+    {
+        if (replicated_index.replicas.front() == nullptr)
+        {
+            throw std::logic_error("The index must be replicated before searching. ");
+        }
+
+        const auto cpu = Parallel::Current_CPU();
+        const auto node = cpu < replicated_index.cpu_to_node.size() ? replicated_index.cpu_to_node[cpu] : 0;
+
+        return *replicated_index.replicas[node];
+    }
+
+    // 查询距离目标向量最近的top-k个向量
+    //
+    // 使用调用的线程所在节点的副本
+    template <typename Element>
+    inline std::priority_queue<std::pair<float, ID>> Search(const Replicated_Index<Element> &replicated_index,
+                                                            const Space::Input_Type<Element> *const target_vector,
+                                                            const uint64_t top_k, const uint64_t magnification)
+    {
+        return Search(Local_Replica(replicated_index), target_vector, top_k, magnification);
+    }
+
+    // 批量查询
+    //
+    // targets 中依次存放 number 个目标向量，由 thread_number 个线程查询
+    //
+    // 有多个节点时线程轮流分配到各个节点，在节点的线程池中执行，每个线程只使用本节点的副本，
+    // 所有线程依次领取下一个查询；只有一个节点时使用默认的线程池
+    template <typename Element>
+    inline std::vector<std::priority_queue<std::pair<float, ID>>> Search_Batch(
+        const Replicated_Index<Element> &replicated_index, const Space::Input_Type<Element> *const targets,
+        const uint64_t number, const uint64_t top_k, const uint64_t magnification, const uint64_t thread_number)
+    {
+        if (replicated_index.replicas.front() == nullptr)
+        {
+            throw std::logic_error("The index must be replicated before searching. ");
+        }
+
+        const auto dimension = replicated_index.replicas.front()->parameters.dimension;
+        auto results = std::vector<std::priority_queue<std::pair<float, ID>>>(number);
+
+        if (replicated_index.pools.empty())
+        {
+            const auto &replica = *replicated_index.replicas.front();
+
+            Parallel::For(0, number, thread_number,
+                          [&](const uint64_t i)
+                          { results[i] = Search(replica, targets + i * dimension, top_k, magnification); });
+
+            return results;
+        }
+
+        const auto node_number = replicated_index.pools.size();
+        auto thread_numbers = std::vector<uint64_t>(node_number, 0);
+        auto next = std::atomic<uint64_t>(0);
+
+        for (auto i = 0; i < std::min(std::max<uint64_t>(thread_number, 1), number); ++i)
+        {
+            ++thread_numbers[i % node_number];
+        }
+
+        Run_On_Nodes(replicated_index, thread_numbers,
+                     [&](const uint64_t node)
+                     {
+                         const auto &replica = *replicated_index.replicas[node];
+
+                         for (auto i = next++; i < number; i = next++)
+                         {
+                             results[i] = Search(replica, targets + i * dimension, top_k, magnification);
+                         }
+                     });
+
+        return results;
+    }
+
+} // namespace HSG
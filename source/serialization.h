@@ -0,0 +1,852 @@
+#pragma once
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "HSG.h"
+#include "parallel.h"
+
+namespace HSG
+{
+
+    // 索引文件的格式
+    //
+    // 文件头之后依次是若干段，每段保存段的字节数、内容和内容的校验和，段中的每个数组都按8字节对齐
+    //
+    // 1. 参数：维度、距离类型、元素类型和各项参数
+    // 2. 顶点：每个顶点的 id、到零点的距离和标记
+    // 3. 向量：有数据的顶点按偏移量从小到大依次存放
+    // 4. 短边：每个顶点的出边数量，所有出边的终点和长度，入边在读取时由出边得到
+    // 5. 长边：和短边相同
+    // 6. 保持连通的边：每个顶点的数量和终点
+    // 7. 空位
+    // 8. 乘积量化器和量化编码
+    // 9. 二值草图和每个向量的草图
+    namespace Format
+    {
+        // 文件开头的标识
+        constexpr char magic[8] = {'H', 'S', 'G', 'I', 'N', 'D', 'E', 'X'};
+        // 格式的版本，格式改变时增加
+        constexpr uint64_t version = 1;
+        // 顶点的标记
+        constexpr uint8_t has_data = 1;
+        constexpr uint8_t deleted = 2;
+
+        // 元素类型的编号
+        template <typename Element>
+        constexpr uint64_t element_code()
+        {
+            if constexpr (std::is_same_v<Element, float>)
+            {
+                return 0;
+            }
+            else if constexpr (std::is_same_v<Element, uint8_t>)
+            {
+                return 1;
+            }
+            else if constexpr (std::is_same_v<Element, Space::Float16>)
+            {
+                return 2;
+            }
+            else
+            {
+                return 3;
+            }
+        }
+
+        // 64位校验和
+        //
+        // 每次处理8个字节，分多次更新时和一次更新的结果相同
+        class Checksum
+        {
+          public:
+            uint64_t state;
+            // 已经处理的字节数
+            uint64_t length;
+            // 不足8个字节的剩余部分
+            uint64_t tail;
+            uint64_t tail_size;
+
+            explicit Checksum() : state(0x9E3779B97F4A7C15ULL), length(0), tail(0), tail_size(0)
+            {
+            }
+
+            void mix(const uint64_t word)
+            {
+                this->state = (this->state ^ word) * 0xBF58476D1CE4E5B9ULL;
+                this->state ^= this->state >> 31;
+            }
+
+            void update(const char *data, uint64_t size)
+            {
+                this->length += size;
+
+                for (; size != 0 && this->tail_size != 0; ++data, --size)
+                {
+                    this->tail |= uint64_t(uint8_t(*data)) << (8 * this->tail_size);
+
+                    if (++this->tail_size == 8)
+                    {
+                        this->mix(this->tail);
+                        this->tail = 0;
+                        this->tail_size = 0;
+                    }
+                }
+
+                for (; 8 <= size; data += 8, size -= 8)
+                {
+                    uint64_t word = 0;
+
+                    std::memcpy(&word, data, 8);
+                    this->mix(word);
+                }
+
+                for (; size != 0; ++data, --size)
+                {
+                    this->tail |= uint64_t(uint8_t(*data)) << (8 * this->tail_size);
+                    ++this->tail_size;
+                }
+            }
+
+            uint64_t value() const
+            {
+                auto result = *this;
+
+                if (result.tail_size != 0)
+                {
+                    result.mix(result.tail);
+                }
+
+                result.mix(result.length);
+
+                return result.state;
+            }
+        };
+
+        // 数组按8字节对齐后占用的字节数
+        template <typename T>
+        constexpr uint64_t array_size(const uint64_t number)
+        {
+            return (number * sizeof(T) + 7) / 8 * 8;
+        }
+
+        // 带缓冲的顺序写入
+        class Writer
+        {
+          public:
+            // 缓冲区的大小
+            static constexpr uint64_t buffer_size = 1ULL << 24;
+            std::ofstream file;
+            std::vector<char> buffer;
+            uint64_t used;
+            Checksum checksum;
+            // 当前段剩余的字节数
+            uint64_t remaining;
+
+            explicit Writer(const std::string &path)
+                : file(path, std::ios::out | std::ios::binary | std::ios::trunc), buffer(buffer_size), used(0),
+                  remaining(0)
+            {
+                if (!this->file)
+                {
+                    throw std::runtime_error("Cannot open '" + path + "' for writing. ");
+                }
+            }
+
+            void flush()
+            {
+                this->file.write(this->buffer.data(), this->used);
+                this->used = 0;
+
+                if (!this->file)
+                {
+                    throw std::runtime_error("Failed to write the index file. ");
+                }
+            }
+
+            void raw(const void *data, const uint64_t size)
+            {
+                // 空数组的地址可能为空指针
+                if (size == 0)
+                {
+                    return;
+                }
+
+                // 大块数据直接写入，不经过缓冲区
+                if (buffer_size <= size)
+                {
+                    this->flush();
+                    this->file.write(static_cast<const char *>(data), size);
+                    return;
+                }
+
+                if (buffer_size < this->used + size)
+                {
+                    this->flush();
+                }
+
+                std::memcpy(this->buffer.data() + this->used, data, size);
+                this->used += size;
+            }
+
+            // 开始一段，size 为段的字节数
+            void begin(const uint64_t size)
+            {
+                this->raw(&size, sizeof(size));
+                this->checksum = Checksum();
+                this->remaining = size;
+            }
+
+            // 写入 number 个元素并补齐到8字节
+            template <typename T>
+            void array(const T *data, const uint64_t number)
+            {
+                static constexpr char zeros[8] = {};
+                const auto size = number * sizeof(T);
+                const auto padding = array_size<T>(number) - size;
+
+                if (this->remaining < size + padding)
+                {
+                    throw std::logic_error("The section is larger than its declared size. ");
+                }
+
+                this->checksum.update(reinterpret_cast<const char *>(data), size);
+                this->checksum.update(zeros, padding);
+                this->raw(data, size);
+                this->raw(zeros, padding);
+                this->remaining -= size + padding;
+            }
+
+            template <typename T>
+            void value(const T &data)
+            {
+                this->array(&data, 1);
+            }
+
+            // 结束一段，写入校验和
+            void end()
+            {
+                if (this->remaining != 0)
+                {
+                    throw std::logic_error("The section is smaller than its declared size. ");
+                }
+
+                const auto checksum = this->checksum.value();
+
+                this->raw(&checksum, sizeof(checksum));
+            }
+        };
+
+        // 读取的一段
+        //
+        // 整段一次读入内存并检查校验和，内容按8字节对齐保存
+        class Section
+        {
+          public:
+            std::vector<uint64_t> words;
+            // 已经读取的字节数
+            uint64_t position;
+            uint64_t size;
+
+            explicit Section(std::ifstream &file) : position(0), size(0)
+            {
+                uint64_t checksum = 0;
+
+                file.read(reinterpret_cast<char *>(&this->size), sizeof(this->size));
+
+                // 段的字节数损坏时不分配内存
+                const auto begin = file.tellg();
+
+                file.seekg(0, std::ios::end);
+
+                const auto end = file.tellg();
+
+                file.seekg(begin);
+
+                if (!file || this->size % 8 != 0 || uint64_t(end - begin) < this->size + sizeof(checksum))
+                {
+                    throw std::runtime_error("The index file is truncated or corrupted. ");
+                }
+
+                this->words.resize(this->size / 8);
+                file.read(reinterpret_cast<char *>(this->words.data()), this->size);
+                file.read(reinterpret_cast<char *>(&checksum), sizeof(checksum));
+
+                auto expected = Checksum();
+
+                expected.update(reinterpret_cast<const char *>(this->words.data()), this->size);
+
+                if (!file || expected.value() != checksum)
+                {
+                    throw std::runtime_error("The index file is truncated or corrupted. ");
+                }
+            }
+
+            // 取出 number 个元素
+            template <typename T>
+            const T *array(const uint64_t number)
+            {
+                if (this->size - this->position < array_size<T>(number))
+                {
+                    throw std::runtime_error("The index file is corrupted. ");
+                }
+
+                const auto *data = reinterpret_cast<const T *>(reinterpret_cast<const char *>(this->words.data()) +
+                                                               this->position);
+
+                this->position += array_size<T>(number);
+
+                return data;
+            }
+
+            template <typename T>
+            T value()
+            {
+                return *this->array<T>(1);
+            }
+        };
+
+        // 按 CSR 格式保存每个顶点的边
+        //
+        // 第 i 个顶点的边为 [begins[i], begins[i + 1])
+        class Edges
+        {
+          public:
+            std::vector<uint64_t> begins;
+            const uint64_t *targets;
+            const float *distances;
+
+            explicit Edges() : targets(nullptr), distances(nullptr)
+            {
+            }
+
+            // 从段中读取，检查终点的范围
+            void read(Section &section, const uint64_t vertex_number, const bool has_distances)
+            {
+                const auto *counts = section.array<uint64_t>(vertex_number);
+
+                this->begins.assign(vertex_number + 1, 0);
+
+                for (auto i = 0; i < vertex_number; ++i)
+                {
+                    this->begins[i + 1] = this->begins[i] + counts[i];
+                }
+
+                const auto number = this->begins.back();
+
+                this->targets = section.array<uint64_t>(number);
+                this->distances = has_distances ? section.array<float>(number) : nullptr;
+
+                for (auto i = 0; i < number; ++i)
+                {
+                    if (vertex_number <= this->targets[i])
+                    {
+                        throw std::runtime_error("The index file is corrupted. ");
+                    }
+                }
+            }
+
+            // 入边，按终点分组的出边的起点
+            //
+            // reverse_begins[target] 开始保存指向 target 的出边在 targets 中的位置
+            void reverse(std::vector<uint64_t> &reverse_begins, std::vector<uint64_t> &sources,
+                         std::vector<uint64_t> &positions) const
+            {
+                const auto vertex_number = this->begins.size() - 1;
+                const auto number = this->begins.back();
+
+                reverse_begins.assign(vertex_number + 1, 0);
+                sources.resize(number);
+                positions.resize(number);
+
+                for (auto i = 0; i < number; ++i)
+                {
+                    ++reverse_begins[this->targets[i] + 1];
+                }
+
+                for (auto i = 0; i < vertex_number; ++i)
+                {
+                    reverse_begins[i + 1] += reverse_begins[i];
+                }
+
+                auto next = std::vector<uint64_t>(reverse_begins.begin(), reverse_begins.end() - 1);
+
+                for (auto source = 0; source < vertex_number; ++source)
+                {
+                    for (auto i = this->begins[source]; i < this->begins[source + 1]; ++i)
+                    {
+                        const auto j = next[this->targets[i]]++;
+
+                        sources[j] = source;
+                        positions[j] = i;
+                    }
+                }
+            }
+        };
+
+        // 写入边
+        //
+        // count(vector) 返回边的数量，visit(vector, function) 对每条边调用 function(target, distance)
+        template <typename Element, typename Count, typename Visit>
+        inline void Write_Edges(Writer &writer, const Index<Element> &index, const bool has_distances,
+                                const Count &count, const Visit &visit)
+        {
+            const auto vertex_number = index.vectors.size();
+            auto counts = std::vector<uint64_t>(vertex_number);
+            uint64_t number = 0;
+
+            for (auto i = 0; i < vertex_number; ++i)
+            {
+                counts[i] = count(index.vectors[i]);
+                number += counts[i];
+            }
+
+            auto targets = std::vector<uint64_t>();
+            auto distances = std::vector<float>();
+
+            targets.reserve(number);
+            distances.reserve(has_distances ? number : 0);
+
+            for (auto i = 0; i < vertex_number; ++i)
+            {
+                visit(index.vectors[i],
+                      [&](const Offset target, const float distance)
+                      {
+                          targets.push_back(target);
+
+                          if (has_distances)
+                          {
+                              distances.push_back(distance);
+                          }
+                      });
+            }
+
+            writer.begin(array_size<uint64_t>(vertex_number) + array_size<uint64_t>(number) +
+                         (has_distances ? array_size<float>(number) : 0));
+            writer.array(counts.data(), vertex_number);
+            writer.array(targets.data(), number);
+
+            if (has_distances)
+            {
+                writer.array(distances.data(), number);
+            }
+
+            writer.end();
+        }
+
+    } // namespace Format
+
+    // 把索引保存到 path
+    //
+    // 保存期间不能修改索引
+    template <typename Element>
+    inline void Save(const Index<Element> &index, const std::string &path)
+    {
+        if (index.serving)
+        {
+            throw std::logic_error("Save cannot be called while concurrent search is enabled. ");
+        }
+
+        const auto &parameters = index.parameters;
+        const auto &dimension = parameters.dimension;
+        const auto vertex_number = index.vectors.size();
+        auto writer = Format::Writer(path);
+
+        writer.raw(Format::magic, sizeof(Format::magic));
+
+        // 参数
+        writer.begin(13 * 8);
+        writer.value(Format::version);
+        writer.value(Format::element_code<Element>());
+        writer.value(uint64_t(parameters.space_metric));
+        writer.value(dimension);
+        writer.value(parameters.magnification);
+        writer.value(parameters.short_edge_lower_limit);
+        writer.value(parameters.short_edge_upper_limit);
+        writer.value(parameters.cover_range);
+        writer.value(parameters.connected_limit);
+        writer.value(double(index.norm_bound));
+        writer.value(index.count);
+        writer.value(index.deleted_count);
+        writer.value(vertex_number);
+        writer.end();
+
+        // 顶点
+        auto ids = std::vector<ID>(vertex_number);
+        auto zeros = std::vector<float>(vertex_number);
+        auto flags = std::vector<uint8_t>(vertex_number);
+        uint64_t data_number = 0;
+
+        for (auto i = 0; i < vertex_number; ++i)
+        {
+            const auto &vector = index.vectors[i];
+
+            ids[i] = vector.id;
+            zeros[i] = vector.zero;
+            flags[i] = vector.deleted ? Format::deleted : 0;
+
+            // 零点的数据由索引构造时生成
+            if (i != 0 && vector.data != nullptr)
+            {
+                flags[i] |= Format::has_data;
+                ++data_number;
+            }
+        }
+
+        writer.begin(Format::array_size<ID>(vertex_number) + Format::array_size<float>(vertex_number) +
+                     Format::array_size<uint8_t>(vertex_number));
+        writer.array(ids.data(), vertex_number);
+        writer.array(zeros.data(), vertex_number);
+        writer.array(flags.data(), vertex_number);
+        writer.end();
+
+        // 向量，逐个写入，不需要把所有向量复制到一起
+        writer.begin(data_number * Format::array_size<Element>(dimension));
+
+        for (auto i = 1; i < vertex_number; ++i)
+        {
+            if ((flags[i] & Format::has_data) != 0)
+            {
+                writer.array(index.vectors[i].data, dimension);
+            }
+        }
+
+        writer.end();
+
+        // 短边
+        Format::Write_Edges(
+            writer, index, true, [](const Vector<Element> &vector) { return vector.short_edge_out.size(); },
+            [](const Vector<Element> &vector, const auto &function)
+            {
+                for (auto iterator = vector.short_edge_out.begin(); iterator != vector.short_edge_out.end();
+                     ++iterator)
+                {
+                    function(iterator->second, iterator->first);
+                }
+            });
+
+        // 长边
+        Format::Write_Edges(
+            writer, index, true, [](const Vector<Element> &vector) { return vector.long_edge_out.size(); },
+            [](const Vector<Element> &vector, const auto &function)
+            {
+                for (auto iterator = vector.long_edge_out.begin(); iterator != vector.long_edge_out.end(); ++iterator)
+                {
+                    function(iterator->first, iterator->second);
+                }
+            });
+
+        // 保持连通的边
+        Format::Write_Edges(
+            writer, index, false, [](const Vector<Element> &vector) { return vector.keep_connected.size(); },
+            [](const Vector<Element> &vector, const auto &function)
+            {
+                for (auto iterator = vector.keep_connected.begin(); iterator != vector.keep_connected.end();
+                     ++iterator)
+                {
+                    function(*iterator, 0);
+                }
+            });
+
+        // 空位，从栈底到栈顶
+        auto empty = index.empty;
+        auto empty_offsets = std::vector<Offset>(empty.size());
+
+        for (auto i = empty_offsets.size(); i != 0; --i)
+        {
+            empty_offsets[i - 1] = empty.top();
+            empty.pop();
+        }
+
+        writer.begin(8 + Format::array_size<Offset>(empty_offsets.size()));
+        writer.value(uint64_t(empty_offsets.size()));
+        writer.array(empty_offsets.data(), empty_offsets.size());
+        writer.end();
+
+        // 乘积量化器，没有训练时子空间的数量为 0
+        const auto &quantizer = index.quantizer;
+        const auto subspace_number = quantizer.trained() ? quantizer.subspace_number : 0;
+
+        writer.begin(5 * 8 + Format::array_size<float>(quantizer.centroids.size()) +
+                     Format::array_size<uint8_t>(index.codes.size()));
+        writer.value(quantizer.dimension);
+        writer.value(subspace_number);
+        writer.value(quantizer.bits);
+        writer.value(uint64_t(quantizer.centroids.size()));
+        writer.value(uint64_t(index.codes.size()));
+        writer.array(quantizer.centroids.data(), quantizer.centroids.size());
+        writer.array(index.codes.data(), index.codes.size());
+        writer.end();
+
+        // 二值草图，没有训练时位数为 0
+        const auto &sketch = index.sketch;
+        const auto bits = sketch.trained() ? sketch.bits : 0;
+
+        writer.begin(7 * 8 + Format::array_size<float>(sketch.center.size()) +
+                     Format::array_size<float>(sketch.projections.size()) +
+                     Format::array_size<float>(sketch.cosine_upper_bounds.size()) +
+                     Format::array_size<uint64_t>(index.sketches.size()) +
+                     Format::array_size<float>(index.sketch_norms.size()));
+        writer.value(sketch.dimension);
+        writer.value(bits);
+        writer.value(uint64_t(sketch.center.size()));
+        writer.value(uint64_t(sketch.projections.size()));
+        writer.value(uint64_t(sketch.cosine_upper_bounds.size()));
+        writer.value(uint64_t(index.sketches.size()));
+        writer.value(uint64_t(index.sketch_norms.size()));
+        writer.array(sketch.center.data(), sketch.center.size());
+        writer.array(sketch.projections.data(), sketch.projections.size());
+        writer.array(sketch.cosine_upper_bounds.data(), sketch.cosine_upper_bounds.size());
+        writer.array(index.sketches.data(), index.sketches.size());
+        writer.array(index.sketch_norms.data(), index.sketch_norms.size());
+        writer.end();
+
+        writer.flush();
+    }
+
+    // 从 path 读取 Save 保存的索引
+    //
+    // 每段一次读入内存，由 thread_number 个线程并行地恢复顶点的边，向量数据由索引持有
+    template <typename Element = float>
+    inline Index<Element> Load(const std::string &path, const uint64_t thread_number = 1)
+    {
+        auto file = std::ifstream(path, std::ios::in | std::ios::binary);
+        char magic[sizeof(Format::magic)] = {};
+
+        if (!file)
+        {
+            throw std::runtime_error("Cannot open '" + path + "' for reading. ");
+        }
+
+        file.read(magic, sizeof(magic));
+
+        if (!file || std::memcmp(magic, Format::magic, sizeof(magic)) != 0)
+        {
+            throw std::runtime_error("'" + path + "' is not an index file. ");
+        }
+
+        // 参数
+        auto header = Format::Section(file);
+
+        if (header.value<uint64_t>() != Format::version)
+        {
+            throw std::runtime_error("The version of the index file is not supported. ");
+        }
+
+        if (header.value<uint64_t>() != Format::element_code<Element>())
+        {
+            throw std::invalid_argument("The element type of the index file is different. ");
+        }
+
+        const auto space_metric = Space::Metric(header.value<uint64_t>());
+        const auto dimension = header.value<uint64_t>();
+        const auto magnification = header.value<uint64_t>();
+        const auto short_edge_lower_limit = header.value<uint64_t>();
+        const auto short_edge_upper_limit = header.value<uint64_t>();
+        const auto cover_range = header.value<uint64_t>();
+        auto index = Index<Element>(space_metric, dimension, short_edge_lower_limit, short_edge_upper_limit,
+                                    cover_range, magnification);
+
+        index.parameters.connected_limit = header.value<uint64_t>();
+        index.norm_bound = header.value<double>();
+        index.count = header.value<uint64_t>();
+        index.deleted_count = header.value<uint64_t>();
+
+        const auto vertex_number = header.value<uint64_t>();
+
+        if (vertex_number == 0)
+        {
+            throw std::runtime_error("The index file is corrupted. ");
+        }
+
+        // 顶点
+        auto vertices = Format::Section(file);
+        const auto *ids = vertices.array<ID>(vertex_number);
+        const auto *zeros = vertices.array<float>(vertex_number);
+        const auto *flags = vertices.array<uint8_t>(vertex_number);
+
+        index.vectors.reserve(vertex_number);
+        index.id_to_offset.reserve(vertex_number);
+        index.vectors.front().deleted = (flags[0] & Format::deleted) != 0;
+
+        for (auto i = 1; i < vertex_number; ++i)
+        {
+            index.vectors.push_back(Vector<Element>(ids[i], i, nullptr, zeros[i]));
+            index.vectors[i].deleted = (flags[i] & Format::deleted) != 0;
+
+            // 标记删除的向量已经不能通过 id 访问
+            if (flags[i] == Format::has_data)
+            {
+                index.id_to_offset.insert({ids[i], i});
+            }
+        }
+
+        // 向量
+        auto data = Format::Section(file);
+        auto data_offsets = std::vector<Offset>();
+
+        for (auto i = 1; i < vertex_number; ++i)
+        {
+            if ((flags[i] & Format::has_data) != 0)
+            {
+                data_offsets.push_back(i);
+            }
+        }
+
+        const auto *elements = data.array<Element>(0);
+
+        if (data.size != data_offsets.size() * Format::array_size<Element>(dimension))
+        {
+            throw std::runtime_error("The index file is corrupted. ");
+        }
+
+        // 先分配所有的内存块，之后多个线程同时复制
+        if (!data_offsets.empty())
+        {
+            index.storage.address(data_offsets.back());
+        }
+
+        const auto stride = Format::array_size<Element>(dimension) / sizeof(Element);
+
+        Parallel::For(0, data_offsets.size(), thread_number,
+                      [&](const uint64_t i)
+                      {
+                          const auto offset = data_offsets[i];
+                          auto *address = index.storage.address(offset);
+
+                          std::copy_n(elements + i * stride, dimension, address);
+                          index.vectors[offset].data = address;
+                      });
+
+        // 边
+        auto short_section = Format::Section(file);
+        auto long_section = Format::Section(file);
+        auto keep_section = Format::Section(file);
+        auto short_edges = Format::Edges();
+        auto long_edges = Format::Edges();
+        auto keep_edges = Format::Edges();
+
+        short_edges.read(short_section, vertex_number, true);
+        long_edges.read(long_section, vertex_number, true);
+        keep_edges.read(keep_section, vertex_number, false);
+
+        auto short_begins = std::vector<uint64_t>();
+        auto short_sources = std::vector<uint64_t>();
+        auto short_positions = std::vector<uint64_t>();
+        auto long_begins = std::vector<uint64_t>();
+        auto long_sources = std::vector<uint64_t>();
+        auto long_positions = std::vector<uint64_t>();
+
+        short_edges.reverse(short_begins, short_sources, short_positions);
+        long_edges.reverse(long_begins, long_sources, long_positions);
+
+        // 每个线程只修改自己的顶点
+        Parallel::For(0, vertex_number, thread_number,
+                      [&](const uint64_t offset)
+                      {
+                          auto &vector = index.vectors[offset];
+
+                          for (auto i = short_edges.begins[offset]; i < short_edges.begins[offset + 1]; ++i)
+                          {
+                              vector.short_edge_out.insert({short_edges.distances[i], short_edges.targets[i]});
+                          }
+
+                          vector.short_edge_in.reserve(short_begins[offset + 1] - short_begins[offset]);
+
+                          for (auto i = short_begins[offset]; i < short_begins[offset + 1]; ++i)
+                          {
+                              vector.short_edge_in.insert(
+                                  {short_sources[i], short_edges.distances[short_positions[i]]});
+                          }
+
+                          vector.long_edge_out.reserve(long_edges.begins[offset + 1] - long_edges.begins[offset]);
+
+                          for (auto i = long_edges.begins[offset]; i < long_edges.begins[offset + 1]; ++i)
+                          {
+                              vector.long_edge_out.insert({long_edges.targets[i], long_edges.distances[i]});
+                          }
+
+                          vector.long_edge_in.reserve(long_begins[offset + 1] - long_begins[offset]);
+
+                          for (auto i = long_begins[offset]; i < long_begins[offset + 1]; ++i)
+                          {
+                              vector.long_edge_in.insert({long_sources[i], long_edges.distances[long_positions[i]]});
+                          }
+
+                          vector.keep_connected.reserve(keep_edges.begins[offset + 1] - keep_edges.begins[offset]);
+
+                          for (auto i = keep_edges.begins[offset]; i < keep_edges.begins[offset + 1]; ++i)
+                          {
+                              vector.keep_connected.insert(keep_edges.targets[i]);
+                          }
+                      });
+
+        // 空位
+        auto empty = Format::Section(file);
+        const auto empty_number = empty.value<uint64_t>();
+        const auto *empty_offsets = empty.array<Offset>(empty_number);
+
+        for (auto i = 0; i < empty_number; ++i)
+        {
+            index.empty.push(empty_offsets[i]);
+        }
+
+        // 乘积量化器
+        auto quantization = Format::Section(file);
+        const auto quantizer_dimension = quantization.value<uint64_t>();
+        const auto subspace_number = quantization.value<uint64_t>();
+        const auto quantizer_bits = quantization.value<uint64_t>();
+        const auto centroid_number = quantization.value<uint64_t>();
+        const auto code_number = quantization.value<uint64_t>();
+
+        if (subspace_number != 0)
+        {
+            index.quantizer = Quantization::Product_Quantizer(quantizer_dimension, subspace_number, quantizer_bits);
+
+            const auto *centroids = quantization.array<float>(centroid_number);
+
+            index.quantizer.centroids.assign(centroids, centroids + centroid_number);
+        }
+        else
+        {
+            quantization.array<float>(centroid_number);
+        }
+
+        const auto *codes = quantization.array<uint8_t>(code_number);
+
+        index.codes.assign(codes, codes + code_number);
+
+        // 二值草图
+        auto sketching = Format::Section(file);
+        const auto sketch_dimension = sketching.value<uint64_t>();
+        const auto sketch_bits = sketching.value<uint64_t>();
+        const auto center_number = sketching.value<uint64_t>();
+        const auto projection_number = sketching.value<uint64_t>();
+        const auto bound_number = sketching.value<uint64_t>();
+        const auto sketch_number = sketching.value<uint64_t>();
+        const auto norm_number = sketching.value<uint64_t>();
+        const auto *center = sketching.array<float>(center_number);
+        const auto *projections = sketching.array<float>(projection_number);
+        const auto *bounds = sketching.array<float>(bound_number);
+        const auto *sketches = sketching.array<uint64_t>(sketch_number);
+        const auto *norms = sketching.array<float>(norm_number);
+
+        if (sketch_bits != 0)
+        {
+            index.sketch = Quantization::Binary_Sketch(sketch_dimension, sketch_bits);
+            index.sketch.center.assign(center, center + center_number);
+            index.sketch.projections.assign(projections, projections + projection_number);
+            index.sketch.cosine_upper_bounds.assign(bounds, bounds + bound_number);
+        }
+
+        index.sketches.assign(sketches, sketches + sketch_number);
+        index.sketch_norms.assign(norms, norms + norm_number);
+
+        return index;
+    }
+
+} // namespace HSG
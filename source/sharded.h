@@ -0,0 +1,397 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <immintrin.h>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "HSG.h"
+#include "parallel.h"
+#include "quantization.h"
+
+namespace HSG
+{
+
+    // 把向量划分到分片的方式
+    enum class Partition
+    {
+        // 按 id 的哈希值划分，查询时访问所有的分片
+        Hash,
+        // 按距离最近的聚类中心划分，查询时可以只访问距离查询向量最近的几个分片
+        Cluster
+    };
+
+    // 分片索引
+    //
+    // 向量被划分到 shard_number 个相互独立的索引中，分片并行地构建和查询，查询结果合并后返回
+    template <typename Element = float>
+    class Sharded_Index
+    {
+      public:
+        // 向量的维度
+        uint64_t dimension;
+        // 划分的方式
+        Partition partition;
+        // 分片
+        std::vector<std::unique_ptr<Index<Element>>> shards;
+        // 按聚类划分时每个分片的聚类中心
+        //
+        // centers[shard * dimension]
+        std::vector<float> centers;
+        // 记录向量的 id 和所在的分片的对应关系
+        std::unordered_map<ID, uint64_t> id_to_shard;
+        // 批量构建时按分片重新排列的向量
+        //
+        // 分片可能只记录向量的地址，所以由分片索引持有
+        std::vector<std::vector<Space::Input_Type<Element>>> data;
+
+        explicit Sharded_Index(const Space::Metric space, const uint64_t dimension,
+                               const uint64_t short_edge_lower_limit, const uint64_t short_edge_upper_limit,
+                               const uint64_t cover_range, const uint64_t magnification, const uint64_t shard_number,
+                               const Partition partition)
+            : dimension(dimension), partition(partition), data(shard_number)
+        {
+            if (shard_number == 0)
+            {
+                throw std::invalid_argument("The number of shards must be positive. ");
+            }
+
+            for (auto i = 0; i < shard_number; ++i)
+            {
+                this->shards.push_back(std::make_unique<Index<Element>>(
+                    space, dimension, short_edge_lower_limit, short_edge_upper_limit, cover_range, magnification));
+            }
+        }
+    };
+
+    // 按 id 的哈希值选择分片
+    //
+    // 连续的 id 先打散，再取模
+    inline uint64_t Hash_Shard(const ID id, const uint64_t shard_number)
+    {
+        auto hash = id;
+
+        hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+        hash = hash ^ (hash >> 31);
+
+        return hash % shard_number;
+    }
+
+    // 距离向量最近的 probe 个聚类中心，按距离从小到大保存在 nearest 中
+    template <typename Element>
+    inline void Nearest_Shards(const Sharded_Index<Element> &sharded_index, const Space::Input_Type<Element> *vector,
+                               const uint64_t probe, std::vector<uint64_t> &nearest)
+    {
+        const auto shard_number = sharded_index.shards.size();
+        auto distances = std::vector<std::pair<float, uint64_t>>(shard_number);
+
+        for (auto i = 0; i < shard_number; ++i)
+        {
+            distances[i] = {Quantization::Subspace_Distance(vector, sharded_index.centers.data() +
+                                                                       i * sharded_index.dimension,
+                                                            sharded_index.dimension),
+                            i};
+        }
+
+        const auto number = std::min<uint64_t>(probe, shard_number);
+
+        std::partial_sort(distances.begin(), distances.begin() + number, distances.end());
+        nearest.clear();
+
+        for (auto i = 0; i < number; ++i)
+        {
+            nearest.push_back(distances[i].second);
+        }
+    }
+
+    // 向量所在的分片
+    template <typename Element>
+    inline uint64_t Shard_Of(const Sharded_Index<Element> &sharded_index, const ID id,
+                             const Space::Input_Type<Element> *vector)
+    {
+        if (sharded_index.partition == Partition::Hash)
+        {
+            return Hash_Shard(id, sharded_index.shards.size());
+        }
+
+        if (sharded_index.centers.empty())
+        {
+            throw std::logic_error("The clusters must be trained by building before adding vectors. ");
+        }
+
+        auto nearest = std::vector<uint64_t>();
+
+        Nearest_Shards(sharded_index, vector, 1, nearest);
+
+        return nearest.front();
+    }
+
+    // 使用 k-means 训练每个分片的聚类中心
+    //
+    // 训练样本从 data 中随机抽取
+    template <typename Element>
+    inline void Train_Clusters(Sharded_Index<Element> &sharded_index, const Space::Input_Type<Element> *const data,
+                               const uint64_t number, const uint64_t iterations = 25)
+    {
+        const auto &dimension = sharded_index.dimension;
+        const auto K = sharded_index.shards.size();
+
+        if (number < K)
+        {
+            throw std::invalid_argument("The number of vectors is less than the number of shards. ");
+        }
+
+        auto random = std::mt19937(0);
+        auto order = std::vector<uint64_t>(number, 0);
+
+        for (auto i = 0; i < number; ++i)
+        {
+            order[i] = i;
+        }
+
+        std::shuffle(order.begin(), order.end(), random);
+        order.resize(std::min<uint64_t>(number, 256 * K));
+
+        auto samples = std::vector<const Space::Input_Type<Element> *>(order.size());
+
+        for (auto i = 0; i < order.size(); ++i)
+        {
+            samples[i] = data + order[i] * dimension;
+        }
+
+        sharded_index.centers.assign(K * dimension, 0);
+        Quantization::K_Means(samples, 0, dimension, K, iterations, random, sharded_index.centers.data());
+    }
+
+    // 批量构建
+    //
+    // ids 和 data 中保存 number 个向量，向量依次存放，只能在空的分片索引上调用
+    //
+    // 向量按分片重新排列后，同时构建 min(thread_number, 分片数量) 个分片，每个分片使用其余的线程
+    template <typename Element>
+    inline void Build(Sharded_Index<Element> &sharded_index, const ID *const ids,
+                      const Space::Input_Type<Element> *const data, const uint64_t number,
+                      const uint64_t thread_number)
+    {
+        if (!sharded_index.id_to_shard.empty())
+        {
+            throw std::logic_error("The index must be empty before building. ");
+        }
+
+        const auto &dimension = sharded_index.dimension;
+        const auto shard_number = sharded_index.shards.size();
+
+        if (sharded_index.partition == Partition::Cluster)
+        {
+            Train_Clusters(sharded_index, data, number);
+        }
+
+        auto shard_ids = std::vector<std::vector<ID>>(shard_number);
+
+        for (auto i = 0; i < number; ++i)
+        {
+            const auto *vector = data + i * dimension;
+            const auto shard = Shard_Of(sharded_index, ids[i], vector);
+
+            shard_ids[shard].push_back(ids[i]);
+            sharded_index.data[shard].insert(sharded_index.data[shard].end(), vector, vector + dimension);
+            sharded_index.id_to_shard.insert({ids[i], shard});
+        }
+
+        const auto parallel_shards = std::clamp<uint64_t>(thread_number, 1, shard_number);
+        const auto shard_threads = std::max<uint64_t>(thread_number / parallel_shards, 1);
+
+        Parallel::For(0, shard_number, parallel_shards,
+                      [&](const uint64_t shard)
+                      {
+                          if (!shard_ids[shard].empty())
+                          {
+                              Build(*sharded_index.shards[shard], shard_ids[shard].data(),
+                                    sharded_index.data[shard].data(), shard_ids[shard].size(), shard_threads);
+                          }
+                      });
+    }
+
+    // 添加
+    template <typename Element>
+    inline void Add(Sharded_Index<Element> &sharded_index, const ID id,
+                    const Space::Input_Type<Element> *const added_vector_data)
+    {
+        const auto shard = Shard_Of(sharded_index, id, added_vector_data);
+
+        Add(*sharded_index.shards[shard], id, added_vector_data);
+        sharded_index.id_to_shard.insert({id, shard});
+    }
+
+    // 删除
+    template <typename Element>
+    inline void Erase(Sharded_Index<Element> &sharded_index, const ID removed_id)
+    {
+        const auto iterator = sharded_index.id_to_shard.find(removed_id);
+
+        if (iterator == sharded_index.id_to_shard.end())
+        {
+            throw std::invalid_argument("The vector to be erased is not in the index. ");
+        }
+
+        const auto shard = iterator->second;
+
+        Erase(*sharded_index.shards[shard], removed_id);
+        sharded_index.id_to_shard.erase(iterator);
+    }
+
+    // 优先队列的底层数组
+    inline std::vector<std::pair<float, ID>> &Container(std::priority_queue<std::pair<float, ID>> &queue)
+    {
+        class Access : public std::priority_queue<std::pair<float, ID>>
+        {
+          public:
+            static std::vector<std::pair<float, ID>> &get(std::priority_queue<std::pair<float, ID>> &queue)
+            {
+                return queue.*&Access::c;
+            }
+        };
+
+        return Access::get(queue);
+    }
+
+    // 各个分片当前最近的结果中距离最小的一个
+    //
+    // heads 的长度为 8 的正整数倍，补齐的位置和已经取完的分片为正无穷
+    inline uint64_t Nearest_Head(const float *const heads, const uint64_t number)
+    {
+        auto nearest = 0;
+
+        for (auto i = 1; i < number; ++i)
+        {
+            if (heads[i] < heads[nearest])
+            {
+                nearest = i;
+            }
+        }
+
+        return nearest;
+    }
+
+    __attribute__((target("avx2"))) inline uint64_t Nearest_Head_AVX2(const float *const heads, const uint64_t number)
+    {
+        auto minimum = _mm256_loadu_ps(heads);
+
+        for (auto i = 8; i < number; i += 8)
+        {
+            minimum = _mm256_min_ps(minimum, _mm256_loadu_ps(heads + i));
+        }
+
+        // 把 8 个通道的最小值广播到所有通道
+        minimum = _mm256_min_ps(minimum, _mm256_permute2f128_ps(minimum, minimum, 1));
+        minimum = _mm256_min_ps(minimum, _mm256_shuffle_ps(minimum, minimum, _MM_SHUFFLE(1, 0, 3, 2)));
+        minimum = _mm256_min_ps(minimum, _mm256_shuffle_ps(minimum, minimum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+        for (auto i = 0; i < number; i += 8)
+        {
+            const auto mask =
+                _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(heads + i), minimum, _CMP_EQ_OQ));
+
+            if (mask != 0)
+            {
+                return i + __builtin_ctz(mask);
+            }
+        }
+
+        return 0;
+    }
+
+    // 合并各个分片的查询结果，保留距离最近的 top_k 个
+    //
+    // 每个分片的结果先排成从近到远的序列，再做 k 路归并，每一步用 SIMD 同时比较所有分片的当前结果，
+    // 选出距离最小的一个，一共 top_k 步，调用后 results 被清空
+    inline std::priority_queue<std::pair<float, ID>> Merge(
+        std::vector<std::priority_queue<std::pair<float, ID>>> &results, const uint64_t top_k, const Space::ISA isa)
+    {
+        const auto infinity = std::numeric_limits<float>::infinity();
+        const auto number = results.size();
+        auto lists = std::vector<std::vector<std::pair<float, ID>>>(number);
+        auto positions = std::vector<uint64_t>(number, 0);
+        auto heads = std::vector<float>(std::max<uint64_t>((number + 7) / 8, 1) * 8, infinity);
+        auto merged = std::vector<std::pair<float, ID>>();
+
+        for (auto i = 0; i < number; ++i)
+        {
+            // 直接排序优先队列的底层数组，比逐个出队快
+            lists[i] = std::move(Container(results[i]));
+            std::sort(lists[i].begin(), lists[i].end());
+            results[i] = std::priority_queue<std::pair<float, ID>>();
+
+            if (!lists[i].empty())
+            {
+                heads[i] = lists[i].front().first;
+            }
+        }
+
+        while (merged.size() < top_k)
+        {
+            const auto shard = isa >= Space::ISA::AVX2 ? Nearest_Head_AVX2(heads.data(), heads.size())
+                                                       : Nearest_Head(heads.data(), heads.size());
+
+            if (number <= shard || positions[shard] == lists[shard].size())
+            {
+                break;
+            }
+
+            merged.push_back(lists[shard][positions[shard]++]);
+            heads[shard] = positions[shard] < lists[shard].size() ? lists[shard][positions[shard]].first : infinity;
+        }
+
+        return std::priority_queue<std::pair<float, ID>>(std::less<std::pair<float, ID>>(), std::move(merged));
+    }
+
+    // 查询距离目标向量最近的top-k个向量
+    //
+    // 按聚类划分时只查询距离目标向量最近的 probe 个分片，probe 为 0 时查询所有分片
+    //
+    // 由 thread_number 个线程同时查询不同的分片
+    template <typename Element>
+    inline std::priority_queue<std::pair<float, ID>> Search(const Sharded_Index<Element> &sharded_index,
+                                                            const Space::Input_Type<Element> *const target_vector,
+                                                            const uint64_t top_k, const uint64_t magnification,
+                                                            const uint64_t probe = 0, const uint64_t thread_number = 1)
+    {
+        const auto shard_number = sharded_index.shards.size();
+        auto selected = std::vector<uint64_t>();
+
+        if (sharded_index.partition == Partition::Cluster && probe != 0 && !sharded_index.centers.empty())
+        {
+            Nearest_Shards(sharded_index, target_vector, probe, selected);
+        }
+        else
+        {
+            for (auto i = 0; i < shard_number; ++i)
+            {
+                selected.push_back(i);
+            }
+        }
+
+        // 跳过空的分片
+        std::erase_if(selected, [&](const uint64_t shard) { return sharded_index.shards[shard]->count == 1; });
+
+        auto results = std::vector<std::priority_queue<std::pair<float, ID>>>(selected.size());
+
+        Parallel::For(0, selected.size(), std::min<uint64_t>(thread_number, selected.size()),
+                      [&](const uint64_t i)
+                      {
+                          const auto &shard = *sharded_index.shards[selected[i]];
+
+                          results[i] = Search(shard, target_vector, top_k, magnification);
+                      });
+
+        return Merge(results, top_k, sharded_index.shards.front()->isa);
+    }
+
+} // namespace HSG
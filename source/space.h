@@ -2,8 +2,10 @@
 
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <immintrin.h>
 #include <stdexcept>
+#include <type_traits>
 
 namespace Space
 {
@@ -16,274 +18,1172 @@ namespace Space
         Cosine_Similarity
     };
 
-    namespace Euclidean2
+    // 指令集
+    //
+    // 按从低到高的顺序排列，高一级的指令集包含低一级的指令集
+    enum class ISA : uint64_t
+    {
+        Generic,
+        SSE,
+        AVX2,
+        AVX512
+    };
+
+    // 检测处理器支持的指令集，只在第一次调用时检测
+    //
+    // AVX2 要求同时支持 FMA 和 F16C，AVX512 要求同时支持 AVX512F、AVX512BW 和 AVX512VL
+    inline ISA get_isa()
+    {
+        static const auto isa = []()
+        {
+            __builtin_cpu_init();
+
+            if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("fma") || !__builtin_cpu_supports("f16c"))
+            {
+                return __builtin_cpu_supports("sse2") ? ISA::SSE : ISA::Generic;
+            }
+
+            if (!__builtin_cpu_supports("avx512f") || !__builtin_cpu_supports("avx512bw") ||
+                !__builtin_cpu_supports("avx512vl"))
+            {
+                return ISA::AVX2;
+            }
+
+            return ISA::AVX512;
+        }();
+
+        return isa;
+    }
+
+    inline const char *get_isa_name(const ISA isa)
+    {
+        switch (isa)
+        {
+        case ISA::AVX512:
+            return "AVX512";
+        case ISA::AVX2:
+            return "AVX2";
+        case ISA::SSE:
+            return "SSE";
+        default:
+            return "Generic";
+        }
+    }
+
+    // 半精度浮点数（IEEE 754 binary16）
+    class Float16
     {
+      public:
+        uint16_t value;
 
-        inline float zero(const float *vector1, const uint64_t dimension)
-        {
-#if defined(__AVX512F__)
-            auto *vector1_pointer = vector1;
-            float __attribute__((aligned(64))) temporary_result[16];
-            const float *end = vector1_pointer + dimension;
-            __m512 part_vevtor1;
-            __m512 sum = _mm512_set1_ps(0);
-            while (vector1_pointer < end)
-            {
-                part_vevtor1 = _mm512_loadu_ps(vector1_pointer);
-                vector1_pointer += 16;
-                sum = _mm512_add_ps(sum, _mm512_mul_ps(part_vevtor1, part_vevtor1));
-            }
-            _mm512_store_ps(temporary_result, sum);
-            float distance = temporary_result[0] + temporary_result[1] + temporary_result[2] + temporary_result[3] +
-                             temporary_result[4] + temporary_result[5] + temporary_result[6] + temporary_result[7] +
-                             temporary_result[8] + temporary_result[9] + temporary_result[10] + temporary_result[11] +
-                             temporary_result[12] + temporary_result[13] + temporary_result[14] + temporary_result[15];
-            return distance;
-#elif defined(__AVX__)
-            auto *vector1_pointer = vector1;
-            float __attribute__((aligned(32))) temporary_result[8];
-            const float *end = vector1_pointer + dimension;
-            __m256 part_vector1;
-            __m256 sum = _mm256_set1_ps(0);
-            while (vector1_pointer < end)
-            {
-                part_vector1 = _mm256_loadu_ps(vector1_pointer);
-                vector1_pointer += 8;
-                sum = _mm256_add_ps(sum, _mm256_mul_ps(part_vector1, part_vector1));
-            }
-            _mm256_store_ps(temporary_result, sum);
-            float distance = temporary_result[0] + temporary_result[1] + temporary_result[2] + temporary_result[3] +
-                             temporary_result[4] + temporary_result[5] + temporary_result[6] + temporary_result[7];
-            return distance;
-#elif defined(__SSE__)
-            auto *vector1_pointer = vector1;
-            float __attribute__((aligned(16))) temporary_result[4];
-            const float *end = vector1_pointer + dimension;
-            __m128 part_vector1;
-            __m128 sum = _mm128_set1_ps(0);
-            while (vector1_pointer < end)
-            {
-                part_vector1 = _mm128_loadu_ps(vector1_pointer);
-                vector1_pointer += 4;
-                sum = _mm128_add_ps(sum, _mm128_mul_ps(part_vector1, part_vector1));
-            }
-            _mm128_store_ps(temporary_result, sum);
-            float distance = temporary_result[0] + temporary_result[1] + temporary_result[2] + temporary_result[3];
-            return distance;
+        Float16() : value(0)
+        {
+        }
+
+        explicit Float16(const float number)
+        {
+#if defined(__F16C__)
+            this->value = _cvtss_sh(number, _MM_FROUND_TO_NEAREST_INT);
 #else
-            float square_distance = 0;
-            for (auto i = 0; i < dimension; ++i)
+            uint32_t bits = 0;
+            std::memcpy(&bits, &number, sizeof(float));
+
+            const uint32_t sign = (bits >> 16) & 0x8000;
+            const int32_t exponent = int32_t((bits >> 23) & 0xFF) - 127 + 15;
+            uint32_t mantissa = bits & 0x007FFFFF;
+
+            if (((bits >> 23) & 0xFF) == 0xFF)
+            {
+                // 无穷大和非数
+                this->value = sign | 0x7C00 | (mantissa != 0 ? 0x0200 : 0);
+            }
+            else if (31 <= exponent)
+            {
+                // 上溢
+                this->value = sign | 0x7C00;
+            }
+            else if (exponent <= 0)
             {
-                square_distance += std::pow(vector1[i], 2);
+                // 非规格化数或下溢为零
+                if (exponent < -10)
+                {
+                    this->value = sign;
+                }
+                else
+                {
+                    mantissa |= 0x00800000;
+                    const uint32_t shift = 14 - exponent;
+                    uint32_t half = mantissa >> shift;
+                    const uint32_t remainder = mantissa & ((1U << shift) - 1);
+                    const uint32_t middle = 1U << (shift - 1);
+
+                    if (middle < remainder || (remainder == middle && (half & 1)))
+                    {
+                        ++half;
+                    }
+
+                    this->value = sign | half;
+                }
+            }
+            else
+            {
+                // 就近舍入到偶数，进位可以直接传递到指数
+                uint32_t half = sign | (uint32_t(exponent) << 10) | (mantissa >> 13);
+                const uint32_t remainder = mantissa & 0x1FFF;
+
+                if (0x1000 < remainder || (remainder == 0x1000 && (half & 1)))
+                {
+                    ++half;
+                }
+
+                this->value = half;
             }
-            // 根据距离定义应开方，但是不影响距离对比所以省略
-            return square_distance;
 #endif
         }
 
-        inline float distance(const float *vector1, const float *vector2, const uint64_t dimension)
-        {
-#if defined(__AVX512F__)
-            auto *vector1_pointer = vector1;
-            auto *vector2_pointer = vector2;
-            float __attribute__((aligned(64))) temporary_result[16];
-            const float *end = vector1_pointer + dimension;
-            __m512 difference, part_vevtor1, part_vevtor2;
-            __m512 sum = _mm512_set1_ps(0);
-            while (vector1_pointer < end)
-            {
-                part_vevtor1 = _mm512_loadu_ps(vector1_pointer);
-                vector1_pointer += 16;
-                part_vevtor2 = _mm512_loadu_ps(vector2_pointer);
-                vector2_pointer += 16;
-                difference = _mm512_sub_ps(part_vevtor1, part_vevtor2);
-                sum = _mm512_add_ps(sum, _mm512_mul_ps(difference, difference));
-            }
-            _mm512_store_ps(temporary_result, sum);
-            float distance = temporary_result[0] + temporary_result[1] + temporary_result[2] + temporary_result[3] +
-                             temporary_result[4] + temporary_result[5] + temporary_result[6] + temporary_result[7] +
-                             temporary_result[8] + temporary_result[9] + temporary_result[10] + temporary_result[11] +
-                             temporary_result[12] + temporary_result[13] + temporary_result[14] + temporary_result[15];
-            return distance;
-#elif defined(__AVX__)
-            auto *vector1_pointer = vector1;
-            auto *vector2_pointer = vector2;
-            float __attribute__((aligned(32))) temporary_result[8];
-            const float *end = vector1_pointer + dimension;
-            __m256 difference, part_vector1, part_vector2;
-            __m256 sum = _mm256_set1_ps(0);
-            while (vector1_pointer < end)
-            {
-                part_vector1 = _mm256_loadu_ps(vector1_pointer);
-                vector1_pointer += 8;
-                part_vector2 = _mm256_loadu_ps(vector2_pointer);
-                vector2_pointer += 8;
-                difference = _mm256_sub_ps(part_vector1, part_vector2);
-                sum = _mm256_add_ps(sum, _mm256_mul_ps(difference, difference));
-            }
-            _mm256_store_ps(temporary_result, sum);
-            float distance = temporary_result[0] + temporary_result[1] + temporary_result[2] + temporary_result[3] +
-                             temporary_result[4] + temporary_result[5] + temporary_result[6] + temporary_result[7];
-            return distance;
-#elif defined(__SSE__)
-            auto *vector1_pointer = vector1;
-            auto *vector2_pointer = vector2;
-            float __attribute__((aligned(16))) temporary_result[4];
-            const float *end = vector1_pointer + dimension;
-            __m128 difference, part_vector1, part_vector2;
-            __m128 sum = _mm128_set1_ps(0);
-            while (vector1_pointer < end)
-            {
-                part_vector1 = _mm128_loadu_ps(vector1_pointer);
-                vector1_pointer += 4;
-                part_vector2 = _mm128_loadu_ps(vector2_pointer);
-                vector2_pointer += 4;
-                difference = _mm128_sub_ps(part_vector1, part_vector2);
-                sum = _mm128_add_ps(sum, _mm128_mul_ps(difference, difference));
-            }
-            _mm128_store_ps(temporary_result, sum);
-            float distance = temporary_result[0] + temporary_result[1] + temporary_result[2] + temporary_result[3];
-            return distance;
+        operator float() const
+        {
+#if defined(__F16C__)
+            return _cvtsh_ss(this->value);
 #else
-            float square_distance = 0;
-            for (auto i = 0; i < dimension; ++i)
+            const uint32_t sign = uint32_t(this->value & 0x8000) << 16;
+            uint32_t exponent = (this->value >> 10) & 0x1F;
+            uint32_t mantissa = this->value & 0x03FF;
+            uint32_t bits = 0;
+
+            if (exponent == 0x1F)
             {
-                square_distance += std::pow(vector1[i] - vector2[i], 2);
+                bits = sign | 0x7F800000 | (mantissa << 13);
             }
-            // 根据距离定义应开方，但是不影响距离对比所以省略
-            return square_distance;
+            else if (exponent != 0)
+            {
+                bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+            }
+            else if (mantissa != 0)
+            {
+                // 非规格化数
+                exponent = 127 - 15 + 1;
+
+                while ((mantissa & 0x0400) == 0)
+                {
+                    mantissa <<= 1;
+                    --exponent;
+                }
+
+                bits = sign | (exponent << 23) | ((mantissa & 0x03FF) << 13);
+            }
+            else
+            {
+                bits = sign;
+            }
+
+            float number = 0;
+            std::memcpy(&number, &bits, sizeof(float));
+            return number;
 #endif
         }
+    };
+
+    // 脑浮点数（bfloat16）
+    //
+    // 即单精度浮点数的高16位
+    class BFloat16
+    {
+      public:
+        uint16_t value;
+
+        BFloat16() : value(0)
+        {
+        }
+
+        explicit BFloat16(const float number)
+        {
+            uint32_t bits = 0;
+            std::memcpy(&bits, &number, sizeof(float));
+
+            if ((bits & 0x7FFFFFFF) > 0x7F800000)
+            {
+                // 非数
+                this->value = (bits >> 16) | 0x0040;
+            }
+            else
+            {
+                // 就近舍入到偶数
+                this->value = (bits + 0x7FFF + ((bits >> 16) & 1)) >> 16;
+            }
+        }
+
+        operator float() const
+        {
+            const uint32_t bits = uint32_t(this->value) << 16;
+            float number = 0;
+            std::memcpy(&number, &bits, sizeof(float));
+            return number;
+        }
+    };
+
+    // 添加和查询时输入的向量中元素的类型
+    //
+    // 半精度的向量在索引中以半精度保存，输入和查询使用单精度
+    template <typename Element>
+    class Input
+    {
+      public:
+        using type = Element;
+    };
+
+    template <>
+    class Input<Float16>
+    {
+      public:
+        using type = float;
+    };
+
+    template <>
+    class Input<BFloat16>
+    {
+      public:
+        using type = float;
+    };
+
+    template <typename Element>
+    using Input_Type = typename Input<Element>::type;
+
+    // 转换向量中元素的类型
+    template <typename Source, typename Destination>
+    inline void convert(const Source *source, Destination *destination, const uint64_t dimension)
+    {
+        for (auto i = 0; i < dimension; ++i)
+        {
+            destination[i] = Destination(float(source[i]));
+        }
+    }
+
+    namespace Euclidean2
+    {
+
+        // 各指令集的平方欧氏距离
+        //
+        // 未特化的模板不使用SIMD
+        //
+        // 根据距离定义应开方，但是不影响距离对比所以省略
+        template <ISA isa>
+        class Kernel
+        {
+          public:
+            template <typename Element>
+            static float zero(const Element *vector1, const uint64_t dimension)
+            {
+                float square_distance = 0;
+
+                for (auto i = 0; i < dimension; ++i)
+                {
+                    const float element = vector1[i];
+                    square_distance += element * element;
+                }
+
+                return square_distance;
+            }
+
+            // 无符号8位整数使用32位整数累加，结果是精确的
+            static float zero(const uint8_t *vector1, const uint64_t dimension)
+            {
+                int32_t square_distance = 0;
+
+                for (auto i = 0; i < dimension; ++i)
+                {
+                    square_distance += int32_t(vector1[i]) * vector1[i];
+                }
+
+                return square_distance;
+            }
+
+            // 半精度的向量先转换为单精度再计算
+            template <typename Input, typename Element>
+            static float distance(const Input *vector1, const Element *vector2, const uint64_t dimension)
+            {
+                float square_distance = 0;
+
+                for (auto i = 0; i < dimension; ++i)
+                {
+                    auto difference = float(vector1[i]) - float(vector2[i]);
+                    square_distance += difference * difference;
+                }
+
+                return square_distance;
+            }
+
+            static float distance(const uint8_t *vector1, const uint8_t *vector2, const uint64_t dimension)
+            {
+                int32_t square_distance = 0;
+
+                for (auto i = 0; i < dimension; ++i)
+                {
+                    auto difference = int32_t(vector1[i]) - vector2[i];
+                    square_distance += difference * difference;
+                }
+
+                return square_distance;
+            }
+        };
+
+        // SSE 是 x86-64 的基础指令集，不需要指定 target
+        template <>
+        class Kernel<ISA::SSE>
+        {
+          public:
+            // 没有实现的类型使用低一级的指令集
+            template <typename Element>
+            static float zero(const Element *vector1, const uint64_t dimension)
+            {
+                return Kernel<ISA::Generic>::zero(vector1, dimension);
+            }
+
+            template <typename Input, typename Element>
+            static float distance(const Input *vector1, const Element *vector2, const uint64_t dimension)
+            {
+                return Kernel<ISA::Generic>::distance(vector1, vector2, dimension);
+            }
+
+            static float reduce(const __m128 sum)
+            {
+                auto half = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+                half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+                return _mm_cvtss_f32(half);
+            }
+
+            static float zero(const float *vector1, const uint64_t dimension)
+            {
+                uint64_t i = 0;
+                __m128 sum = _mm_setzero_ps();
+
+                for (; i + 4 <= dimension; i += 4)
+                {
+                    auto part_vector1 = _mm_loadu_ps(vector1 + i);
+                    sum = _mm_add_ps(sum, _mm_mul_ps(part_vector1, part_vector1));
+                }
+
+                float square_distance = reduce(sum);
+
+                for (; i < dimension; ++i)
+                {
+                    square_distance += vector1[i] * vector1[i];
+                }
+
+                return square_distance;
+            }
+
+            static float distance(const float *vector1, const float *vector2, const uint64_t dimension)
+            {
+                uint64_t i = 0;
+                __m128 sum = _mm_setzero_ps();
+
+                for (; i + 4 <= dimension; i += 4)
+                {
+                    auto difference = _mm_sub_ps(_mm_loadu_ps(vector1 + i), _mm_loadu_ps(vector2 + i));
+                    sum = _mm_add_ps(sum, _mm_mul_ps(difference, difference));
+                }
+
+                float square_distance = reduce(sum);
+
+                for (; i < dimension; ++i)
+                {
+                    auto difference = vector1[i] - vector2[i];
+                    square_distance += difference * difference;
+                }
+
+                return square_distance;
+            }
+        };
+
+        template <>
+        class Kernel<ISA::AVX2>
+        {
+          public:
+            // 没有实现的类型使用低一级的指令集
+            template <typename Element>
+            static float zero(const Element *vector1, const uint64_t dimension)
+            {
+                return Kernel<ISA::SSE>::zero(vector1, dimension);
+            }
+
+            template <typename Input, typename Element>
+            static float distance(const Input *vector1, const Element *vector2, const uint64_t dimension)
+            {
+                return Kernel<ISA::SSE>::distance(vector1, vector2, dimension);
+            }
+
+            // 前 number 个元素有效的掩码，用于处理末尾不足8个的元素
+            __attribute__((target("avx2,fma,f16c"))) static __m256i mask(const uint64_t number)
+            {
+                return _mm256_cmpgt_epi32(_mm256_set1_epi32(number), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+            }
+
+            __attribute__((target("avx2,fma,f16c"))) static float reduce(const __m256 sum)
+            {
+                return Kernel<ISA::SSE>::reduce(_mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1)));
+            }
+
+            __attribute__((target("avx2,fma,f16c"))) static float zero(const float *vector1, const uint64_t dimension)
+            {
+                uint64_t i = 0;
+                __m256 sum = _mm256_setzero_ps();
+
+                for (; i + 8 <= dimension; i += 8)
+                {
+                    auto part_vector1 = _mm256_loadu_ps(vector1 + i);
+                    sum = _mm256_fmadd_ps(part_vector1, part_vector1, sum);
+                }
+
+                if (i < dimension)
+                {
+                    auto part_vector1 = _mm256_maskload_ps(vector1 + i, mask(dimension - i));
+                    sum = _mm256_fmadd_ps(part_vector1, part_vector1, sum);
+                }
+
+                return reduce(sum);
+            }
+
+            // 使用四个累加器打断加法的依赖链
+            __attribute__((target("avx2,fma,f16c"))) static float distance(const float *vector1, const float *vector2,
+                                                                           const uint64_t dimension)
+            {
+                uint64_t i = 0;
+                __m256 sum0 = _mm256_setzero_ps();
+                __m256 sum1 = _mm256_setzero_ps();
+                __m256 sum2 = _mm256_setzero_ps();
+                __m256 sum3 = _mm256_setzero_ps();
+
+                for (; i + 32 <= dimension; i += 32)
+                {
+                    auto difference0 = _mm256_sub_ps(_mm256_loadu_ps(vector1 + i), _mm256_loadu_ps(vector2 + i));
+                    auto difference1 =
+                        _mm256_sub_ps(_mm256_loadu_ps(vector1 + i + 8), _mm256_loadu_ps(vector2 + i + 8));
+                    auto difference2 =
+                        _mm256_sub_ps(_mm256_loadu_ps(vector1 + i + 16), _mm256_loadu_ps(vector2 + i + 16));
+                    auto difference3 =
+                        _mm256_sub_ps(_mm256_loadu_ps(vector1 + i + 24), _mm256_loadu_ps(vector2 + i + 24));
+                    sum0 = _mm256_fmadd_ps(difference0, difference0, sum0);
+                    sum1 = _mm256_fmadd_ps(difference1, difference1, sum1);
+                    sum2 = _mm256_fmadd_ps(difference2, difference2, sum2);
+                    sum3 = _mm256_fmadd_ps(difference3, difference3, sum3);
+                }
+
+                for (; i + 8 <= dimension; i += 8)
+                {
+                    auto difference = _mm256_sub_ps(_mm256_loadu_ps(vector1 + i), _mm256_loadu_ps(vector2 + i));
+                    sum0 = _mm256_fmadd_ps(difference, difference, sum0);
+                }
+
+                if (i < dimension)
+                {
+                    auto part_mask = mask(dimension - i);
+                    auto difference = _mm256_sub_ps(_mm256_maskload_ps(vector1 + i, part_mask),
+                                                    _mm256_maskload_ps(vector2 + i, part_mask));
+                    sum1 = _mm256_fmadd_ps(difference, difference, sum1);
+                }
+
+                return reduce(_mm256_add_ps(_mm256_add_ps(sum0, sum1), _mm256_add_ps(sum2, sum3)));
+            }
+
+            // 维度在编译期确定，内联后循环次数固定
+            template <uint64_t Dimension>
+            __attribute__((target("avx2,fma,f16c"))) static float distance(const float *vector1, const float *vector2)
+            {
+                return distance(vector1, vector2, Dimension);
+            }
+
+            // 差值扩展为16位有符号整数，相乘后以32位整数累加
+            __attribute__((target("avx2,fma,f16c"))) static float zero(const uint8_t *vector1, const uint64_t dimension)
+            {
+                uint64_t i = 0;
+                __m256i sum = _mm256_setzero_si256();
+
+                for (; i + 16 <= dimension; i += 16)
+                {
+                    auto part_vector1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(vector1 + i)));
+                    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(part_vector1, part_vector1));
+                }
+
+                auto half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+                half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0b01001110));
+                half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0b10110001));
+                int32_t square_distance = _mm_cvtsi128_si32(half);
+
+                for (; i < dimension; ++i)
+                {
+                    square_distance += int32_t(vector1[i]) * vector1[i];
+                }
+
+                return square_distance;
+            }
+
+            __attribute__((target("avx2,fma,f16c"))) static float distance(const uint8_t *vector1,
+                                                                           const uint8_t *vector2,
+                                                                           const uint64_t dimension)
+            {
+                uint64_t i = 0;
+                __m256i sum = _mm256_setzero_si256();
+
+                for (; i + 16 <= dimension; i += 16)
+                {
+                    auto part_vector1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(vector1 + i)));
+                    auto part_vector2 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(vector2 + i)));
+                    auto difference = _mm256_sub_epi16(part_vector1, part_vector2);
+                    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(difference, difference));
+                }
+
+                auto half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+                half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0b01001110));
+                half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0b10110001));
+                int32_t square_distance = _mm_cvtsi128_si32(half);
+
+                for (; i < dimension; ++i)
+                {
+                    auto difference = int32_t(vector1[i]) - vector2[i];
+                    square_distance += difference * difference;
+                }
+
+                return square_distance;
+            }
+
+            __attribute__((target("avx2,fma,f16c"))) static float distance(const float *vector1,
+                                                                           const Float16 *vector2,
+                                                                           const uint64_t dimension)
+            {
+                uint64_t i = 0;
+                __m256 sum = _mm256_setzero_ps();
+
+                for (; i + 8 <= dimension; i += 8)
+                {
+                    auto part_vector1 = _mm256_loadu_ps(vector1 + i);
+                    auto part_vector2 = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(vector2 + i)));
+                    auto difference = _mm256_sub_ps(part_vector1, part_vector2);
+                    sum = _mm256_fmadd_ps(difference, difference, sum);
+                }
+
+                float square_distance = reduce(sum);
+
+                for (; i < dimension; ++i)
+                {
+                    auto difference = vector1[i] - _cvtsh_ss(vector2[i].value);
+                    square_distance += difference * difference;
+                }
+
+                return square_distance;
+            }
+
+            // bfloat16 左移16位即为单精度浮点数
+            __attribute__((target("avx2,fma,f16c"))) static float distance(const float *vector1,
+                                                                           const BFloat16 *vector2,
+                                                                           const uint64_t dimension)
+            {
+                uint64_t i = 0;
+                __m256 sum = _mm256_setzero_ps();
+
+                for (; i + 8 <= dimension; i += 8)
+                {
+                    auto part_vector1 = _mm256_loadu_ps(vector1 + i);
+                    auto part_vector2 = _mm256_castsi256_ps(
+                        _mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(vector2 + i))), 16));
+                    auto difference = _mm256_sub_ps(part_vector1, part_vector2);
+                    sum = _mm256_fmadd_ps(difference, difference, sum);
+                }
+
+                float square_distance = reduce(sum);
+
+                for (; i < dimension; ++i)
+                {
+                    auto difference = vector1[i] - float(vector2[i]);
+                    square_distance += difference * difference;
+                }
+
+                return square_distance;
+            }
+        };
+
+        // 末尾不足一个寄存器的元素使用掩码加载，被屏蔽的元素不会被访问
+        template <>
+        class Kernel<ISA::AVX512>
+        {
+          public:
+            // 没有实现的类型使用低一级的指令集
+            template <typename Element>
+            static float zero(const Element *vector1, const uint64_t dimension)
+            {
+                return Kernel<ISA::AVX2>::zero(vector1, dimension);
+            }
+
+            template <typename Input, typename Element>
+            static float distance(const Input *vector1, const Element *vector2, const uint64_t dimension)
+            {
+                return Kernel<ISA::AVX2>::distance(vector1, vector2, dimension);
+            }
+
+            __attribute__((target("avx512f,avx512bw,avx512vl,avx2,fma,f16c"))) static float zero(
+                const float *vector1, const uint64_t dimension)
+            {
+                uint64_t i = 0;
+                __m512 sum = _mm512_setzero_ps();
+
+                for (; i + 16 <= dimension; i += 16)
+                {
+                    auto part_vector1 = _mm512_loadu_ps(vector1 + i);
+                    sum = _mm512_fmadd_ps(part_vector1, part_vector1, sum);
+                }
+
+                if (i < dimension)
+                {
+                    auto part_vector1 = _mm512_maskz_loadu_ps(__mmask16((1U << (dimension - i)) - 1), vector1 + i);
+                    sum = _mm512_fmadd_ps(part_vector1, part_vector1, sum);
+                }
+
+                return _mm512_reduce_add_ps(sum);
+            }
+
+            // 使用四个累加器打断加法的依赖链
+            __attribute__((target("avx512f,avx512bw,avx512vl,avx2,fma,f16c"))) static float distance(
+                const float *vector1, const float *vector2, const uint64_t dimension)
+            {
+                uint64_t i = 0;
+                __m512 sum0 = _mm512_setzero_ps();
+                __m512 sum1 = _mm512_setzero_ps();
+                __m512 sum2 = _mm512_setzero_ps();
+                __m512 sum3 = _mm512_setzero_ps();
+
+                for (; i + 64 <= dimension; i += 64)
+                {
+                    auto difference0 = _mm512_sub_ps(_mm512_loadu_ps(vector1 + i), _mm512_loadu_ps(vector2 + i));
+                    auto difference1 =
+                        _mm512_sub_ps(_mm512_loadu_ps(vector1 + i + 16), _mm512_loadu_ps(vector2 + i + 16));
+                    auto difference2 =
+                        _mm512_sub_ps(_mm512_loadu_ps(vector1 + i + 32), _mm512_loadu_ps(vector2 + i + 32));
+                    auto difference3 =
+                        _mm512_sub_ps(_mm512_loadu_ps(vector1 + i + 48), _mm512_loadu_ps(vector2 + i + 48));
+                    sum0 = _mm512_fmadd_ps(difference0, difference0, sum0);
+                    sum1 = _mm512_fmadd_ps(difference1, difference1, sum1);
+                    sum2 = _mm512_fmadd_ps(difference2, difference2, sum2);
+                    sum3 = _mm512_fmadd_ps(difference3, difference3, sum3);
+                }
+
+                for (; i + 16 <= dimension; i += 16)
+                {
+                    auto difference = _mm512_sub_ps(_mm512_loadu_ps(vector1 + i), _mm512_loadu_ps(vector2 + i));
+                    sum0 = _mm512_fmadd_ps(difference, difference, sum0);
+                }
+
+                if (i < dimension)
+                {
+                    auto part_mask = __mmask16((1U << (dimension - i)) - 1);
+                    auto difference = _mm512_sub_ps(_mm512_maskz_loadu_ps(part_mask, vector1 + i),
+                                                    _mm512_maskz_loadu_ps(part_mask, vector2 + i));
+                    sum1 = _mm512_fmadd_ps(difference, difference, sum1);
+                }
+
+                return _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(sum0, sum1), _mm512_add_ps(sum2, sum3)));
+            }
+
+            // 维度在编译期确定，内联后循环次数固定
+            template <uint64_t Dimension>
+            __attribute__((target("avx512f,avx512bw,avx512vl,avx2,fma,f16c"))) static float distance(
+                const float *vector1, const float *vector2)
+            {
+                return distance(vector1, vector2, Dimension);
+            }
+
+            // 差值扩展为16位有符号整数，相乘后以32位整数累加
+            __attribute__((target("avx512f,avx512bw,avx512vl,avx2,fma,f16c"))) static float zero(
+                const uint8_t *vector1, const uint64_t dimension)
+            {
+                uint64_t i = 0;
+                __m512i sum = _mm512_setzero_si512();
+
+                for (; i + 32 <= dimension; i += 32)
+                {
+                    auto part_vector1 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(vector1 + i)));
+                    sum = _mm512_add_epi32(sum, _mm512_madd_epi16(part_vector1, part_vector1));
+                }
+
+                if (i < dimension)
+                {
+                    auto part_mask = __mmask32((1ULL << (dimension - i)) - 1);
+                    auto part_vector1 = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(part_mask, vector1 + i));
+                    sum = _mm512_add_epi32(sum, _mm512_madd_epi16(part_vector1, part_vector1));
+                }
+
+                return _mm512_reduce_add_epi32(sum);
+            }
+
+            __attribute__((target("avx512f,avx512bw,avx512vl,avx2,fma,f16c"))) static float distance(
+                const uint8_t *vector1, const uint8_t *vector2, const uint64_t dimension)
+            {
+                uint64_t i = 0;
+                __m512i sum = _mm512_setzero_si512();
+
+                for (; i + 32 <= dimension; i += 32)
+                {
+                    auto part_vector1 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(vector1 + i)));
+                    auto part_vector2 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(vector2 + i)));
+                    auto difference = _mm512_sub_epi16(part_vector1, part_vector2);
+                    sum = _mm512_add_epi32(sum, _mm512_madd_epi16(difference, difference));
+                }
+
+                if (i < dimension)
+                {
+                    auto part_mask = __mmask32((1ULL << (dimension - i)) - 1);
+                    auto part_vector1 = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(part_mask, vector1 + i));
+                    auto part_vector2 = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(part_mask, vector2 + i));
+                    auto difference = _mm512_sub_epi16(part_vector1, part_vector2);
+                    sum = _mm512_add_epi32(sum, _mm512_madd_epi16(difference, difference));
+                }
+
+                return _mm512_reduce_add_epi32(sum);
+            }
+
+            __attribute__((target("avx512f,avx512bw,avx512vl,avx2,fma,f16c"))) static float distance(
+                const float *vector1, const Float16 *vector2, const uint64_t dimension)
+            {
+                uint64_t i = 0;
+                __m512 sum = _mm512_setzero_ps();
+
+                for (; i + 16 <= dimension; i += 16)
+                {
+                    auto part_vector1 = _mm512_loadu_ps(vector1 + i);
+                    auto part_vector2 = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(vector2 + i)));
+                    auto difference = _mm512_sub_ps(part_vector1, part_vector2);
+                    sum = _mm512_fmadd_ps(difference, difference, sum);
+                }
+
+                if (i < dimension)
+                {
+                    auto part_mask = __mmask16((1U << (dimension - i)) - 1);
+                    auto part_vector1 = _mm512_maskz_loadu_ps(part_mask, vector1 + i);
+                    auto part_vector2 = _mm512_cvtph_ps(_mm256_maskz_loadu_epi16(part_mask, vector2 + i));
+                    auto difference = _mm512_sub_ps(part_vector1, part_vector2);
+                    sum = _mm512_fmadd_ps(difference, difference, sum);
+                }
+
+                return _mm512_reduce_add_ps(sum);
+            }
+
+            // bfloat16 左移16位即为单精度浮点数
+            __attribute__((target("avx512f,avx512bw,avx512vl,avx2,fma,f16c"))) static float distance(
+                const float *vector1, const BFloat16 *vector2, const uint64_t dimension)
+            {
+                uint64_t i = 0;
+                __m512 sum = _mm512_setzero_ps();
+
+                for (; i + 16 <= dimension; i += 16)
+                {
+                    auto part_vector1 = _mm512_loadu_ps(vector1 + i);
+                    auto part_vector2 = _mm512_castsi512_ps(_mm512_slli_epi32(
+                        _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i *)(vector2 + i))), 16));
+                    auto difference = _mm512_sub_ps(part_vector1, part_vector2);
+                    sum = _mm512_fmadd_ps(difference, difference, sum);
+                }
+
+                if (i < dimension)
+                {
+                    auto part_mask = __mmask16((1U << (dimension - i)) - 1);
+                    auto part_vector1 = _mm512_maskz_loadu_ps(part_mask, vector1 + i);
+                    auto part_vector2 = _mm512_castsi512_ps(
+                        _mm512_slli_epi32(_mm512_cvtepu16_epi32(_mm256_maskz_loadu_epi16(part_mask, vector2 + i)), 16));
+                    auto difference = _mm512_sub_ps(part_vector1, part_vector2);
+                    sum = _mm512_fmadd_ps(difference, difference, sum);
+                }
+
+                return _mm512_reduce_add_ps(sum);
+            }
+        };
+
+        // 使用运行时检测到的指令集计算
+        template <typename Element>
+        inline float zero(const Element *vector1, const uint64_t dimension)
+        {
+            switch (get_isa())
+            {
+            case ISA::AVX512:
+                return Kernel<ISA::AVX512>::zero(vector1, dimension);
+            case ISA::AVX2:
+                return Kernel<ISA::AVX2>::zero(vector1, dimension);
+            case ISA::SSE:
+                return Kernel<ISA::SSE>::zero(vector1, dimension);
+            default:
+                return Kernel<ISA::Generic>::zero(vector1, dimension);
+            }
+        }
+
+        template <typename Input, typename Element>
+        inline float distance(const Input *vector1, const Element *vector2, const uint64_t dimension)
+        {
+            switch (get_isa())
+            {
+            case ISA::AVX512:
+                return Kernel<ISA::AVX512>::distance(vector1, vector2, dimension);
+            case ISA::AVX2:
+                return Kernel<ISA::AVX2>::distance(vector1, vector2, dimension);
+            case ISA::SSE:
+                return Kernel<ISA::SSE>::distance(vector1, vector2, dimension);
+            default:
+                return Kernel<ISA::Generic>::distance(vector1, vector2, dimension);
+            }
+        }
 
     } // namespace Euclidean2
 
+    namespace Inner_Product
+    {
+
+        // 各指令集的内积
+        //
+        // 内积越大越相似，返回内积的相反数，和其它距离一样越小越相似
+        template <ISA isa>
+        class Kernel
+        {
+          public:
+            static float distance(const float *vector1, const float *vector2, const uint64_t dimension)
+            {
+                float product = 0;
+
+                for (auto i = 0; i < dimension; ++i)
+                {
+                    product += vector1[i] * vector2[i];
+                }
+
+                return -product;
+            }
+        };
+
+        template <>
+        class Kernel<ISA::SSE>
+        {
+          public:
+            static float distance(const float *vector1, const float *vector2, const uint64_t dimension)
+            {
+                uint64_t i = 0;
+                __m128 sum = _mm_setzero_ps();
+
+                for (; i + 4 <= dimension; i += 4)
+                {
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(vector1 + i), _mm_loadu_ps(vector2 + i)));
+                }
+
+                float product = Euclidean2::Kernel<ISA::SSE>::reduce(sum);
+
+                for (; i < dimension; ++i)
+                {
+                    product += vector1[i] * vector2[i];
+                }
+
+                return -product;
+            }
+        };
+
+        template <>
+        class Kernel<ISA::AVX2>
+        {
+          public:
+            // 使用四个累加器打断加法的依赖链
+            __attribute__((target("avx2,fma,f16c"))) static float distance(const float *vector1, const float *vector2,
+                                                                           const uint64_t dimension)
+            {
+                uint64_t i = 0;
+                __m256 sum0 = _mm256_setzero_ps();
+                __m256 sum1 = _mm256_setzero_ps();
+                __m256 sum2 = _mm256_setzero_ps();
+                __m256 sum3 = _mm256_setzero_ps();
+
+                for (; i + 32 <= dimension; i += 32)
+                {
+                    sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(vector1 + i), _mm256_loadu_ps(vector2 + i), sum0);
+                    sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(vector1 + i + 8), _mm256_loadu_ps(vector2 + i + 8), sum1);
+                    sum2 = _mm256_fmadd_ps(_mm256_loadu_ps(vector1 + i + 16), _mm256_loadu_ps(vector2 + i + 16), sum2);
+                    sum3 = _mm256_fmadd_ps(_mm256_loadu_ps(vector1 + i + 24), _mm256_loadu_ps(vector2 + i + 24), sum3);
+                }
+
+                for (; i + 8 <= dimension; i += 8)
+                {
+                    sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(vector1 + i), _mm256_loadu_ps(vector2 + i), sum0);
+                }
+
+                if (i < dimension)
+                {
+                    auto part_mask = Euclidean2::Kernel<ISA::AVX2>::mask(dimension - i);
+                    sum1 = _mm256_fmadd_ps(_mm256_maskload_ps(vector1 + i, part_mask),
+                                           _mm256_maskload_ps(vector2 + i, part_mask), sum1);
+                }
+
+                return -Euclidean2::Kernel<ISA::AVX2>::reduce(
+                    _mm256_add_ps(_mm256_add_ps(sum0, sum1), _mm256_add_ps(sum2, sum3)));
+            }
+        };
+
+        template <>
+        class Kernel<ISA::AVX512>
+        {
+          public:
+            // 使用四个累加器打断加法的依赖链
+            __attribute__((target("avx512f,avx512bw,avx512vl,avx2,fma,f16c"))) static float distance(
+                const float *vector1, const float *vector2, const uint64_t dimension)
+            {
+                uint64_t i = 0;
+                __m512 sum0 = _mm512_setzero_ps();
+                __m512 sum1 = _mm512_setzero_ps();
+                __m512 sum2 = _mm512_setzero_ps();
+                __m512 sum3 = _mm512_setzero_ps();
+
+                for (; i + 64 <= dimension; i += 64)
+                {
+                    sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(vector1 + i), _mm512_loadu_ps(vector2 + i), sum0);
+                    sum1 = _mm512_fmadd_ps(_mm512_loadu_ps(vector1 + i + 16), _mm512_loadu_ps(vector2 + i + 16), sum1);
+                    sum2 = _mm512_fmadd_ps(_mm512_loadu_ps(vector1 + i + 32), _mm512_loadu_ps(vector2 + i + 32), sum2);
+                    sum3 = _mm512_fmadd_ps(_mm512_loadu_ps(vector1 + i + 48), _mm512_loadu_ps(vector2 + i + 48), sum3);
+                }
+
+                for (; i + 16 <= dimension; i += 16)
+                {
+                    sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(vector1 + i), _mm512_loadu_ps(vector2 + i), sum0);
+                }
+
+                if (i < dimension)
+                {
+                    auto part_mask = __mmask16((1U << (dimension - i)) - 1);
+                    sum1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(part_mask, vector1 + i),
+                                           _mm512_maskz_loadu_ps(part_mask, vector2 + i), sum1);
+                }
+
+                return -_mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(sum0, sum1), _mm512_add_ps(sum2, sum3)));
+            }
+        };
+
+    } // namespace Inner_Product
+
     namespace Cosine
     {
 
-        inline float distance(const float *vector1, const float *vector2, const uint64_t dimension)
-        {
-#if defined(__AVX512F__)
-            auto *vector1_pointer = vector1;
-            auto *vector2_pointer = vector2;
-            float __attribute__((aligned(64))) temporary_product[16];
-            float __attribute__((aligned(64))) temporary_result1[16];
-            float __attribute__((aligned(64))) temporary_result2[16];
-            const float *end = vector1_pointer + dimension;
-            __m512 part_vector1, part_vector2;
-            __m512 product = _mm512_set1_ps(0);
-            __m512 result1 = _mm512_set1_ps(0);
-            __m512 result2 = _mm512_set1_ps(0);
-            while (vector1_pointer < end)
-            {
-                part_vector1 = _mm512_loadu_ps(vector1_pointer);
-                vector1_pointer += 16;
-                part_vector2 = _mm512_loadu_ps(vector2_pointer);
-                vector2_pointer += 16;
-                product = _mm512_add_ps(product, _mm512_mul_ps(part_vector1, part_vector2));
-                result1 = _mm512_add_ps(result1, _mm512_mul_ps(part_vector1, part_vector1));
-                result2 = _mm512_add_ps(result2, _mm512_mul_ps(part_vector2, part_vector2));
-            }
-            _mm512_store_ps(temporary_product, product);
-            _mm512_store_ps(temporary_result1, result1);
-            _mm512_store_ps(temporary_result2, result2);
-            return (product[0] + product[1] + product[2] + product[3] + product[4] + product[5] + product[6] +
-                    product[7]) /
-                   std::sqrt(
-                       (temporary_result1[0] + temporary_result1[1] + temporary_result1[2] + temporary_result1[3] +
-                        temporary_result1[4] + temporary_result1[5] + temporary_result1[6] + temporary_result1[7] +
-                        temporary_result1[8] + temporary_result1[9] + temporary_result1[10] + temporary_result1[11] +
-                        temporary_result1[12] + temporary_result1[13] + temporary_result1[14] + temporary_result1[15]) *
-                       (temporary_result2[0] + temporary_result2[1] + temporary_result2[2] + temporary_result2[3] +
-                        temporary_result2[4] + temporary_result2[5] + temporary_result2[6] + temporary_result2[7] +
-                        temporary_result2[8] + temporary_result2[9] + temporary_result2[10] + temporary_result2[11] +
-                        temporary_result2[12] + temporary_result2[13] + temporary_result2[14] + temporary_result2[15]));
-#elif defined(__AVX__)
-            auto *vector1_pointer = vector1;
-            auto *vector2_pointer = vector2;
-            float __attribute__((aligned(32))) temporary_product[8];
-            float __attribute__((aligned(32))) temporary_result1[8];
-            float __attribute__((aligned(32))) temporary_result2[8];
-            const float *end = vector1_pointer + dimension;
-            __m256 part_vector1, part_vector2;
-            __m256 product = _mm256_set1_ps(0);
-            __m256 result1 = _mm256_set1_ps(0);
-            __m256 result2 = _mm256_set1_ps(0);
-            while (vector1_pointer < end)
-            {
-                part_vector1 = _mm256_loadu_ps(vector1_pointer);
-                vector1_pointer += 8;
-                part_vector2 = _mm256_loadu_ps(vector2_pointer);
-                vector2_pointer += 8;
-                product = _mm256_add_ps(product, _mm256_mul_ps(part_vector1, part_vector2));
-                result1 = _mm256_add_ps(result1, _mm256_mul_ps(part_vector1, part_vector1));
-                result2 = _mm256_add_ps(result2, _mm256_mul_ps(part_vector2, part_vector2));
-            }
-            _mm256_store_ps(temporary_product, product);
-            _mm256_store_ps(temporary_result1, result1);
-            _mm256_store_ps(temporary_result2, result2);
-            return (product[0] + product[1] + product[2] + product[3] + product[4] + product[5] + product[6] +
-                    product[7]) /
-                   std::sqrt(
-                       (temporary_result1[0] + temporary_result1[1] + temporary_result1[2] + temporary_result1[3] +
-                        temporary_result1[4] + temporary_result1[5] + temporary_result1[6] + temporary_result1[7]) *
-                       (temporary_result2[0] + temporary_result2[1] + temporary_result2[2] + temporary_result2[3] +
-                        temporary_result2[4] + temporary_result2[5] + temporary_result2[6] + temporary_result2[7]));
-#elif defined(__SSE__)
-            auto *vector1_pointer = vector1;
-            auto *vector2_pointer = vector2;
-            float __attribute__((aligned(16))) temporary_product[4];
-            float __attribute__((aligned(16))) temporary_result1[4];
-            float __attribute__((aligned(16))) temporary_result2[4];
-            const float *end = vector1_pointer + dimension;
-            __m128 part_vector1, part_vector2;
-            __m128 product = _mm128_set1_ps(0);
-            __m128 result1 = _mm128_set1_ps(0);
-            __m128 result2 = _mm128_set1_ps(0);
-            while (vector1_pointer < end)
-            {
-                part_vector1 = _mm128_loadu_ps(vector1_pointer);
-                vector1_pointer += 4;
-                part_vector2 = _mm128_loadu_ps(vector2_pointer);
-                vector2_pointer += 4;
-                product = _mm128_add_ps(product, _mm128_mul_ps(part_vector1, part_vector2));
-                result1 = _mm128_add_ps(result1, _mm128_mul_ps(part_vector1, part_vector1));
-                result2 = _mm128_add_ps(result2, _mm128_mul_ps(part_vector2, part_vector2));
-            }
-            _mm128_store_ps(temporary_product, product);
-            _mm128_store_ps(temporary_result1, result1);
-            _mm128_store_ps(temporary_result2, result2);
-            return (product[0] + product[1] + product[2] + product[3] + product[4] + product[5] + product[6] +
-                    product[7]) /
-                   std::sqrt(
-                       (temporary_result1[0] + temporary_result1[1] + temporary_result1[2] + temporary_result1[3]) *
-                       (temporary_result2[0] + temporary_result2[1] + temporary_result2[2] + temporary_result2[3]));
-#else
-            float product = 0;
-            float square_sum1 = 0;
-            float square_sum2 = 0;
-            for (size_t i = 0; i < vector1.size(); ++i)
+        // 各指令集的余弦距离
+        //
+        // 向量在添加和查询时已经归一化，余弦距离为 1 减去内积，只需要计算一次内积
+        template <ISA isa>
+        class Kernel
+        {
+          public:
+            static float distance(const float *vector1, const float *vector2, const uint64_t dimension)
             {
-                product += vector1[i] * vector2[i];
-                square_sum1 += vector1[i] * vector1[i];
-                square_sum2 += vector2[i] * vector2[i];
+                return 1 + Inner_Product::Kernel<isa>::distance(vector1, vector2, dimension);
             }
-            return product / std::sqrt(square_sum1 * square_sum2);
-#endif
+        };
+
+        template <>
+        class Kernel<ISA::AVX2>
+        {
+          public:
+            __attribute__((target("avx2,fma,f16c"))) static float distance(const float *vector1, const float *vector2,
+                                                                           const uint64_t dimension)
+            {
+                return 1 + Inner_Product::Kernel<ISA::AVX2>::distance(vector1, vector2, dimension);
+            }
+        };
+
+        template <>
+        class Kernel<ISA::AVX512>
+        {
+          public:
+            __attribute__((target("avx512f,avx512bw,avx512vl,avx2,fma,f16c"))) static float distance(
+                const float *vector1, const float *vector2, const uint64_t dimension)
+            {
+                return 1 + Inner_Product::Kernel<ISA::AVX512>::distance(vector1, vector2, dimension);
+            }
+        };
+
+        // 归一化
+        //
+        // 把 vector 除以它的范数后写入 normalized，返回归一化前的平方范数
+        inline float normalize(const float *vector, float *normalized, const uint64_t dimension)
+        {
+            auto square_norm = Euclidean2::zero(vector, dimension);
+
+            if (square_norm == 0)
+            {
+                return 0;
+            }
+
+            auto reciprocal = 1 / std::sqrt(square_norm);
+
+            for (auto i = 0; i < dimension; ++i)
+            {
+                normalized[i] = vector[i] * reciprocal;
+            }
+
+            return square_norm;
         }
 
     } // namespace Cosine
 
-    inline auto get_similarity(const Metric space)
+
+    // 距离计算函数
+    //
+    // vector1 为输入类型的向量，vector2 为索引中保存的向量
+    template <typename Element>
+    using Similarity = float (*)(const Input_Type<Element> *vector1, const Element *vector2, uint64_t dimension);
+
+    // 选择指令集对应的 Kernel 中的距离计算函数
+    template <template <ISA> class Kernel, typename Element>
+    inline Similarity<Element> select_kernel(const ISA isa)
+    {
+        switch (isa)
+        {
+        case ISA::AVX512:
+            return Kernel<ISA::AVX512>::distance;
+        case ISA::AVX2:
+            return Kernel<ISA::AVX2>::distance;
+        case ISA::SSE:
+            return Kernel<ISA::SSE>::distance;
+        default:
+            return Kernel<ISA::Generic>::distance;
+        }
+    }
+
+    template <typename Element>
+    inline Similarity<Element> get_similarity(const Metric space, const ISA isa);
+
+    template <>
+    inline Similarity<float> get_similarity<float>(const Metric space, const ISA isa)
     {
         switch (space)
         {
         case Metric::Euclidean2:
-            return Euclidean2::distance;
+            return select_kernel<Euclidean2::Kernel, float>(isa);
+        case Metric::Inner_Product:
+            return select_kernel<Inner_Product::Kernel, float>(isa);
         case Metric::Cosine_Similarity:
-            return Cosine::distance;
+            return select_kernel<Cosine::Kernel, float>(isa);
         default:
             throw std::logic_error("for now, we only support 'Euclidean2', 'Inner Product', 'Cosine Similarity'. ");
         }
     }
 
+    template <>
+    inline Similarity<uint8_t> get_similarity<uint8_t>(const Metric space, const ISA isa)
+    {
+        switch (space)
+        {
+        case Metric::Euclidean2:
+            return select_kernel<Euclidean2::Kernel, uint8_t>(isa);
+        default:
+            throw std::logic_error("for now, vectors of 'uint8_t' only support 'Euclidean2'. ");
+        }
+    }
+
+    template <>
+    inline Similarity<Float16> get_similarity<Float16>(const Metric space, const ISA isa)
+    {
+        switch (space)
+        {
+        case Metric::Euclidean2:
+            return select_kernel<Euclidean2::Kernel, Float16>(isa);
+        default:
+            throw std::logic_error("for now, vectors of 'Float16' only support 'Euclidean2'. ");
+        }
+    }
+
+    template <>
+    inline Similarity<BFloat16> get_similarity<BFloat16>(const Metric space, const ISA isa)
+    {
+        switch (space)
+        {
+        case Metric::Euclidean2:
+            return select_kernel<Euclidean2::Kernel, BFloat16>(isa);
+        default:
+            throw std::logic_error("for now, vectors of 'BFloat16' only support 'Euclidean2'. ");
+        }
+    }
+
+    // 编译期确定度量、指令集和维度的距离计算
+    //
+    // 直接调用对应指令集的距离函数，没有函数指针的间接调用
+    // Dimension 为 0 时使用运行时传入的维度
+    template <typename Element, Metric metric, ISA isa, uint64_t Dimension = 0>
+    class Distance
+    {
+      public:
+        float operator()(const Input_Type<Element> *vector1, const Element *vector2, const uint64_t dimension) const
+        {
+            if constexpr (metric == Metric::Euclidean2 && Dimension != 0)
+            {
+                return Euclidean2::Kernel<isa>::template distance<Dimension>(vector1, vector2);
+            }
+            else if constexpr (metric == Metric::Euclidean2)
+            {
+                return Euclidean2::Kernel<isa>::distance(vector1, vector2, dimension);
+            }
+            else if constexpr (metric == Metric::Inner_Product)
+            {
+                return Inner_Product::Kernel<isa>::distance(vector1, vector2, dimension);
+            }
+            else
+            {
+                return Cosine::Kernel<isa>::distance(vector1, vector2, dimension);
+            }
+        }
+    };
+
+    // 根据运行时的指令集、度量和维度选择对应的 Distance 实例，调用 function(distance)
+    //
+    // 支持 AVX2 及以上指令集时，单精度向量的常见维度 128、784、960 使用固定维度的实例
+    template <typename Element, Metric metric, ISA isa, typename Function>
+    inline decltype(auto) dispatch(const uint64_t dimension, Function &&function)
+    {
+        if constexpr (std::is_same_v<Element, float> && metric == Metric::Euclidean2 && ISA::AVX2 <= isa)
+        {
+            switch (dimension)
+            {
+            case 128:
+                return function(Distance<Element, metric, isa, 128>());
+            case 784:
+                return function(Distance<Element, metric, isa, 784>());
+            case 960:
+                return function(Distance<Element, metric, isa, 960>());
+            }
+        }
+
+        return function(Distance<Element, metric, isa>());
+    }
+
+    template <typename Element, Metric metric, typename Function>
+    inline decltype(auto) dispatch(const ISA isa, const uint64_t dimension, Function &&function)
+    {
+        switch (isa)
+        {
+        case ISA::AVX512:
+            return dispatch<Element, metric, ISA::AVX512>(dimension, function);
+        case ISA::AVX2:
+            return dispatch<Element, metric, ISA::AVX2>(dimension, function);
+        case ISA::SSE:
+            return dispatch<Element, metric, ISA::SSE>(dimension, function);
+        default:
+            return dispatch<Element, metric, ISA::Generic>(dimension, function);
+        }
+    }
+
+    template <typename Element, typename Function>
+    inline decltype(auto) dispatch(const ISA isa, const Metric space, const uint64_t dimension, Function &&function)
+    {
+        if constexpr (std::is_same_v<Element, float>)
+        {
+            if (space == Metric::Inner_Product)
+            {
+                return dispatch<Element, Metric::Inner_Product>(isa, dimension, function);
+            }
+
+            if (space == Metric::Cosine_Similarity)
+            {
+                return dispatch<Element, Metric::Cosine_Similarity>(isa, dimension, function);
+            }
+        }
+
+        // 其余度量在构造索引时已经被 get_similarity 拒绝
+        return dispatch<Element, Metric::Euclidean2>(isa, dimension, function);
+    }
+
 } // namespace Space
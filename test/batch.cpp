@@ -0,0 +1,149 @@
+#include <format>
+#include <iostream>
+#include <vector>
+
+#include "HSG.h"
+#include "universal.h"
+
+const uint64_t number = 4000;
+const uint64_t dimension = 32;
+const uint64_t k = 10;
+const uint64_t magnification = 64;
+const uint64_t thread_number = 4;
+
+std::vector<std::vector<float>> train;
+std::vector<std::vector<float>> test;
+// float 类型的索引只记录向量的地址，所以向量在测试期间一直保存
+std::vector<float> data;
+std::vector<std::unordered_set<uint64_t>> neighbors;
+
+double recall(const HSG::Index<float> &index)
+{
+    uint64_t hit = 0;
+
+    for (auto i = 0; i < test.size(); ++i)
+    {
+        hit += hit_count(HSG::Search(index, test[i].data(), k, magnification), neighbors[i], k);
+    }
+
+    return double(hit) / (test.size() * k);
+}
+
+// 并行添加时两个线程同时修改一个顶点会破坏边的对称性或者丢失顶点，检查：
+// 每条短边在两端都有记录且长度相同，保持连通的边在两端都有记录，所有向量都能从零点到达
+uint64_t broken_edges(const HSG::Index<float> &index, uint64_t &unreachable)
+{
+    uint64_t broken = 0;
+
+    for (auto offset = 0; offset < index.vectors.size(); ++offset)
+    {
+        const auto &vector = index.vectors[offset];
+
+        for (const auto &[distance, neighbor_offset] : vector.short_edge_out)
+        {
+            const auto &in = index.vectors[neighbor_offset].short_edge_in;
+            const auto iterator = in.find(offset);
+
+            broken += iterator == in.end() || iterator->second != distance;
+        }
+
+        for (const auto &[neighbor_offset, distance] : vector.short_edge_in)
+        {
+            const auto &out = index.vectors[neighbor_offset].short_edge_out;
+
+            broken += std::none_of(out.begin(), out.end(), [&](const auto &edge) { return edge.second == offset; });
+        }
+
+        for (const auto neighbor_offset : vector.keep_connected)
+        {
+            broken += !index.vectors[neighbor_offset].keep_connected.contains(offset);
+        }
+    }
+
+    auto visited = std::vector<bool>(index.vectors.size(), false);
+    auto pool = std::vector<HSG::Offset>();
+    auto frontier = std::vector<HSG::Offset>(1, 0);
+
+    visited[0] = true;
+
+    while (!frontier.empty())
+    {
+        const auto offset = frontier.back();
+
+        frontier.pop_back();
+        HSG::Get_Pool_From_SE(index, offset, visited, pool);
+        HSG::Get_Pool_From_LEO(index, offset, visited, pool);
+        frontier.insert(frontier.end(), pool.begin(), pool.end());
+        pool.clear();
+    }
+
+    unreachable = std::count(visited.begin(), visited.end(), false);
+
+    return broken;
+}
+
+void check_index(const HSG::Index<float> &index, const double serial_recall, const std::string &name)
+{
+    uint64_t unreachable = 0;
+    const auto broken = broken_edges(index, unreachable);
+    const auto batch_recall = recall(index);
+
+    std::cout << std::format("{0:<24} recall: {1:.4f} broken edges: {2} unreachable: {3}", name, batch_recall,
+                             broken, unreachable)
+              << std::endl;
+    check(HSG::Vertex_Number(index) == number + 1, name + ": a vector is lost");
+    check(broken == 0, name + ": an edge is recorded on only one end");
+    check(unreachable == 0, name + ": a vector cannot be reached from the zero vector");
+    check(serial_recall - 0.03 <= batch_recall, name + ": the recall is much lower than adding one by one");
+}
+
+int main()
+{
+    train = random_vectors(number, dimension, 1);
+    test = random_vectors(200, dimension, 2);
+    data = flatten(train);
+    neighbors = exact_neighbors(train, test, k);
+
+    auto ids = std::vector<uint64_t>(train.size());
+
+    for (auto i = 0; i < ids.size(); ++i)
+    {
+        ids[i] = i;
+    }
+
+    auto serial_index = HSG::Index<float>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+
+    for (auto i = 0; i < train.size(); ++i)
+    {
+        HSG::Add(serial_index, i, train[i].data());
+    }
+
+    const auto serial_recall = recall(serial_index);
+
+    std::cout << std::format("{0:<24} recall: {1:.4f}", "add one by one", serial_recall) << std::endl;
+
+    // 空的索引先逐个添加一部分向量，剩下的并行添加
+    {
+        auto index = HSG::Index<float>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+
+        HSG::Add_Batch(index, ids.data(), data.data(), number, thread_number);
+        check_index(index, serial_recall, "one batch");
+    }
+
+    // 在已有的索引上分多批添加
+    {
+        auto index = HSG::Index<float>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+        const auto batch_size = number / 4;
+
+        for (auto i = 0; i < number; i += batch_size)
+        {
+            HSG::Add_Batch(index, ids.data() + i, data.data() + i * dimension, batch_size, thread_number);
+        }
+
+        check_index(index, serial_recall, "four batches");
+    }
+
+    std::cout << (failed ? "failed" : "passed") << std::endl;
+
+    return failed;
+}
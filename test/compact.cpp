@@ -0,0 +1,185 @@
+#include <format>
+#include <iostream>
+#include <vector>
+
+#include "HSG.h"
+#include "universal.h"
+
+const uint64_t number = 4000;
+const uint64_t dimension = 32;
+const uint64_t k = 10;
+const uint64_t magnification = 64;
+
+std::vector<std::vector<float>> train;
+std::vector<std::vector<float>> test;
+
+// 压缩后每个 id 对应的向量、所有的边都指向压缩后的位置，没有空位
+template <typename Element>
+uint64_t invalid_offsets(const HSG::Index<Element> &index)
+{
+    uint64_t invalid = !index.empty.empty();
+    const auto size = index.vectors.size();
+
+    for (const auto &[id, offset] : index.id_to_offset)
+    {
+        invalid += size <= offset || index.vectors[offset].id != id;
+    }
+
+    for (auto offset = 0; offset < size; ++offset)
+    {
+        const auto &vector = index.vectors[offset];
+
+        invalid += vector.offset != offset || vector.data == nullptr;
+
+        for (const auto &[length, neighbor_offset] : vector.short_edge_out)
+        {
+            invalid += size <= neighbor_offset || !index.vectors[neighbor_offset].short_edge_in.contains(offset);
+        }
+
+        // 零点的长边可能只记录在一端，长边只检查指向的位置
+        for (const auto &[neighbor_offset, length] : vector.long_edge_out)
+        {
+            invalid += size <= neighbor_offset;
+        }
+
+        for (const auto &[neighbor_offset, length] : vector.long_edge_in)
+        {
+            invalid += size <= neighbor_offset;
+        }
+
+        for (const auto neighbor_offset : vector.keep_connected)
+        {
+            invalid += size <= neighbor_offset;
+        }
+    }
+
+    return invalid;
+}
+
+template <typename Element>
+double recall(const HSG::Index<Element> &index, const std::vector<std::unordered_set<uint64_t>> &neighbors,
+              const std::unordered_set<uint64_t> &erased, uint64_t &erased_hit)
+{
+    uint64_t hit = 0;
+
+    erased_hit = 0;
+
+    for (auto i = 0; i < test.size(); ++i)
+    {
+        const auto result = HSG::Search(index, test[i].data(), k, magnification);
+
+        hit += hit_count(result, neighbors[i], k);
+        erased_hit += hit_count(result, erased);
+    }
+
+    return double(hit) / (test.size() * k);
+}
+
+// 量化编码和草图随向量一起移动
+enum class Encoding
+{
+    None,
+    Quantizer,
+    Sketch
+};
+
+// 删除三分之一的向量、标记删除一部分向量后压缩，查询结果和压缩前一样好，之后可以继续添加
+template <typename Element>
+void check_compact(HSG::Index<Element> &index, const Encoding encoding, const std::string &name)
+{
+    for (auto i = 0; i < train.size(); ++i)
+    {
+        HSG::Add(index, i, train[i].data());
+    }
+
+    if (encoding == Encoding::Quantizer)
+    {
+        HSG::Train_Quantizer(index, 8, 8, 2000);
+    }
+    else if (encoding == Encoding::Sketch)
+    {
+        HSG::Enable_Sketch(index, 256, 1);
+    }
+
+    auto erased = std::unordered_set<uint64_t>();
+
+    for (auto id = 0; id < number; id += 3)
+    {
+        HSG::Erase(index, id);
+        erased.insert(id);
+    }
+
+    for (auto id = 1; id < number; id += 9)
+    {
+        HSG::Mark_Deleted(index, id);
+        erased.insert(id);
+    }
+
+    const auto neighbors = exact_neighbors(train, test, k, erased);
+    uint64_t erased_hit = 0;
+    const auto before = recall(index, neighbors, erased, erased_hit);
+
+    HSG::Compact(index);
+
+    const auto after = recall(index, neighbors, erased, erased_hit);
+    const auto invalid = invalid_offsets(index);
+
+    std::cout << std::format("{0:<24} recall before: {1:.4f} after: {2:.4f} erased results: {3} invalid: {4}", name,
+                             before, after, erased_hit, invalid)
+              << std::endl;
+    check(HSG::Vertex_Number(index) == index.count, name + ": a deleted slot is kept");
+    check(invalid == 0, name + ": an id or an edge points to a wrong position");
+    check(before - 0.01 <= after, name + ": the recall drops after compacting");
+    check(erased_hit == 0, name + ": a deleted vector is returned after compacting");
+
+    // 标记删除的向量压缩后仍然参与路由，之后整理时删除；被删除的 id 可以重新添加
+    check(HSG::Consolidate(index, 0, 1), name + ": the vectors marked deleted are lost");
+
+    for (auto id = 0; id < number; id += 3)
+    {
+        HSG::Add(index, id, train[id].data());
+        erased.erase(id);
+    }
+
+    const auto added = recall(index, exact_neighbors(train, test, k, erased), erased, erased_hit);
+
+    std::cout << std::format("{0:<24} recall after adding again: {1:.4f}", name, added) << std::endl;
+    check(before - 0.03 <= added, name + ": the recall after adding to a compacted index is much lower");
+    check(erased_hit == 0, name + ": a consolidated vector is returned");
+}
+
+int main()
+{
+    train = random_vectors(number, dimension, 1);
+    test = random_vectors(200, dimension, 2);
+
+    {
+        auto index = HSG::Index<float>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+        check_compact(index, Encoding::Quantizer, "Euclidean2 float PQ");
+    }
+
+    {
+        auto index = HSG::Index<float>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+        check_compact(index, Encoding::Sketch, "Euclidean2 float sketch");
+    }
+
+    {
+        auto index = HSG::Index<Space::Float16>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+        check_compact(index, Encoding::None, "Euclidean2 Float16");
+    }
+
+    // 向量归一化后欧氏距离和余弦相似度的排序相同
+    for (auto &vector : train)
+    {
+        Space::Cosine::normalize(vector.data(), vector.data(), dimension);
+    }
+
+    {
+        auto index = HSG::Index<float>(Space::Metric::Cosine_Similarity, dimension, 10, 20, 2, 32);
+        check_compact(index, Encoding::None, "Cosine float");
+    }
+
+    std::cout << (failed ? "failed" : "passed") << std::endl;
+
+    return failed;
+}
@@ -47,6 +47,9 @@ void base_test(const uint64_t short_edge_lower_limit, const uint64_t short_edge_
         HSG::Add(index, i, train[i].data());
     }
 
+    // 删除时重复使用的缓冲区
+    auto context = HSG::Insert_Context<float>();
+
     {
         uint64_t total_hit = 0;
         uint64_t total_time = 0;
@@ -76,13 +79,13 @@ void base_test(const uint64_t short_edge_lower_limit, const uint64_t short_edge_
     {
         while (irrelevant_number < irrelevant.size() / 3)
         {
-            HSG::Erase(index, irrelevant[irrelevant_number]);
+            HSG::Erase(index, irrelevant[irrelevant_number], context);
             ++irrelevant_number;
         }
 
         while (relevant_number < relevant.size() / 3)
         {
-            HSG::Erase(index, *iterator);
+            HSG::Erase(index, *iterator, context);
             deleted_relevant.insert(*iterator);
             ++relevant_number;
             ++iterator;
@@ -112,13 +115,13 @@ void base_test(const uint64_t short_edge_lower_limit, const uint64_t short_edge_
     {
         while (irrelevant_number < (irrelevant.size() / 3) * 2)
         {
-            HSG::Erase(index, irrelevant[irrelevant_number]);
+            HSG::Erase(index, irrelevant[irrelevant_number], context);
             ++irrelevant_number;
         }
 
         while (relevant_number < (relevant.size() / 3) * 2)
         {
-            HSG::Erase(index, *iterator);
+            HSG::Erase(index, *iterator, context);
             deleted_relevant.insert(*iterator);
             ++relevant_number;
             ++iterator;
@@ -148,13 +151,13 @@ void base_test(const uint64_t short_edge_lower_limit, const uint64_t short_edge_
     {
         while (irrelevant_number < irrelevant.size())
         {
-            HSG::Erase(index, irrelevant[irrelevant_number]);
+            HSG::Erase(index, irrelevant[irrelevant_number], context);
             ++irrelevant_number;
         }
 
         while (relevant_number < relevant.size())
         {
-            HSG::Erase(index, *iterator);
+            HSG::Erase(index, *iterator, context);
             deleted_relevant.insert(*iterator);
             ++relevant_number;
             ++iterator;
@@ -295,15 +298,7 @@ void base_test(const uint64_t short_edge_lower_limit, const uint64_t short_edge_
 
 int main(int argc, char **argv)
 {
-#if defined(__AVX512F__)
-    std::cout << "AVX512 supported. " << std::endl;
-#elif defined(__AVX__)
-    std::cout << "AVX supported. " << std::endl;
-#elif defined(__SSE__)
-    std::cout << "SSE supported. " << std::endl;
-#else
-    std::cout << "no SIMD supported. " << std::endl;
-#endif
+    std::cout << Space::get_isa_name(Space::get_isa()) << " supported. " << std::endl;
 
     std::cout << "CPU physical units: " << std::thread::hardware_concurrency() << std::endl;
 
@@ -45,6 +45,9 @@ void base_test(const uint64_t short_edge_lower_limit, const uint64_t short_edge_
         HSG::Add(index, i, train[i].data());
     }
 
+    // 删除时重复使用的缓冲区
+    auto context = HSG::Insert_Context<float>();
+
     {
         uint64_t total_hit = 0;
         uint64_t total_time = 0;
@@ -73,7 +76,7 @@ void base_test(const uint64_t short_edge_lower_limit, const uint64_t short_edge_
     {
         while (relevant_number < relevant.size() / 3)
         {
-            HSG::Erase(index, *iterator);
+            HSG::Erase(index, *iterator, context);
             deleted_relevant.insert(*iterator);
             ++relevant_number;
             ++iterator;
@@ -103,7 +106,7 @@ void base_test(const uint64_t short_edge_lower_limit, const uint64_t short_edge_
     {
         while (relevant_number < (relevant.size() / 3) * 2)
         {
-            HSG::Erase(index, *iterator);
+            HSG::Erase(index, *iterator, context);
             deleted_relevant.insert(*iterator);
             ++relevant_number;
             ++iterator;
@@ -133,7 +136,7 @@ void base_test(const uint64_t short_edge_lower_limit, const uint64_t short_edge_
     {
         while (relevant_number < relevant.size())
         {
-            HSG::Erase(index, *iterator);
+            HSG::Erase(index, *iterator, context);
             deleted_relevant.insert(*iterator);
             ++relevant_number;
             ++iterator;
@@ -255,15 +258,7 @@ void base_test(const uint64_t short_edge_lower_limit, const uint64_t short_edge_
 
 int main(int argc, char **argv)
 {
-#if defined(__AVX512F__)
-    std::cout << "AVX512 supported. " << std::endl;
-#elif defined(__AVX__)
-    std::cout << "AVX supported. " << std::endl;
-#elif defined(__SSE__)
-    std::cout << "SSE supported. " << std::endl;
-#else
-    std::cout << "no SIMD supported. " << std::endl;
-#endif
+    std::cout << Space::get_isa_name(Space::get_isa()) << " supported. " << std::endl;
 
     std::cout << "CPU physical units: " << std::thread::hardware_concurrency() << std::endl;
 
@@ -0,0 +1,169 @@
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <vector>
+
+#include "disk.h"
+#include "universal.h"
+
+const uint64_t number = 4000;
+const uint64_t dimension = 32;
+const uint64_t k = 10;
+const uint64_t magnification = 64;
+const uint64_t degree = 32;
+
+std::vector<std::vector<float>> train;
+std::vector<std::vector<float>> test;
+// float 类型的索引只记录向量的地址，所以向量在测试期间一直保存
+std::vector<float> data;
+std::unordered_set<uint64_t> erased;
+std::vector<std::unordered_set<uint64_t>> neighbors;
+
+// 计算查询结果的召回率
+template <typename Search>
+double recall(Search &&search)
+{
+    uint64_t hit = 0;
+
+    for (auto i = 0; i < test.size(); ++i)
+    {
+        hit += hit_count(search(test[i].data()), neighbors[i], k);
+    }
+
+    return double(hit) / (test.size() * k);
+}
+
+int main()
+{
+    train = random_vectors(number, dimension, 1);
+    test = random_vectors(200, dimension, 2);
+    data = flatten(train);
+
+    for (auto i = 0; i < train.size(); i += 10)
+    {
+        erased.insert(i);
+    }
+
+    neighbors = exact_neighbors(train, test, k, erased);
+
+    const auto path = (std::filesystem::temp_directory_path() / "HSG-disk.index").string();
+    auto index = HSG::Index<float>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+    auto ids = std::vector<uint64_t>(train.size());
+
+    for (auto i = 0; i < ids.size(); ++i)
+    {
+        ids[i] = i;
+    }
+
+    HSG::Build(index, ids.data(), data.data(), ids.size(), 1);
+
+    for (const auto &id : erased)
+    {
+        HSG::Erase(index, id);
+    }
+
+    HSG::Train_Quantizer(index, 8, 8, 2000);
+    HSG::Write_Disk(index, path, degree);
+
+    const auto memory_recall =
+        recall([&](const float *target) { return HSG::Search(index, target, k, magnification); });
+
+    for (const auto direct : {true, false})
+    {
+        auto disk_index = HSG::Disk_Index<float>(path, direct);
+        auto uring_results = std::vector<std::priority_queue<std::pair<float, uint64_t>>>();
+        auto pread_results = std::vector<std::priority_queue<std::pair<float, uint64_t>>>();
+
+        disk_index.io_uring = true;
+
+        const auto disk_recall = recall(
+            [&](const float *target)
+            {
+                uring_results.push_back(HSG::Search(disk_index, target, k, magnification));
+                return uring_results.back();
+            });
+
+        disk_index.io_uring = false;
+
+        recall(
+            [&](const float *target)
+            {
+                pread_results.push_back(HSG::Search(disk_index, target, k, magnification));
+                return pread_results.back();
+            });
+
+        const auto targets = flatten(test);
+        const auto batch_results =
+            HSG::Search_Batch(disk_index, targets.data(), test.size(), k, magnification, 4);
+        uint64_t pread_different = 0;
+        uint64_t batch_different = 0;
+
+        for (auto i = 0; i < test.size(); ++i)
+        {
+            pread_different += !same_result(uring_results[i], pread_results[i]);
+            batch_different += !same_result(pread_results[i], batch_results[i]);
+        }
+
+        std::cout << std::format("direct: {0} memory recall: {1:.4f} disk recall: {2:.4f}", direct, memory_recall,
+                                 disk_recall)
+                  << std::endl;
+        std::cout << std::format("pread different results: {0}/{1} batch different results: {2}/{1}",
+                                 pread_different, test.size(), batch_different)
+                  << std::endl;
+
+        // 磁盘上的索引用原始向量计算结果，召回率不应该比内存中的索引低很多
+        check(memory_recall - 0.05 <= disk_recall, "the recall of the disk index is too low");
+        check(pread_different == 0, "pread and io_uring return different results");
+        check(batch_different == 0, "batch search returns different results");
+    }
+
+    // 文件中的邻居不是有效的位置时，打开文件或者查询时报错，而不是越界访问
+    auto sector_size = uint64_t(0);
+    auto vertex_number = uint64_t(0);
+    auto entry = std::vector<uint64_t>();
+
+    {
+        const auto disk_index = HSG::Disk_Index<float>(path, false);
+
+        sector_size = disk_index.sector_size;
+        vertex_number = disk_index.vertex_number;
+        entry = disk_index.entry;
+    }
+
+    overwrite(path, sector_size + sizeof(uint64_t), vertex_number);
+    check_throw<std::runtime_error>([&]() { HSG::Disk_Index<float>{path, false}; },
+                                    "a disk index file with an invalid entry is opened");
+
+    HSG::Write_Disk(index, path, degree);
+    overwrite(path, sector_size, degree + 1);
+    check_throw<std::runtime_error>([&]() { HSG::Disk_Index<float>{path, false}; },
+                                    "a disk index file with too many entries is opened");
+
+    // 所有的查询都从入口开始展开，损坏入口的扇区后每次查询都会读到，零点的扇区在打开时检查
+    HSG::Write_Disk(index, path, degree);
+
+    for (const auto offset : entry)
+    {
+        if (offset != 0)
+        {
+            overwrite(path, (offset + 1) * sector_size + sizeof(uint64_t), vertex_number);
+        }
+    }
+
+    {
+        const auto disk_index = HSG::Disk_Index<float>(path, false);
+        const auto targets = flatten(test);
+
+        check_throw<std::runtime_error>([&]() { HSG::Search(disk_index, test[0].data(), k, magnification); },
+                                        "a corrupted sector is searched");
+        check_throw<std::runtime_error>(
+            [&]() { HSG::Search_Batch(disk_index, targets.data(), test.size(), k, magnification, 4); },
+            "a corrupted sector is searched in a batch");
+    }
+
+    std::filesystem::remove(path);
+
+    std::cout << (failed ? "failed" : "passed") << std::endl;
+
+    return failed;
+}
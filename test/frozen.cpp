@@ -0,0 +1,134 @@
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "frozen.h"
+#include "universal.h"
+
+const uint64_t number = 4000;
+const uint64_t dimension = 32;
+const uint64_t k = 10;
+const uint64_t magnification = 64;
+
+std::vector<std::vector<float>> train;
+std::vector<std::vector<float>> test;
+// float 类型的索引只记录向量的地址，所以向量在测试期间一直保存
+std::vector<float> data;
+
+// 构建索引后删除一部分向量，让冻结的文件中有被删除的位置
+template <typename Element>
+void build(HSG::Index<Element> &index)
+{
+    auto ids = std::vector<uint64_t>(train.size());
+
+    for (auto i = 0; i < ids.size(); ++i)
+    {
+        ids[i] = i;
+    }
+
+    HSG::Build(index, ids.data(), data.data(), ids.size(), 1);
+
+    for (auto i = 0; i < train.size(); i += 10)
+    {
+        HSG::Erase(index, i);
+    }
+}
+
+// 冻结的索引和原来的索引查询的结果应该完全相同
+template <typename Element>
+void freeze_and_search(const HSG::Index<Element> &index, const std::string &path, const HSG::Advice advice,
+                       const std::string &name)
+{
+    HSG::Freeze(index, path);
+
+    const auto frozen = HSG::Frozen_Index<Element>(path, advice);
+    uint64_t different = 0;
+
+    for (auto i = 0; i < test.size(); ++i)
+    {
+        different += !same_result(HSG::Search(index, test[i].data(), k, magnification),
+                                  HSG::Search(frozen, test[i].data(), k, magnification));
+    }
+
+    std::cout << std::format("{0:<28} different results: {1}/{2}", name, different, test.size()) << std::endl;
+    check(different == 0, name + ": the frozen index returns different results");
+}
+
+int main()
+{
+    train = random_vectors(number, dimension, 1);
+    test = random_vectors(200, dimension, 2);
+    data = flatten(train);
+
+    const auto path = (std::filesystem::temp_directory_path() / "HSG-frozen.index").string();
+
+    {
+        auto index = HSG::Index<float>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+        build(index);
+        freeze_and_search(index, path, HSG::Advice::Normal, "Euclidean2 float Normal");
+        freeze_and_search(index, path, HSG::Advice::Random, "Euclidean2 float Random");
+        freeze_and_search(index, path, HSG::Advice::Will_Need, "Euclidean2 float Will_Need");
+        freeze_and_search(index, path, HSG::Advice::Populate, "Euclidean2 float Populate");
+    }
+
+    {
+        auto index = HSG::Index<Space::Float16>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+        build(index);
+        freeze_and_search(index, path, HSG::Advice::Normal, "Euclidean2 Float16");
+    }
+
+    {
+        auto index = HSG::Index<float>(Space::Metric::Cosine_Similarity, dimension, 10, 20, 2, 32);
+        build(index);
+        freeze_and_search(index, path, HSG::Advice::Normal, "Cosine float");
+    }
+
+    // 损坏、截断的文件和元素类型不同的文件都不能映射
+    {
+        auto index = HSG::Index<float>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+        build(index);
+        HSG::Freeze(index, path);
+
+        check_throw<std::invalid_argument>([&]() { HSG::Frozen_Index<uint8_t>{path}; },
+                                           "a frozen index file of another element type is mapped");
+
+        const auto size = std::filesystem::file_size(path);
+
+        std::filesystem::resize_file(path, size - HSG::Frozen_Format::alignment);
+        check_throw<std::runtime_error>([&]() { HSG::Frozen_Index<float>{path}; },
+                                        "a truncated frozen index file is mapped");
+
+        std::filesystem::resize_file(path, size);
+        corrupt_file(path, offsetof(HSG::Frozen_Format::Header, vertex_number));
+        check_throw<std::runtime_error>([&]() { HSG::Frozen_Index<float>{path}; },
+                                        "a frozen index file with a corrupted header is mapped");
+
+        // 文件头的校验和不覆盖数组，邻接表损坏时也不能映射
+        auto header = HSG::Frozen_Format::Header();
+
+        HSG::Freeze(index, path);
+        std::ifstream(path, std::ios::binary).read(reinterpret_cast<char *>(&header), sizeof(header));
+
+        overwrite(path, header.short_targets + 8 * sizeof(uint64_t), header.vertex_number);
+        check_throw<std::runtime_error>([&]() { HSG::Frozen_Index<float>{path}; },
+                                        "a frozen index file with an invalid neighbor is mapped");
+
+        HSG::Freeze(index, path);
+        overwrite(path, header.long_begins + 8 * sizeof(uint64_t), header.long_number + 1);
+        check_throw<std::runtime_error>([&]() { HSG::Frozen_Index<float>{path}; },
+                                        "a frozen index file with invalid edge ranges is mapped");
+
+        HSG::Freeze(index, path);
+        overwrite(path, header.short_begins + header.vertex_number * sizeof(uint64_t), header.short_number - 1);
+        check_throw<std::runtime_error>([&]() { HSG::Frozen_Index<float>{path}; },
+                                        "a frozen index file with a wrong number of edges is mapped");
+    }
+
+    std::filesystem::remove(path);
+
+    std::cout << (failed ? "failed" : "passed") << std::endl;
+
+    return failed;
+}
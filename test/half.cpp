@@ -0,0 +1,121 @@
+#include <cmath>
+#include <format>
+#include <iostream>
+#include <vector>
+
+#include "HSG.h"
+#include "universal.h"
+
+const uint64_t number = 4000;
+const uint64_t dimension = 100;
+const uint64_t k = 10;
+const uint64_t magnification = 64;
+
+std::vector<std::vector<float>> train;
+std::vector<std::vector<float>> test;
+std::vector<std::unordered_set<uint64_t>> neighbors;
+// 单精度的索引逐个添加时的召回率，半精度的索引的召回率不应该低很多
+double float_recall;
+
+// 逐个添加向量后的召回率
+template <typename Element>
+double add_and_search(HSG::Index<Element> &index)
+{
+    auto buffer = std::vector<float>(dimension);
+
+    // float 类型的索引只记录向量的地址，直接添加 train 中的向量，
+    // 半精度的索引保存转换后的向量，添加时传入的向量在添加后就被覆盖
+    for (auto i = 0; i < train.size(); ++i)
+    {
+        if constexpr (std::is_same_v<Element, float>)
+        {
+            HSG::Add(index, i, train[i].data());
+            continue;
+        }
+
+        buffer = train[i];
+        HSG::Add(index, i, buffer.data());
+        std::fill(buffer.begin(), buffer.end(), std::numeric_limits<float>::quiet_NaN());
+    }
+
+    uint64_t hit = 0;
+
+    for (auto i = 0; i < test.size(); ++i)
+    {
+        hit += hit_count(HSG::Search(index, test[i].data(), k, magnification), neighbors[i], k);
+    }
+
+    return double(hit) / (test.size() * k);
+}
+
+// precision 为元素类型的相对精度，minimum 为最小的正规数，更小的数的绝对误差不超过 precision * minimum
+template <typename Element>
+void check_half(const float precision, const float minimum, const std::string &name)
+{
+    auto index = HSG::Index<Element>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+    const auto recall = add_and_search(index);
+
+    // 保存的向量和添加的向量的误差不超过元素类型的精度
+    uint64_t inexact = 0;
+
+    for (auto i = 0; i < train.size(); ++i)
+    {
+        const auto *data = index.vectors[index.id_to_offset.at(i)].data;
+
+        for (auto j = 0; j < dimension; ++j)
+        {
+            inexact += precision * std::max(std::abs(train[i][j]), minimum) < std::abs(float(data[j]) - train[i][j]);
+        }
+    }
+
+    // 批量构建后覆盖输入的数组，查询只使用索引保存的向量
+    auto batch_index = HSG::Index<Element>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+    auto ids = std::vector<uint64_t>(train.size());
+    auto data = flatten(train);
+
+    for (auto i = 0; i < ids.size(); ++i)
+    {
+        ids[i] = i;
+    }
+
+    HSG::Build(batch_index, ids.data(), data.data(), ids.size(), 1);
+    std::fill(data.begin(), data.end(), std::numeric_limits<float>::quiet_NaN());
+
+    uint64_t batch_hit = 0;
+
+    for (auto i = 0; i < test.size(); ++i)
+    {
+        batch_hit += hit_count(HSG::Search(batch_index, test[i].data(), k, magnification), neighbors[i], k);
+    }
+
+    const auto batch_recall = double(batch_hit) / (test.size() * k);
+
+    std::cout << std::format("{0:<10} inexact elements: {1} recall: {2:.4f} build recall: {3:.4f}", name, inexact,
+                             recall, batch_recall)
+              << std::endl;
+    check(inexact == 0, name + ": a stored element differs from the added one by more than its precision");
+    check(float_recall - 0.02 <= recall, name + ": the recall is much lower than the float index");
+    check(0.9 <= batch_recall, name + ": the recall after building is too low");
+}
+
+int main()
+{
+    train = random_vectors(number, dimension, 1);
+    test = random_vectors(200, dimension, 2);
+    neighbors = exact_neighbors(train, test, k);
+
+    {
+        auto index = HSG::Index<float>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+        float_recall = add_and_search(index);
+    }
+
+    std::cout << std::format("{0:<10} recall: {1:.4f}", "float", float_recall) << std::endl;
+
+    // binary16 有 10 位尾数，bfloat16 有 7 位尾数，舍入的相对误差分别不超过 2^-11 和 2^-8
+    check_half<Space::Float16>(std::ldexp(1.0F, -11), std::ldexp(1.0F, -14), "Float16");
+    check_half<Space::BFloat16>(std::ldexp(1.0F, -8), std::ldexp(1.0F, -126), "BFloat16");
+
+    std::cout << (failed ? "failed" : "passed") << std::endl;
+
+    return failed;
+}
@@ -3,11 +3,11 @@
 #include <format>
 #include <fstream>
 #include <iostream>
-#include <semaphore>
 #include <thread>
 #include <vector>
 
 #include "../../hnswlib/hnswlib/hnswlib.h"
+#include "parallel.h"
 #include "universal.h"
 
 std::vector<std::vector<float>> train;
@@ -16,12 +16,6 @@ std::vector<std::vector<uint64_t>> neighbors;
 std::vector<std::vector<float>> reference_answer;
 std::string name;
 
-auto available_thread = std::counting_semaphore<>(12);
-auto done_semaphore = std::counting_semaphore<>(1);
-uint64_t done_thread = 0;
-uint64_t done_number = 0;
-auto done = std::counting_semaphore<>(0);
-
 void test_hnsw(uint64_t M, uint64_t ef_construction)
 {
     auto test_result = std::ofstream(std::format("result/hnsw/{0}-{1}-{2}.txt", name, M, ef_construction),
@@ -78,16 +72,6 @@ void test_hnsw(uint64_t M, uint64_t ef_construction)
     }
 
     delete alg_hnsw;
-    done_semaphore.acquire();
-    ++done_thread;
-
-    if (done_thread == done_number)
-    {
-        done.release();
-    }
-
-    done_semaphore.release();
-    available_thread.release();
 }
 
 int main(int argc, char **argv)
@@ -122,18 +106,23 @@ int main(int argc, char **argv)
 
     std::vector<uint64_t> Ms{4, 8, 12, 16, 24, 36, 48, 64, 96};
     std::vector<uint64_t> ef_constructions{500};
-    done_number += Ms.size() * ef_constructions.size();
+    auto configurations = std::vector<std::pair<uint64_t, uint64_t>>();
 
     for (auto &M : Ms)
     {
         for (auto &ef_construction : ef_constructions)
         {
-            available_thread.acquire();
-            auto one_thread = std::thread(test_hnsw, M, ef_construction);
-            one_thread.detach();
+            configurations.push_back({M, ef_construction});
         }
     }
 
-    done.acquire();
+    // 同时测试的参数组合的数量，可以由第 6 个参数指定
+    const uint64_t thread_number = 6 < argc ? std::stoull(argv[6]) : 12;
+    // 使用默认的线程池，和索引内部的并行任务共用同一组工作线程，不会超额订阅
+    Parallel::Configure(std::max<uint64_t>(thread_number, 1) - 1);
+
+    Parallel::For(0, configurations.size(), thread_number,
+                  [&](const uint64_t i) { test_hnsw(configurations[i].first, configurations[i].second); });
+
     return 0;
 }
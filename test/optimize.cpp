@@ -75,15 +75,7 @@ void base_test(const uint64_t short_edge_lower_limit, const uint64_t short_edge_
 
 int main(int argc, char **argv)
 {
-#if defined(__AVX512F__)
-    std::cout << "AVX512 supported. " << std::endl;
-#elif defined(__AVX__)
-    std::cout << "AVX supported. " << std::endl;
-#elif defined(__SSE__)
-    std::cout << "SSE supported. " << std::endl;
-#else
-    std::cout << "no SIMD supported. " << std::endl;
-#endif
+    std::cout << Space::get_isa_name(Space::get_isa()) << " supported. " << std::endl;
 
     std::cout << "CPU physical units: " << std::thread::hardware_concurrency() << std::endl;
 
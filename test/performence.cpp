@@ -3,25 +3,24 @@
 #include <format>
 #include <fstream>
 #include <iostream>
-#include <semaphore>
 #include <thread>
+#include <tuple>
 #include <vector>
 
 #include "HSG.h"
+#include "parallel.h"
 #include "universal.h"
 
-std::vector<std::vector<float>> train;
-std::vector<std::vector<float>> test;
+// sift10M 的向量以 uint8_t 保存，其余数据集以 float 保存
+template <typename Element>
+std::vector<std::vector<Element>> train;
+template <typename Element>
+std::vector<std::vector<Element>> test;
 std::vector<std::vector<uint64_t>> neighbors;
 std::vector<std::vector<float>> reference_answer;
 std::string name;
 
-auto available_thread = std::counting_semaphore<>(0);
-auto done_semaphore = std::counting_semaphore<>(1);
-uint64_t done_thread = 0;
-uint64_t done_number = 0;
-auto done = std::counting_semaphore<>(0);
-
+template <typename Element>
 void base_test(const uint64_t short_edge_lower_limit, const uint64_t short_edge_upper_limit, const uint64_t cover_range,
                const uint64_t build_magnification, const uint64_t k)
 {
@@ -52,16 +51,20 @@ void base_test(const uint64_t short_edge_lower_limit, const uint64_t short_edge_
 
     test_result << "]" << std::endl;
 
-    HSG::Index index(Space::Metric::Euclidean2, train[0].size(), short_edge_lower_limit, short_edge_upper_limit,
-                     cover_range, build_magnification);
+    const auto &train = ::train<Element>;
+    const auto &test = ::test<Element>;
+
+    HSG::Index<Element> index(Space::Metric::Euclidean2, train[0].size(), short_edge_lower_limit,
+                              short_edge_upper_limit, cover_range, build_magnification);
 
     uint64_t build_time = 0;
+    auto context = HSG::Insert_Context<Element>();
 
     for (auto i = 0; i < train.size(); ++i)
     {
         auto begin = std::chrono::high_resolution_clock::now();
 
-        HSG::Add(index, i, train[i].data());
+        HSG::Add(index, i, train[i].data(), context);
 
         auto end = std::chrono::high_resolution_clock::now();
 
@@ -137,63 +140,42 @@ void base_test(const uint64_t short_edge_lower_limit, const uint64_t short_edge_
     }
 
     test_result.close();
-    done_semaphore.acquire();
-    ++done_thread;
-
-    if (done_thread == done_number)
-    {
-        done.release();
-    }
-
-    done_semaphore.release();
-    available_thread.release();
 }
 
 int main(int argc, char **argv)
 {
-#if defined(__AVX512F__)
-    std::cout << "AVX512 supported. " << std::endl;
-#elif defined(__AVX__)
-    std::cout << "AVX supported. " << std::endl;
-#elif defined(__SSE__)
-    std::cout << "SSE supported. " << std::endl;
-#else
-    std::cout << "no SIMD supported. " << std::endl;
-#endif
+    std::cout << Space::get_isa_name(Space::get_isa()) << " supported. " << std::endl;
     std::cout << "CPU physical units: " << std::thread::hardware_concurrency() << std::endl;
 
     name = std::string(argv[5]);
 
+    // 同时测试的参数组合的数量，可以由第 11 个参数指定
+    uint64_t thread_number = 12;
+
     if (name == "sift10M")
     {
-        for (auto i = 0; i < 4; ++i)
-        {
-            available_thread.release();
-        }
+        thread_number = 4;
+    }
+    else if (name == "gist")
+    {
+        thread_number = 8;
+    }
 
-        bvecs_vectors(argv[1], train, 10000000);
-        bvecs_vectors(argv[2], test);
+    if (11 < argc)
+    {
+        thread_number = std::stoull(argv[11]);
+    }
+
+    if (name == "sift10M")
+    {
+        bvecs_vectors(argv[1], train<uint8_t>, 10000000);
+        bvecs_vectors(argv[2], test<uint8_t>);
         ivecs(argv[3], neighbors);
     }
     else
     {
-        if (name == "gist")
-        {
-            for (auto i = 0; i < 8; ++i)
-            {
-                available_thread.release();
-            }
-        }
-        else
-        {
-            for (auto i = 0; i < 12; ++i)
-            {
-                available_thread.release();
-            }
-        }
-
-        train = load_vector(argv[1]);
-        test = load_vector(argv[2]);
+        train<float> = load_vector(argv[1]);
+        test<float> = load_vector(argv[2]);
         neighbors = load_neighbors(argv[3]);
     }
 
@@ -232,28 +214,33 @@ int main(int argc, char **argv)
         build_magnifications.push_back(temporary);
     }
 
-    done_number += short_edge_lower_limits.size() * cover_ranges.size() * build_magnifications.size();
+    auto run = name == "sift10M" ? base_test<uint8_t> : base_test<float>;
+    auto configurations = std::vector<std::tuple<uint64_t, uint64_t, uint64_t, uint64_t>>();
 
     for (auto a = 0; a < short_edge_lower_limits.size(); ++a)
     {
-        auto &short_edge_lower_limit = short_edge_lower_limits[a];
-        auto &short_edge_upper_limit = short_edge_upper_limits[a];
-
         for (auto b = 0; b < cover_ranges.size(); ++b)
         {
-            auto &cover_range = cover_ranges[b];
-
             for (auto c = 0; c < build_magnifications.size(); ++c)
             {
-                auto &build_magnification = build_magnifications[c];
-                available_thread.acquire();
-                auto one_thread = std::thread(base_test, short_edge_lower_limit, short_edge_upper_limit, cover_range,
-                                              build_magnification, k);
-                one_thread.detach();
+                configurations.push_back({short_edge_lower_limits[a], short_edge_upper_limits[a], cover_ranges[b],
+                                          build_magnifications[c]});
             }
         }
     }
 
-    done.acquire();
+    // 每组参数是线程池中的一个任务，主线程也参与测试
+    // 使用默认的线程池，和索引内部的并行任务共用同一组工作线程，不会超额订阅
+    Parallel::Configure(std::max<uint64_t>(thread_number, 1) - 1);
+
+    Parallel::For(0, configurations.size(), thread_number,
+                  [&](const uint64_t i)
+                  {
+                      const auto &[short_edge_lower_limit, short_edge_upper_limit, cover_range, build_magnification] =
+                          configurations[i];
+
+                      run(short_edge_lower_limit, short_edge_upper_limit, cover_range, build_magnification, k);
+                  });
+
     return 0;
 }
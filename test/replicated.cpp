@@ -0,0 +1,114 @@
+#include <format>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "replicated.h"
+#include "universal.h"
+
+const uint64_t number = 4000;
+const uint64_t dimension = 32;
+const uint64_t k = 10;
+const uint64_t magnification = 64;
+
+int main()
+{
+    const auto train = random_vectors(number, dimension, 1);
+    const auto test = random_vectors(200, dimension, 2);
+    const auto targets = flatten(test);
+    auto data = flatten(train);
+    auto index = std::make_unique<HSG::Index<float>>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+    auto ids = std::vector<uint64_t>(train.size());
+    auto expected = std::vector<std::priority_queue<std::pair<float, uint64_t>>>();
+
+    for (auto i = 0; i < ids.size(); ++i)
+    {
+        ids[i] = i;
+    }
+
+    HSG::Build(*index, ids.data(), data.data(), ids.size(), 1);
+
+    for (auto i = 0; i < train.size(); i += 10)
+    {
+        HSG::Erase(*index, i);
+    }
+
+    for (auto i = 0; i < test.size(); ++i)
+    {
+        expected.push_back(HSG::Search(*index, test[i].data(), k, magnification));
+    }
+
+    auto replicated_index = HSG::Replicated_Index<float>();
+
+    HSG::Replicate(replicated_index, *index);
+
+    // 副本持有自己的向量数据，原来的索引和向量释放后仍然可以查询
+    index.reset();
+    std::fill(data.begin(), data.end(), 0.0F);
+
+    uint64_t replica_different = 0;
+    uint64_t local_different = 0;
+    uint64_t batch_different = 0;
+
+    for (const auto &replica : replicated_index.replicas)
+    {
+        for (auto i = 0; i < test.size(); ++i)
+        {
+            replica_different += !same_result(expected[i], HSG::Search(*replica, test[i].data(), k, magnification));
+        }
+    }
+
+    for (auto i = 0; i < test.size(); ++i)
+    {
+        local_different +=
+            !same_result(expected[i], HSG::Search(replicated_index, test[i].data(), k, magnification));
+    }
+
+    const auto batch_results =
+        HSG::Search_Batch(replicated_index, targets.data(), test.size(), k, magnification, 4);
+
+    for (auto i = 0; i < test.size(); ++i)
+    {
+        batch_different += !same_result(expected[i], batch_results[i]);
+    }
+
+    // 把 CPU 分成两个节点，测试每个节点的线程池使用本节点的副本查询
+    auto split_index = HSG::Replicated_Index<float>();
+    auto cpus = Parallel::CPUs();
+
+    if (cpus.size() < 2)
+    {
+        split_index.nodes = {cpus, cpus};
+    }
+    else
+    {
+        split_index.nodes = {std::vector<uint64_t>(cpus.begin(), cpus.begin() + cpus.size() / 2),
+                             std::vector<uint64_t>(cpus.begin() + cpus.size() / 2, cpus.end())};
+    }
+
+    HSG::Replicate(split_index, *replicated_index.replicas.front());
+
+    const auto split_results = HSG::Search_Batch(split_index, targets.data(), test.size(), k, magnification, 4);
+    uint64_t split_different = 0;
+
+    for (auto i = 0; i < test.size(); ++i)
+    {
+        split_different += !same_result(expected[i], split_results[i]);
+    }
+
+    std::cout << std::format("nodes: {0}", replicated_index.nodes.size()) << std::endl;
+    std::cout << std::format("replica different results: {0}", replica_different) << std::endl;
+    std::cout << std::format("local different results: {0}", local_different) << std::endl;
+    std::cout << std::format("batch different results: {0}", batch_different) << std::endl;
+    std::cout << std::format("split batch different results: {0}", split_different) << std::endl;
+
+    check(replica_different == 0, "a replica returns different results");
+    check(local_different == 0, "the local replica returns different results");
+    check(batch_different == 0, "batch search returns different results");
+    check(split_index.pools.size() == 2, "the split index has no pool per node");
+    check(split_different == 0, "batch search on two nodes returns different results");
+
+    std::cout << (failed ? "failed" : "passed") << std::endl;
+
+    return failed;
+}
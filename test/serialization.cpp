@@ -0,0 +1,118 @@
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <vector>
+
+#include "serialization.h"
+#include "universal.h"
+
+const uint64_t number = 4000;
+const uint64_t dimension = 32;
+const uint64_t k = 10;
+const uint64_t magnification = 64;
+
+std::vector<std::vector<float>> train;
+std::vector<std::vector<float>> test;
+// float 类型的索引只记录向量的地址，所以向量在测试期间一直保存
+std::vector<float> data;
+
+// 保存后读入的索引和原来的索引查询的结果应该完全相同
+template <typename Element>
+void check_equal(const HSG::Index<Element> &index, const HSG::Index<Element> &loaded, const std::string &name)
+{
+    uint64_t different = 0;
+
+    for (auto i = 0; i < test.size(); ++i)
+    {
+        different += !same_result(HSG::Search(index, test[i].data(), k, magnification),
+                                  HSG::Search(loaded, test[i].data(), k, magnification));
+    }
+
+    std::cout << std::format("{0:<28} different results: {1}/{2}", name, different, test.size()) << std::endl;
+    check(different == 0, name + ": the loaded index returns different results");
+    check(HSG::Vertex_Number(index) == HSG::Vertex_Number(loaded), name + ": the number of vectors is different");
+}
+
+// 构建索引后删除一部分向量，让保存的文件中有被删除的位置
+template <typename Element>
+void build(HSG::Index<Element> &index)
+{
+    auto ids = std::vector<uint64_t>(train.size());
+
+    for (auto i = 0; i < ids.size(); ++i)
+    {
+        ids[i] = i;
+    }
+
+    HSG::Build(index, ids.data(), data.data(), ids.size(), 1);
+
+    for (auto i = 0; i < train.size(); i += 10)
+    {
+        HSG::Erase(index, i);
+    }
+}
+
+template <typename Element>
+void save_and_load(const HSG::Index<Element> &index, const std::string &path, const std::string &name)
+{
+    HSG::Save(index, path);
+    check_equal(index, HSG::Load<Element>(path), name);
+}
+
+int main()
+{
+    train = random_vectors(number, dimension, 1);
+    test = random_vectors(200, dimension, 2);
+    data = flatten(train);
+
+    const auto path = (std::filesystem::temp_directory_path() / "HSG-serialization.index").string();
+
+    {
+        auto index = HSG::Index<float>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+        build(index);
+        save_and_load(index, path, "Euclidean2 float");
+    }
+
+    {
+        auto index = HSG::Index<float>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+        build(index);
+        HSG::Train_Quantizer(index, 8, 8, 2000);
+        save_and_load(index, path, "Euclidean2 float PQ");
+    }
+
+    {
+        auto index = HSG::Index<Space::Float16>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+        build(index);
+        save_and_load(index, path, "Euclidean2 Float16");
+    }
+
+    {
+        auto index = HSG::Index<float>(Space::Metric::Cosine_Similarity, dimension, 10, 20, 2, 32);
+        build(index);
+        save_and_load(index, path, "Cosine float");
+    }
+
+    // 损坏、截断的文件和元素类型不同的文件都不能读入
+    {
+        auto index = HSG::Index<float>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+        build(index);
+        HSG::Save(index, path);
+
+        check_throw<std::invalid_argument>([&]() { HSG::Load<uint8_t>(path); },
+                                           "an index file of another element type is loaded");
+
+        const auto size = std::filesystem::file_size(path);
+
+        corrupt_file(path, size / 2);
+        check_throw<std::runtime_error>([&]() { HSG::Load<float>(path); }, "a corrupted index file is loaded");
+
+        std::filesystem::resize_file(path, size / 3);
+        check_throw<std::runtime_error>([&]() { HSG::Load<float>(path); }, "a truncated index file is loaded");
+    }
+
+    std::filesystem::remove(path);
+
+    std::cout << (failed ? "failed" : "passed") << std::endl;
+
+    return failed;
+}
@@ -0,0 +1,176 @@
+#include <atomic>
+#include <format>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "HSG.h"
+#include "universal.h"
+
+const uint64_t number = 3000;
+const uint64_t window = 2000;
+const uint64_t dimension = 16;
+const uint64_t k = 10;
+const uint64_t magnification = 64;
+const uint64_t reader_number = 3;
+
+std::vector<std::vector<float>> train;
+std::vector<std::vector<float>> moved;
+std::vector<std::vector<float>> test;
+// float 类型的索引只记录向量的地址，所以向量在测试期间一直保存
+std::vector<float> data;
+
+// 滑动窗口：写者不断添加新的向量、删除最早的向量，同时更新和标记删除窗口中的向量，多个读者同时查询
+//
+// 用 ThreadSanitizer 编译时检查查询和写者之间没有数据竞争
+int main()
+{
+    train = random_vectors(number, dimension, 1);
+    moved = random_vectors(number, dimension, 3);
+    test = random_vectors(100, dimension, 2);
+    data = flatten(train);
+
+    auto index = HSG::Index<float>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+    auto ids = std::vector<uint64_t>(window);
+
+    for (auto i = 0; i < ids.size(); ++i)
+    {
+        ids[i] = i;
+    }
+
+    HSG::Build(index, ids.data(), data.data(), ids.size(), 1);
+    HSG::Enable_Concurrent_Search(index, number + 1);
+
+    // 每个 id 当前的向量，不在索引中时为空
+    auto current = std::vector<const float *>(number, nullptr);
+
+    for (auto i = 0; i < window; ++i)
+    {
+        current[i] = train[i].data();
+    }
+
+    auto stop = std::atomic<bool>(false);
+    auto searched = std::atomic<uint64_t>(0);
+    auto invalid = std::atomic<uint64_t>(0);
+    auto readers = std::vector<std::thread>();
+
+    for (auto reader = 0; reader < reader_number; ++reader)
+    {
+        readers.emplace_back(
+            [&, reader]()
+            {
+                for (auto i = reader; !stop.load(); i = (i + 1) % test.size())
+                {
+                    auto result = HSG::Search(index, test[i].data(), k, magnification);
+
+                    invalid += k + magnification < result.size();
+
+                    for (; !result.empty(); result.pop())
+                    {
+                        invalid += number <= result.top().second;
+                    }
+
+                    ++searched;
+                }
+            });
+    }
+
+    auto marked = uint64_t(0);
+
+    for (auto id = window; id < number; ++id)
+    {
+        HSG::Add(index, id, train[id].data());
+        current[id] = train[id].data();
+
+        // 最早的向量已经被标记删除时跳过
+        if (current[id - window] != nullptr)
+        {
+            HSG::Erase(index, id - window);
+            current[id - window] = nullptr;
+        }
+
+        const auto target = id - window + 1 + (id * 7919) % (window - 1);
+
+        if (current[target] == nullptr)
+        {
+            continue;
+        }
+
+        if (id % 5 == 0)
+        {
+            HSG::Update(index, target, moved[target].data());
+            current[target] = moved[target].data();
+        }
+        else if (id % 5 == 1)
+        {
+            HSG::Mark_Deleted(index, target);
+            current[target] = nullptr;
+            ++marked;
+        }
+
+        if (id % 100 == 0)
+        {
+            HSG::Consolidate(index, 0.01, 1);
+        }
+    }
+
+    stop = true;
+
+    for (auto &reader : readers)
+    {
+        reader.join();
+    }
+
+    std::cout << std::format("searched: {0} marked deleted: {1}", searched.load(), marked) << std::endl;
+    check(0 < searched, "no search runs while the index is modified");
+    check(invalid == 0, "a search returns invalid results while the index is modified");
+
+    // 发布的邻居和图中的边相同，停用并发查询前后查询的结果相同
+    auto serving_results = std::vector<std::priority_queue<std::pair<float, uint64_t>>>();
+
+    for (auto i = 0; i < test.size(); ++i)
+    {
+        serving_results.push_back(HSG::Search(index, test[i].data(), k, magnification));
+    }
+
+    HSG::Disable_Concurrent_Search(index);
+
+    auto vectors = std::vector<std::vector<float>>(number);
+    auto erased = std::unordered_set<uint64_t>();
+    uint64_t different = 0;
+    uint64_t hit = 0;
+
+    for (auto id = 0; id < number; ++id)
+    {
+        if (current[id] == nullptr)
+        {
+            vectors[id] = train[id];
+            erased.insert(id);
+        }
+        else
+        {
+            vectors[id].assign(current[id], current[id] + dimension);
+        }
+    }
+
+    const auto neighbors = exact_neighbors(vectors, test, k, erased);
+
+    for (auto i = 0; i < test.size(); ++i)
+    {
+        const auto result = HSG::Search(index, test[i].data(), k, magnification);
+
+        different += !same_result(serving_results[i], result);
+        hit += hit_count(result, neighbors[i], k);
+    }
+
+    const auto recall = double(hit) / (test.size() * k);
+
+    std::cout << std::format("recall: {0:.4f} different results: {1}/{2}", recall, different, test.size())
+              << std::endl;
+    check(different == 0, "the published neighbors differ from the edges of the graph");
+    check(0.85 <= recall, "the recall after sliding the window is too low");
+
+    std::cout << (failed ? "failed" : "passed") << std::endl;
+
+    return failed;
+}
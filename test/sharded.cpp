@@ -0,0 +1,88 @@
+#include <format>
+#include <iostream>
+#include <vector>
+
+#include "sharded.h"
+#include "universal.h"
+
+const uint64_t number = 4000;
+const uint64_t dimension = 32;
+const uint64_t k = 10;
+const uint64_t magnification = 64;
+const uint64_t shard_number = 4;
+
+std::vector<std::vector<float>> train;
+std::vector<std::vector<float>> test;
+
+// 计算分片索引的召回率
+double recall(const HSG::Sharded_Index<float> &sharded_index,
+              const std::vector<std::unordered_set<uint64_t>> &neighbors, const uint64_t probe)
+{
+    uint64_t hit = 0;
+
+    for (auto i = 0; i < test.size(); ++i)
+    {
+        hit += hit_count(HSG::Search(sharded_index, test[i].data(), k, magnification, probe, 2), neighbors[i], k);
+    }
+
+    return double(hit) / (test.size() * k);
+}
+
+void sharded_test(const HSG::Partition partition, const uint64_t probe, const double lowest_recall,
+                  const std::string &name)
+{
+    auto sharded_index =
+        HSG::Sharded_Index<float>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32, shard_number, partition);
+    auto ids = std::vector<uint64_t>(train.size());
+    const auto data = flatten(train);
+
+    for (auto i = 0; i < ids.size(); ++i)
+    {
+        ids[i] = i;
+    }
+
+    HSG::Build(sharded_index, ids.data(), data.data(), ids.size(), 2);
+
+    const auto build_recall = recall(sharded_index, exact_neighbors(train, test, k), probe);
+
+    // 删除一部分向量后查询结果中不应该出现被删除的向量
+    auto erased = std::unordered_set<uint64_t>();
+
+    for (auto i = 0; i < train.size(); i += 10)
+    {
+        HSG::Erase(sharded_index, i);
+        erased.insert(i);
+    }
+
+    const auto erase_recall = recall(sharded_index, exact_neighbors(train, test, k, erased), probe);
+    uint64_t erased_hit = 0;
+
+    for (auto i = 0; i < test.size(); ++i)
+    {
+        erased_hit += hit_count(HSG::Search(sharded_index, test[i].data(), k, magnification, probe), erased);
+    }
+
+    std::cout << std::format("{0:<16} build recall: {1:.4f} erase recall: {2:.4f} erased results: {3}", name,
+                             build_recall, erase_recall, erased_hit)
+              << std::endl;
+
+    check(lowest_recall <= build_recall, name + ": the recall after building is too low");
+    check(lowest_recall <= erase_recall, name + ": the recall after erasing is too low");
+    check(erased_hit == 0, name + ": erased vectors are returned");
+    check_throw<std::invalid_argument>([&]() { HSG::Erase(sharded_index, 0); }, name + ": an unknown id is erased");
+}
+
+int main()
+{
+    train = random_vectors(number, dimension, 1);
+    test = random_vectors(200, dimension, 2);
+
+    sharded_test(HSG::Partition::Hash, 0, 0.9, "Hash");
+    sharded_test(HSG::Partition::Cluster, 0, 0.9, "Cluster");
+    // 只查询最近的两个分片时，靠近分片边界的最近邻可能在没有查询的分片中
+    sharded_test(HSG::Partition::Cluster, 2, 0.8, "Cluster probe 2");
+
+    std::cout << (failed ? "failed" : "passed") << std::endl;
+
+    return failed;
+}
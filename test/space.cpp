@@ -0,0 +1,142 @@
+#include <cmath>
+#include <format>
+#include <iostream>
+#include <vector>
+
+#include "space.h"
+#include "universal.h"
+
+// 维度不是 SIMD 宽度的整数倍时由尾部的标量循环或者掩码处理，100 和 300 覆盖 SSE、AVX2 和 AVX512 的各种余数
+const uint64_t dimensions[] = {1, 3, 7, 15, 16, 17, 31, 33, 63, 100, 128, 300, 784, 960};
+
+const Space::ISA isas[] = {Space::ISA::Generic, Space::ISA::SSE, Space::ISA::AVX2, Space::ISA::AVX512};
+
+// 单精度的累加顺序不同，结果允许有相对误差
+bool close(const float result, const float reference)
+{
+    return std::abs(result - reference) <= 1e-4 * std::max(1.0F, std::abs(reference));
+}
+
+// 每个向量单独分配和维度相同大小的内存，尾部读取越界时可以被 AddressSanitizer 发现
+template <typename Element>
+std::vector<std::vector<Element>> convert_vectors(const std::vector<std::vector<float>> &vectors)
+{
+    auto result = std::vector<std::vector<Element>>();
+
+    for (const auto &vector : vectors)
+    {
+        result.emplace_back(vector.size());
+        Space::convert(vector.data(), result.back().data(), vector.size());
+    }
+
+    return result;
+}
+
+// 使用 isa 计算平方范数
+template <typename Element>
+float zero(const Space::ISA isa, const Element *vector, const uint64_t dimension)
+{
+    switch (isa)
+    {
+    case Space::ISA::AVX512:
+        return Space::Euclidean2::Kernel<Space::ISA::AVX512>::zero(vector, dimension);
+    case Space::ISA::AVX2:
+        return Space::Euclidean2::Kernel<Space::ISA::AVX2>::zero(vector, dimension);
+    case Space::ISA::SSE:
+        return Space::Euclidean2::Kernel<Space::ISA::SSE>::zero(vector, dimension);
+    default:
+        return Space::Euclidean2::Kernel<Space::ISA::Generic>::zero(vector, dimension);
+    }
+}
+
+// 所有支持的指令集的距离和不使用 SIMD 的结果相同
+template <typename Element>
+void check_similarity(const Space::Metric metric, const std::string &name)
+{
+    for (const auto dimension : dimensions)
+    {
+        auto inputs = random_vectors(8, dimension, 1);
+        auto stored = random_vectors(8, dimension, 2);
+
+        if constexpr (std::is_same_v<Element, uint8_t>)
+        {
+            for (auto &vectors : {&inputs, &stored})
+            {
+                for (auto &vector : *vectors)
+                {
+                    for (auto &value : vector)
+                    {
+                        value = std::clamp(std::floor((value + 2) * 60), 0.0F, 255.0F);
+                    }
+                }
+            }
+        }
+
+        if (metric == Space::Metric::Cosine_Similarity)
+        {
+            for (auto &vectors : {&inputs, &stored})
+            {
+                for (auto &vector : *vectors)
+                {
+                    Space::Cosine::normalize(vector.data(), vector.data(), dimension);
+                }
+            }
+        }
+
+        const auto elements = convert_vectors<Element>(stored);
+        const auto queries = convert_vectors<Space::Input_Type<Element>>(inputs);
+        const auto reference = Space::get_similarity<Element>(metric, Space::ISA::Generic);
+        uint64_t different = 0;
+
+        for (const auto isa : isas)
+        {
+            if (Space::get_isa() < isa)
+            {
+                continue;
+            }
+
+            const auto similarity = Space::get_similarity<Element>(metric, isa);
+
+            for (auto i = 0; i < queries.size(); ++i)
+            {
+                for (auto j = 0; j < elements.size(); ++j)
+                {
+                    const auto expected = reference(queries[i].data(), elements[j].data(), dimension);
+
+                    different += !close(similarity(queries[i].data(), elements[j].data(), dimension), expected);
+
+                    // 编译期确定维度的实例和运行时的结果相同
+                    const auto fixed = Space::dispatch<Element>(isa, metric, dimension,
+                                                                [&](const auto &distance) {
+                                                                    return distance(queries[i].data(),
+                                                                                    elements[j].data(), dimension);
+                                                                });
+
+                    different += !close(fixed, expected);
+                }
+
+                different += !close(zero(isa, elements[i].data(), dimension),
+                                    zero(Space::ISA::Generic, elements[i].data(), dimension));
+            }
+        }
+
+        check(different == 0, std::format("{0} dimension {1}: a SIMD kernel differs from the scalar one", name,
+                                          dimension));
+    }
+
+    std::cout << std::format("{0:<20} checked up to {1}", name, Space::get_isa_name(Space::get_isa())) << std::endl;
+}
+
+int main()
+{
+    check_similarity<float>(Space::Metric::Euclidean2, "Euclidean2 float");
+    check_similarity<float>(Space::Metric::Inner_Product, "Inner_Product float");
+    check_similarity<float>(Space::Metric::Cosine_Similarity, "Cosine float");
+    check_similarity<uint8_t>(Space::Metric::Euclidean2, "Euclidean2 uint8_t");
+    check_similarity<Space::Float16>(Space::Metric::Euclidean2, "Euclidean2 Float16");
+    check_similarity<Space::BFloat16>(Space::Metric::Euclidean2, "Euclidean2 BFloat16");
+
+    std::cout << (failed ? "failed" : "passed") << std::endl;
+
+    return failed;
+}
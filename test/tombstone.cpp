@@ -0,0 +1,108 @@
+#include <format>
+#include <iostream>
+#include <vector>
+
+#include "HSG.h"
+#include "universal.h"
+
+const uint64_t number = 4000;
+const uint64_t dimension = 32;
+const uint64_t k = 10;
+const uint64_t magnification = 64;
+
+std::vector<std::vector<float>> train;
+std::vector<std::vector<float>> test;
+// float 类型的索引只记录向量的地址，所以向量在测试期间一直保存
+std::vector<float> data;
+
+// 计算召回率，同时统计查询结果中出现的被删除的向量
+double recall(const HSG::Index<float> &index, const std::unordered_set<uint64_t> &erased, uint64_t &erased_hit)
+{
+    const auto neighbors = exact_neighbors(train, test, k, erased);
+    uint64_t hit = 0;
+
+    erased_hit = 0;
+
+    for (auto i = 0; i < test.size(); ++i)
+    {
+        const auto result = HSG::Search(index, test[i].data(), k, magnification);
+
+        hit += hit_count(result, neighbors[i], k);
+        erased_hit += hit_count(result, erased);
+    }
+
+    return double(hit) / (test.size() * k);
+}
+
+int main()
+{
+    train = random_vectors(number, dimension, 1);
+    test = random_vectors(200, dimension, 2);
+    data = flatten(train);
+
+    auto index = HSG::Index<float>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+    auto ids = std::vector<uint64_t>(train.size());
+
+    for (auto i = 0; i < ids.size(); ++i)
+    {
+        ids[i] = i;
+    }
+
+    HSG::Build(index, ids.data(), data.data(), ids.size(), 1);
+
+    // 标记删除的向量不应该出现在查询结果中
+    auto erased = std::unordered_set<uint64_t>();
+
+    for (auto i = 0; i < train.size(); i += 10)
+    {
+        HSG::Mark_Deleted(index, i);
+        erased.insert(i);
+    }
+
+    uint64_t erased_hit = 0;
+    const auto mark_recall = recall(index, erased, erased_hit);
+
+    std::cout << std::format("mark deleted recall: {0:.4f} erased results: {1}", mark_recall, erased_hit)
+              << std::endl;
+    check(0.9 <= mark_recall, "the recall after marking vectors deleted is too low");
+    check(erased_hit == 0, "a vector marked deleted is returned");
+
+    // 不在索引中、已经删除的和重复的 id 都不能删除，也不能更新，抛出异常时索引不变
+    const auto vertex_number = HSG::Vertex_Number(index);
+    const uint64_t repeated[] = {1, 2, 1};
+    const uint64_t unknown[] = {1, number};
+
+    check_throw<std::invalid_argument>([&]() { HSG::Mark_Deleted(index, 0); }, "a deleted vector is marked again");
+    check_throw<std::invalid_argument>([&]() { HSG::Mark_Deleted(index, number); }, "an unknown id is marked");
+    check_throw<std::invalid_argument>([&]() { HSG::Erase(index, number); }, "an unknown id is erased");
+    check_throw<std::invalid_argument>([&]() { HSG::Erase_Batch(index, repeated, 3, 1); },
+                                       "repeated ids are erased");
+    check_throw<std::invalid_argument>([&]() { HSG::Erase_Batch(index, unknown, 2, 1); },
+                                       "an unknown id is erased in a batch");
+    check_throw<std::invalid_argument>([&]() { HSG::Update(index, number, test[0].data()); },
+                                       "an unknown id is updated");
+    check_throw<std::invalid_argument>([&]() { HSG::Erase(index, std::numeric_limits<uint64_t>::max()); },
+                                       "the zero vector is erased");
+    check(HSG::Vertex_Number(index) == vertex_number, "a rejected call changes the index");
+    check(recall(index, erased, erased_hit) == mark_recall, "a rejected call changes the results");
+
+    // 标记删除的比例没有超过阈值时不删除，超过时从图中删除，查询结果仍然不包括被删除的向量
+    check(!HSG::Consolidate(index, 0.5, 1), "vectors are consolidated below the threshold");
+    check(HSG::Consolidate(index, 0.05, 1), "vectors are not consolidated above the threshold");
+
+    const auto consolidate_recall = recall(index, erased, erased_hit);
+
+    std::cout << std::format("consolidate recall: {0:.4f} erased results: {1}", consolidate_recall, erased_hit)
+              << std::endl;
+    check(0.9 <= consolidate_recall, "the recall after consolidating is too low");
+    check(erased_hit == 0, "a consolidated vector is returned");
+
+    // 被删除的 id 可以重新添加
+    HSG::Add(index, 0, train[0].data());
+    check(hit_count(HSG::Search(index, train[0].data(), k, magnification), {0}, k) == 1,
+          "a vector added again with a deleted id is not found");
+
+    std::cout << (failed ? "failed" : "passed") << std::endl;
+
+    return failed;
+}
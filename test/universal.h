@@ -1,13 +1,18 @@
+#include <algorithm>
 #include <ctime>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <queue>
+#include <random>
 #include <unordered_set>
 #include <vector>
 
 #include "../source/space.h"
 
-inline std::vector<std::vector<float>> get_reference_answer(const std::vector<std::vector<float>> &train,
-                                                            const std::vector<std::vector<float>> &test,
+template <typename Element>
+inline std::vector<std::vector<float>> get_reference_answer(const std::vector<std::vector<Element>> &train,
+                                                            const std::vector<std::vector<Element>> &test,
                                                             const std::vector<std::vector<uint64_t>> &neighbors)
 {
     auto reference_answer = std::vector<std::vector<float>>(test.size(), std::vector<float>(neighbors[0].size(), 0));
@@ -74,7 +79,8 @@ inline void load_reference_answer(const char *file_path, std::vector<std::vector
     file.close();
 }
 
-inline uint64_t verify(const std::vector<std::vector<float>> &train, const std::vector<float> &test,
+template <typename Element>
+inline uint64_t verify(const std::vector<std::vector<Element>> &train, const std::vector<Element> &test,
                        const std::vector<float> &reference_answer,
                        std::priority_queue<std::pair<float, uint64_t>> &query_result, uint64_t top_k)
 {
@@ -157,7 +163,9 @@ inline std::vector<std::vector<uint64_t>> load_neighbors(const char *file_path)
     return neighbors;
 }
 
-inline void bvecs_vectors(const char *file_path, std::vector<std::vector<float>> &vectors, uint64_t number = 0)
+// Element 为 uint8_t 时按原始类型保存，不展开为 float
+template <typename Element>
+inline void bvecs_vectors(const char *file_path, std::vector<std::vector<Element>> &vectors, uint64_t number = 0)
 {
     auto file = std::ifstream(file_path, std::ios::in | std::ios::binary);
 
@@ -254,7 +262,8 @@ inline void load_deleted(const char *file_path, std::vector<uint64_t> &result)
     }
 }
 
-inline uint64_t verify_with_delete(const std::vector<std::vector<float>> &train, const std::vector<float> &test,
+template <typename Element>
+inline uint64_t verify_with_delete(const std::vector<std::vector<Element>> &train, const std::vector<Element> &test,
                                    const std::vector<uint64_t> &neighbors, const std::vector<float> &reference_answer,
                                    std::priority_queue<std::pair<float, uint64_t>> &query_result,
                                    std::unordered_set<uint64_t> &relevant, uint64_t k)
@@ -289,3 +298,181 @@ inline uint64_t verify_with_delete(const std::vector<std::vector<float>> &train,
 
     return hit;
 }
+
+// 生成 number 个 dimension 维的随机向量，不需要数据集的测试使用
+//
+// 向量分布在 32 个固定的中心附近，seed 只影响向量在中心附近的位置
+inline std::vector<std::vector<float>> random_vectors(const uint64_t number, const uint64_t dimension,
+                                                      const uint64_t seed)
+{
+    auto center_random = std::mt19937(0);
+    auto random = std::mt19937(seed);
+    auto uniform = std::uniform_real_distribution<float>(-1, 1);
+    auto normal = std::normal_distribution<float>(0, 0.25);
+    auto centers = std::vector<std::vector<float>>(32, std::vector<float>(dimension));
+    auto vectors = std::vector<std::vector<float>>(number, std::vector<float>(dimension));
+
+    for (auto &center : centers)
+    {
+        for (auto &value : center)
+        {
+            value = uniform(center_random);
+        }
+    }
+
+    for (auto i = 0; i < number; ++i)
+    {
+        const auto &center = centers[random() % centers.size()];
+
+        for (auto j = 0; j < dimension; ++j)
+        {
+            vectors[i][j] = center[j] + normal(random);
+        }
+    }
+
+    return vectors;
+}
+
+// 把向量依次存放到一个数组中，批量构建和批量查询使用
+inline std::vector<float> flatten(const std::vector<std::vector<float>> &vectors)
+{
+    auto data = std::vector<float>();
+
+    for (const auto &vector : vectors)
+    {
+        data.insert(data.end(), vector.begin(), vector.end());
+    }
+
+    return data;
+}
+
+// 暴力计算 test 中每个向量在 train 中按欧氏距离最近的 k 个向量的下标，跳过 erased 中的向量
+inline std::vector<std::unordered_set<uint64_t>> exact_neighbors(const std::vector<std::vector<float>> &train,
+                                                                 const std::vector<std::vector<float>> &test,
+                                                                 const uint64_t k,
+                                                                 const std::unordered_set<uint64_t> &erased = {})
+{
+    auto neighbors = std::vector<std::unordered_set<uint64_t>>(test.size());
+
+    for (auto i = 0; i < test.size(); ++i)
+    {
+        auto nearest = std::priority_queue<std::pair<float, uint64_t>>();
+
+        for (auto j = 0; j < train.size(); ++j)
+        {
+            if (erased.contains(j))
+            {
+                continue;
+            }
+
+            nearest.push({Space::Euclidean2::distance(test[i].data(), train[j].data(), test[i].size()), j});
+
+            if (k < nearest.size())
+            {
+                nearest.pop();
+            }
+        }
+
+        while (!nearest.empty())
+        {
+            neighbors[i].insert(nearest.top().second);
+            nearest.pop();
+        }
+    }
+
+    return neighbors;
+}
+
+// 查询结果中距离最近的 top_k 个向量中属于 neighbors 的向量的数量
+//
+// Search 返回 top_k + magnification 个候选，计算召回率时只统计最近的 top_k 个，不传 top_k 时统计全部结果
+inline uint64_t hit_count(std::priority_queue<std::pair<float, uint64_t>> query_result,
+                          const std::unordered_set<uint64_t> &neighbors,
+                          const uint64_t top_k = std::numeric_limits<uint64_t>::max())
+{
+    uint64_t hit = 0;
+
+    while (top_k < query_result.size())
+    {
+        query_result.pop();
+    }
+
+    while (!query_result.empty())
+    {
+        hit += neighbors.contains(query_result.top().second);
+        query_result.pop();
+    }
+
+    return hit;
+}
+
+// 两次查询的结果是否完全相同
+inline bool same_result(std::priority_queue<std::pair<float, uint64_t>> result1,
+                        std::priority_queue<std::pair<float, uint64_t>> result2)
+{
+    while (!result1.empty() && !result2.empty())
+    {
+        if (result1.top() != result2.top())
+        {
+            return false;
+        }
+
+        result1.pop();
+        result2.pop();
+    }
+
+    return result1.empty() && result2.empty();
+}
+
+// 检查不通过时输出原因，测试最后根据 failed 返回非零值
+inline bool failed = false;
+
+inline void check(const bool condition, const std::string &message)
+{
+    if (!condition)
+    {
+        std::cout << "failed: " << message << std::endl;
+        failed = true;
+    }
+}
+
+// 检查 function 是否抛出 Exception 类型的异常
+template <typename Exception, typename Function>
+inline void check_throw(Function &&function, const std::string &message)
+{
+    try
+    {
+        function();
+    }
+    catch (const Exception &)
+    {
+        return;
+    }
+    catch (...)
+    {
+    }
+
+    check(false, message);
+}
+
+// 把文件中 position 处的字节取反，测试损坏的文件
+inline void corrupt_file(const std::string &path, const uint64_t position)
+{
+    auto file = std::fstream(path, std::ios::in | std::ios::out | std::ios::binary);
+    auto byte = char();
+
+    file.seekg(position);
+    file.read(&byte, 1);
+    byte = char(~byte);
+    file.seekp(position);
+    file.write(&byte, 1);
+}
+
+// 把文件中 position 处的 8 个字节改为 value
+inline void overwrite(const std::string &path, const uint64_t position, const uint64_t value)
+{
+    auto file = std::fstream(path, std::ios::in | std::ios::out | std::ios::binary);
+
+    file.seekp(position);
+    file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
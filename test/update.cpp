@@ -0,0 +1,144 @@
+#include <cmath>
+#include <format>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "HSG.h"
+#include "universal.h"
+
+const uint64_t number = 4000;
+const uint64_t dimension = 32;
+const uint64_t k = 10;
+const uint64_t magnification = 64;
+
+std::vector<std::vector<float>> train;
+std::vector<std::vector<float>> test;
+// float 类型的索引只记录向量的地址，所以向量在测试期间一直保存
+std::vector<float> data;
+// 更新后的向量
+std::vector<std::vector<float>> updated;
+
+// 检查边记录的距离和两端当前的向量一致，长边总是从范数较小的向量指向范数较大的向量
+void check_edges(const HSG::Index<float> &index, const std::string &name)
+{
+    uint64_t stale = 0;
+    uint64_t misordered = 0;
+
+    auto distance = [&](const HSG::Offset offset1, const HSG::Offset offset2)
+    {
+        return Space::Euclidean2::distance(index.vectors[offset1].data, index.vectors[offset2].data, dimension);
+    };
+
+    auto close = [](const float result, const float reference)
+    { return std::abs(result - reference) <= 1e-4 * std::max(1.0F, reference); };
+
+    for (auto offset = 1; offset < index.vectors.size(); ++offset)
+    {
+        const auto &vector = index.vectors[offset];
+
+        if (vector.data == nullptr)
+        {
+            continue;
+        }
+
+        stale += !close(vector.zero, Space::Euclidean2::zero(vector.data, dimension));
+
+        for (const auto &[length, neighbor_offset] : vector.short_edge_out)
+        {
+            stale += neighbor_offset != 0 && !close(length, distance(offset, neighbor_offset));
+        }
+
+        for (const auto &[neighbor_offset, length] : vector.long_edge_out)
+        {
+            stale += !close(length, distance(offset, neighbor_offset));
+            misordered += index.vectors[neighbor_offset].zero <= vector.zero;
+        }
+    }
+
+    std::cout << std::format("{0:<16} stale distances: {1} misordered long edges: {2}", name, stale, misordered)
+              << std::endl;
+    check(stale == 0, name + ": an edge keeps the distance to a vector before it was updated");
+    check(misordered == 0, name + ": a long edge points to a vector with a smaller norm");
+}
+
+// 更新后的向量能被查询到，召回率按更新后的向量计算
+void check_search(const HSG::Index<float> &index, const std::string &name)
+{
+    const auto neighbors = exact_neighbors(updated, test, k);
+    uint64_t hit = 0;
+    uint64_t missed = 0;
+
+    for (auto i = 0; i < test.size(); ++i)
+    {
+        hit += hit_count(HSG::Search(index, test[i].data(), k, magnification), neighbors[i], k);
+    }
+
+    for (auto id = 0; id < number; ++id)
+    {
+        missed += hit_count(HSG::Search(index, updated[id].data(), k, magnification), {uint64_t(id)}, 1) == 0;
+    }
+
+    const auto recall = double(hit) / (test.size() * k);
+
+    std::cout << std::format("{0:<16} recall: {1:.4f} missed vectors: {2}", name, recall, missed) << std::endl;
+    check(0.9 <= recall, name + ": the recall after updating is too low");
+    check(missed == 0, name + ": an updated vector is not its own nearest neighbor");
+}
+
+int main()
+{
+    train = random_vectors(number, dimension, 1);
+    test = random_vectors(200, dimension, 2);
+    data = flatten(train);
+    updated = train;
+
+    const auto moved = random_vectors(number, dimension, 3);
+    auto index = HSG::Index<float>(Space::Metric::Euclidean2, dimension, 10, 20, 2, 32);
+    auto ids = std::vector<uint64_t>(train.size());
+
+    for (auto i = 0; i < ids.size(); ++i)
+    {
+        ids[i] = i;
+    }
+
+    HSG::Build(index, ids.data(), data.data(), ids.size(), 1);
+
+    // 小幅移动的向量原地更新，位置不变
+    auto random = std::mt19937(4);
+    auto normal = std::normal_distribution<float>(0, 0.01);
+    uint64_t relocated = 0;
+
+    for (auto id = 0; id < number; id += 3)
+    {
+        const auto offset = index.id_to_offset.at(id);
+
+        for (auto &value : updated[id])
+        {
+            value += normal(random);
+        }
+
+        HSG::Update(index, id, updated[id].data());
+        relocated += index.id_to_offset.at(id) != offset;
+    }
+
+    std::cout << std::format("{0:<16} relocated vectors: {1}", "small moves", relocated) << std::endl;
+    check(relocated == 0, "a slightly moved vector is not updated in place");
+    check(HSG::Vertex_Number(index) == number + 1, "updating in place changes the number of vertices");
+    check_edges(index, "small moves");
+    check_search(index, "small moves");
+
+    // 移动到另一个簇的向量先删除再添加
+    for (auto id = 1; id < number; id += 3)
+    {
+        updated[id] = moved[id];
+        HSG::Update(index, id, updated[id].data());
+    }
+
+    check_edges(index, "large moves");
+    check_search(index, "large moves");
+
+    std::cout << (failed ? "failed" : "passed") << std::endl;
+
+    return failed;
+}